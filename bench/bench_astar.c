@@ -0,0 +1,726 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+/* A standalone micro-benchmark of the A* searches in a_star.c. The navigation
+ * data baked by the engine (the '.nav' file written next to a map) is loaded
+ * and the path queries that the engine issues against it are replayed, both
+ * with AStar_* and with a reference search built on the generic priority
+ * queue and hash tables:
+ *
+ *   grid   - the chunk-local searches between every pair of portals of a
+ *            chunk, which are issued when the portal graph is linked
+ *   portal - searches from a random pathable tile to a random portal,
+ *            which are issued for every path request
+ *
+ * When the map spans more than one region, the regions are built first, so 
+ * that AStar_PortalGraphPath crosses them using the upper level of the 
+ * portal graph. The cost and the existence of every path found by the two 
+ * are compared.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "../src/navigation/a_star.h"
+#include "../src/navigation/nav_private.h"
+#include "../src/navigation/fieldcache.h"
+#include "../src/lib/public/pqueue.h"
+#include "../src/lib/public/khash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <time.h>
+
+
+PQUEUE_TYPE(coord, struct coord)
+PQUEUE_IMPL(static, coord, struct coord)
+
+PQUEUE_TYPE(portal, const struct portal*)
+PQUEUE_IMPL(static, portal, const struct portal*)
+
+KHASH_MAP_INIT_INT64(key_coord, struct coord)
+KHASH_MAP_INIT_INT64(key_portal, const struct portal*)
+KHASH_MAP_INIT_INT64(key_float, float)
+
+#define COST_EPSILON    (1.0f / 256)
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
+
+#define kh_put_val(name, table, key, val)               \
+    do{                                                 \
+        int ret;                                        \
+        khiter_t k = kh_put(name, table, key, &ret);    \
+        kh_value(table, k) = val;                       \
+    }while(0)
+
+enum kind{
+    KIND_GRID,
+    KIND_PORTAL,
+};
+
+struct query{
+    struct coord         chunk;
+    struct coord         start, finish;
+    const struct portal *finish_portal;
+};
+
+struct answer{
+    bool  exists;
+    float cost;
+};
+
+struct result{
+    double ms_per_query;
+    size_t nfound;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static uint32_t s_rand_state;
+
+static const char *s_kind_names[] = {
+    [KIND_GRID]   = "grid",
+    [KIND_PORTAL] = "portal",
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t rand_next(void)
+{
+    s_rand_state ^= s_rand_state << 13;
+    s_rand_state ^= s_rand_state >> 17;
+    s_rand_state ^= s_rand_state << 5;
+    return s_rand_state;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static bool index_to_portal(struct nav_private *priv, uintptr_t idx, struct portal **out)
+{
+    if(idx == 0) {
+        *out = NULL;
+        return true;
+    }
+
+    size_t chunk_idx = (idx - 1) / MAX_PORTALS_PER_CHUNK;
+    size_t portal_idx = (idx - 1) % MAX_PORTALS_PER_CHUNK;
+    if(chunk_idx >= priv->width * priv->height)
+        return false;
+    if(portal_idx >= priv->chunks[chunk_idx].num_portals)
+        return false;
+
+    *out = &priv->chunks[chunk_idx].portals[portal_idx];
+    return true;
+}
+
+static bool unswizzle_chunk(struct nav_private *priv, struct nav_chunk *chunk)
+{
+    if(chunk->num_portals > MAX_PORTALS_PER_CHUNK)
+        return false;
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        struct portal *port = &chunk->portals[i];
+        if(port->num_neighbours > ARR_SIZE(port->edges))
+            return false;
+
+        for(int j = 0; j < port->num_neighbours; j++) {
+            if(port->edges[j].neighbour >= chunk->num_portals)
+                return false;
+        }
+        if(!index_to_portal(priv, (uintptr_t)port->connected, &port->connected))
+            return false;
+    }
+    return true;
+}
+
+/* Mirrors N_LoadBaked, without checking the hash of the map tiles */
+static struct nav_private *load_baked(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file)
+        goto fail_open;
+
+    struct baked_hdr hdr;
+    if(fread(&hdr, sizeof(hdr), 1, file) != 1)
+        goto fail_hdr;
+    if(memcmp(hdr.magic, BAKED_MAGIC, sizeof(hdr.magic)) || hdr.version != BAKED_VER)
+        goto fail_hdr;
+    if(hdr.chunk_size != sizeof(struct nav_chunk))
+        goto fail_hdr;
+
+    size_t nchunks = hdr.width * hdr.height;
+    struct nav_private *ret = calloc(1, sizeof(struct nav_private) + nchunks * sizeof(struct nav_chunk));
+    if(!ret)
+        goto fail_hdr;
+
+    ret->width = hdr.width;
+    ret->height = hdr.height;
+    ret->tile_costs = hdr.tile_costs;
+
+    if(fread(ret->chunks, sizeof(struct nav_chunk), nchunks, file) != nchunks)
+        goto fail_chunks;
+
+    for(int i = 0; i < nchunks; i++) {
+        ret->chunks[i].portal_travel_costs = NULL;
+        ret->chunks[i].travel_costs_capacity = 0;
+    }
+    for(int i = 0; i < nchunks; i++) {
+        if(!unswizzle_chunk(ret, &ret->chunks[i]))
+            goto fail_costs;
+    }
+
+    for(int i = 0; i < nchunks; i++) {
+
+        struct nav_chunk *chunk = &ret->chunks[i];
+        if(chunk->num_portals == 0)
+            continue;
+
+        chunk->portal_travel_costs = malloc(chunk->num_portals * sizeof(chunk->portal_travel_costs[0]));
+        if(!chunk->portal_travel_costs)
+            goto fail_costs;
+        chunk->travel_costs_capacity = chunk->num_portals;
+
+        if(fread(chunk->portal_travel_costs, sizeof(chunk->portal_travel_costs[0]),
+            chunk->num_portals, file) != chunk->num_portals)
+            goto fail_costs;
+    }
+
+    fclose(file);
+    return ret;
+
+fail_costs:
+    for(int i = 0; i < nchunks; i++)
+        free(ret->chunks[i].portal_travel_costs);
+fail_chunks:
+    free(ret);
+fail_hdr:
+    fclose(file);
+fail_open:
+    return NULL;
+}
+
+/* Mirrors n_bake_regions */
+static bool build_regions(struct nav_private *priv)
+{
+    size_t region_w = (priv->width + REGION_CHUNKS - 1) / REGION_CHUNKS;
+    size_t region_h = (priv->height + REGION_CHUNKS - 1) / REGION_CHUNKS;
+    if(region_w * region_h <= 1)
+        return true;
+
+    priv->regions = calloc(region_w * region_h, sizeof(struct nav_region));
+    if(!priv->regions)
+        return false;
+    priv->region_w = region_w;
+    priv->region_h = region_h;
+
+    for(int i = 0; i < region_w * region_h; i++) {
+        if(!AStar_BuildRegion(priv, i))
+            return false;
+    }
+    return true;
+}
+
+static void free_baked(struct nav_private *priv)
+{
+    for(int i = 0; i < priv->width * priv->height; i++)
+        free(priv->chunks[i].portal_travel_costs);
+
+    if(priv->regions) {
+        for(int i = 0; i < priv->region_w * priv->region_h; i++) {
+            free(priv->regions[i].nodes);
+            free(priv->regions[i].offsets);
+            free(priv->regions[i].edges);
+        }
+        free(priv->regions);
+    }
+    free(priv);
+}
+
+static struct coord portal_midpoint(const struct portal *port)
+{
+    return (struct coord){
+        (port->endpoints[0].r + port->endpoints[1].r) / 2,
+        (port->endpoints[0].c + port->endpoints[1].c) / 2,
+    };
+}
+
+/* The same queries as are issued when linking the portals of every chunk */
+static size_t gen_grid_queries(const struct nav_private *priv, struct query *out, size_t maxout)
+{
+    size_t ret = 0;
+    for(int r = 0; r < priv->height; r++) {
+    for(int c = 0; c < priv->width; c++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[r * priv->width + c];
+        for(int i = 0; i < chunk->num_portals; i++) {
+        for(int j = 0; j < chunk->num_portals; j++) {
+
+            if(i == j)
+                continue;
+            if(ret == maxout)
+                return ret;
+
+            out[ret++] = (struct query){
+                .chunk = {r, c},
+                .start = portal_midpoint(&chunk->portals[i]),
+                .finish = portal_midpoint(&chunk->portals[j]),
+            };
+        }}
+    }}
+    return ret;
+}
+
+static size_t gen_portal_queries(const struct nav_private *priv, struct query *out, size_t maxout)
+{
+    size_t nchunks = priv->width * priv->height;
+    size_t ret = 0;
+    bool any = false;
+
+    for(int i = 0; i < nchunks; i++)
+        any = any || (priv->chunks[i].num_portals > 0);
+    if(!any)
+        return 0;
+
+    s_rand_state = 0x9e3779b9;
+    while(ret < maxout) {
+
+        int src = rand_next() % nchunks;
+        int dst = rand_next() % nchunks;
+        const struct nav_chunk *src_chunk = &priv->chunks[src];
+        const struct nav_chunk *dst_chunk = &priv->chunks[dst];
+        if(src_chunk->num_portals == 0 || dst_chunk->num_portals == 0)
+            continue;
+
+        struct coord tile = {rand_next() % FIELD_RES_R, rand_next() % FIELD_RES_C};
+        if(src_chunk->cost_base[tile.r][tile.c] == COST_IMPASSABLE)
+            continue;
+
+        out[ret++] = (struct query){
+            .chunk = {src / priv->width, src % priv->width},
+            .start = tile,
+            .finish_portal = &dst_chunk->portals[rand_next() % dst_chunk->num_portals],
+        };
+    }
+    return ret;
+}
+
+static uint64_t coord_to_key(struct coord c)
+{
+    return (((uint64_t)c.r) << 32) | (((uint64_t)c.c) & ~((uint32_t)0));
+}
+
+static uint64_t portal_to_key(const struct portal *p)
+{
+    return (uint64_t)(uintptr_t)p;
+}
+
+static float heuristic(struct coord a, struct coord b)
+{
+    const float D = 1.0f;
+    const float D2 = sqrt(2) * D;
+
+    int dx = abs(a.r - b.r);
+    int dy = abs(a.c - b.c);
+
+    return D * (dx + dy) + (D2 - 2 * D) * MIN(dx, dy);
+}
+
+/* The search that AStar_GridPath used to do before it was moved to dense arrays */
+static bool ref_grid_path(struct coord start, struct coord finish,
+                          const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C],
+                          vec_coord_t *out_path, float *out_cost)
+{
+    pq_coord_t frontier;
+    pq_coord_init(&frontier);
+    khash_t(key_coord) *came_from = kh_init(key_coord);
+    khash_t(key_float) *running_cost = kh_init(key_float);
+
+    kh_put_val(key_float, running_cost, coord_to_key(start), 0.0f);
+    pq_coord_push(&frontier, 0.0f, start);
+
+    while(pq_size(&frontier) > 0) {
+
+        struct coord curr;
+        pq_coord_pop(&frontier, &curr);
+
+        if(0 == memcmp(&curr, &finish, sizeof(struct coord)))
+            break;
+
+        struct coord neighbours[8];
+        float neighbour_costs[8];
+        int num_neighbours = N_GridNeighbours(cost_field, curr, neighbours, neighbour_costs);
+
+        khiter_t k = kh_get(key_float, running_cost, coord_to_key(curr));
+        float curr_cost = kh_value(running_cost, k);
+
+        for(int i = 0; i < num_neighbours; i++) {
+
+            struct coord next = neighbours[i];
+            float new_cost = curr_cost + neighbour_costs[i];
+
+            if((k = kh_get(key_float, running_cost, coord_to_key(next))) == kh_end(running_cost)
+            || new_cost < kh_value(running_cost, k)) {
+
+                kh_put_val(key_float, running_cost, coord_to_key(next), new_cost);
+                pq_coord_push(&frontier, new_cost + heuristic(finish, next), next);
+                kh_put_val(key_coord, came_from, coord_to_key(next), curr);
+            }
+        }
+    }
+
+    bool ret = (kh_get(key_coord, came_from, coord_to_key(finish)) != kh_end(came_from));
+    if(ret) {
+
+        vec_coord_reset(out_path);
+        struct coord curr = finish;
+        while(0 != memcmp(&curr, &start, sizeof(struct coord))) {
+            vec_coord_push(out_path, curr);
+            curr = kh_value(came_from, kh_get(key_coord, came_from, coord_to_key(curr)));
+        }
+        vec_coord_push(out_path, start);
+        *out_cost = kh_value(running_cost, kh_get(key_float, running_cost, coord_to_key(finish)));
+    }
+
+    pq_coord_destroy(&frontier);
+    kh_destroy(key_float, running_cost);
+    kh_destroy(key_coord, came_from);
+    return ret;
+}
+
+/* The search that AStar_PortalGraphPath used to do before it was moved to dense arrays */
+static bool ref_portal_path(struct tile_desc start_tile, const struct portal *finish,
+                            const struct nav_private *priv,
+                            vec_portal_t *out_path, float *out_cost)
+{
+    pq_portal_t frontier;
+    pq_portal_init(&frontier);
+    khash_t(key_portal) *came_from = kh_init(key_portal);
+    khash_t(key_float) *running_cost = kh_init(key_float);
+
+    const struct nav_chunk *chunk = &priv->chunks[start_tile.chunk_r * priv->width + start_tile.chunk_c];
+    const float penalty = sqrt(pow(FIELD_RES_R, 2.0f) + pow(FIELD_RES_C, 2.0f));
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *port = &chunk->portals[i];
+        struct coord tile_coord = (struct coord){start_tile.tile_r, start_tile.tile_c};
+
+        if(!N_PortalReachableFromTile(port, tile_coord, chunk))
+            continue;
+        float cost = N_PortalTravelCost(chunk, i, tile_coord);
+        if(cost == FLT_MAX)
+            continue;
+
+        kh_put_val(key_float, running_cost, portal_to_key(port), cost);
+        pq_portal_push(&frontier, cost, port);
+    }
+
+    while(pq_size(&frontier) > 0) {
+
+        const struct portal *curr;
+        pq_portal_pop(&frontier, &curr);
+
+        if(curr == finish)
+            break;
+
+        khiter_t k = kh_get(key_float, running_cost, portal_to_key(curr));
+        float curr_cost = kh_value(running_cost, k);
+
+        const struct portal *neighbours[MAX_PORTALS_PER_CHUNK];
+        float neighbour_costs[MAX_PORTALS_PER_CHUNK];
+        int num_neighbours = 0;
+        const struct nav_chunk *curr_chunk = &priv->chunks[curr->chunk.r * priv->width + curr->chunk.c];
+
+        for(int i = 0; i < curr->num_neighbours; i++) {
+            if(curr->edges[i].es == EDGE_STATE_BLOCKED)
+                continue;
+            neighbours[num_neighbours] = &curr_chunk->portals[curr->edges[i].neighbour];
+            neighbour_costs[num_neighbours++] = curr->edges[i].cost;
+        }
+        neighbours[num_neighbours] = curr->connected;
+        neighbour_costs[num_neighbours++] = 1;
+
+        for(int i = 0; i < num_neighbours; i++) {
+
+            const struct portal *next = neighbours[i];
+            float new_cost = curr_cost + neighbour_costs[i] + penalty;
+
+            if((k = kh_get(key_float, running_cost, portal_to_key(next))) == kh_end(running_cost)
+            || new_cost < kh_value(running_cost, k)) {
+
+                kh_put_val(key_float, running_cost, portal_to_key(next), new_cost);
+                pq_portal_push(&frontier, new_cost, next);
+                kh_put_val(key_portal, came_from, portal_to_key(next), curr);
+            }
+        }
+    }
+
+    bool ret = (kh_get(key_portal, came_from, portal_to_key(finish)) != kh_end(came_from));
+    if(ret) {
+
+        vec_portal_reset(out_path);
+        const struct portal *curr = finish;
+        while(true) {
+            vec_portal_push(out_path, (struct portal*)curr);
+            khiter_t k = kh_get(key_portal, came_from, portal_to_key(curr));
+            if(k == kh_end(came_from))
+                break;
+            curr = kh_value(came_from, k);
+        }
+        *out_cost = kh_value(running_cost, kh_get(key_float, running_cost, portal_to_key(finish)));
+    }
+
+    pq_portal_destroy(&frontier);
+    kh_destroy(key_float, running_cost);
+    kh_destroy(key_portal, came_from);
+    return ret;
+}
+
+static struct answer run_query(const struct nav_private *priv, enum kind kind,
+                               const struct query *q, bool reference)
+{
+    static vec_coord_t s_grid_path;
+    static vec_portal_t s_portal_path;
+    static bool s_init = false;
+
+    if(!s_init) {
+        vec_coord_init(&s_grid_path);
+        vec_portal_init(&s_portal_path);
+        s_init = true;
+    }
+
+    const struct nav_chunk *chunk = &priv->chunks[q->chunk.r * priv->width + q->chunk.c];
+    struct tile_desc td = {q->chunk.r, q->chunk.c, q->start.r, q->start.c};
+    struct answer ret = {0};
+
+    switch(kind) {
+    case KIND_GRID:
+        ret.exists = reference
+            ? ref_grid_path(q->start, q->finish, chunk->cost_base, &s_grid_path, &ret.cost)
+            : AStar_GridPath(q->start, q->finish, q->chunk, chunk->cost_base, &s_grid_path, &ret.cost);
+        break;
+    case KIND_PORTAL:
+        ret.exists = reference
+            ? ref_portal_path(td, q->finish_portal, priv, &s_portal_path, &ret.cost)
+            : AStar_PortalGraphPath(td, q->finish_portal, priv, &s_portal_path, &ret.cost);
+        break;
+    }
+    return ret;
+}
+
+static void bench(const struct nav_private *priv, enum kind kind, const struct query *queries,
+                  size_t nqueries, int niters, bool reference,
+                  struct answer *answers, struct result *out)
+{
+    size_t nfound = 0;
+    double begin = now_ms();
+
+    for(int it = 0; it < niters; it++) {
+        for(size_t i = 0; i < nqueries; i++) {
+            answers[i] = run_query(priv, kind, &queries[i], reference);
+            nfound += answers[i].exists;
+        }
+    }
+
+    out->ms_per_query = (now_ms() - begin) / (niters * nqueries);
+    out->nfound = nfound / niters;
+}
+
+static size_t count_mismatches(const struct answer *a, const struct answer *b, size_t n)
+{
+    size_t ret = 0;
+    for(size_t i = 0; i < n; i++) {
+        if(a[i].exists != b[i].exists)
+            ret++;
+        else if(a[i].exists && fabsf(a[i].cost - b[i].cost) > COST_EPSILON * MAX(1.0f, a[i].cost))
+            ret++;
+    }
+    return ret;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+/* The grid paths are never cached, so that every query does a search */
+bool N_FC_GetGridPath(struct coord local_start, struct coord local_dest,
+                      struct coord chunk, struct grid_path_desc *out)
+{
+    return false;
+}
+
+void N_FC_PutGridPath(struct coord local_start, struct coord local_dest,
+                      struct coord chunk, const struct grid_path_desc *in)
+{
+    vec_coord_destroy((vec_coord_t*)&in->path);
+}
+
+/* The blockers are not part of the baked data, so every portal
+ * with a travel cost is considered reachable */
+bool N_PortalReachableFromTile(const struct portal *port, struct coord tile,
+                               const struct nav_chunk *chunk)
+{
+    return true;
+}
+
+float N_PortalTravelCost(const struct nav_chunk *chunk, int portal_idx, struct coord tile)
+{
+    if(portal_idx >= chunk->travel_costs_capacity)
+        return FLT_MAX;
+
+    uint16_t cost = chunk->portal_travel_costs[portal_idx][tile.r][tile.c];
+    if(cost == PORTAL_COST_NONE)
+        return FLT_MAX;
+    return ((float)cost) / PORTAL_COST_SCALE;
+}
+
+int N_GridNeighbours(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord coord,
+                     struct coord out_neighbours[static 8], float out_costs[static 8])
+{
+    int ret = 0;
+
+    for(int r = -1; r <= 1; r++) {
+    for(int c = -1; c <= 1; c++) {
+
+        int abs_r = coord.r + r;
+        int abs_c = coord.c + c;
+
+        if(abs_r < 0 || abs_r >= FIELD_RES_R)
+            continue;
+        if(abs_c < 0 || abs_c >= FIELD_RES_C)
+            continue;
+        if(r == 0 && c == 0)
+            continue;
+        if(cost_field[abs_r][abs_c] == COST_IMPASSABLE)
+            continue;
+
+        bool diag = (r == c) || (r == -c);
+        if(diag && cost_field[abs_r][coord.c] == COST_IMPASSABLE
+                && cost_field[coord.r][abs_c] == COST_IMPASSABLE)
+            continue;
+        float cost_mult = diag ? sqrt(2) : 1.0f;
+
+        out_neighbours[ret] = (struct coord){abs_r, abs_c};
+        out_costs[ret] = cost_field[abs_r][abs_c] * cost_mult;
+        ret++;
+    }}
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    size_t maxqueries = 20000;
+    int niters = 5;
+
+    if(argc > 2)
+        maxqueries = strtoul(argv[2], NULL, 10);
+    if(argc > 3)
+        niters = atoi(argv[3]);
+
+    if(argc < 2 || maxqueries == 0 || niters <= 0) {
+        printf("Usage: %s <baked .nav file> [max queries] [num iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct nav_private *priv = load_baked(argv[1]);
+    if(!priv) {
+        fprintf(stderr, "Failed to load the navigation data from '%s'.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    double begin = now_ms();
+    if(!build_regions(priv)) {
+        fprintf(stderr, "Failed to build the regions.\n");
+        return EXIT_FAILURE;
+    }
+    double regions_ms = now_ms() - begin;
+
+    struct query *queries = malloc(maxqueries * sizeof(struct query));
+    struct answer *ref_answers = malloc(maxqueries * sizeof(struct answer));
+    struct answer *answers = malloc(maxqueries * sizeof(struct answer));
+    if(!queries || !ref_answers || !answers) {
+        fprintf(stderr, "Failed to allocate the queries.\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%zux%zu chunks, %zux%zu regions (built in %.3f ms), %d iterations\n\n", 
+        priv->width, priv->height, priv->region_w, priv->region_h, regions_ms, niters);
+    printf("%-8s %9s %8s %14s %14s %9s\n",
+        "queries", "count", "found", "reference (us)", "a_star (us)", "speedup");
+
+    for(int kind = 0; kind < ARR_SIZE(s_kind_names); kind++) {
+
+        size_t nqueries = (kind == KIND_GRID)
+            ? gen_grid_queries(priv, queries, maxqueries)
+            : gen_portal_queries(priv, queries, maxqueries);
+        if(nqueries == 0)
+            continue;
+
+        struct result ref_res, res;
+        bench(priv, kind, queries, nqueries, niters, true, ref_answers, &ref_res);
+        bench(priv, kind, queries, nqueries, niters, false, answers, &res);
+
+        size_t nmismatch = count_mismatches(ref_answers, answers, nqueries);
+        printf("%-8s %9zu %8zu %14.3f %14.3f %8.2fx", s_kind_names[kind], nqueries, res.nfound,
+            ref_res.ms_per_query * 1000.0, res.ms_per_query * 1000.0,
+            ref_res.ms_per_query / res.ms_per_query);
+        if(nmismatch)
+            printf(" (%zu results differ)", nmismatch);
+        printf("\n");
+    }
+
+    AStar_Shutdown();
+    free(queries);
+    free(ref_answers);
+    free(answers);
+    free_baked(priv);
+    return EXIT_SUCCESS;
+}
+
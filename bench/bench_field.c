@@ -0,0 +1,442 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+/* A standalone micro-benchmark of the integration field sweeps in sweep.c.
+ * The chunks of the navigation data baked by the engine (the '.nav' file 
+ * written next to a map) are loaded and the integration fields that the 
+ * flow fields are built from are computed for them, both with 
+ * Sweep_IntegrationField and with a reference Dijkstra search built on the 
+ * generic priority queue:
+ *
+ *   portal  - the fields towards every portal of every chunk, which are 
+ *             built for every chunk a path passes through
+ *   tile    - the fields towards a random pathable tile of a chunk, which
+ *             are built for the chunk holding the destination of a path
+ *   blocked - the same as 'portal', with random 2x2 squares of tiles 
+ *             taken up by blockers
+ *
+ * The flow field directions are derived from the integration field alone,
+ * so the fields of the two are compared tile for tile and must be equal.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "../src/navigation/sweep.h"
+#include "../src/navigation/nav_private.h"
+#include "../src/lib/public/pqueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+
+PQUEUE_TYPE(coord, struct coord)
+PQUEUE_IMPL(static, coord, struct coord)
+
+#define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
+/* The fraction of tiles that the 'blocked' queries cover with blockers */
+#define BLOCKED_FRAC    (0.05f)
+
+enum kind{
+    KIND_PORTAL,
+    KIND_TILE,
+    KIND_BLOCKED,
+};
+
+struct query{
+    size_t       chunk_idx;
+    size_t       nsources;
+    struct coord sources[FIELD_RES_R + FIELD_RES_C];
+};
+
+struct result{
+    double ms_per_query;
+    size_t nreached;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static uint32_t s_rand_state;
+
+static const char *s_kind_names[] = {
+    [KIND_PORTAL]  = "portal",
+    [KIND_TILE]    = "tile",
+    [KIND_BLOCKED] = "blocked",
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t rand_next(void)
+{
+    s_rand_state ^= s_rand_state << 13;
+    s_rand_state ^= s_rand_state >> 17;
+    s_rand_state ^= s_rand_state << 5;
+    return s_rand_state;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Only the chunk images are needed, so the portal pointers are left 
+ * swizzled and the portal travel costs are not read */
+static struct nav_chunk *load_chunks(const char *path, size_t *out_nchunks)
+{
+    FILE *file = fopen(path, "rb");
+    if(!file)
+        goto fail_open;
+
+    struct baked_hdr hdr;
+    if(fread(&hdr, sizeof(hdr), 1, file) != 1)
+        goto fail_hdr;
+    if(memcmp(hdr.magic, BAKED_MAGIC, sizeof(hdr.magic)) || hdr.version != BAKED_VER)
+        goto fail_hdr;
+    if(hdr.chunk_size != sizeof(struct nav_chunk))
+        goto fail_hdr;
+
+    size_t nchunks = hdr.width * hdr.height;
+    struct nav_chunk *ret = malloc(nchunks * sizeof(struct nav_chunk));
+    if(!ret)
+        goto fail_hdr;
+
+    if(fread(ret, sizeof(struct nav_chunk), nchunks, file) != nchunks)
+        goto fail_chunks;
+
+    for(int i = 0; i < nchunks; i++) {
+        if(ret[i].num_portals > MAX_PORTALS_PER_CHUNK)
+            goto fail_chunks;
+        memset(ret[i].blockers, 0, sizeof(ret[i].blockers));
+    }
+
+    fclose(file);
+    *out_nchunks = nchunks;
+    return ret;
+
+fail_chunks:
+    free(ret);
+fail_hdr:
+    fclose(file);
+fail_open:
+    return NULL;
+}
+
+static void add_blockers(struct nav_chunk *chunks, size_t nchunks)
+{
+    size_t nsquares = FIELD_RES_R * FIELD_RES_C * BLOCKED_FRAC / 4;
+
+    s_rand_state = 0x85ebca6b;
+    for(int i = 0; i < nchunks; i++) {
+        for(int j = 0; j < nsquares; j++) {
+
+            int r = rand_next() % (FIELD_RES_R - 1);
+            int c = rand_next() % (FIELD_RES_C - 1);
+            chunks[i].blockers[r + 0][c + 0]++;
+            chunks[i].blockers[r + 0][c + 1]++;
+            chunks[i].blockers[r + 1][c + 0]++;
+            chunks[i].blockers[r + 1][c + 1]++;
+        }
+    }
+}
+
+static void clear_blockers(struct nav_chunk *chunks, size_t nchunks)
+{
+    for(int i = 0; i < nchunks; i++)
+        memset(chunks[i].blockers, 0, sizeof(chunks[i].blockers));
+}
+
+/* The same frontier as is set up for a portal target: all the tiles 
+ * of the portal that are not blocked */
+static size_t gen_portal_queries(const struct nav_chunk *chunks, size_t nchunks,
+                                 struct query *out, size_t maxout)
+{
+    size_t ret = 0;
+    for(int i = 0; i < nchunks; i++) {
+
+        const struct nav_chunk *chunk = &chunks[i];
+        for(int j = 0; j < chunk->num_portals; j++) {
+
+            if(ret == maxout)
+                return ret;
+
+            const struct portal *port = &chunk->portals[j];
+            struct query *q = &out[ret];
+            q->chunk_idx = i;
+            q->nsources = 0;
+
+            for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
+            for(int c = port->endpoints[0].c; c <= port->endpoints[1].c; c++) {
+
+                if(chunk->blockers[r][c] > 0)
+                    continue;
+                q->sources[q->nsources++] = (struct coord){r, c};
+            }}
+
+            if(q->nsources > 0)
+                ret++;
+        }
+    }
+    return ret;
+}
+
+static size_t gen_tile_queries(const struct nav_chunk *chunks, size_t nchunks,
+                               struct query *out, size_t maxout)
+{
+    size_t ret = 0;
+    int attempts = 0;
+
+    s_rand_state = 0x9e3779b9;
+    while(ret < maxout && attempts++ < maxout * 16) {
+
+        size_t idx = rand_next() % nchunks;
+        struct coord tile = {rand_next() % FIELD_RES_R, rand_next() % FIELD_RES_C};
+        if(chunks[idx].cost_base[tile.r][tile.c] == COST_IMPASSABLE)
+            continue;
+
+        out[ret++] = (struct query){
+            .chunk_idx = idx,
+            .nsources = 1,
+            .sources = {tile},
+        };
+    }
+    return ret;
+}
+
+static int compare_tiles(void *a, void *b)
+{
+    struct coord *ac = a;
+    struct coord *bc = b;
+    return !((bc->r == ac->r) && (bc->c == ac->c));
+}
+
+static bool tile_passable(const struct nav_chunk *chunk, struct coord tile)
+{
+    if(chunk->cost_base[tile.r][tile.c] == COST_IMPASSABLE)
+        return false;
+    if(chunk->blockers[tile.r][tile.c] > 0)
+        return false;
+    return true;
+}
+
+/* The search that the flow fields were built with before the sweeps */
+static void ref_integration_field(pq_coord_t *frontier, const struct nav_chunk *chunk, 
+                                  float inout[FIELD_RES_R][FIELD_RES_C])
+{
+    const struct coord deltas[] = {{-1, 0}, {0, -1}, {0, 1}, {1, 0}};
+
+    while(pq_size(frontier) > 0) {
+
+        struct coord curr;
+        pq_coord_pop(frontier, &curr);
+
+        for(int i = 0; i < ARR_SIZE(deltas); i++) {
+
+            struct coord next = {curr.r + deltas[i].r, curr.c + deltas[i].c};
+            if(next.r < 0 || next.r >= FIELD_RES_R)
+                continue;
+            if(next.c < 0 || next.c >= FIELD_RES_C)
+                continue;
+            if(!tile_passable(chunk, next))
+                continue;
+
+            float total_cost = inout[curr.r][curr.c] + chunk->cost_base[next.r][next.c];
+            if(total_cost < inout[next.r][next.c]) {
+
+                inout[next.r][next.c] = total_cost;
+                if(!pq_coord_contains(frontier, compare_tiles, next))
+                    pq_coord_push(frontier, total_cost, next);
+            }
+        }
+    }
+}
+
+static void run_query(const struct nav_chunk *chunks, const struct query *q, bool reference,
+                      float out[FIELD_RES_R][FIELD_RES_C])
+{
+    const struct nav_chunk *chunk = &chunks[q->chunk_idx];
+
+    for(int r = 0; r < FIELD_RES_R; r++)
+        for(int c = 0; c < FIELD_RES_C; c++)
+            out[r][c] = INFINITY;
+
+    if(!reference) {
+
+        for(int i = 0; i < q->nsources; i++)
+            out[q->sources[i].r][q->sources[i].c] = 0.0f;
+        Sweep_IntegrationField(chunk, out);
+        return;
+    }
+
+    pq_coord_t frontier;
+    pq_coord_init(&frontier);
+
+    for(int i = 0; i < q->nsources; i++) {
+        pq_coord_push(&frontier, 0.0f, q->sources[i]);
+        out[q->sources[i].r][q->sources[i].c] = 0.0f;
+    }
+    ref_integration_field(&frontier, chunk, out);
+    pq_coord_destroy(&frontier);
+}
+
+static size_t count_reached(const float field[FIELD_RES_R][FIELD_RES_C])
+{
+    size_t ret = 0;
+    for(int r = 0; r < FIELD_RES_R; r++)
+        for(int c = 0; c < FIELD_RES_C; c++)
+            ret += (field[r][c] < INFINITY);
+    return ret;
+}
+
+static void bench(const struct nav_chunk *chunks, const struct query *queries,
+                  size_t nqueries, int niters, bool reference, struct result *out)
+{
+    static float s_field[FIELD_RES_R][FIELD_RES_C];
+    size_t nreached = 0;
+    double begin = now_ms();
+
+    for(int it = 0; it < niters; it++) {
+        for(size_t i = 0; i < nqueries; i++) {
+            run_query(chunks, &queries[i], reference, s_field);
+            nreached += count_reached(s_field);
+        }
+    }
+
+    out->ms_per_query = (now_ms() - begin) / (niters * nqueries);
+    out->nreached = nreached / niters;
+}
+
+static size_t count_mismatches(const struct nav_chunk *chunks, const struct query *queries, 
+                               size_t nqueries)
+{
+    static float s_ref[FIELD_RES_R][FIELD_RES_C];
+    static float s_field[FIELD_RES_R][FIELD_RES_C];
+    size_t ret = 0;
+
+    for(size_t i = 0; i < nqueries; i++) {
+
+        run_query(chunks, &queries[i], true, s_ref);
+        run_query(chunks, &queries[i], false, s_field);
+
+        for(int r = 0; r < FIELD_RES_R; r++) {
+        for(int c = 0; c < FIELD_RES_C; c++) {
+            if(s_ref[r][c] != s_field[r][c])
+                goto mismatch;
+        }}
+        continue;
+    mismatch:
+        ret++;
+    }
+    return ret;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    size_t maxqueries = 4000;
+    int niters = 3;
+
+    if(argc > 2)
+        maxqueries = strtoul(argv[2], NULL, 10);
+    if(argc > 3)
+        niters = atoi(argv[3]);
+
+    if(argc < 2 || maxqueries == 0 || niters <= 0) {
+        printf("Usage: %s <baked .nav file> [max queries] [num iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t nchunks;
+    struct nav_chunk *chunks = load_chunks(argv[1], &nchunks);
+    if(!chunks) {
+        fprintf(stderr, "Failed to load the navigation data from '%s'.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    struct query *queries = malloc(maxqueries * sizeof(struct query));
+    if(!queries) {
+        fprintf(stderr, "Failed to allocate the queries.\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu chunks, %d iterations\n\n", nchunks, niters);
+    printf("%-8s %9s %9s %14s %14s %9s\n",
+        "queries", "count", "reached", "reference (us)", "sweep (us)", "speedup");
+
+    for(int kind = 0; kind < ARR_SIZE(s_kind_names); kind++) {
+
+        if(kind == KIND_BLOCKED)
+            add_blockers(chunks, nchunks);
+
+        size_t nqueries = (kind == KIND_TILE)
+            ? gen_tile_queries(chunks, nchunks, queries, maxqueries)
+            : gen_portal_queries(chunks, nchunks, queries, maxqueries);
+        if(nqueries == 0)
+            continue;
+
+        struct result ref_res, res;
+        bench(chunks, queries, nqueries, niters, true, &ref_res);
+        bench(chunks, queries, nqueries, niters, false, &res);
+
+        size_t nmismatch = count_mismatches(chunks, queries, nqueries);
+        printf("%-8s %9zu %9zu %14.3f %14.3f %8.2fx", s_kind_names[kind], nqueries, 
+            res.nreached / nqueries, ref_res.ms_per_query * 1000.0, res.ms_per_query * 1000.0,
+            ref_res.ms_per_query / res.ms_per_query);
+        if(nmismatch)
+            printf(" (%zu fields differ)", nmismatch);
+        printf("\n");
+
+        if(kind == KIND_BLOCKED)
+            clear_blockers(chunks, nchunks);
+    }
+
+    Sweep_Shutdown();
+    free(queries);
+    free(chunks);
+    return EXIT_SUCCESS;
+}
+
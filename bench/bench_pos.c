@@ -0,0 +1,442 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+/* A standalone micro-benchmark of the spatial indices that can back the 
+ * G_Pos_* queries. The same workload is replayed against the quadtree and 
+ * the uniform grid. Every tick, all the entities are moved and then one of 
+ * the following query mixes is issued:
+ *
+ *   combat    - every entity queries the circle within its attack range
+ *   harvester - a quarter of the entities look for the nearest resource
+ *   movement  - every entity queries its immediate neighbours
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#define _XOPEN_SOURCE   500
+
+#include "../src/lib/public/quadtree.h"
+#include "../src/lib/public/ugrid.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <time.h>
+
+
+QUADTREE_TYPE(ent, uint32_t)
+QUADTREE_PROTOTYPES(static, ent, uint32_t)
+QUADTREE_IMPL(static, ent, uint32_t)
+
+#define MAP_HALF_LEN    (512.0f)
+#define GRID_CELL_SZ    (32.0f)
+#define MAX_RESULTS     (8192)
+#define NEAREST_RANGE   (512.0f)
+#define MOVE_STEP       (1.5f)
+#define NEIGHBOUR_RANGE (20.0f)
+#define RESOURCE_FRAC   (16)
+#define QT_RESERVE_MIN  (16384)
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
+
+enum mix{
+    MIX_COMBAT,
+    MIX_HARVESTER,
+    MIX_MOVEMENT,
+};
+
+struct ents{
+    size_t    count;
+    float    *xs, *zs;
+    float    *dxs, *dzs;
+    float    *ranges;
+    /* The location of each entity in the uniform grid */
+    uint32_t *cells, *slots;
+};
+
+struct result{
+    double   ms_per_tick;
+    uint64_t checksum;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static uint32_t s_rand_state;
+static uint32_t s_results[MAX_RESULTS];
+
+static const char *s_mix_names[] = {
+    [MIX_COMBAT]    = "combat",
+    [MIX_HARVESTER] = "harvester",
+    [MIX_MOVEMENT]  = "movement",
+};
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static uint32_t rand_next(void)
+{
+    s_rand_state ^= s_rand_state << 13;
+    s_rand_state ^= s_rand_state >> 17;
+    s_rand_state ^= s_rand_state << 5;
+    return s_rand_state;
+}
+
+static float rand_range(float min, float max)
+{
+    return min + (max - min) * ((rand_next() & 0xffffff) / (float)0xffffff);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static bool ents_init(struct ents *ents, size_t count)
+{
+    ents->count = count;
+    ents->xs = malloc(count * sizeof(float));
+    ents->zs = malloc(count * sizeof(float));
+    ents->dxs = malloc(count * sizeof(float));
+    ents->dzs = malloc(count * sizeof(float));
+    ents->ranges = malloc(count * sizeof(float));
+    ents->cells = malloc(count * sizeof(uint32_t));
+    ents->slots = malloc(count * sizeof(uint32_t));
+
+    if(!ents->xs || !ents->zs || !ents->dxs || !ents->dzs 
+    || !ents->ranges || !ents->cells || !ents->slots)
+        return false;
+
+    s_rand_state = 0x9e3779b9;
+    for(size_t i = 0; i < count; i++) {
+
+        ents->xs[i] = rand_range(-MAP_HALF_LEN, MAP_HALF_LEN);
+        ents->zs[i] = rand_range(-MAP_HALF_LEN, MAP_HALF_LEN);
+        float angle = rand_range(0.0f, 2.0f * M_PI);
+        ents->dxs[i] = cosf(angle) * MOVE_STEP;
+        ents->dzs[i] = sinf(angle) * MOVE_STEP;
+        ents->ranges[i] = rand_range(50.0f, 150.0f);
+    }
+    return true;
+}
+
+static void ents_destroy(struct ents *ents)
+{
+    free(ents->xs);
+    free(ents->zs);
+    free(ents->dxs);
+    free(ents->dzs);
+    free(ents->ranges);
+    free(ents->cells);
+    free(ents->slots);
+}
+
+/* Moves the entity, bouncing it off the edges of the map */
+static void ents_step(struct ents *ents, size_t i)
+{
+    float x = ents->xs[i] + ents->dxs[i];
+    float z = ents->zs[i] + ents->dzs[i];
+
+    if(x < -MAP_HALF_LEN || x > MAP_HALF_LEN) {
+        ents->dxs[i] = -ents->dxs[i];
+        x = ents->xs[i] + ents->dxs[i];
+    }
+    if(z < -MAP_HALF_LEN || z > MAP_HALF_LEN) {
+        ents->dzs[i] = -ents->dzs[i];
+        z = ents->zs[i] + ents->dzs[i];
+    }
+    ents->xs[i] = x;
+    ents->zs[i] = z;
+}
+
+static bool is_resource(uint32_t uid, void *arg)
+{
+    return (uid % RESOURCE_FRAC) == 0;
+}
+
+static uint64_t checksum_results(int nresults)
+{
+    uint64_t ret = 0;
+    for(int i = 0; i < nresults; i++)
+        ret += s_results[i];
+    return ret;
+}
+
+/* Mirrors the search that G_Pos_NearestWithPred used to do with the quadtree: 
+ * circles of doubling radius are queried until a match is found. */
+static bool qt_nearest(qt_ent_t *qt, const struct ents *ents, float x, float z, uint32_t *out)
+{
+    float range = GRID_CELL_SZ;
+    while(true) {
+
+        int nres = qt_ent_inrange_circle(qt, x, z, range, s_results, ARR_SIZE(s_results));
+        float best_dist2 = FLT_MAX;
+        bool found = false;
+
+        for(int i = 0; i < nres; i++) {
+
+            uint32_t uid = s_results[i];
+            if(!is_resource(uid, NULL))
+                continue;
+            float dx = ents->xs[uid] - x, dz = ents->zs[uid] - z;
+            float dist2 = dx * dx + dz * dz;
+            if(dist2 < best_dist2) {
+                best_dist2 = dist2;
+                *out = uid;
+                found = true;
+            }
+        }
+
+        if(found || range >= NEAREST_RANGE)
+            return found;
+        range = MIN(range * 2, NEAREST_RANGE);
+    }
+}
+
+static uint64_t qt_queries(qt_ent_t *qt, const struct ents *ents, enum mix mix)
+{
+    uint64_t ret = 0;
+    for(size_t i = 0; i < ents->count; i++) {
+
+        uint32_t nearest;
+        switch(mix) {
+        case MIX_COMBAT:
+            ret += qt_ent_inrange_circle(qt, ents->xs[i], ents->zs[i], ents->ranges[i], 
+                s_results, ARR_SIZE(s_results));
+            break;
+        case MIX_HARVESTER:
+            if(i % 4)
+                break;
+            if(qt_nearest(qt, ents, ents->xs[i], ents->zs[i], &nearest))
+                ret += nearest;
+            break;
+        case MIX_MOVEMENT:
+            ret += qt_ent_inrange_circle(qt, ents->xs[i], ents->zs[i], NEIGHBOUR_RANGE, 
+                s_results, ARR_SIZE(s_results));
+            break;
+        }
+    }
+    return ret;
+}
+
+static uint64_t grid_queries(struct ugrid *grid, const struct ents *ents, enum mix mix)
+{
+    uint64_t ret = 0;
+    for(size_t i = 0; i < ents->count; i++) {
+
+        uint32_t nearest;
+        switch(mix) {
+        case MIX_COMBAT:
+            ret += ugrid_inrange_circle(grid, ents->xs[i], ents->zs[i], ents->ranges[i], 
+                s_results, ARR_SIZE(s_results));
+            break;
+        case MIX_HARVESTER:
+            if(i % 4)
+                break;
+            if(ugrid_nearest(grid, ents->xs[i], ents->zs[i], NEAREST_RANGE, 
+                is_resource, NULL, &nearest))
+                ret += nearest;
+            break;
+        case MIX_MOVEMENT:
+            ret += ugrid_inrange_circle(grid, ents->xs[i], ents->zs[i], NEIGHBOUR_RANGE, 
+                s_results, ARR_SIZE(s_results));
+            break;
+        }
+    }
+    return ret;
+}
+
+static bool bench_quadtree(size_t count, int nticks, enum mix mix, struct result *out)
+{
+    struct ents ents;
+    if(!ents_init(&ents, count))
+        goto fail_ents;
+
+    qt_ent_t qt;
+    qt_ent_init(&qt, -MAP_HALF_LEN, MAP_HALF_LEN, -MAP_HALF_LEN, MAP_HALF_LEN);
+    /* The node pool must not be grown while the tree is partitioned, 
+     * so reserve enough for the internal nodes up front. */
+    if(!qt_ent_reserve(&qt, MAX(QT_RESERVE_MIN, count * 8)))
+        goto fail_qt;
+
+    for(uint32_t i = 0; i < count; i++) {
+        if(!qt_ent_insert(&qt, ents.xs[i], ents.zs[i], i))
+            goto fail_insert;
+    }
+
+    uint64_t checksum = 0;
+    double begin = now_ms();
+
+    for(int t = 0; t < nticks; t++) {
+
+        for(uint32_t i = 0; i < count; i++) {
+
+            float oldx = ents.xs[i], oldz = ents.zs[i];
+            ents_step(&ents, i);
+            qt_ent_delete(&qt, oldx, oldz, i);
+            if(!qt_ent_insert(&qt, ents.xs[i], ents.zs[i], i))
+                goto fail_insert;
+        }
+        checksum += qt_queries(&qt, &ents, mix);
+    }
+
+    out->ms_per_tick = (now_ms() - begin) / nticks;
+    out->checksum = checksum;
+
+    qt_ent_destroy(&qt);
+    ents_destroy(&ents);
+    return true;
+
+fail_insert:
+fail_qt:
+    qt_ent_destroy(&qt);
+fail_ents:
+    ents_destroy(&ents);
+    return false;
+}
+
+static bool grid_insert(struct ugrid *grid, struct ents *ents, uint32_t i)
+{
+    ents->cells[i] = ugrid_cell_for(grid, ents->xs[i], ents->zs[i]);
+    return ugrid_insert(grid, ents->cells[i], ents->xs[i], ents->zs[i], i, &ents->slots[i]);
+}
+
+static bool bench_grid(size_t count, int nticks, enum mix mix, struct result *out)
+{
+    struct ents ents;
+    if(!ents_init(&ents, count))
+        goto fail_ents;
+
+    struct ugrid grid;
+    if(!ugrid_init(&grid, -MAP_HALF_LEN, MAP_HALF_LEN, -MAP_HALF_LEN, MAP_HALF_LEN, GRID_CELL_SZ))
+        goto fail_grid;
+
+    for(uint32_t i = 0; i < count; i++) {
+        if(!grid_insert(&grid, &ents, i))
+            goto fail_insert;
+    }
+
+    uint64_t checksum = 0;
+    double begin = now_ms();
+
+    for(int t = 0; t < nticks; t++) {
+
+        /* The positions are all updated in a single batch, as G_Pos does 
+         * before the first query of the tick. */
+        for(uint32_t i = 0; i < count; i++) {
+
+            ents_step(&ents, i);
+            uint32_t cell = ugrid_cell_for(&grid, ents.xs[i], ents.zs[i]);
+            if(cell == ents.cells[i]) {
+                ugrid_move(&grid, cell, ents.slots[i], ents.xs[i], ents.zs[i]);
+                continue;
+            }
+
+            uint32_t moved;
+            if(ugrid_remove(&grid, ents.cells[i], ents.slots[i], &moved))
+                ents.slots[moved] = ents.slots[i];
+            if(!grid_insert(&grid, &ents, i))
+                goto fail_insert;
+        }
+        checksum += grid_queries(&grid, &ents, mix);
+    }
+
+    out->ms_per_tick = (now_ms() - begin) / nticks;
+    out->checksum = checksum;
+
+    ugrid_destroy(&grid);
+    ents_destroy(&ents);
+    return true;
+
+fail_insert:
+    ugrid_destroy(&grid);
+fail_grid:
+fail_ents:
+    ents_destroy(&ents);
+    return false;
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    size_t count = 2048;
+    int nticks = 100;
+
+    if(argc > 1)
+        count = strtoul(argv[1], NULL, 10);
+    if(argc > 2)
+        nticks = atoi(argv[2]);
+
+    if(count == 0 || nticks <= 0) {
+        printf("Usage: %s [num entities] [num ticks]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%zu entities, %d ticks\n\n", count, nticks);
+    printf("%-10s %14s %14s %9s\n", "mix", "quadtree (ms)", "grid (ms)", "speedup");
+
+    for(int mix = 0; mix < ARR_SIZE(s_mix_names); mix++) {
+
+        struct result qt_res, grid_res;
+        if(!bench_quadtree(count, nticks, mix, &qt_res)
+        || !bench_grid(count, nticks, mix, &grid_res)) {
+            fprintf(stderr, "Failed to allocate the indices.\n");
+            return EXIT_FAILURE;
+        }
+
+        /* The quadtree tests the distances in double precision, so a 
+         * few records right on the edge of a circle may be counted differently. */
+        int64_t diff = (int64_t)(grid_res.checksum - qt_res.checksum);
+        printf("%-10s %14.3f %14.3f %8.2fx", s_mix_names[mix], 
+            qt_res.ms_per_tick, grid_res.ms_per_tick, 
+            qt_res.ms_per_tick / grid_res.ms_per_tick);
+        if(diff)
+            printf(" (checksum differs by %lld)", (long long)diff);
+        printf("\n");
+    }
+    return EXIT_SUCCESS;
+}
+
@@ -102,6 +102,13 @@ class PerfStatsWindow(pf.Window):
             .format(used=nav_stats["grid_path_used"], cap=nav_stats["grid_path_max"], hr=nav_stats["grid_path_hit_rate"]), \
             (0, 255, 0))
 
+        for i, shard in enumerate(nav_stats["shards"]):
+            self.layout_row_dynamic(20, 1)
+            self.label_colored_wrap("[Shard {idx}] LOS: {lh:05d}/{lq:05d}  Flow: {fh:05d}/{fq:05d}  Mapping: {mh:05d}/{mq:05d}  Grid Path: {gh:05d}/{gq:05d}" \
+                .format(idx=i, lh=shard["los_hit"], lq=shard["los_query"], fh=shard["flow_hit"], fq=shard["flow_query"], 
+                mh=shard["ffid_hit"], mq=shard["ffid_query"], gh=shard["grid_path_hit"], gq=shard["grid_path_query"]), \
+                (255, 255, 255))
+
     def threads_tab(self):
         for name in self.frame_perfstats[self.tickindex]:
             t_frame_times = [0] * 100
@@ -39,6 +39,7 @@
 #include "anim_ctx.h"
 #include "../entity.h"
 #include "../event.h"
+#include "../main.h"
 #include "../lib/public/attr.h"
 #include "../lib/public/pf_string.h"
 #include "../render/public/render.h"
@@ -113,28 +114,89 @@ static void a_make_bind_mat(int joint_idx, const struct skeleton *skel, mat4x4_t
     *out = bind_trans;
 }
 
-static void a_make_pose_mat(const struct entity *ent, int joint_idx, const struct skeleton *skel, mat4x4_t *out)
+static void a_make_pose_mats(const struct skeleton *skel, const struct SQT *local_poses, 
+                             mat4x4_t *out)
 {
-    struct anim_ctx *ctx = ent->anim_ctx;
-    struct anim_sample *sample = &ctx->active->samples[ctx->curr_frame];
+    assert(skel->num_joints <= MAX_JOINTS);
 
-    mat4x4_t pose_trans;
-    PFM_Mat4x4_Identity(&pose_trans);
+    bool done[MAX_JOINTS] = {0};
+    int chain[MAX_JOINTS];
 
-    /* Same as a_make_bind_mat, except for the current pose. */
-    while(joint_idx >= 0) {
+    /* Compute the poses top-down so that every joint's object-space transform 
+     * is derived from its' parent's one with a single matrix multiplication, 
+     * rather than by walking the entire chain of ancestors for every joint. 
+     * The joints are not guaranteed to be stored in hierarchy order, so we 
+     * first walk up to the first ancestor that has already been resolved.
+     */
+    for(int i = 0; i < skel->num_joints; i++) {
 
-        struct joint *joint = &skel->joints[joint_idx];
-        struct SQT   *pose_sqt = &sample->local_joint_poses[joint_idx];
-        mat4x4_t to_parent, to_curr = pose_trans;
+        int nchain = 0;
+        int joint_idx = i;
 
-        a_mat_from_sqt(pose_sqt, &to_parent);
-        PFM_Mat4x4_Mult4x4(&to_parent, &to_curr, &pose_trans);
+        while(joint_idx >= 0 && !done[joint_idx]) {
+            chain[nchain++] = joint_idx;
+            joint_idx = skel->joints[joint_idx].parent_idx;
+        }
 
-        joint_idx = joint->parent_idx;
+        while(nchain > 0) {
+
+            int curr = chain[--nchain];
+            int parent = skel->joints[curr].parent_idx;
+
+            mat4x4_t to_parent;
+            a_mat_from_sqt(&local_poses[curr], &to_parent);
+
+            if(parent >= 0) {
+                PFM_Mat4x4_Mult4x4(&out[parent], &to_parent, &out[curr]);
+            }else{
+                out[curr] = to_parent;
+            }
+            done[curr] = true;
+        }
+    }
+}
+
+static void a_blend_sqt(const struct SQT *a, const struct SQT *b, float alpha, struct SQT *out)
+{
+    for(int i = 0; i < 3; i++) {
+        out->scale.raw[i] = a->scale.raw[i] + (b->scale.raw[i] - a->scale.raw[i]) * alpha;
+        out->trans.raw[i] = a->trans.raw[i] + (b->trans.raw[i] - a->trans.raw[i]) * alpha;
     }
 
-    *out = pose_trans;
+    /* Normalized linear interpolation of the rotations. Take the shortest 
+     * path between the two orientations, since q and -q are equivalent. 
+     */
+    quat_t qa = a->quat_rotation, qb = b->quat_rotation;
+    float sign = (PFM_Vec4_Dot(&qa, &qb, NULL) < 0.0f) ? -1.0f : 1.0f;
+
+    for(int i = 0; i < 4; i++) {
+        out->quat_rotation.raw[i] = qa.raw[i] * (1.0f - alpha) + qb.raw[i] * sign * alpha;
+    }
+    PFM_Quat_Normal(&out->quat_rotation, &out->quat_rotation);
+}
+
+static bool a_blend_target(const struct anim_ctx *ctx, int *out_next_frame, float *out_alpha)
+{
+    if(ctx->active->num_frames < 2)
+        return false;
+
+    /* A non-looping clip is not blended back to its' first frame */
+    int next_frame = (ctx->curr_frame + 1) % ctx->active->num_frames;
+    if(next_frame == 0 && ctx->mode != ANIM_MODE_LOOP)
+        return false;
+
+    float frame_period_secs = 1.0f/ctx->key_fps;
+    float elapsed_secs = (Engine_GetTicks() - ctx->curr_frame_start_ticks)/1000.0f;
+    float alpha = elapsed_secs / frame_period_secs;
+
+    if(alpha > 1.0f)
+        alpha = 1.0f;
+    if(alpha <= 0.0f)
+        return false;
+
+    *out_next_frame = next_frame;
+    *out_alpha = alpha;
+    return true;
 }
 
 /*****************************************************************************/
@@ -169,7 +231,7 @@ void A_SetActiveClip(const struct entity *ent, const char *name,
     ctx->mode = mode;
     ctx->key_fps = key_fps;
     ctx->curr_frame = 0;
-    ctx->curr_frame_start_ticks = SDL_GetTicks();
+    ctx->curr_frame_start_ticks = Engine_GetTicks();
 }
 
 void A_Update(struct entity *ent)
@@ -177,7 +239,7 @@ void A_Update(struct entity *ent)
     struct anim_ctx *ctx = ent->anim_ctx;
 
     float frame_period_secs = 1.0f/ctx->key_fps;
-    uint32_t curr_ticks = SDL_GetTicks();
+    uint32_t curr_ticks = Engine_GetTicks();
     float elapsed_secs = (curr_ticks - ctx->curr_frame_start_ticks)/1000.0f;
 
     if(elapsed_secs > frame_period_secs) {
@@ -206,14 +268,30 @@ void A_Update(struct entity *ent)
     }
 }
 
-void A_GetRenderState(const struct entity *ent, size_t *out_njoints, 
+void A_GetRenderState(const struct entity *ent, bool blend, size_t *out_njoints, 
                       mat4x4_t *out_curr_pose, const mat4x4_t **out_inv_bind_pose)
 {
     assert(ent->flags & ENTITY_FLAG_ANIMATED);
     struct anim_data *priv = (struct anim_data*)ent->anim_private;
+    struct anim_ctx *ctx = ent->anim_ctx;
+    const struct anim_sample *sample = &ctx->active->samples[ctx->curr_frame];
+
+    int next_frame;
+    float alpha;
+
+    if(blend && a_blend_target(ctx, &next_frame, &alpha)) {
 
-    for(int j = 0; j < priv->skel.num_joints; j++) {
-        a_make_pose_mat(ent, j, &priv->skel, out_curr_pose + j);
+        const struct anim_sample *next = &ctx->active->samples[next_frame];
+        struct SQT blended[MAX_JOINTS];
+
+        for(int j = 0; j < priv->skel.num_joints; j++) {
+            a_blend_sqt(&sample->local_joint_poses[j], &next->local_joint_poses[j], 
+                alpha, &blended[j]);
+        }
+        a_make_pose_mats(&priv->skel, blended, out_curr_pose);
+
+    }else{
+        memcpy(out_curr_pose, sample->joint_poses, priv->skel.num_joints * sizeof(mat4x4_t));
     }
 
     *out_njoints = priv->skel.num_joints;
@@ -259,11 +337,13 @@ const struct skeleton *A_GetCurrPoseSkeleton(const struct entity *ent)
 
     ret->inv_bind_poses = (void*)((char*)ret->bind_sqts + num_joints * sizeof(struct SQT));
 
+    struct anim_ctx *ctx = ent->anim_ctx;
+    const struct anim_sample *sample = &ctx->active->samples[ctx->curr_frame];
+
     for(int i = 0; i < ret->num_joints; i++) {
     
         /* Update the inverse bind matrices for the current frame */
-        mat4x4_t pose_mat;
-        a_make_pose_mat(ent, i, ret, &pose_mat);
+        mat4x4_t pose_mat = sample->joint_poses[i];
         PFM_Mat4x4_Inverse(&pose_mat, &ret->inv_bind_poses[i]);
     }
 
@@ -282,6 +362,19 @@ void A_PrepareInvBindMatrices(const struct skeleton *skel)
     }
 }
 
+void A_PrepareSamplePoses(const struct anim_data *data)
+{
+    for(int i = 0; i < data->num_anims; i++) {
+
+        const struct anim_clip *clip = &data->anims[i];
+        for(int f = 0; f < clip->num_frames; f++) {
+
+            const struct anim_sample *sample = &clip->samples[f];
+            a_make_pose_mats(&data->skel, sample->local_joint_poses, sample->joint_poses);
+        }
+    }
+}
+
 const struct aabb *A_GetCurrPoseAABB(const struct entity *ent)
 {
     struct anim_ctx *ctx = ent->anim_ctx;
@@ -353,7 +446,7 @@ bool A_SaveState(struct SDL_RWops *stream, const struct entity *ent)
 
     struct attr curr_frame_ticks_elapsed = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = SDL_GetTicks() - ctx->curr_frame_start_ticks
+        .val.as_int = Engine_GetTicks() - ctx->curr_frame_start_ticks
     };
     CHK_TRUE_RET(Attr_Write(stream, &curr_frame_ticks_elapsed, "curr_frame_ticks_elapsed"));
 
@@ -391,7 +484,7 @@ bool A_LoadState(struct SDL_RWops *stream, const struct entity *ent)
 
     CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
     CHK_TRUE_RET(attr.type == TYPE_INT);
-    ctx->curr_frame_start_ticks = SDL_GetTicks() - attr.val.as_int;
+    ctx->curr_frame_start_ticks = Engine_GetTicks() - attr.val.as_int;
 
     return true;
 }
@@ -155,16 +155,65 @@ size_t al_data_buffsize_from_header(const struct pfobj_hdr *header)
      *    1. a 'struct anim_sample' (for referencing this frame's SQT array)
      *    2. num_joint number of 'struct SQT's (each joint's transform
      *       for the current frame)
+     *    3. num_joint number of 'mat4x4_t's (each joint's object-space 
+     *       pose for the current frame)
      */
     for(unsigned as_idx  = 0; as_idx < header->num_as; as_idx++) {
 
         ret += header->frame_counts[as_idx] * 
-               (sizeof(struct anim_sample) + header->num_joints * sizeof(struct SQT));
+               (sizeof(struct anim_sample) + header->num_joints * sizeof(struct SQT)
+                                           + header->num_joints * sizeof(mat4x4_t));
     }
 
     return ret;
 }
 
+static void al_carve_buffer(struct anim_data *ret, const struct pfobj_hdr *header)
+{
+    char *unused_base = (char*)(ret + 1);
+
+    ret->num_anims = header->num_as; 
+    ret->skel.num_joints = header->num_joints;
+
+    ret->skel.bind_sqts = (void*)unused_base;
+    unused_base += sizeof(struct SQT) * header->num_joints;
+
+    ret->skel.inv_bind_poses = (void*)unused_base;
+    unused_base += sizeof(mat4x4_t) * header->num_joints;
+
+    ret->skel.joints = (void*)unused_base;
+    unused_base += sizeof(struct joint) * header->num_joints;
+
+    ret->anims = (void*)unused_base;
+    unused_base += sizeof(struct anim_clip) * header->num_as;
+
+    for(int i = 0; i < header->num_as; i++) {
+
+        ret->anims[i].samples = (void*)unused_base;
+        unused_base += sizeof(struct anim_sample) * header->frame_counts[i];
+    }
+
+    for(int i = 0; i < header->num_as; i++) {
+
+        ret->anims[i].skel = &ret->skel;
+        ret->anims[i].num_frames = header->frame_counts[i];
+
+        for(int f = 0; f < header->frame_counts[i]; f++) {
+
+            ret->anims[i].samples[f].local_joint_poses = (void*)unused_base;
+            unused_base += sizeof(struct SQT) * header->num_joints;
+        }
+    }
+
+    for(int i = 0; i < header->num_as; i++) {
+        for(int f = 0; f < header->frame_counts[i]; f++) {
+
+            ret->anims[i].samples[f].joint_poses = (void*)unused_base;
+            unused_base += sizeof(mat4x4_t) * header->num_joints;
+        }
+    }
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -194,6 +243,9 @@ size_t A_AL_CtxBuffSize(void)
  *  | struct SQT[num_as * num_joints] |
  *  |    (stored in clip-major order) |
  *  +---------------------------------+
+ *  | mat4x4_t[num_as * num_joints]   |
+ *  |    (stored in clip-major order) |
+ *  +---------------------------------+
  *
  */
 
@@ -203,64 +255,92 @@ void *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream)
     if(!ret)
         goto fail_alloc;
 
-    /*-----------------------------------------------------------
-     * First divide up the buffer betwen data members,
-     * set counts and pointers 
-     *-----------------------------------------------------------
-     */
+    al_carve_buffer(ret, header);
 
-    char *unused_base = (char*)(ret + 1);
+    for(int i = 0; i < header->num_joints; i++) {
 
-    ret->num_anims = header->num_as; 
-    ret->skel.num_joints = header->num_joints;
+        if(!al_read_joint(stream, &ret->skel.joints[i], &ret->skel.bind_sqts[i]))
+            goto fail_parse;
+    }
 
-    ret->skel.bind_sqts = (void*)unused_base;
-    unused_base += sizeof(struct SQT) * header->num_joints;
+    for(int i = 0; i < header->num_as; i++) {
+        
+        if(!al_read_anim_clip(stream, &ret->anims[i], header))
+            goto fail_parse;
+    }
 
-    ret->skel.inv_bind_poses = (void*)unused_base;
-    unused_base += sizeof(mat4x4_t) * header->num_joints;
+    A_PrepareInvBindMatrices(&ret->skel);
+    A_PrepareSamplePoses(ret);
+    return ret;
 
-    ret->skel.joints = (void*)unused_base;
-    unused_base += sizeof(struct joint) * header->num_joints;
+fail_parse:
+    free(ret);
+fail_alloc:
+    return NULL;
+}
 
-    ret->anims = (void*)unused_base;
-    unused_base += sizeof(struct anim_clip) * header->num_as;
+/*
+ * Cooked animation section layout:
+ *
+ *  +---------------------------------+
+ *  | struct joint[num_joints]        |
+ *  +---------------------------------+
+ *  | struct SQT[num_joints] (bind)   |
+ *  +---------------------------------+
+ *  | char[num_as][ANIM_NAME_LEN]     |
+ *  +---------------------------------+
+ *  | struct SQT[num_as * num_frames  |
+ *  |    * num_joints]                |
+ *  |    (stored in clip-major order) |
+ *  +---------------------------------+
+ *  | struct aabb[num_as * num_frames]|
+ *  +---------------------------------+
+ *
+ * Since the per-frame SQTs of all clips are contiguous in the private 
+ * buffer as well, they are read with a single copy.
+ */
 
-    for(int i = 0; i < header->num_as; i++) {
+void *A_AL_PrivFromCooked(const struct pfobj_hdr *header, SDL_RWops *stream)
+{
+    struct anim_data *ret = malloc(al_data_buffsize_from_header(header));
+    if(!ret)
+        goto fail_alloc;
 
-        ret->anims[i].samples = (void*)unused_base;
-        unused_base += sizeof(struct anim_sample) * header->frame_counts[i];
-    }
+    al_carve_buffer(ret, header);
 
+    size_t nframes = 0;
     for(int i = 0; i < header->num_as; i++) {
+        nframes += header->frame_counts[i];
+    }
 
-        ret->anims[i].skel = &ret->skel;
-        ret->anims[i].num_frames = header->frame_counts[i];
-
-        for(int f = 0; f < header->frame_counts[i]; f++) {
-
-            ret->anims[i].samples[f].local_joint_poses = (void*)unused_base;
-            unused_base += sizeof(struct SQT) * header->num_joints;
-        }
+    if(header->num_joints) {
+        if(!SDL_RWread(stream, ret->skel.joints, sizeof(struct joint) * header->num_joints, 1))
+            goto fail_parse;
+        if(!SDL_RWread(stream, ret->skel.bind_sqts, sizeof(struct SQT) * header->num_joints, 1))
+            goto fail_parse;
     }
 
-    /*---------------------------------------------------------------
-     * Then we populate priv members with the file data 
-     *---------------------------------------------------------------
-     */
-    for(int i = 0; i < header->num_joints; i++) {
+    for(int i = 0; i < header->num_as; i++) {
+        if(!SDL_RWread(stream, ret->anims[i].name, sizeof(ret->anims[i].name), 1))
+            goto fail_parse;
+        ret->anims[i].name[sizeof(ret->anims[i].name)-1] = '\0';
+    }
 
-        if(!al_read_joint(stream, &ret->skel.joints[i], &ret->skel.bind_sqts[i]))
+    if(nframes && header->num_joints) {
+        struct SQT *sqts = ret->anims[0].samples[0].local_joint_poses;
+        if(!SDL_RWread(stream, sqts, sizeof(struct SQT) * header->num_joints * nframes, 1))
             goto fail_parse;
     }
 
     for(int i = 0; i < header->num_as; i++) {
-        
-        if(!al_read_anim_clip(stream, &ret->anims[i], header))
-            goto fail_parse;
+        for(int f = 0; f < header->frame_counts[i]; f++) {
+            if(!SDL_RWread(stream, &ret->anims[i].samples[f].sample_aabb, sizeof(struct aabb), 1))
+                goto fail_parse;
+        }
     }
 
     A_PrepareInvBindMatrices(&ret->skel);
+    A_PrepareSamplePoses(ret);
     return ret;
 
 fail_parse:
@@ -269,6 +349,50 @@ fail_alloc:
     return NULL;
 }
 
+bool A_AL_CookPFObj(const struct pfobj_hdr *header, SDL_RWops *in, SDL_RWops *out)
+{
+    struct anim_data *priv = A_AL_PrivFromStream(header, in);
+    if(!priv)
+        return false;
+
+    size_t nframes = 0;
+    for(int i = 0; i < header->num_as; i++) {
+        nframes += header->frame_counts[i];
+    }
+
+    if(header->num_joints) {
+        if(!SDL_RWwrite(out, priv->skel.joints, sizeof(struct joint) * header->num_joints, 1))
+            goto fail;
+        if(!SDL_RWwrite(out, priv->skel.bind_sqts, sizeof(struct SQT) * header->num_joints, 1))
+            goto fail;
+    }
+
+    for(int i = 0; i < header->num_as; i++) {
+        if(!SDL_RWwrite(out, priv->anims[i].name, sizeof(priv->anims[i].name), 1))
+            goto fail;
+    }
+
+    if(nframes && header->num_joints) {
+        struct SQT *sqts = priv->anims[0].samples[0].local_joint_poses;
+        if(!SDL_RWwrite(out, sqts, sizeof(struct SQT) * header->num_joints * nframes, 1))
+            goto fail;
+    }
+
+    for(int i = 0; i < header->num_as; i++) {
+        for(int f = 0; f < header->frame_counts[i]; f++) {
+            if(!SDL_RWwrite(out, &priv->anims[i].samples[f].sample_aabb, sizeof(struct aabb), 1))
+                goto fail;
+        }
+    }
+
+    free(priv);
+    return true;
+
+fail:
+    free(priv);
+    return false;
+}
+
 void A_AL_DumpPrivate(FILE *stream, void *priv_data)
 {
     struct anim_data *priv = priv_data;
@@ -46,6 +46,10 @@
 
 struct anim_sample{
     struct SQT  *local_joint_poses;
+    /* Object-space transform of every joint at this frame. This is 
+     * computed once at load time and shared by all entities which are 
+     * playing the clip. */
+    mat4x4_t    *joint_poses;
     struct aabb  sample_aabb;
 };
 
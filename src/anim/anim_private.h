@@ -37,6 +37,7 @@
 #define ANIM_PRIVATE_H
 
 struct skeleton;
+struct anim_data;
 
 /* Computes the inverse bind matrix for each joint based on the 
  * joint's bind SQT. The inverse bind matrix will be used by the vertex
@@ -48,4 +49,11 @@ struct skeleton;
  */
 void A_PrepareInvBindMatrices(const struct skeleton *skel);
 
+/* Computes the object-space pose matrix of every joint for every frame
+ * of every clip. The result is written to each sample's 'joint_poses' 
+ * array, which is expected to be allocated already. This way, all the
+ * entities which are at the same keyframe share a single skinning palette.
+ */
+void A_PrepareSamplePoses(const struct anim_data *data);
+
 #endif
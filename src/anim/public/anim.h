@@ -94,10 +94,12 @@ void                   A_SetActiveClip(const struct entity *ent, const char *nam
 void                   A_Update(struct entity *ent);
 
 /* ---------------------------------------------------------------------------
- * Retreive a copy of the state needed to render an animated entity.
+ * Retreive a copy of the state needed to render an animated entity. When
+ * 'blend' is set, the pose is interpolated between the current and the next
+ * keyframe. Otherwise, the cached pose of the current keyframe is returned.
  * ---------------------------------------------------------------------------
  */
-void                   A_GetRenderState(const struct entity *ent, size_t *out_njoints, 
+void                   A_GetRenderState(const struct entity *ent, bool blend, size_t *out_njoints, 
                                         mat4x4_t *out_curr_pose, const mat4x4_t **out_inv_bind_pose);
 
 /* ---------------------------------------------------------------------------
@@ -187,6 +189,19 @@ size_t A_AL_CtxBuffSize(void);
  */
 void  *A_AL_PrivFromStream(const struct pfobj_hdr *header, SDL_RWops *stream);
 
+/* ---------------------------------------------------------------------------
+ * Same as 'A_AL_PrivFromStream', but for a cooked PFOBJ stream.
+ * ---------------------------------------------------------------------------
+ */
+void  *A_AL_PrivFromCooked(const struct pfobj_hdr *header, SDL_RWops *stream);
+
+/* ---------------------------------------------------------------------------
+ * Consumes the animation section of a PFOBJ stream and writes it to 'out' 
+ * in cooked form.
+ * ---------------------------------------------------------------------------
+ */
+bool   A_AL_CookPFObj(const struct pfobj_hdr *header, SDL_RWops *in, SDL_RWops *out);
+
 /* ---------------------------------------------------------------------------
  * Dumps private animation data in PF Object format.
  * ---------------------------------------------------------------------------
@@ -52,6 +52,17 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h> 
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
 
 
 #define CHK_TRUE_RET(_pred)             \
@@ -137,6 +148,42 @@ fail:
     return false;
 }
 
+static bool al_read_cooked_hdr(SDL_RWops *stream, enum cooked_type type)
+{
+    struct cooked_hdr hdr;
+    Sint64 pos = SDL_RWtell(stream);
+
+    if(!SDL_RWread(stream, &hdr, sizeof(hdr), 1))
+        goto fail;
+    if(memcmp(hdr.magic, PFCOOKED_MAGIC, sizeof(hdr.magic)))
+        goto fail;
+    if(hdr.version != PFCOOKED_VER || hdr.type != type)
+        goto fail;
+    return true;
+
+fail:
+    SDL_RWseek(stream, pos, RW_SEEK_SET);
+    return false;
+}
+
+static bool al_write_cooked_hdr(SDL_RWops *stream, enum cooked_type type)
+{
+    struct cooked_hdr hdr = {
+        .version = PFCOOKED_VER,
+        .type = type
+    };
+    memcpy(hdr.magic, PFCOOKED_MAGIC, sizeof(hdr.magic));
+    return SDL_RWwrite(stream, &hdr, sizeof(hdr), 1);
+}
+
+static bool al_read_pfobj_header(SDL_RWops *stream, struct pfobj_hdr *out, bool *out_cooked)
+{
+    *out_cooked = al_read_cooked_hdr(stream, COOKED_PFOBJ);
+    if(*out_cooked)
+        return SDL_RWread(stream, out, sizeof(*out), 1);
+    return al_parse_pfobj_header(stream, out);
+}
+
 static bool al_parse_pfmap_header(SDL_RWops *stream, struct pfmap_hdr *out)
 {
     char line[MAX_LINE_LEN];
@@ -163,6 +210,152 @@ fail:
     return false;
 }
 
+static bool al_read_pfmap_header(SDL_RWops *stream, struct pfmap_hdr *out, bool *out_cooked)
+{
+    *out_cooked = al_read_cooked_hdr(stream, COOKED_PFMAP);
+    if(*out_cooked)
+        return SDL_RWread(stream, out, sizeof(*out), 1);
+    return al_parse_pfmap_header(stream, out);
+}
+
+static int al_mapped_close(SDL_RWops *context)
+{
+    void *base = context->hidden.mem.base;
+    size_t size = context->hidden.mem.stop - context->hidden.mem.base;
+
+#if defined(_WIN32)
+    (void)size;
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+    SDL_FreeRW(context);
+    return 0;
+}
+
+static SDL_RWops *al_map_file(const char *path)
+{
+    void *base;
+    size_t size;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, 
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+        goto fail_open;
+
+    LARGE_INTEGER fsize;
+    if(!GetFileSizeEx(file, &fsize) || fsize.QuadPart == 0)
+        goto fail_map;
+    size = fsize.QuadPart;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping)
+        goto fail_map;
+
+    /* The view keeps a reference to the mapping, so the handles can be closed */
+    base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if(!base)
+        goto fail_map;
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        goto fail_open;
+
+    struct stat st;
+    if(fstat(fd, &st) || st.st_size == 0)
+        goto fail_map;
+    size = st.st_size;
+
+    base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(base == MAP_FAILED)
+        goto fail_map;
+    close(fd);
+#endif
+
+    SDL_RWops *ret = SDL_RWFromConstMem(base, size);
+    if(!ret)
+        goto fail_rwops;
+
+    ret->close = al_mapped_close;
+    return ret;
+
+fail_rwops:
+#if defined(_WIN32)
+    UnmapViewOfFile(base);
+#else
+    munmap(base, size);
+#endif
+    return NULL;
+fail_map:
+#if defined(_WIN32)
+    CloseHandle(file);
+#else
+    close(fd);
+#endif
+fail_open:
+    return NULL;
+}
+
+static bool al_cook_pfobj(SDL_RWops *in, SDL_RWops *out)
+{
+    struct pfobj_hdr header;
+    struct aabb aabb;
+
+    if(!al_parse_pfobj_header(in, &header))
+        return false;
+    if(!header.has_collision)
+        return false;
+
+    CHK_TRUE_RET(al_write_cooked_hdr(out, COOKED_PFOBJ));
+    CHK_TRUE_RET(SDL_RWwrite(out, &header, sizeof(header), 1));
+    CHK_TRUE_RET(R_AL_CookPFObj(&header, in, out));
+    CHK_TRUE_RET(A_AL_CookPFObj(&header, in, out));
+    CHK_TRUE_RET(AL_ParseAABB(in, &aabb));
+    CHK_TRUE_RET(SDL_RWwrite(out, &aabb, sizeof(aabb), 1));
+    return true;
+}
+
+static bool al_cook_pfmap(SDL_RWops *in, SDL_RWops *out)
+{
+    struct pfmap_hdr header;
+
+    if(!al_parse_pfmap_header(in, &header))
+        return false;
+
+    CHK_TRUE_RET(al_write_cooked_hdr(out, COOKED_PFMAP));
+    CHK_TRUE_RET(SDL_RWwrite(out, &header, sizeof(header), 1));
+    CHK_TRUE_RET(M_AL_CookPFMap(&header, in, out));
+    return true;
+}
+
+static bool al_cookable(const char *name)
+{
+    const char *ext = strrchr(name, '.');
+    if(!ext)
+        return false;
+    return !strcmp(ext, ".pfobj") || !strcmp(ext, ".pfmap");
+}
+
+static void al_cook_visit(const char *path, bool is_dir, size_t *nok, size_t *nfail)
+{
+    if(is_dir) {
+        AL_CookDirectory(path, nok, nfail);
+        return;
+    }
+    if(!al_cookable(path))
+        return;
+
+    if(AL_CookAsset(path)) {
+        (*nok)++;
+    }else{
+        fprintf(stderr, "Failed to cook asset: %s\n", path);
+        (*nfail)++;
+    }
+}
+
 static void al_set_ent_defaults(struct entity *ent)
 {
     ent->flags = 0;
@@ -188,19 +381,24 @@ static bool al_get_resource(const char *path, const char *basedir,
         return true;
     }
 
-    stream = SDL_RWFromFile(path, "r");
+    stream = AL_OpenCooked(path);
+    if(!stream)
+        stream = SDL_RWFromFile(path, "r");
     if(!stream)
         goto fail_init; 
 
-    if(!al_parse_pfobj_header(stream, &header))
+    bool cooked;
+    if(!al_read_pfobj_header(stream, &header, &cooked))
         goto fail_parse;
 
     out->ent_flags = 0;
-    out->render_private = R_AL_PrivFromStream(basedir, &header, stream);
+    out->render_private = cooked ? R_AL_PrivFromCooked(basedir, &header, stream)
+                                 : R_AL_PrivFromStream(basedir, &header, stream);
     if(!out->render_private)
         goto fail_parse;
 
-    out->anim_private = A_AL_PrivFromStream(&header, stream);
+    out->anim_private = cooked ? A_AL_PrivFromCooked(&header, stream)
+                               : A_AL_PrivFromStream(&header, stream);
     if(!out->anim_private)
         goto fail_parse;
 
@@ -213,7 +411,10 @@ static bool al_get_resource(const char *path, const char *basedir,
         goto fail_parse;
     }
 
-    if(!AL_ParseAABB(stream, &out->aabb))
+    if(cooked && !SDL_RWread(stream, &out->aabb, sizeof(out->aabb), 1))
+        goto fail_parse;
+
+    if(!cooked && !AL_ParseAABB(stream, &out->aabb))
         goto fail_parse;
 
     int put_ret;
@@ -328,19 +529,28 @@ void AL_EntityFree(struct entity *entity)
     free(entity);
 }
 
-struct map *AL_MapFromPFMapStream(SDL_RWops *stream, bool update_navgrid)
+struct map *AL_MapFromPFMapStream(SDL_RWops *stream, const char *path, bool update_navgrid)
 {
     struct map *ret;
     struct pfmap_hdr header;
+    bool cooked;
 
-    if(!al_parse_pfmap_header(stream, &header))
+    char navpath[512];
+    if(path) {
+        pf_snprintf(navpath, sizeof(navpath), "%s" PFNAV_EXT, path);
+    }
+
+    if(!al_read_pfmap_header(stream, &header, &cooked))
         goto fail_parse;
 
     ret = malloc(M_AL_BuffSizeFromHeader(&header));
     if(!ret)
         goto fail_alloc;
 
-    if(!M_AL_InitMapFromStream(&header, g_basepath, stream, ret, update_navgrid))
+    const char *navarg = path ? navpath : NULL;
+    bool status = cooked ? M_AL_InitMapFromCooked(&header, g_basepath, navarg, stream, ret, update_navgrid)
+                         : M_AL_InitMapFromStream(&header, g_basepath, navarg, stream, ret, update_navgrid);
+    if(!status)
         goto fail_init;
 
     return ret;
@@ -357,8 +567,9 @@ size_t AL_MapShallowCopySize(SDL_RWops *stream)
     struct pfmap_hdr header;
     size_t ret = 0;
     size_t pos = SDL_RWseek(stream, 0, RW_SEEK_CUR);
+    bool cooked;
 
-    if(!al_parse_pfmap_header(stream, &header))
+    if(!al_read_pfmap_header(stream, &header, &cooked))
         goto fail_parse;
 
     ret = M_AL_ShallowCopySize(header.num_rows, header.num_cols);
@@ -374,6 +585,129 @@ void AL_MapFree(struct map *map)
     free(map);
 }
 
+SDL_RWops *AL_OpenCooked(const char *path)
+{
+    char cooked_path[512];
+    pf_snprintf(cooked_path, sizeof(cooked_path), "%s" PFCOOKED_EXT, path);
+
+    /* Don't pick up a stale cooked file after the source has been edited */
+    struct stat src_st, cooked_st;
+    if(stat(cooked_path, &cooked_st))
+        return NULL;
+    if(!stat(path, &src_st) && src_st.st_mtime > cooked_st.st_mtime)
+        return NULL;
+
+    SDL_RWops *ret = al_map_file(cooked_path);
+    if(!ret)
+        return NULL;
+
+    struct cooked_hdr hdr;
+    if(!SDL_RWread(ret, &hdr, sizeof(hdr), 1)
+    || memcmp(hdr.magic, PFCOOKED_MAGIC, sizeof(hdr.magic))
+    || hdr.version != PFCOOKED_VER) {
+        SDL_RWclose(ret);
+        return NULL;
+    }
+
+    SDL_RWseek(ret, 0, RW_SEEK_SET);
+    return ret;
+}
+
+SDL_RWops *AL_OpenMapped(const char *path)
+{
+    return al_map_file(path);
+}
+
+bool AL_CookAsset(const char *path)
+{
+    char cooked_path[512];
+    pf_snprintf(cooked_path, sizeof(cooked_path), "%s" PFCOOKED_EXT, path);
+
+    if(!al_cookable(path))
+        goto fail_ext;
+    bool pfobj = !strcmp(strrchr(path, '.'), ".pfobj");
+
+    SDL_RWops *in = SDL_RWFromFile(path, "r");
+    if(!in)
+        goto fail_in;
+
+    SDL_RWops *out = SDL_RWFromFile(cooked_path, "wb");
+    if(!out)
+        goto fail_out;
+
+    bool status = pfobj ? al_cook_pfobj(in, out) : al_cook_pfmap(in, out);
+    SDL_RWclose(out);
+    if(!status) {
+        remove(cooked_path);
+        goto fail_out;
+    }
+
+    SDL_RWclose(in);
+    return true;
+
+fail_out:
+    SDL_RWclose(in);
+fail_in:
+fail_ext:
+    return false;
+}
+
+void AL_CookDirectory(const char *dir, size_t *out_ncooked, size_t *out_nfailed)
+{
+    char path[512];
+
+#if defined(_WIN32)
+    pf_snprintf(path, sizeof(path), "%s/*", dir);
+
+    WIN32_FIND_DATAA entry;
+    HANDLE handle = FindFirstFileA(path, &entry);
+    if(handle == INVALID_HANDLE_VALUE)
+        return;
+
+    do{
+        if(!strcmp(entry.cFileName, ".") || !strcmp(entry.cFileName, ".."))
+            continue;
+        pf_snprintf(path, sizeof(path), "%s/%s", dir, entry.cFileName);
+        al_cook_visit(path, entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY, 
+            out_ncooked, out_nfailed);
+    }while(FindNextFileA(handle, &entry));
+
+    FindClose(handle);
+#else
+    DIR *dirp = opendir(dir);
+    if(!dirp)
+        return;
+
+    struct dirent *entry;
+    while((entry = readdir(dirp))) {
+
+        if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+        pf_snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+
+        struct stat st;
+        if(stat(path, &st))
+            continue;
+        al_cook_visit(path, S_ISDIR(st.st_mode), out_ncooked, out_nfailed);
+    }
+
+    closedir(dirp);
+#endif
+}
+
+const void *AL_StreamData(SDL_RWops *stream, size_t size)
+{
+    if(stream->type != SDL_RWOPS_MEMORY && stream->type != SDL_RWOPS_MEMORY_RO)
+        return NULL;
+
+    if(stream->hidden.mem.stop - stream->hidden.mem.here < size)
+        return NULL;
+
+    const void *ret = stream->hidden.mem.here;
+    stream->hidden.mem.here += size;
+    return ret;
+}
+
 bool AL_ReadLine(SDL_RWops *stream, char *outbuff)
 {
     int idx = 0;
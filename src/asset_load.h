@@ -38,12 +38,29 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <SDL.h> /* for SDL_RWops */
 
 #define MAX_ANIM_SETS 16
 #define MAX_LINE_LEN  256
 
+/* A cooked asset is a binary image of a PFOBJ or PFMAP file, holding the 
+ * vertex, joint and tile arrays in the same layout as they are stored in 
+ * memory. The cooked file is placed next to the source file, with the
+ * extension appended (ex. 'knight.pfobj.cooked'). The version must be 
+ * bumped whenever the layout of any of the cooked structures changes.
+ */
+#define PFCOOKED_MAGIC "PFCK"
+#define PFCOOKED_VER   (1)
+#define PFCOOKED_EXT   ".cooked"
+
+/* The navigation data baked from a PFMAP file is saved next to it, with 
+ * the extension appended (ex. 'map.pfmap.nav'), so that it doesn't need 
+ * to be re-computed on the next load. The data is tagged with a hash of 
+ * the map's tiles and is re-baked when the tiles change. */
+#define PFNAV_EXT      ".nav"
+
 #define READ_LINE(rwops, buff, fail_label)              \
     do{                                                 \
         if(!AL_ReadLine(rwops, buff))                   \
@@ -74,6 +91,17 @@ struct pfmap_hdr{
     unsigned num_cols;
 };
 
+enum cooked_type{
+    COOKED_PFOBJ,
+    COOKED_PFMAP,
+};
+
+struct cooked_hdr{
+    char     magic[4];
+    uint32_t version;
+    uint32_t type;
+};
+
 
 bool           AL_Init(void);
 void           AL_Shutdown(void);
@@ -83,10 +111,26 @@ struct entity *AL_EntityFromPFObj(const char *base_path, const char *pfobj_name,
 bool           AL_EntitySetPFObj(struct entity *ent, const char *base_path, const char *pfobj_name);
 void           AL_EntityFree(struct entity *entity);
 
-struct map    *AL_MapFromPFMapStream(SDL_RWops *stream, bool update_navgrid);
+/* 'path' is the PFMAP file that the stream was opened from, used for locating 
+ * the baked navigation data, or NULL. */
+struct map    *AL_MapFromPFMapStream(SDL_RWops *stream, const char *path, bool update_navgrid);
 void           AL_MapFree(struct map *map);
 size_t         AL_MapShallowCopySize(SDL_RWops *stream);
 
+/* Returns a read-only stream over the memory-mapped cooked version of the 
+ * asset at 'path', or NULL if there is no valid cooked file that is at 
+ * least as new as the source. */
+SDL_RWops     *AL_OpenCooked(const char *path);
+/* Returns a read-only stream over the memory-mapped file at 'path', or NULL. */
+SDL_RWops     *AL_OpenMapped(const char *path);
+/* Converts the PFOBJ or PFMAP file at 'path' to its' cooked form. */
+bool           AL_CookAsset(const char *path);
+/* Cooks every PFOBJ and PFMAP file under 'dir', recursively. */
+void           AL_CookDirectory(const char *dir, size_t *out_ncooked, size_t *out_nfailed);
+/* If the stream is backed by memory, returns a pointer to the next 'size' 
+ * bytes and advances the stream past them. Otherwise, returns NULL. */
+const void    *AL_StreamData(SDL_RWops *stream, size_t size);
+
 bool           AL_ReadLine(SDL_RWops *stream, char *outbuff);
 bool           AL_ParseAABB(SDL_RWops *stream, struct aabb *out);
 
@@ -0,0 +1,241 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "bench.h"
+#include "perf.h"
+#include "lib/public/khash.h"
+#include "lib/public/vec.h"
+#include "lib/public/pf_string.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <assert.h>
+
+
+#define MAX_THREADS     (128)
+#define MAX_LINE_LEN    (512)
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+
+enum bench_fmt{
+    BENCH_FMT_CSV,
+    BENCH_FMT_JSON,
+};
+
+struct func_stats{
+    const char *name; /* borrowed */
+    unsigned    calls;
+    double      ms;
+};
+
+/* Function names returned by 'Perf_Report' are unique per thread, so the 
+ * pointer can be used as the key for aggregating the calls. */
+KHASH_MAP_INIT_INT64(idx, int)
+
+VEC_TYPE(stats, struct func_stats)
+VEC_IMPL(static inline, stats, struct func_stats)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static SDL_RWops       *s_stream;
+static enum bench_fmt   s_fmt;
+static bool             s_first_record;
+static khash_t(idx)    *s_func_idx;
+static vec_stats_t      s_func_stats;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void bench_write(const char *fmt, ...)
+{
+    char line[MAX_LINE_LEN];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+
+    len = MIN(len, (int)sizeof(line)-1);
+    if(len > 0) {
+        SDL_RWwrite(s_stream, line, len, 1);
+    }
+}
+
+static void bench_aggregate(const struct perf_info *info)
+{
+    kh_clear(idx, s_func_idx);
+    vec_stats_reset(&s_func_stats);
+
+    for(int i = 0; i < info->nentries; i++) {
+
+        uint64_t key = (uintptr_t)info->entries[i].funcname;
+        khiter_t k = kh_get(idx, s_func_idx, key);
+
+        if(k == kh_end(s_func_idx)) {
+
+            int status;
+            k = kh_put(idx, s_func_idx, key, &status);
+            if(status == -1)
+                continue;
+            kh_val(s_func_idx, k) = vec_size(&s_func_stats);
+            vec_stats_push(&s_func_stats, (struct func_stats){
+                .name = info->entries[i].funcname,
+            });
+        }
+
+        struct func_stats *stats = &vec_AT(&s_func_stats, kh_val(s_func_idx, k));
+        stats->calls++;
+        stats->ms += info->entries[i].ms_delta;
+    }
+}
+
+static void bench_write_csv(unsigned long tick, double tick_ms, 
+                            size_t nthreads, struct perf_info **infos)
+{
+    bench_write("%lu,,tick,1,%.6f\n", tick, tick_ms);
+
+    for(int i = 0; i < nthreads; i++) {
+
+        bench_aggregate(infos[i]);
+        for(int j = 0; j < vec_size(&s_func_stats); j++) {
+
+            const struct func_stats *stats = &vec_AT(&s_func_stats, j);
+            bench_write("%lu,%s,%s,%u,%.6f\n", tick, infos[i]->threadname, 
+                stats->name, stats->calls, stats->ms);
+        }
+    }
+}
+
+static void bench_write_json(unsigned long tick, double tick_ms, 
+                             size_t nthreads, struct perf_info **infos)
+{
+    bench_write("%s  {\"tick\": %lu, \"ms\": %.6f, \"threads\": {", 
+        s_first_record ? "" : ",\n", tick, tick_ms);
+
+    for(int i = 0; i < nthreads; i++) {
+
+        bench_write("%s\"%s\": {", (i > 0) ? ", " : "", infos[i]->threadname);
+        bench_aggregate(infos[i]);
+
+        for(int j = 0; j < vec_size(&s_func_stats); j++) {
+
+            const struct func_stats *stats = &vec_AT(&s_func_stats, j);
+            bench_write("%s\"%s\": {\"calls\": %u, \"ms\": %.6f}", (j > 0) ? ", " : "", 
+                stats->name, stats->calls, stats->ms);
+        }
+        bench_write("}");
+    }
+    bench_write("}}");
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Bench_Init(const char *path)
+{
+    s_fmt = pf_endswith(path, ".json") ? BENCH_FMT_JSON : BENCH_FMT_CSV;
+    s_first_record = true;
+
+    s_func_idx = kh_init(idx);
+    if(!s_func_idx)
+        goto fail_idx;
+
+    vec_stats_init(&s_func_stats);
+    if(!vec_stats_resize(&s_func_stats, 256))
+        goto fail_stats;
+
+    s_stream = SDL_RWFromFile(path, "w");
+    if(!s_stream)
+        goto fail_stream;
+
+    switch(s_fmt) {
+    case BENCH_FMT_CSV:
+        bench_write("tick,thread,function,calls,ms\n");
+        break;
+    case BENCH_FMT_JSON:
+        bench_write("[\n");
+        break;
+    default: assert(0);
+    }
+    return true;
+
+fail_stream:
+    vec_stats_destroy(&s_func_stats);
+fail_stats:
+    kh_destroy(idx, s_func_idx);
+fail_idx:
+    return false;
+}
+
+void Bench_Shutdown(void)
+{
+    if(s_fmt == BENCH_FMT_JSON) {
+        bench_write("\n]\n");
+    }
+
+    SDL_RWclose(s_stream);
+    vec_stats_destroy(&s_func_stats);
+    kh_destroy(idx, s_func_idx);
+    s_stream = NULL;
+}
+
+void Bench_RecordTick(unsigned long tick, double tick_ms)
+{
+    if(!s_stream)
+        return;
+
+    struct perf_info *infos[MAX_THREADS];
+    size_t nthreads = Perf_ReportLastTick(MAX_THREADS, infos);
+
+    switch(s_fmt) {
+    case BENCH_FMT_CSV:
+        bench_write_csv(tick, tick_ms, nthreads, infos);
+        break;
+    case BENCH_FMT_JSON:
+        bench_write_json(tick, tick_ms, nthreads, infos);
+        break;
+    default: assert(0);
+    }
+    s_first_record = false;
+
+    for(int i = 0; i < nthreads; i++) {
+        free(infos[i]);
+    }
+}
+
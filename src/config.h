@@ -63,10 +63,19 @@
 #define CONFIG_SETTINGS_FILENAME    "pf.conf"
 
 #define CONFIG_LOS_CACHE_SZ         (512)
-#define CONFIG_FLOW_CAHCE_SZ        (512)
+/* The default memory budget of the flow field cache, in megabytes. It can be
+ * changed via the 'pf.game.flow_field_cache_mb' setting. */
+#define CONFIG_FLOW_CACHE_MB        (16)
 #define CONFIG_MAPPING_CACHE_SZ     (512)
 #define CONFIG_GRID_PATH_CACHE_SZ   (8192)
+/* The field caches are split into this many independently locked shards. 
+ * The cache sizes above are divided evenly between the shards. */
+#define CONFIG_FC_SHARDS            (8)
 
 #define CONFIG_FRAME_STEP_HOTKEY    (SDL_SCANCODE_SPACE)
 
+/* The fixed amount of virtual time that passes in a single tick when 
+ * running headless */
+#define CONFIG_HEADLESS_TICK_MS     (1000.0/60.0)
+
 #endif
@@ -220,8 +220,9 @@ bool Cursor_InitDefault(const char *basedir)
         if(!curr->path 
         || !Cursor_LoadBMP(i, curr->path, curr->hot_x, curr->hot_y)) {
 
+            /* The dummy video driver used in headless mode has no cursors */
             curr->cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_ARROW);
-            if(!curr->cursor)
+            if(!curr->cursor && !Engine_Headless())
                 goto fail;
         }
     }
@@ -75,13 +75,13 @@ static struct result ping_task(void *arg)
     Entity_CurrentOBB(ent, &obb, false);
 
     uint32_t elapsed = 0;
-    uint32_t start = SDL_GetTicks();
+    uint32_t start = Engine_GetTicks();
     int source;
 
     while(elapsed < 1200) {
         Task_AwaitEvent(EVENT_RENDER_3D_POST, &source);
 
-        uint32_t curr = SDL_GetTicks();
+        uint32_t curr = Engine_GetTicks();
         elapsed = curr - start;
 
         if((elapsed / 400) == 1)
@@ -244,6 +244,7 @@ void Entity_FaceTowards(struct entity *ent, vec2_t point)
     quat_t rot;
     PFM_Quat_FromRotMat(&rotmat, &rot);
     ent->rotation = rot;
+    G_UpdateBounds(ent);
 }
 
 void Entity_Ping(const struct entity *ent)
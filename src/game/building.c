@@ -36,6 +36,7 @@
 #include "building.h"
 #include "game_private.h"
 #include "storage_site.h"
+#include "resource.h"
 #include "public/game.h"
 #include "../event.h"
 #include "../collision.h"
@@ -46,29 +47,12 @@
 #include "../lib/public/khash.h"
 #include "../lib/public/vec.h"
 #include "../lib/public/attr.h"
-#include "../lib/public/mpool.h"
-#include "../lib/public/string_intern.h"
 #include "../lib/public/pf_string.h"
 
 #include <assert.h>
 #include <stdint.h>
 
 
-static void *pmalloc(size_t size);
-static void *pcalloc(size_t n, size_t size);
-static void *prealloc(void *ptr, size_t size);
-static void  pfree(void *ptr);
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  pmalloc
-#define kcalloc  pcalloc
-#define krealloc prealloc
-#define kfree    pfree
-
 #define ARR_SIZE(a)         (sizeof(a)/sizeof(a[0]))
 #define MARKER_DIR          "assets/models/build_site_marker"
 #define MARKER_OBJ          "build-site-marker.pfobj"
@@ -83,8 +67,6 @@ static void  pfree(void *ptr);
             return false;               \
     }while(0)
 
-KHASH_MAP_INIT_STR(int, int)
-
 VEC_TYPE(uid, uint32_t)
 VEC_IMPL(static inline, uid, uint32_t)
 
@@ -103,25 +85,9 @@ struct buildstate{
     bool       blocking;
     bool       is_storage_site;
     struct obb obb;
-    kh_int_t  *required;
+    struct res_table required;
 };
 
-typedef char buff_t[512];
-
-MPOOL_TYPE(buff, buff_t)
-MPOOL_PROTOTYPES(static, buff, buff_t)
-MPOOL_IMPL(static, buff, buff_t)
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  malloc
-#define kcalloc  calloc
-#define krealloc realloc
-#define kfree    free
-
 KHASH_MAP_INIT_INT(state, struct buildstate)
 KHASH_SET_INIT_INT64(td)
 
@@ -132,48 +98,10 @@ KHASH_SET_INIT_INT64(td)
 static const struct map     *s_map;
 static khash_t(state)       *s_entity_state_table;
 
-static mp_buff_t             s_mpool;
-static khash_t(stridx)      *s_stridx;
-static mp_strbuff_t          s_stringpool;
-
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static void *pmalloc(size_t size)
-{
-    mp_ref_t ref = mp_buff_alloc(&s_mpool);
-    if(ref == 0)
-        return NULL;
-    return mp_buff_entry(&s_mpool, ref);
-}
-
-static void *pcalloc(size_t n, size_t size)
-{
-    void *ret = pmalloc(n * size);
-    if(!ret)
-        return NULL;
-    memset(ret, 0, n * size);
-    return ret;
-}
-
-static void *prealloc(void *ptr, size_t size)
-{
-    if(!ptr)
-        return pmalloc(size);
-    if(size <= sizeof(buff_t))
-        return ptr;
-    return NULL;
-}
-
-static void pfree(void *ptr)
-{
-    if(!ptr)
-        return;
-    mp_ref_t ref = mp_buff_ref(&s_mpool, ptr);
-    mp_buff_free(&s_mpool, ref);
-}
-
 static struct buildstate *buildstate_get(uint32_t uid)
 {
     khiter_t k = kh_get(state, s_entity_state_table, uid);
@@ -201,7 +129,6 @@ static void buildstate_remove(const struct entity *ent)
     if(k != kh_end(s_entity_state_table)) {
 
         struct buildstate *bs = &kh_value(s_entity_state_table, k);
-        kh_destroy(int, bs->required);
         vec_uid_destroy(&bs->markers);
         kh_del(state, s_entity_state_table, k);
     }
@@ -347,41 +274,6 @@ static void building_clear_markers(struct buildstate *bs)
     }
 }
 
-static bool bstate_set_key(khash_t(int) *table, const char *name, int val)
-{
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(int, table, key);
-    if(k != kh_end(table)) {
-        kh_value(table, k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(int, table, key, &status);
-    if(status == -1)
-        return false;
-
-    assert(status == 1);
-    kh_value(table, k) = val;
-    return true;
-}
-
-static bool bstate_get_key(khash_t(int) *table, const char *name, int *out)
-{
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(int, table, key);
-    if(k == kh_end(table))
-        return false;
-    *out = kh_value(table, k);
-    return true;
-}
-
 static void on_amount_changed(void *user, void *event)
 {
     uint32_t uid = (uintptr_t)user;
@@ -400,16 +292,10 @@ static void on_amount_changed(void *user, void *event)
 
 bool G_Building_Init(const struct map *map)
 {
-    mp_buff_init(&s_mpool);
-
-    if(!mp_buff_reserve(&s_mpool, 2048))
-        goto fail_mpool; 
     if(NULL == (s_entity_state_table = kh_init(state)))
         goto fail_table;
     if(0 != kh_resize(state, s_entity_state_table, 2048))
         goto fail_res;
-    if(!si_init(&s_stringpool, &s_stridx, 512))
-        goto fail_res;
 
     E_Global_Register(EVENT_RENDER_3D_PRE, on_render_3d, NULL, G_RUNNING | G_PAUSED_FULL | G_PAUSED_UI_RUNNING);
     s_map = map;
@@ -418,8 +304,6 @@ bool G_Building_Init(const struct map *map)
 fail_res:
     kh_destroy(state, s_entity_state_table);
 fail_table:
-    mp_buff_destroy(&s_mpool);
-fail_mpool:
     return false;
 }
 
@@ -436,9 +320,7 @@ void G_Building_Shutdown(void)
         vec_uid_destroy(&curr.markers);
     });
 
-    si_shutdown(&s_stringpool, s_stridx);
     kh_destroy(state, s_entity_state_table);
-    mp_buff_destroy(&s_mpool);
 }
 
 bool G_Building_AddEntity(struct entity *ent)
@@ -456,9 +338,7 @@ bool G_Building_AddEntity(struct entity *ent)
         .is_storage_site = !!(ent->flags & ENTITY_FLAG_STORAGE_SITE)
     };
 
-    new_bs.required = kh_init(int);
-    if(!new_bs.required)
-        return false;
+    res_clear(&new_bs.required);
 
     vec_uid_init(&new_bs.markers);
     buildstate_set(ent, new_bs);
@@ -550,9 +430,10 @@ bool G_Building_Found(struct entity *ent, bool blocking)
         bs->obb = obb;
     }
 
-    const char *key;
+    int id;
     int amount;
-    kh_foreach(bs->required, key, amount, {
+    res_foreach(&bs->required, id, amount, {
+        const char *key = G_Resource_IDName(id);
         G_StorageSite_SetAltCapacity(ent, key, amount);
         G_StorageSite_SetAltDesired(ent->uid, key, amount);
     });
@@ -725,16 +606,23 @@ int G_Building_GetRequired(uint32_t uid, const char *rname)
     struct buildstate *bs = buildstate_get(uid);
     assert(bs);
 
-    int ret = 0;
-    bstate_get_key(bs->required, rname, &ret);
-    return ret;
+    int id = G_Resource_NameID(rname);
+    if(id < 0 || !res_exists(&bs->required, id))
+        return 0;
+    return bs->required.vals[id];
 }
 
 bool G_Building_SetRequired(uint32_t uid, const char *rname, int req)
 {
     struct buildstate *bs = buildstate_get(uid);
     assert(bs);
-    return bstate_set_key(bs->required, rname, req);
+
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return false;
+
+    res_set(&bs->required, id, req);
+    return true;
 }
 
 bool G_Building_SaveState(struct SDL_RWops *stream)
@@ -797,16 +685,16 @@ bool G_Building_SaveState(struct SDL_RWops *stream)
 
         struct attr num_required = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.required)
+            .val.as_int = res_size(&curr.required)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_required, "num_required"));
 
-        const char *required_key;
+        int required_id;
         int required_amount;
-        kh_foreach(curr.required, required_key, required_amount, {
+        res_foreach(&curr.required, required_id, required_amount, {
         
             struct attr required_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(required_key_attr.val.as_string, required_key, sizeof(required_key_attr.val.as_string));
+            pf_strlcpy(required_key_attr.val.as_string, G_Resource_IDName(required_id), sizeof(required_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &required_key_attr, "required_key"));
 
             struct attr required_amount_attr = (struct attr){
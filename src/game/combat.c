@@ -39,6 +39,7 @@
 #include "building.h"
 #include "fog_of_war.h"
 #include "position.h"
+#include "cull.h"
 #include "public/game.h"
 #include "../ui.h"
 #include "../event.h"
@@ -50,6 +51,8 @@
 #include "../render/public/render_ctrl.h"
 #include "../lib/public/khash.h"
 #include "../lib/public/attr.h"
+#include "../lib/public/comp_store.h"
+#include "../lib/public/stalloc.h"
 
 #include <assert.h>
 #include <float.h>
@@ -114,9 +117,14 @@ struct combatstate{
      * its' intial move command once it finishes combat. */
     bool               move_cmd_interrupted;
     vec2_t             move_cmd_xz;
+    /* Whether the entity can be picked as a target during the current 
+     * tick's batched target acquisition */
+    bool               targetable;
 };
 
-KHASH_MAP_INIT_INT(state, struct combatstate)
+COMP_STORE_TYPE(state, struct combatstate)
+COMP_STORE_PROTOTYPES(static, state, struct combatstate)
+COMP_STORE_IMPL(static, state, struct combatstate)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -131,47 +139,43 @@ static const char *s_name_for_state[] = {
     [STATE_DEATH_ANIM_PLAYING]      = "DEATH_ANIM_PLAYING"
 };
 
-static khash_t(state)   *s_entity_state_table;
+static cs(state)          s_entity_states;
 /* For saving/restoring state */
 static vec_pentity_t     s_dying_ents;
 static const struct map *s_map;
 /* How many units of a faction currently currently occupy that bin.
  * For quickly finding that there are no enemy units nearby */
 static uint16_t         *s_fac_refcnts[MAX_FACTIONS];
+/* The set of factions with at least one unit in each bin */
+static uint16_t         *s_fac_presence;
+static struct memstack   s_acquire_mem;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
 /* The returned pointer is guaranteed to be valid to write to for
- * so long as we don't add anything to the table. At that point, there
+ * so long as we don't add anything to the store. At that point, there
  * is a case that a 'realloc' might take place. */
 static struct combatstate *combatstate_get(uint32_t uid)
 {
-    khiter_t k = kh_get(state, s_entity_state_table, uid);
-    if(k == kh_end(s_entity_state_table))
-        return NULL;
-
-    return &kh_value(s_entity_state_table, k);
+    return cs_state_get(&s_entity_states, uid);
 }
 
 static void combatstate_set(const struct entity *ent, const struct combatstate *cs)
 {
     assert(ent->flags & ENTITY_FLAG_COMBATABLE);
 
-    int ret;
-    khiter_t k = kh_put(state, s_entity_state_table, ent->uid, &ret);
-    assert(ret != -1 && ret != 0);
-    kh_value(s_entity_state_table, k) = *cs;
+    assert(!cs_state_contains(&s_entity_states, ent->uid));
+    bool ret = cs_state_put(&s_entity_states, ent->uid, cs);
+    assert(ret);
 }
 
 static void combatstate_remove(const struct entity *ent)
 {
     assert(ent->flags & ENTITY_FLAG_COMBATABLE);
 
-    khiter_t k = kh_get(state, s_entity_state_table, ent->uid);
-    if(k != kh_end(s_entity_state_table))
-        kh_del(state, s_entity_state_table, k);
+    cs_state_remove(&s_entity_states, ent->uid);
 }
 
 static bool pentities_equal(struct entity *const *a, struct entity *const *b)
@@ -189,14 +193,7 @@ static void dying_remove(const struct entity *ent)
 
 static bool enemies(const struct entity *a, const struct entity *b)
 {
-    if(a->faction_id == b->faction_id)
-        return false;
-
-    enum diplomacy_state ds;
-    bool result = G_GetDiplomacyState(a->faction_id, b->faction_id, &ds);
-
-    assert(result);
-    return (ds == DIPLOMACY_STATE_WAR);
+    return !!(G_GetEnemyFactions(a->faction_id) & (0x1 << b->faction_id));
 }
 
 static float ents_distance(const struct entity *a, const struct entity *b)
@@ -208,30 +205,11 @@ static float ents_distance(const struct entity *a, const struct entity *b)
     return PFM_Vec2_Len(&dist) - a->selection_radius - b->selection_radius;
 }
 
-static bool enemies_in_bin(int faction_id, struct map_resolution binres, struct tile_desc td)
+static size_t bin_index(struct map_resolution binres, struct tile_desc td)
 {
-    uint16_t facs = G_GetFactions(NULL, NULL, NULL);
-
     size_t x = td.chunk_c * X_BINS_PER_CHUNK + td.tile_c;
     size_t z = td.chunk_r * Z_BINS_PER_CHUNK + td.tile_r;
-    size_t idx = x * (binres.chunk_w * binres.tile_w) + z;
-
-    for(int i = 0; facs; facs >>= 1, i++) {
-
-        if(!(facs & 0x1))
-            continue;
-        if(i == faction_id)
-            continue;
-
-        enum diplomacy_state ds;
-        G_GetDiplomacyState(faction_id, i, &ds);
-        if(ds != DIPLOMACY_STATE_WAR)
-            continue;
-
-        if(s_fac_refcnts[i][idx] > 0)
-            return true;
-    }
-    return false;
+    return x * (binres.chunk_w * binres.tile_w) + z;
 }
 
 static bool maybe_enemy_near(const struct entity *ent)
@@ -256,8 +234,7 @@ static bool maybe_enemy_near(const struct entity *ent)
     bool found = M_Tile_DescForPoint2D(binres, M_GetPos(s_map), pos, &td);
     assert(found);
 
-    size_t binx = td.chunk_c * X_COORDS_PER_TILE + td.tile_c;
-    size_t binz = td.chunk_r * Z_COORDS_PER_TILE + td.tile_r;
+    uint16_t enemy_facs = G_GetEnemyFactions(ent->faction_id);
 
     for(int dr = -binrange; dr <= binrange; dr++) {
     for(int dc = -binrange; dc <= binrange; dc++) {
@@ -265,7 +242,7 @@ static bool maybe_enemy_near(const struct entity *ent)
         struct tile_desc bin = td;
         if(!M_Tile_RelativeDesc(binres, &bin, dc, dr))
             continue;
-        if(enemies_in_bin(ent->faction_id, binres, bin))
+        if(s_fac_presence[bin_index(binres, bin)] & enemy_facs)
             PERF_RETURN(true);
     }}
     PERF_RETURN(false);
@@ -278,6 +255,18 @@ static bool melee_can_attack(const struct entity *ent, const struct entity *targ
     return M_NavObjAdjacent(s_map, ent, target);
 }
 
+static bool entity_targetable(const struct entity *ent, const struct combatstate *cs, uint16_t pmask)
+{
+    if((ent->flags & ENTITY_FLAG_BUILDING) && !G_Building_IsFounded(ent))
+        return false;
+    if(cs->state == STATE_DEATH_ANIM_PLAYING)
+        return false;
+
+    struct obb obb;
+    Entity_CurrentOBB(ent, &obb, false);
+    return G_Fog_ObjVisible(pmask, &obb);
+}
+
 static bool valid_enemy(const struct entity *curr, void *arg)
 {
     const struct entity *ent = arg;
@@ -286,24 +275,30 @@ static bool valid_enemy(const struct entity *curr, void *arg)
         return false;
     if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
         return false;
-    if((curr->flags & ENTITY_FLAG_BUILDING) && !G_Building_IsFounded(curr))
-        return false;
     if(!enemies(ent, curr))
         return false;
 
     struct combatstate *cs = combatstate_get(curr->uid);
     assert(cs);
-    if(cs->state == STATE_DEATH_ANIM_PLAYING)
-        return false;
+    return entity_targetable(curr, cs, G_GetPlayerControlledFactions());
+}
 
-    struct obb obb;
-    Entity_CurrentOBB(curr, &obb, false);
+/* Same as 'valid_enemy', but relies on the state computed by 'acquire_targets' 
+ * so that it is safe to call from multiple threads at once. */
+static bool valid_enemy_batched(const struct entity *curr, void *arg)
+{
+    const struct entity *ent = arg;
 
-    uint16_t pmask = G_GetPlayerControlledFactions();
-    if(!G_Fog_ObjVisible(pmask, &obb))
+    if(curr == ent)
+        return false;
+    if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
+        return false;
+    if(!(G_GetEnemyFactions(ent->faction_id) & (0x1 << curr->faction_id)))
         return false;
 
-    return true;
+    struct combatstate *cs = combatstate_get(curr->uid);
+    assert(cs);
+    return cs->targetable;
 }
 
 static quat_t quat_from_vec(vec2_t dir)
@@ -328,6 +323,7 @@ static void entity_turn_to_target(struct entity *ent, const struct entity *targe
     PFM_Vec2_Sub(&tar_pos_xz, &ent_pos_xz, &ent_to_target);
     PFM_Vec2_Normal(&ent_to_target, &ent_to_target);
     ent->rotation = quat_from_vec(ent_to_target);
+    G_Cull_Invalidate(ent);
 }
 
 static void on_death_anim_finish(void *user, void *event)
@@ -399,6 +395,80 @@ static bool entity_dead(const struct entity *ent)
     return false;
 }
 
+static bool wants_target(const struct entity *ent, const struct combatstate *cs)
+{
+    switch(cs->state) {
+    case STATE_NOT_IN_COMBAT:
+        if(cs->stance == COMBAT_STANCE_NO_ENGAGEMENT)
+            return false;
+        if(G_Combat_GetBaseDamage(ent) == 0)
+            return false;
+        return maybe_enemy_near(ent);
+    case STATE_MOVING_TO_TARGET:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void update_targetable(void)
+{
+    uint16_t pmask = G_GetPlayerControlledFactions();
+
+    uint32_t uid;
+    struct combatstate *cs;
+
+    cs_foreach_ptr(&s_entity_states, uid, cs, {
+
+        const struct entity *ent = G_EntityForUID(uid);
+        cs->targetable = ent && entity_targetable(ent, cs, pmask);
+    });
+}
+
+/* Look up the closest eligible enemy of every entity that needs a target during 
+ * this tick. The visibility of all the potential targets is computed only once, 
+ * after which all the queries are answered in parallel. Entities which don't 
+ * need a target have 'out_queried' cleared. */
+static void acquire_targets(size_t nents, struct entity *const *ents, 
+                            bool *out_queried, struct entity **out_enemies)
+{
+    PERF_ENTER();
+
+    vec2_t *positions = stalloc(&s_acquire_mem, nents * sizeof(vec2_t));
+    void **args = stalloc(&s_acquire_mem, nents * sizeof(void*));
+    size_t *idxs = stalloc(&s_acquire_mem, nents * sizeof(size_t));
+    struct entity **results = stalloc(&s_acquire_mem, nents * sizeof(struct entity*));
+    size_t nqueries = 0;
+
+    for(int i = 0; i < nents; i++) {
+
+        struct combatstate *cs = combatstate_get(ents[i]->uid);
+        assert(cs);
+
+        out_enemies[i] = NULL;
+        out_queried[i] = wants_target(ents[i], cs);
+        if(!out_queried[i])
+            continue;
+
+        positions[nqueries] = G_Pos_GetXZ(ents[i]->uid);
+        args[nqueries] = ents[i];
+        idxs[nqueries] = i;
+        nqueries++;
+    }
+
+    if(nqueries == 0)
+        PERF_RETURN_VOID();
+
+    update_targetable();
+    G_Pos_NearestWithPredBatch(nqueries, positions, valid_enemy_batched, args,
+        ENEMY_TARGET_ACQUISITION_RANGE, results);
+
+    for(int i = 0; i < nqueries; i++) {
+        out_enemies[idxs[i]] = results[i];
+    }
+    PERF_RETURN_VOID();
+}
+
 static void on_20hz_tick(void *user, void *event)
 {
     PERF_ENTER();
@@ -407,29 +477,38 @@ static void on_20hz_tick(void *user, void *event)
     struct entity *curr;
     (void)key;
 
-    kh_foreach(G_GetDynamicEntsSet(), key, curr, {
+    stalloc_clear(&s_acquire_mem);
+
+    const khash_t(entity) *dynamic = G_GetDynamicEntsSet();
+    struct entity **ents = stalloc(&s_acquire_mem, kh_size(dynamic) * sizeof(struct entity*));
+    struct entity **targets = stalloc(&s_acquire_mem, kh_size(dynamic) * sizeof(struct entity*));
+    bool *queried = stalloc(&s_acquire_mem, kh_size(dynamic) * sizeof(bool));
+    size_t nents = 0;
+
+    kh_foreach(dynamic, key, curr, {
 
         if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
             continue;
+        ents[nents++] = curr;
+    });
 
+    acquire_targets(nents, ents, queried, targets);
+
+    for(int i = 0; i < nents; i++) {
+
+        curr = ents[i];
         struct combatstate *cs = combatstate_get(curr->uid);
         assert(cs);
 
         switch(cs->state) {
         case STATE_NOT_IN_COMBAT: 
         {
-            if(cs->stance == COMBAT_STANCE_NO_ENGAGEMENT)
-                break;
-
-            if(G_Combat_GetBaseDamage(curr) == 0)
-                break;
-
-            if(!maybe_enemy_near(curr))
+            if(!queried[i])
                 break;
 
             /* Make the entity seek enemy units. */
             struct entity *enemy;
-            if((enemy = G_Combat_ClosestEligibleEnemy(curr)) != NULL) {
+            if((enemy = targets[i]) != NULL) {
 
                 if(melee_can_attack(curr, enemy)) {
 
@@ -460,7 +539,7 @@ static void on_20hz_tick(void *user, void *event)
         case STATE_MOVING_TO_TARGET:
         {
             /* Handle the case where our target dies before we reach it */
-            struct entity *enemy = G_Combat_ClosestEligibleEnemy(curr);
+            struct entity *enemy = queried[i] ? targets[i] : G_Combat_ClosestEligibleEnemy(curr);
             if(!enemy) {
 
                 cs->state = STATE_NOT_IN_COMBAT; 
@@ -579,8 +658,7 @@ static void on_20hz_tick(void *user, void *event)
             break;
         default: assert(0);
         };
-    
-    });
+    }
     PERF_RETURN_VOID();
 }
 
@@ -652,7 +730,7 @@ static void on_render_3d(void *user, void *event)
     uint32_t key;
     struct combatstate curr;
 
-    kh_foreach(s_entity_state_table, key, curr, {
+    cs_foreach(&s_entity_states, key, curr, {
 
         vec2_t ent_pos = G_Pos_GetXZ(key);
         mat4x4_t ident;
@@ -724,12 +802,20 @@ static void on_render_3d(void *user, void *event)
 
 bool G_Combat_Init(const struct map *map)
 {
-    if(NULL == (s_entity_state_table = kh_init(state)))
-        return false;
+    cs_state_init(&s_entity_states);
 
     struct map_resolution res;
     M_GetResolution(map, &res);
 
+    s_fac_presence = calloc((res.chunk_w * X_BINS_PER_CHUNK) 
+                          * (res.chunk_h * Z_BINS_PER_CHUNK) 
+                          * sizeof(uint16_t), 1);
+    if(!s_fac_presence)
+        goto fail_presence;
+
+    if(!stalloc_init(&s_acquire_mem))
+        goto fail_mem;
+
     for(int i = 0; i < MAX_FACTIONS; i++) {
         s_fac_refcnts[i] = calloc((res.chunk_w * X_BINS_PER_CHUNK) 
                                 * (res.chunk_h * Z_BINS_PER_CHUNK) 
@@ -748,7 +834,11 @@ bool G_Combat_Init(const struct map *map)
 fail_refcnts:
     for(int i = 0; i < MAX_FACTIONS; i++)
         free(s_fac_refcnts[i]);
-    kh_destroy(state, s_entity_state_table);
+    stalloc_destroy(&s_acquire_mem);
+fail_mem:
+    free(s_fac_presence);
+fail_presence:
+    cs_state_destroy(&s_entity_states);
     return false;
 }
 
@@ -761,7 +851,9 @@ void G_Combat_Shutdown(void)
     vec_pentity_destroy(&s_dying_ents);
     for(int i = 0; i < MAX_FACTIONS; i++)
         free(s_fac_refcnts[i]);
-    kh_destroy(state, s_entity_state_table);
+    stalloc_destroy(&s_acquire_mem);
+    free(s_fac_presence);
+    cs_state_destroy(&s_entity_states);
 }
 
 void G_Combat_AddEntity(const struct entity *ent, enum combat_stance initial)
@@ -927,6 +1019,17 @@ struct entity *G_Combat_ClosestEligibleEnemy(const struct entity *ent)
     return ret;
 }
 
+void G_Combat_ClosestEligibleEnemyBatch(size_t nents, const vec2_t *xz_positions, 
+                                        struct entity *const *ents, struct entity **out)
+{
+    if(nents == 0)
+        return;
+
+    update_targetable();
+    G_Pos_NearestWithPredBatch(nents, xz_positions, valid_enemy_batched, (void *const*)ents,
+        ENEMY_TARGET_ACQUISITION_RANGE, out);
+}
+
 void G_Combat_AddRef(int faction_id, vec2_t pos)
 {
     struct map_resolution mapres;
@@ -941,11 +1044,9 @@ void G_Combat_AddRef(int faction_id, vec2_t pos)
     if(!M_Tile_DescForPoint2D(binres, M_GetPos(s_map), pos, &td))
         return;
 
-    size_t x = td.chunk_c * X_BINS_PER_CHUNK + td.tile_c;
-    size_t z = td.chunk_r * Z_BINS_PER_CHUNK + td.tile_r;
-    size_t idx = x * (binres.chunk_w * binres.tile_w) + z;
-
+    size_t idx = bin_index(binres, td);
     s_fac_refcnts[faction_id][idx]++;
+    s_fac_presence[idx] |= (0x1 << faction_id);
 }
 
 void G_Combat_RemoveRef(int faction_id, vec2_t pos)
@@ -962,12 +1063,12 @@ void G_Combat_RemoveRef(int faction_id, vec2_t pos)
     if(!M_Tile_DescForPoint2D(binres, M_GetPos(s_map), pos, &td))
         return;
 
-    size_t x = td.chunk_c * X_BINS_PER_CHUNK + td.tile_c;
-    size_t z = td.chunk_r * Z_BINS_PER_CHUNK + td.tile_r;
-    size_t idx = x * (binres.chunk_w * binres.tile_w) + z;
-
+    size_t idx = bin_index(binres, td);
     assert(s_fac_refcnts[faction_id][idx] < UINT16_MAX);
     s_fac_refcnts[faction_id][idx]--;
+
+    if(s_fac_refcnts[faction_id][idx] == 0)
+        s_fac_presence[idx] &= ~(0x1 << faction_id);
 }
 
 void G_Combat_UpdateRef(int oldfac, int newfac, vec2_t pos)
@@ -1024,14 +1125,14 @@ bool G_Combat_SaveState(struct SDL_RWops *stream)
 {
     struct attr num_ents = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = kh_size(s_entity_state_table)
+        .val.as_int = cs_size(&s_entity_states)
     };
     CHK_TRUE_RET(Attr_Write(stream, &num_ents, "num_ents"));
 
     uint32_t key;
     struct combatstate curr;
 
-    kh_foreach(s_entity_state_table, key, curr, {
+    cs_foreach(&s_entity_states, key, curr, {
 
         struct attr uid = (struct attr){
             .type = TYPE_INT,
@@ -1115,9 +1216,8 @@ bool G_Combat_LoadState(struct SDL_RWops *stream)
         uid = attr.val.as_int;
 
         /* The entity should have already been loaded from the scripting state */
-        khiter_t k = kh_get(state, s_entity_state_table, uid);
-        CHK_TRUE_RET(k != kh_end(s_entity_state_table));
-        cs = &kh_value(s_entity_state_table, k);
+        cs = combatstate_get(uid);
+        CHK_TRUE_RET(cs);
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
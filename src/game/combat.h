@@ -61,6 +61,10 @@ bool G_Combat_SaveState(struct SDL_RWops *stream);
 bool G_Combat_LoadState(struct SDL_RWops *stream);
 
 struct entity *G_Combat_ClosestEligibleEnemy(const struct entity *ent);
+/* Same as 'G_Combat_ClosestEligibleEnemy' for many entities at once, answered 
+ * using the worker threads. */
+void           G_Combat_ClosestEligibleEnemyBatch(size_t nents, const vec2_t *xz_positions, 
+                                                  struct entity *const *ents, struct entity **out);
 
 #endif
 
@@ -0,0 +1,550 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "cull.h"
+#include "public/game.h"
+#include "../entity.h"
+#include "../collision.h"
+#include "../perf.h"
+#include "../main.h"
+#include "../map/public/map.h"
+#include "../map/public/tile.h"
+#include "../lib/public/khash.h"
+#include "../lib/public/vec.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+/* The world-space bounds of the entities are cached in packed arrays, one set 
+ * per map chunk. Every tick, the chunks are first tested against the frusta as 
+ * a whole. Only the entities of the chunks that straddle a frustum boundary are 
+ * then tested individually, several at a time. 
+ *
+ * The per-entity test is done against the axis-aligned box enclosing the 
+ * entity's OBB, which is conservative. 
+ */
+
+#define CULL_BATCH      (64)
+#define CULL_INIT_CAP   (16)
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
+
+struct cull_bucket{
+    uint32_t        size;
+    uint32_t        capacity;
+    float          *xmin, *xmax;
+    float          *ymin, *ymax;
+    float          *zmin, *zmax;
+    struct obb     *obbs;
+    struct entity **ents;
+    /* The terrain bounds of the chunk */
+    struct aabb     base;
+    /* Enclose the chunk as well as all the entities in it. The bounds 
+     * only grow as entities are added and are recomputed when an entity 
+     * leaves the chunk. */
+    struct aabb     bounds;
+    bool            shrink;
+};
+
+struct cull_loc{
+    uint32_t bucket;
+    uint32_t slot;
+    bool     dirty;
+};
+
+KHASH_MAP_INIT_INT(loc, struct cull_loc)
+
+VEC_TYPE(uid, uint32_t)
+VEC_IMPL(static inline, uid, uint32_t)
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static const struct map   *s_map;
+static int                 s_nrows, s_ncols;
+static struct cull_bucket *s_buckets;
+static khash_t(loc)       *s_locs;
+static vec_uid_t           s_dirty;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void aabb_union(struct aabb *inout, const struct aabb *other)
+{
+    inout->x_min = MIN(inout->x_min, other->x_min);
+    inout->x_max = MAX(inout->x_max, other->x_max);
+    inout->y_min = MIN(inout->y_min, other->y_min);
+    inout->y_max = MAX(inout->y_max, other->y_max);
+    inout->z_min = MIN(inout->z_min, other->z_min);
+    inout->z_max = MAX(inout->z_max, other->z_max);
+}
+
+static void aabb_for_obb(const struct obb *obb, struct aabb *out)
+{
+    *out = (struct aabb){ FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX };
+    for(int i = 0; i < ARR_SIZE(obb->corners); i++) {
+        const vec3_t *c = &obb->corners[i];
+        *out = (struct aabb){
+            MIN(out->x_min, c->x), MAX(out->x_max, c->x),
+            MIN(out->y_min, c->y), MAX(out->y_max, c->y),
+            MIN(out->z_min, c->z), MAX(out->z_max, c->z),
+        };
+    }
+}
+
+static uint32_t cull_bucket_for(vec2_t xz)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+    vec3_t pos = M_GetPos(s_map);
+
+    const float chunk_x_dim = res.tile_w * X_COORDS_PER_TILE;
+    const float chunk_z_dim = res.tile_h * Z_COORDS_PER_TILE;
+
+    /* The X coordinate decreases with the chunk column */
+    float c = floorf((pos.x - xz.x) / chunk_x_dim);
+    float r = floorf((xz.z - pos.z) / chunk_z_dim);
+
+    c = MIN(MAX(c, 0.0f), s_ncols - 1);
+    r = MIN(MAX(r, 0.0f), s_nrows - 1);
+    return (int)r * s_ncols + (int)c;
+}
+
+static bool cull_bucket_reserve(struct cull_bucket *bucket, uint32_t capacity)
+{
+    if(bucket->capacity >= capacity)
+        return true;
+
+    uint32_t newcap = MAX(CULL_INIT_CAP, bucket->capacity * 2);
+    newcap = MAX(newcap, capacity);
+
+    float **floats[] = {
+        &bucket->xmin, &bucket->xmax, 
+        &bucket->ymin, &bucket->ymax, 
+        &bucket->zmin, &bucket->zmax
+    };
+    for(int i = 0; i < ARR_SIZE(floats); i++) {
+        float *arr = realloc(*floats[i], newcap * sizeof(float));
+        if(!arr)
+            return false;
+        *floats[i] = arr;
+    }
+
+    struct obb *obbs = realloc(bucket->obbs, newcap * sizeof(struct obb));
+    if(!obbs)
+        return false;
+    bucket->obbs = obbs;
+
+    struct entity **ents = realloc(bucket->ents, newcap * sizeof(struct entity*));
+    if(!ents)
+        return false;
+    bucket->ents = ents;
+
+    bucket->capacity = newcap;
+    return true;
+}
+
+static void cull_bucket_destroy(struct cull_bucket *bucket)
+{
+    free(bucket->xmin);
+    free(bucket->xmax);
+    free(bucket->ymin);
+    free(bucket->ymax);
+    free(bucket->zmin);
+    free(bucket->zmax);
+    free(bucket->obbs);
+    free(bucket->ents);
+}
+
+static void cull_bucket_write(struct cull_bucket *bucket, uint32_t slot, 
+                              const struct obb *obb, const struct aabb *aabb)
+{
+    bucket->xmin[slot] = aabb->x_min;
+    bucket->xmax[slot] = aabb->x_max;
+    bucket->ymin[slot] = aabb->y_min;
+    bucket->ymax[slot] = aabb->y_max;
+    bucket->zmin[slot] = aabb->z_min;
+    bucket->zmax[slot] = aabb->z_max;
+    bucket->obbs[slot] = *obb;
+    aabb_union(&bucket->bounds, aabb);
+}
+
+static bool cull_bucket_append(struct cull_bucket *bucket, struct entity *ent,
+                               const struct obb *obb, const struct aabb *aabb, 
+                               uint32_t *out_slot)
+{
+    if(!cull_bucket_reserve(bucket, bucket->size + 1))
+        return false;
+
+    uint32_t slot = bucket->size++;
+    bucket->ents[slot] = ent;
+    cull_bucket_write(bucket, slot, obb, aabb);
+    *out_slot = slot;
+    return true;
+}
+
+static void cull_bucket_remove(struct cull_bucket *bucket, uint32_t slot)
+{
+    assert(slot < bucket->size);
+    uint32_t last = --bucket->size;
+    bucket->shrink = true;
+
+    if(slot == last)
+        return;
+
+    bucket->xmin[slot] = bucket->xmin[last];
+    bucket->xmax[slot] = bucket->xmax[last];
+    bucket->ymin[slot] = bucket->ymin[last];
+    bucket->ymax[slot] = bucket->ymax[last];
+    bucket->zmin[slot] = bucket->zmin[last];
+    bucket->zmax[slot] = bucket->zmax[last];
+    bucket->obbs[slot] = bucket->obbs[last];
+    bucket->ents[slot] = bucket->ents[last];
+
+    khiter_t k = kh_get(loc, s_locs, bucket->ents[slot]->uid);
+    assert(k != kh_end(s_locs));
+    kh_val(s_locs, k).slot = slot;
+}
+
+static void cull_bucket_shrink(struct cull_bucket *bucket)
+{
+    bucket->bounds = bucket->base;
+    for(uint32_t i = 0; i < bucket->size; i++) {
+        aabb_union(&bucket->bounds, &(struct aabb){
+            bucket->xmin[i], bucket->xmax[i],
+            bucket->ymin[i], bucket->ymax[i],
+            bucket->zmin[i], bucket->zmax[i],
+        });
+    }
+    bucket->shrink = false;
+}
+
+static void cull_flush(void)
+{
+    for(int i = 0; i < vec_size(&s_dirty); i++) {
+
+        uint32_t uid = vec_AT(&s_dirty, i);
+        khiter_t k = kh_get(loc, s_locs, uid);
+        if(k == kh_end(s_locs))
+            continue;
+
+        struct cull_loc *loc = &kh_val(s_locs, k);
+        if(!loc->dirty)
+            continue;
+        loc->dirty = false;
+
+        struct cull_bucket *bucket = &s_buckets[loc->bucket];
+        struct entity *ent = bucket->ents[loc->slot];
+
+        struct obb obb;
+        struct aabb aabb;
+        Entity_CurrentOBB(ent, &obb, false);
+        aabb_for_obb(&obb, &aabb);
+
+        uint32_t newidx = cull_bucket_for(G_Pos_GetXZ(uid));
+        uint32_t slot;
+
+        /* If we fail to move the entity to the new bucket, keep it in the old one. 
+         * Its' bounds are still correct, the chunk test is just less effective. */
+        if(newidx == loc->bucket
+        || !cull_bucket_append(&s_buckets[newidx], ent, &obb, &aabb, &slot)) {
+
+            cull_bucket_write(bucket, loc->slot, &obb, &aabb);
+            continue;
+        }
+
+        cull_bucket_remove(bucket, loc->slot);
+        loc = &kh_val(s_locs, k);
+        loc->bucket = newidx;
+        loc->slot = slot;
+    }
+    vec_uid_reset(&s_dirty);
+
+    for(int i = 0; i < s_nrows * s_ncols; i++) {
+        if(s_buckets[i].shrink)
+            cull_bucket_shrink(&s_buckets[i]);
+    }
+}
+
+/* Sets the bit in 'inout_masks' of every entity whose bounds are entirely 
+ * behind one of the planes of the frustum. The 'positive vertex' of the box 
+ * (the corner furthest along the plane normal) is picked per plane, so that 
+ * every box is tested with a single dot product per plane. */
+static void cull_batch_outside(const struct cull_bucket *bucket, uint32_t base, uint32_t n,
+                               const struct frustum *frust, int bit, uint8_t *inout_masks)
+{
+    const struct plane *planes[] = {&frust->top, &frust->bot, &frust->left, 
+                                    &frust->right, &frust->near, &frust->far};
+
+    for(int p = 0; p < ARR_SIZE(planes); p++) {
+
+        const vec3_t normal = planes[p]->normal;
+        const float *px = (normal.x >= 0.0f ? bucket->xmax : bucket->xmin) + base;
+        const float *py = (normal.y >= 0.0f ? bucket->ymax : bucket->ymin) + base;
+        const float *pz = (normal.z >= 0.0f ? bucket->zmax : bucket->zmin) + base;
+        const float offset = PFM_Vec3_Dot((vec3_t*)&normal, (vec3_t*)&planes[p]->point);
+        uint32_t i = 0;
+
+#if defined(__SSE2__)
+        const __m128 nx = _mm_set1_ps(normal.x);
+        const __m128 ny = _mm_set1_ps(normal.y);
+        const __m128 nz = _mm_set1_ps(normal.z);
+        const __m128 off = _mm_set1_ps(offset);
+
+        for(; i + 4 <= n; i += 4) {
+
+            __m128 dist = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(nx, _mm_loadu_ps(px + i)),
+                _mm_mul_ps(ny, _mm_loadu_ps(py + i))),
+                _mm_mul_ps(nz, _mm_loadu_ps(pz + i)));
+            int outside = _mm_movemask_ps(_mm_cmplt_ps(dist, off));
+
+            inout_masks[i + 0] |= (outside & 0x1) ? bit : 0;
+            inout_masks[i + 1] |= (outside & 0x2) ? bit : 0;
+            inout_masks[i + 2] |= (outside & 0x4) ? bit : 0;
+            inout_masks[i + 3] |= (outside & 0x8) ? bit : 0;
+        }
+#endif
+
+        for(; i < n; i++) {
+            float dist = normal.x * px[i] + normal.y * py[i] + normal.z * pz[i];
+            if(dist < offset)
+                inout_masks[i] |= bit;
+        }
+    }
+}
+
+static int cull_bucket_mask(const struct cull_bucket *bucket, const struct frustum *frust, int bit)
+{
+    switch(C_FrustumAABBIntersectionFast(frust, &bucket->bounds)) {
+    case VOLUME_INTERSEC_OUTSIDE:   return 0;
+    case VOLUME_INTERSEC_INSIDE:    return bit;
+    default:                        return -1;
+    }
+}
+
+static void cull_bucket_visit(const struct cull_bucket *bucket, 
+                              const struct frustum *cam, const struct frustum *light,
+                              void (*visit)(struct entity*, const struct obb*, int, void*),
+                              void *arg)
+{
+    /* Either 0 (no entity is inside), the frustum bit (all the entities are 
+     * inside) or -1 (the entities need to be tested individually) */
+    int cam_mask = cull_bucket_mask(bucket, cam, CULL_CAMERA);
+    int light_mask = cull_bucket_mask(bucket, light, CULL_LIGHT);
+
+    if(cam_mask == 0 && light_mask == 0)
+        return;
+
+    for(uint32_t base = 0; base < bucket->size; base += CULL_BATCH) {
+
+        uint32_t n = MIN(CULL_BATCH, bucket->size - base);
+        uint8_t outside[CULL_BATCH] = {0};
+
+        if(cam_mask == -1)
+            cull_batch_outside(bucket, base, n, cam, CULL_CAMERA, outside);
+        if(light_mask == -1)
+            cull_batch_outside(bucket, base, n, light, CULL_LIGHT, outside);
+
+        const int mask = (cam_mask ? CULL_CAMERA : 0) | (light_mask ? CULL_LIGHT : 0);
+        for(uint32_t i = 0; i < n; i++) {
+
+            int curr = mask & ~outside[i];
+            if(!curr)
+                continue;
+            visit(bucket->ents[base + i], &bucket->obbs[base + i], curr, arg);
+        }
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool G_Cull_Init(const struct map *map)
+{
+    struct map_resolution res;
+    M_GetResolution(map, &res);
+
+    s_map = map;
+    s_nrows = res.chunk_h;
+    s_ncols = res.chunk_w;
+
+    s_buckets = calloc(s_nrows * s_ncols, sizeof(struct cull_bucket));
+    if(!s_buckets)
+        goto fail_buckets;
+
+    for(int r = 0; r < s_nrows; r++) {
+    for(int c = 0; c < s_ncols; c++) {
+        struct cull_bucket *bucket = &s_buckets[r * s_ncols + c];
+        M_GetChunkAABB(map, r, c, &bucket->base);
+        bucket->bounds = bucket->base;
+    }}
+
+    s_locs = kh_init(loc);
+    if(!s_locs)
+        goto fail_locs;
+
+    vec_uid_init(&s_dirty);
+    return true;
+
+fail_locs:
+    free(s_buckets);
+fail_buckets:
+    return false;
+}
+
+void G_Cull_Shutdown(void)
+{
+    for(int i = 0; i < s_nrows * s_ncols; i++) {
+        cull_bucket_destroy(&s_buckets[i]);
+    }
+    free(s_buckets);
+    kh_destroy(loc, s_locs);
+    vec_uid_destroy(&s_dirty);
+    s_buckets = NULL;
+    s_map = NULL;
+}
+
+void G_Cull_Clear(void)
+{
+    if(!s_map)
+        return;
+
+    for(int i = 0; i < s_nrows * s_ncols; i++) {
+        s_buckets[i].size = 0;
+        s_buckets[i].bounds = s_buckets[i].base;
+        s_buckets[i].shrink = false;
+    }
+    kh_clear(loc, s_locs);
+    vec_uid_reset(&s_dirty);
+}
+
+bool G_Cull_AddEntity(struct entity *ent)
+{
+    ASSERT_IN_MAIN_THREAD();
+    assert(s_map);
+
+    struct obb obb;
+    struct aabb aabb;
+    Entity_CurrentOBB(ent, &obb, false);
+    aabb_for_obb(&obb, &aabb);
+
+    uint32_t idx = cull_bucket_for(G_Pos_GetXZ(ent->uid));
+    uint32_t slot;
+    if(!cull_bucket_append(&s_buckets[idx], ent, &obb, &aabb, &slot))
+        return false;
+
+    int ret;
+    khiter_t k = kh_put(loc, s_locs, ent->uid, &ret);
+    if(ret == -1) {
+        cull_bucket_remove(&s_buckets[idx], slot);
+        return false;
+    }
+    kh_val(s_locs, k) = (struct cull_loc){idx, slot, false};
+    return true;
+}
+
+void G_Cull_RemoveEntity(const struct entity *ent)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_map)
+        return;
+
+    khiter_t k = kh_get(loc, s_locs, ent->uid);
+    if(k == kh_end(s_locs))
+        return;
+
+    struct cull_loc loc = kh_val(s_locs, k);
+    kh_del(loc, s_locs, k);
+    cull_bucket_remove(&s_buckets[loc.bucket], loc.slot);
+}
+
+void G_Cull_Invalidate(const struct entity *ent)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_map)
+        return;
+
+    khiter_t k = kh_get(loc, s_locs, ent->uid);
+    if(k == kh_end(s_locs))
+        return;
+
+    struct cull_loc *loc = &kh_val(s_locs, k);
+    if(loc->dirty)
+        return;
+
+    /* If we can't queue the update, we must do it right away */
+    if(!vec_uid_push(&s_dirty, ent->uid)) {
+        struct obb obb;
+        struct aabb aabb;
+        Entity_CurrentOBB(ent, &obb, false);
+        aabb_for_obb(&obb, &aabb);
+        cull_bucket_write(&s_buckets[loc->bucket], loc->slot, &obb, &aabb);
+        return;
+    }
+    loc->dirty = true;
+}
+
+void G_Cull_Update(const struct frustum *cam, const struct frustum *light,
+                   void (*visit)(struct entity *ent, const struct obb *obb, int mask, void *arg),
+                   void *arg)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    if(!s_map)
+        PERF_RETURN_VOID();
+
+    cull_flush();
+
+    for(int i = 0; i < s_nrows * s_ncols; i++) {
+        cull_bucket_visit(&s_buckets[i], cam, light, visit, arg);
+    }
+
+    PERF_RETURN_VOID();
+}
+
@@ -0,0 +1,67 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef CULL_H
+#define CULL_H
+
+#include <stdbool.h>
+
+struct map;
+struct entity;
+struct frustum;
+struct obb;
+
+enum{
+    CULL_CAMERA = (1 << 0),
+    CULL_LIGHT  = (1 << 1),
+};
+
+bool G_Cull_Init(const struct map *map);
+void G_Cull_Shutdown(void);
+void G_Cull_Clear(void);
+bool G_Cull_AddEntity(struct entity *ent);
+void G_Cull_RemoveEntity(const struct entity *ent);
+/* Must be called whenever the entity's world-space bounds change (i.e. it's 
+ * moved, rotated, scaled or changes its' animation pose). The bounds are 
+ * recomputed lazily, on the next call to G_Cull_Update. */
+void G_Cull_Invalidate(const struct entity *ent);
+/* Invokes the callback for every entity that intersects at least one of the 
+ * two frusta, with the CULL_* mask of the frusta that it intersects. */
+void G_Cull_Update(const struct frustum *cam, const struct frustum *light,
+                   void (*visit)(struct entity *ent, const struct obb *obb, int mask, void *arg),
+                   void *arg);
+
+#endif
+
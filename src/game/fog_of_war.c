@@ -41,7 +41,6 @@
 #include "../settings.h"
 #include "../render/public/render.h"
 #include "../render/public/render_ctrl.h"
-#include "../lib/public/pqueue.h"
 #include "../lib/public/khash.h"
 #include "../lib/public/attr.h"
 #include "../map/public/map.h"
@@ -70,10 +69,41 @@ enum fog_state{
     STATE_VISIBLE,
 };
 
-PQUEUE_TYPE(td, struct tile_desc)
-PQUEUE_IMPL(static, td, struct tile_desc)
+enum{
+    VIS_BIT_OLD = (1 << 0),
+    VIS_BIT_NEW = (1 << 1),
+};
+
+/* The set of tiles within a vision radius, relative to the origin tile. 
+ * The same template is shared by all units with the same vision range. */
+struct vision_tmpl{
+    /* The larger of the radii along the X and Z axes, in tiles */
+    int radius;
+    int zrad;
+    /* For every row offset in [0, zrad], the largest column offset that is 
+     * still within the radius (or -1 when there is none) */
+    int extents[];
+};
+
+/* A rectangle of tiles, in global (row, column) coordinates, holding a 
+ * bitmask for every tile */
+struct vis_mask{
+    int      r0, c0;
+    int      nrows, ncols;
+    size_t   capacity;
+    uint8_t *bits;
+};
+
+struct vis_cast{
+    struct map_resolution     res;
+    const struct vision_tmpl *tmpl;
+    int                       orow, ocol;
+    int                       ref_height;
+    uint8_t                   bit;
+};
 
 KHASH_SET_INIT_INT(uid)
+KHASH_MAP_INIT_INT(tmpl, struct vision_tmpl*)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
@@ -89,6 +119,18 @@ static uint8_t          *s_vision_refcnts[MAX_FACTIONS];
 /* Cache all the entities that have been explored by the player, for faster queries */
 static khash_t(uid)     *s_explored_cache;
 static bool              s_enabled = true;
+/* For every chunk, the mask of factions for which the state of at least one 
+ * of its' tiles changed since the last upload. Only the chunks with a changed 
+ * state for one of the player's factions are repacked and uploaded. */
+static uint16_t         *s_dirty_chunks;
+/* Set when the uploaded state must be entirely rebuilt */
+static bool              s_upload_all;
+static uint32_t          s_uploaded_mask;
+static bool              s_uploaded_enabled;
+/* Vision templates, keyed by the bits of the radius */
+static khash_t(tmpl)    *s_templates;
+/* Scratch space for computing the visible tiles */
+static struct vis_mask   s_mask;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -123,228 +165,314 @@ static int td_index(struct tile_desc td)
 
 static void update_tile(int faction_id, struct tile_desc td, int delta)
 {
-    uint8_t old = s_vision_refcnts[faction_id][td_index(td)];
+    const int idx = td_index(td);
+    uint8_t old = s_vision_refcnts[faction_id][idx];
     uint8_t new = old + delta;
+    uint32_t old_state = s_fog_state[idx];
 
     if(new) {
-        fog_set_state(s_fog_state + td_index(td), faction_id, STATE_VISIBLE);
+        fog_set_state(s_fog_state + idx, faction_id, STATE_VISIBLE);
     }else{
-        fog_set_state(s_fog_state + td_index(td), faction_id, STATE_IN_FOG);
+        fog_set_state(s_fog_state + idx, faction_id, STATE_IN_FOG);
     }
 
-    s_vision_refcnts[faction_id][td_index(td)] = new;
+    s_vision_refcnts[faction_id][idx] = new;
+
+    if(s_fog_state[idx] != old_state) {
+        struct map_resolution res;
+        M_GetResolution(s_map, &res);
+        s_dirty_chunks[td.chunk_r * res.chunk_w + td.chunk_c] |= (0x1 << faction_id);
+    }
 }
 
-static size_t neighbours(struct tile_desc curr, struct tile_desc *out)
+static bool td_los_blocked(struct tile_desc td, int ref_height)
 {
-    size_t ret = 0;
+    struct tile *tile;
+    M_TileForDesc(s_map, td, &tile);
+    return (M_Tile_BaseHeight(tile) - ref_height > 1);
+}
 
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
+static const struct vision_tmpl *vision_tmpl_get(float radius)
+{
+    uint32_t key;
+    memcpy(&key, &radius, sizeof(key));
 
-    for(int dr = -1; dr <= 1; dr++) {
-    for(int dc = -1; dc <= 1; dc++) {
+    khiter_t k = kh_get(tmpl, s_templates, key);
+    if(k != kh_end(s_templates))
+        return kh_val(s_templates, k);
 
-        if(dr == 0 && dc == 0)
-            continue;
+    const int xrad = ceil(radius / X_COORDS_PER_TILE);
+    const int zrad = ceil(radius / Z_COORDS_PER_TILE);
 
-        struct tile_desc cand = curr;
-        bool exists = M_Tile_RelativeDesc(res, &cand, dc, dr);
-        if(!exists)
-            continue;
-        out[ret++] = cand;
-    }}
+    struct vision_tmpl *ret = malloc(sizeof(struct vision_tmpl) + (zrad + 1) * sizeof(int));
+    if(!ret)
+        return NULL;
+
+    ret->radius = MAX(xrad, zrad);
+    ret->zrad = zrad;
+    for(int dr = 0; dr <= zrad; dr++) {
 
+        /* A tile is in range when the distance between its' center and the 
+         * center of the origin tile does not exceed the radius */
+        int extent = -1;
+        for(int dc = 0; dc <= xrad; dc++) {
+            float x = dc * X_COORDS_PER_TILE;
+            float z = dr * Z_COORDS_PER_TILE;
+            if(x * x + z * z > radius * radius)
+                break;
+            extent = dc;
+        }
+        ret->extents[dr] = extent;
+    }
+
+    int status;
+    k = kh_put(tmpl, s_templates, key, &status);
+    if(status == -1) {
+        free(ret);
+        return NULL;
+    }
+    kh_val(s_templates, k) = ret;
     return ret;
 }
 
-static vec2_t tile_center_pos(struct tile_desc td)
+static bool vision_tmpl_contains(const struct vision_tmpl *tmpl, int dr, int dc)
 {
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
+    dr = abs(dr);
+    dc = abs(dc);
+    return (dr <= tmpl->zrad) && (dc <= tmpl->extents[dr]);
+}
 
-    struct box box = M_Tile_Bounds(res, M_GetPos(s_map), td);
-    return (vec2_t){
-        box.x - box.width / 2.0f,
-        box.z + box.height / 2.0f
-    };
+static bool vis_mask_init(int r0, int c0, int nrows, int ncols)
+{
+    size_t size = nrows * ncols;
+    if(size > s_mask.capacity) {
+        uint8_t *bits = realloc(s_mask.bits, size);
+        if(!bits)
+            return false;
+        s_mask.bits = bits;
+        s_mask.capacity = size;
+    }
+    memset(s_mask.bits, 0, size);
+    s_mask.r0 = r0;
+    s_mask.c0 = c0;
+    s_mask.nrows = nrows;
+    s_mask.ncols = ncols;
+    return true;
 }
 
-static bool td_los_blocked(struct tile_desc td, int ref_height)
+static uint8_t *vis_mask_at(int r, int c)
 {
-    struct tile *tile;
-    M_TileForDesc(s_map, td, &tile);
-    return (M_Tile_BaseHeight(tile) - ref_height > 1);
+    assert(r >= s_mask.r0 && r < s_mask.r0 + s_mask.nrows);
+    assert(c >= s_mask.c0 && c < s_mask.c0 + s_mask.ncols);
+    return &s_mask.bits[(r - s_mask.r0) * s_mask.ncols + (c - s_mask.c0)];
 }
 
-static bool td_is_los_corner(struct tile_desc td, int ref_height)
+static bool global_td(struct map_resolution res, int r, int c, struct tile_desc *out)
 {
-    if(!td_los_blocked(td, ref_height))
+    if(r < 0 || r >= res.chunk_h * res.tile_h)
+        return false;
+    if(c < 0 || c >= res.chunk_w * res.tile_w)
         return false;
 
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
+    *out = (struct tile_desc){
+        r / res.tile_h, c / res.tile_w,
+        r % res.tile_h, c % res.tile_w
+    };
+    return true;
+}
 
-    struct tile_desc left = td, right = td;
-    if(M_Tile_RelativeDesc(res, &left,  -1, 0)
-    && M_Tile_RelativeDesc(res, &right, +1, 0)) {
+/* Tiles outside of the map, as well as tiles that are sufficiently higher 
+ * than the origin, block the line of sight. They are not revealed. */
+static bool cast_blocked(const struct vis_cast *vc, int r, int c)
+{
+    struct tile_desc td;
+    if(!global_td(vc->res, r, c, &td))
+        return true;
+    return td_los_blocked(td, vc->ref_height);
+}
 
-        if(td_los_blocked(left, ref_height) ^ td_los_blocked(right, ref_height))
-            return true;
-    }
+/* Recursive shadowcasting over a single octant. The octant is scanned row by row, 
+ * moving away from the origin. The range of slopes [start, end] that is still lit 
+ * is narrowed, and a new scan is spawned for every run of blocking tiles. The 
+ * multipliers xx, xy, yx, yy transform the octant coordinates into map coordinates. 
+ */
+static void cast_light(const struct vis_cast *vc, int row, float start, float end, 
+                       int xx, int xy, int yx, int yy)
+{
+    if(start < end)
+        return;
 
-    struct tile_desc top = td, bot = td;
-    if(M_Tile_RelativeDesc(res, &top, 0, -1)
-    && M_Tile_RelativeDesc(res, &bot, 0, +1)) {
+    float new_start = 0.0f;
+    for(int j = row; j <= vc->tmpl->radius; j++) {
 
-        if(td_los_blocked(top, ref_height) ^ td_los_blocked(bot, ref_height))
-            return true;
-    }
+        int dx = -j - 1, dy = -j;
+        bool blocked = false;
 
-    return false;
-}
+        while(dx <= 0) {
 
-static void wf_create_blocked_line(int xrad, int zrad, bool wf[][xrad * 2 + 1], 
-                                   struct tile_desc origin, int delta_r, int delta_c)
-{
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
+            dx++;
+            const int dc = dx * xx + dy * xy;
+            const int dr = dx * yx + dy * yy;
 
-    struct tile_desc corner;
-    M_Tile_RelativeDesc(res, &corner, delta_c, delta_r);
-
-    vec2_t origin_center = tile_center_pos(origin);
-    vec2_t corner_center = tile_center_pos(corner);
-
-    vec2_t slope;
-    PFM_Vec2_Sub(&origin_center, &corner_center, &slope);
-    PFM_Vec2_Normal(&slope, &slope);
-
-    /* Now use Bresenham's line drawing algorithm to follow a line 
-     * of the computed slope starting at the 'corner' until we hit the 
-     * edge of the field. 
-     * Multiply by 1_000 to convert slope to integer deltas, but keep 
-     * 3 digits of precision after the decimal.*/
-    int dx =  abs(slope.raw[0] * 1000);
-    int dy = -abs(slope.raw[1] * 1000);
-    int sx = slope.raw[0] > 0.0f ? 1 : -1;
-    int sy = slope.raw[1] < 0.0f ? 1 : -1;
-    int err = dx + dy, e2;
-
-    int curr_dr = delta_r, curr_dc = delta_c;
-    do {
-
-        fflush(stdout);
-        wf[zrad + curr_dr][xrad + curr_dc] = true;
-
-        e2 = 2 * err;
-        if(e2 >= dy) {
-            err += dy;
-            curr_dc  += sx;
-        }
-        if(e2 <= dx) {
-            err += dx;
-            curr_dr += sy;
-        }
-
-    }while(abs(curr_dr) <= zrad && abs(curr_dc) <= xrad);
-}
+            const float l_slope = (dx - 0.5f) / (dy + 0.5f);
+            const float r_slope = (dx + 0.5f) / (dy - 0.5f);
 
-void td_delta(struct tile_desc a, struct tile_desc b, int *out_dr, int *out_dc)
-{
-    struct map_resolution res;
-    M_GetResolution(s_map, &res);
+            if(start < r_slope)
+                continue;
+            if(end > l_slope)
+                break;
 
-    int ar = a.chunk_r * res.tile_h + a.tile_r;
-    int ac = a.chunk_c * res.tile_w + a.tile_c;
+            const bool tile_blocked = cast_blocked(vc, vc->orow + dr, vc->ocol + dc);
+            if(!tile_blocked && vision_tmpl_contains(vc->tmpl, dr, dc)) {
+                *vis_mask_at(vc->orow + dr, vc->ocol + dc) |= vc->bit;
+            }
 
-    int br = b.chunk_r * res.tile_h + b.tile_r;
-    int bc = b.chunk_c * res.tile_w + b.tile_c;
+            if(blocked) {
+                if(tile_blocked) {
+                    new_start = r_slope;
+                    continue;
+                }
+                blocked = false;
+                start = new_start;
+            }else if(tile_blocked && j < vc->tmpl->radius) {
+                blocked = true;
+                cast_light(vc, j + 1, start, l_slope, xx, xy, yx, yy);
+                new_start = r_slope;
+            }
+        }
 
-    *out_dr = br - ar;
-    *out_dc = bc - ac;
+        if(blocked)
+            break;
+    }
 }
 
-static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int delta)
+/* Sets 'bit' in the mask for every tile that can be seen from the origin */
+static void vis_compute(const struct vision_tmpl *tmpl, int orow, int ocol, uint8_t bit)
 {
-    if(radius == 0.0f)
-        return;
+    static const int mult[4][8] = {
+        {1,  0,  0, -1, -1,  0,  0,  1},
+        {0,  1, -1,  0,  0, -1,  1,  0},
+        {0,  1,  1,  0,  0, -1, -1,  0},
+        {1,  0,  0,  1, -1,  0,  0, -1},
+    };
 
     struct map_resolution res;
     M_GetResolution(s_map, &res);
 
     struct tile_desc origin;
-    bool status = M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &origin);
-    assert(status);
+    if(!global_td(res, orow, ocol, &origin))
+        return;
 
     struct tile *tile;
     M_TileForDesc(s_map, origin, &tile);
-    int origin_height = M_Tile_BaseHeight(tile);
 
-    const int tile_x_radius = ceil(radius / X_COORDS_PER_TILE);
-    const int tile_z_radius = ceil(radius / Z_COORDS_PER_TILE);
-    assert(tile_x_radius && tile_z_radius);
+    struct vis_cast vc = (struct vis_cast){
+        .res = res,
+        .tmpl = tmpl,
+        .orow = orow,
+        .ocol = ocol,
+        .ref_height = M_Tile_BaseHeight(tile),
+        .bit = bit
+    };
 
-    /* Declare a byte for every tile within a box having a half-length of 'radius' 
-     * that surrounds the position. When the position is near the map edge, some
-     * elements may be unused.  wf_blocked[tile_x_radius][tile_z_radius] gives the 
-     * byte corresponding to the origin-most tile. */
-    bool wf_blocked[2 * tile_x_radius  + 1][2 * tile_z_radius + 1];
-    memset(wf_blocked, 0, sizeof(wf_blocked));
+    *vis_mask_at(orow, ocol) |= bit;
+    for(int i = 0; i < 8; i++) {
+        cast_light(&vc, 1, 1.0f, 0.0f, mult[0][i], mult[1][i], mult[2][i], mult[3][i]);
+    }
+}
 
-    bool visited[2 * tile_x_radius  + 1][2 * tile_z_radius + 1];
-    memset(visited, 0, sizeof(visited));
+static bool origin_for_pos(vec2_t xz_pos, int *out_r, int *out_c)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
 
-    pq_td_t frontier;
-    pq_td_init(&frontier);
+    struct tile_desc td;
+    bool status = M_Tile_DescForPoint2D(res, M_GetPos(s_map), xz_pos, &td);
+    assert(status);
 
-    pq_td_push(&frontier, 0.0f, origin);
-    visited[tile_x_radius][tile_z_radius] = true;
-    update_tile(faction_id, origin, delta);
+    *out_r = td.chunk_r * res.tile_h + td.tile_r;
+    *out_c = td.chunk_c * res.tile_w + td.tile_c;
+    return status;
+}
 
-    while(pq_size(&frontier) > 0) {
+/* Adds 'delta' to the vision reference count of every tile which has exactly one 
+ * of the bits set in the mask: +delta for 'bit_a' and -delta for 'bit_b' */
+static void vis_mask_apply(int faction_id, uint8_t bit_a, uint8_t bit_b, int delta)
+{
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
 
-        struct tile_desc curr;
-        pq_td_pop(&frontier, &curr);
+    for(int r = 0; r < s_mask.nrows; r++) {
+    for(int c = 0; c < s_mask.ncols; c++) {
 
-        struct tile_desc neighbs[8];
-        size_t num_neighbs = neighbours(curr, neighbs);
+        uint8_t val = s_mask.bits[r * s_mask.ncols + c];
+        bool a = val & bit_a, b = val & bit_b;
+        if(a == b)
+            continue;
 
-        for(int i = 0; i < num_neighbs; i++) {
+        struct tile_desc td;
+        if(!global_td(res, s_mask.r0 + r, s_mask.c0 + c, &td))
+            continue;
+        update_tile(faction_id, td, a ? delta : -delta);
+    }}
+}
 
-            int dr, dc;
-            td_delta(origin, neighbs[i], &dr, &dc);
-            assert(abs(dr) <= tile_z_radius);
-            assert(abs(dc) <= tile_x_radius);
+static void fog_update_visible(int faction_id, vec2_t xz_pos, float radius, int delta)
+{
+    if(radius == 0.0f)
+        return;
 
-            if(visited[tile_x_radius + dr][tile_z_radius + dc])
-                continue;
-            visited[tile_x_radius + dr][tile_z_radius + dc] = true;
+    const struct vision_tmpl *tmpl = vision_tmpl_get(radius);
+    if(!tmpl)
+        return;
 
-            if(wf_blocked[tile_x_radius + dr][tile_z_radius + dc])
-                continue;
+    int orow, ocol;
+    origin_for_pos(xz_pos, &orow, &ocol);
 
-            vec2_t origin_pos = tile_center_pos(origin);
-            vec2_t neighb_pos = tile_center_pos(neighbs[i]);
+    const int rad = tmpl->radius;
+    if(!vis_mask_init(orow - rad, ocol - rad, 2 * rad + 1, 2 * rad + 1))
+        return;
 
-            vec2_t origin_delta;
-            PFM_Vec2_Sub(&neighb_pos, &origin_pos, &origin_delta);
+    vis_compute(tmpl, orow, ocol, VIS_BIT_NEW);
+    vis_mask_apply(faction_id, VIS_BIT_NEW, 0, delta);
+}
 
-            if(PFM_Vec2_Len(&origin_delta) > radius)
-                continue;
+static void fog_move_visible(int faction_id, vec2_t old_xz, vec2_t new_xz, float radius)
+{
+    if(radius == 0.0f)
+        return;
+
+    const struct vision_tmpl *tmpl = vision_tmpl_get(radius);
+    if(!tmpl)
+        return;
 
-            if(td_is_los_corner(neighbs[i], origin_height))
-                wf_create_blocked_line(tile_x_radius, tile_z_radius, wf_blocked, origin, dr, dc);
+    int old_r, old_c, new_r, new_c;
+    origin_for_pos(old_xz, &old_r, &old_c);
+    origin_for_pos(new_xz, &new_r, &new_c);
 
-            if(td_los_blocked(neighbs[i], origin_height))
-                continue;
+    /* The visible area only depends on the tile that the unit is on */
+    if(old_r == new_r && old_c == new_c)
+        return;
 
-            update_tile(faction_id, neighbs[i], delta);
-            pq_td_push(&frontier, PFM_Vec2_Len(&origin_delta), neighbs[i]);
-        }
+    const int rad = tmpl->radius;
+    if(abs(new_r - old_r) > rad || abs(new_c - old_c) > rad) {
+        fog_update_visible(faction_id, old_xz, radius, -1);
+        fog_update_visible(faction_id, new_xz, radius, +1);
+        return;
     }
 
-    pq_td_destroy(&frontier);
+    /* The areas overlap: only touch the tiles whose visibility changed */
+    const int r0 = MIN(old_r, new_r) - rad, r1 = MAX(old_r, new_r) + rad;
+    const int c0 = MIN(old_c, new_c) - rad, c1 = MAX(old_c, new_c) + rad;
+    if(!vis_mask_init(r0, c0, r1 - r0 + 1, c1 - c0 + 1)) {
+        fog_update_visible(faction_id, old_xz, radius, -1);
+        fog_update_visible(faction_id, new_xz, radius, +1);
+        return;
+    }
+
+    vis_compute(tmpl, old_r, old_c, VIS_BIT_OLD);
+    vis_compute(tmpl, new_r, new_c, VIS_BIT_NEW);
+    vis_mask_apply(faction_id, VIS_BIT_NEW, VIS_BIT_OLD, +1);
 }
 
 static bool fog_obj_matches(uint16_t fac_mask, const struct obb *obj, enum fog_state *states, size_t nstates)
@@ -417,12 +545,23 @@ bool G_Fog_Init(const struct map *map)
     if(!s_explored_cache)
         goto fail;
 
+    s_dirty_chunks = calloc(sizeof(s_dirty_chunks[0]), res.chunk_w * res.chunk_h);
+    if(!s_dirty_chunks)
+        goto fail;
+
+    s_templates = kh_init(tmpl);
+    if(!s_templates)
+        goto fail;
+
     s_map = map;
+    s_upload_all = true;
     E_Global_Register(EVENT_RENDER_3D_POST, on_render_3d, NULL, G_RUNNING | G_PAUSED_UI_RUNNING | G_PAUSED_FULL);
     return true;
 
 fail:
     kh_destroy(uid, s_explored_cache);
+    kh_destroy(tmpl, s_templates);
+    free(s_dirty_chunks);
     free(s_fog_state);
     for(int i = 0; i < MAX_FACTIONS; i++) {
         free(s_vision_refcnts[i]);
@@ -434,6 +573,18 @@ void G_Fog_Shutdown(void)
 {
     E_Global_Unregister(EVENT_RENDER_3D_POST, on_render_3d);
     kh_destroy(uid, s_explored_cache);
+
+    struct vision_tmpl *curr;
+    kh_foreach_value(s_templates, curr, {
+        free(curr);
+    });
+    kh_destroy(tmpl, s_templates);
+    s_templates = NULL;
+
+    free(s_mask.bits);
+    memset(&s_mask, 0, sizeof(s_mask));
+    free(s_dirty_chunks);
+    s_dirty_chunks = NULL;
     free(s_fog_state);
     s_fog_state = NULL;
     for(int i = 0; i < MAX_FACTIONS; i++) {
@@ -453,6 +604,11 @@ void G_Fog_RemoveVision(vec2_t xz_pos, int faction_id, float radius)
     fog_update_visible(faction_id, xz_pos, radius, -1);
 }
 
+void G_Fog_MoveVision(vec2_t old_xz, vec2_t new_xz, int faction_id, float radius)
+{
+    fog_move_visible(faction_id, old_xz, new_xz, radius);
+}
+
 void G_Fog_UpdateVisionRange(vec2_t xz_pos, int faction_id, float old, float new)
 {
     G_Fog_RemoveVision(xz_pos, faction_id, old);
@@ -590,49 +746,81 @@ void G_Fog_UpdateVisionState(void)
     bool controllable[MAX_FACTIONS];
     uint16_t facs = G_GetFactions(NULL, NULL, controllable);
 
+    uint16_t player_facs = 0;
     uint32_t player_mask = 0;
     for(int i = 0; facs; facs >>= 1, i++) {
-        if((facs & 0x1) && controllable[i])
+        if((facs & 0x1) && controllable[i]) {
+            player_facs |= (0x1 << i);
             player_mask |= (0x3 << (i * 2));
+        }
     }
 
     struct map_resolution res;
     M_GetResolution(s_map, &res);
 
-    size_t size = res.chunk_h * res.tile_h * res.chunk_w * res.tile_w;
-    unsigned char *visbuff = stalloc(&G_GetSimWS()->args, size);
+    const size_t nchunks = res.chunk_w * res.chunk_h;
+    const size_t chunk_size = res.tile_w * res.tile_h;
+
+    if(player_mask != s_uploaded_mask || s_enabled != s_uploaded_enabled) {
+        s_upload_all = true;
+    }
 
-    if(!s_enabled) {
-        memset(visbuff, STATE_VISIBLE, size);
-        goto submit;
+    size_t ndirty = 0;
+    for(int i = 0; i < nchunks; i++) {
+        if(s_upload_all || (s_dirty_chunks[i] & player_facs))
+            ndirty++;
     }
 
-    for(int cr = 0; cr < res.chunk_h; cr++) {
-    for(int cc = 0; cc < res.chunk_w; cc++) {
+    if(ndirty == 0) {
+        memset(s_dirty_chunks, 0, nchunks * sizeof(s_dirty_chunks[0]));
+        return;
+    }
 
-        for(int tr = 0; tr < res.tile_h; tr++) {
-        for(int tc = 0; tc < res.tile_w; tc++) {
+    unsigned char *visbuff = stalloc(&G_GetSimWS()->args, ndirty * chunk_size);
+    uint32_t *chunks = stalloc(&G_GetSimWS()->args, ndirty * sizeof(uint32_t));
+    unsigned char *out = visbuff;
+    size_t nout = 0;
 
-            struct tile_desc td = (struct tile_desc){cr, cc, tr, tc};
-            int idx = td_index(td);
-            uint32_t player_state = s_fog_state[idx] & player_mask;
+    for(int i = 0; i < nchunks; i++) {
+
+        if(!s_upload_all && !(s_dirty_chunks[i] & player_facs))
+            continue;
+        chunks[nout++] = i;
+
+        if(!s_enabled) {
+            memset(out, STATE_VISIBLE, chunk_size);
+            out += chunk_size;
+            continue;
+        }
+
+        /* The tiles of every chunk are contiguous in the fog state */
+        const uint32_t *states = s_fog_state + i * chunk_size;
+        for(int j = 0; j < chunk_size; j++) {
+
+            uint32_t player_state = states[j] & player_mask;
 
             if(!player_state)
-                visbuff[idx] = STATE_UNEXPLORED;
+                *out++ = STATE_UNEXPLORED;
             else if(fog_any_matches(player_state, STATE_VISIBLE))
-                visbuff[idx] = STATE_VISIBLE;
+                *out++ = STATE_VISIBLE;
             else
-                visbuff[idx] = STATE_IN_FOG;
-        }}
-    }}
+                *out++ = STATE_IN_FOG;
+        }
+    }
+    assert(nout == ndirty);
+
+    memset(s_dirty_chunks, 0, nchunks * sizeof(s_dirty_chunks[0]));
+    s_upload_all = false;
+    s_uploaded_mask = player_mask;
+    s_uploaded_enabled = s_enabled;
 
-submit:
     R_PushCmd((struct rcmd){
         .func = R_GL_MapUpdateFog,
-        .nargs = 2,
+        .nargs = 3,
         .args = {
             visbuff,
-            R_PushArg(&size, sizeof(size)),
+            chunks,
+            R_PushArg(&ndirty, sizeof(ndirty)),
         },
     });
 }
@@ -730,6 +918,7 @@ bool G_Fog_LoadState(struct SDL_RWops *stream)
         s_fog_state[i] = attr.val.as_int;
     }
 
+    s_upload_all = true;
     return true;
 }
 
@@ -756,6 +945,7 @@ void G_Fog_ExploreMap(int faction_id)
             s_fog_state[td_index(td)] = ts;
         }}
     }}
+    s_upload_all = true;
 }
 
 void G_Fog_Enable(void)
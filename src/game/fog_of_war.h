@@ -49,6 +49,9 @@ void G_Fog_Shutdown(void);
 
 void G_Fog_AddVision(vec2_t xz_pos, int faction_id, float radius);
 void G_Fog_RemoveVision(vec2_t xz_pos, int faction_id, float radius);
+/* Equivalent to removing the vision at the old position and adding it at 
+ * the new one, but only touches the tiles whose visibility has changed. */
+void G_Fog_MoveVision(vec2_t old_xz, vec2_t new_xz, int faction_id, float radius);
 
 void G_Fog_UpdateVisionState(void);
 void G_Fog_ClearExploredCache(void);
@@ -42,6 +42,7 @@
 #include "combat.h" 
 #include "clearpath.h"
 #include "position.h"
+#include "cull.h"
 #include "fog_of_war.h"
 #include "building.h"
 #include "builder.h"
@@ -147,6 +148,7 @@ static void g_init_map(void)
     G_Harvester_Init(s_gs.map);
     G_ClearPath_Init(s_gs.map);
     G_Pos_Init(s_gs.map);
+    G_Cull_Init(s_gs.map);
     G_Fog_Init(s_gs.map);
     N_FC_ClearAll();
     N_FC_ClearStats();
@@ -362,7 +364,8 @@ static void g_sort_anim_list(vec_ranim_t *inout)
     }
 }
 
-static void g_make_draw_list(vec_pentity_t ents, vec_rstat_t *out_stat, vec_ranim_t *out_anim)
+static void g_make_draw_list(vec_pentity_t ents, bool blend_anims, 
+                             vec_rstat_t *out_stat, vec_ranim_t *out_anim)
 {
     struct map_resolution res;
     if(s_gs.map) {
@@ -386,7 +389,7 @@ static void g_make_draw_list(vec_pentity_t ents, vec_rstat_t *out_stat, vec_rani
                 .model = model,
                 .translucent = curr->flags & ENTITY_FLAG_TRANSLUCENT
             };
-            A_GetRenderState(curr, &rstate.njoints, rstate.curr_pose, &rstate.inv_bind_pose);
+            A_GetRenderState(curr, blend_anims, &rstate.njoints, rstate.curr_pose, &rstate.inv_bind_pose);
             vec_ranim_push(out_anim, rstate);
         }else{
         
@@ -417,6 +420,10 @@ static void g_create_render_input(struct render_input *out)
     ss_e status = Settings_Get("pf.video.shadows_enabled", &shadows_setting);
     assert(status == SS_OKAY);
 
+    struct sval blend_setting;
+    if(Settings_Get("pf.video.animation_blending", &blend_setting) != SS_OKAY)
+        blend_setting.as_bool = false;
+
     out->cam = s_gs.active_cam;
     out->map = s_gs.prev_tick_map;
     out->shadows = shadows_setting.as_bool;
@@ -428,8 +435,10 @@ static void g_create_render_input(struct render_input *out)
     vec_rstat_init(&out->light_vis_stat);
     vec_ranim_init(&out->light_vis_anim);
 
-    g_make_draw_list(s_gs.visible, &out->cam_vis_stat, &out->cam_vis_anim);
-    g_make_draw_list(s_gs.light_visible, &out->light_vis_stat, &out->light_vis_anim);
+    g_make_draw_list(s_gs.visible, blend_setting.as_bool, 
+        &out->cam_vis_stat, &out->cam_vis_anim);
+    g_make_draw_list(s_gs.light_visible, blend_setting.as_bool, 
+        &out->light_vis_stat, &out->light_vis_anim);
 
     PERF_RETURN_VOID();
 }
@@ -601,6 +610,24 @@ static int g_alloc_faction(void)
     return -1;
 }
 
+static void g_update_war_masks(void)
+{
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+
+        s_gs.war_masks[i] = 0;
+        if(!(s_gs.factions_allocd & (0x1 << i)))
+            continue;
+
+        for(int j = 0; j < MAX_FACTIONS; j++) {
+
+            if(i == j || !(s_gs.factions_allocd & (0x1 << j)))
+                continue;
+            if(s_gs.diplomacy_table[i][j] == DIPLOMACY_STATE_WAR)
+                s_gs.war_masks[i] |= (0x1 << j);
+        }
+    }
+}
+
 static uint16_t g_player_mask(void)
 {
     bool controllable[MAX_FACTIONS];
@@ -631,6 +658,24 @@ static bool g_ent_visible(uint16_t playermask, const struct entity *ent, const s
     return G_Fog_ObjVisible(playermask, obb);
 }
 
+static void g_add_visible(struct entity *ent, const struct obb *obb, int mask, void *arg)
+{
+    uint16_t pm = *(uint16_t*)arg;
+    bool vis = false;
+
+    /* Note that there may be some false positives due to culling the bounding boxes */
+    if((mask & CULL_CAMERA) && (vis = g_ent_visible(pm, ent, obb))) {
+
+        vec_pentity_push(&s_gs.visible, ent);
+        vec_obb_push(&s_gs.visible_obbs, *obb);
+    }
+
+    if((mask & CULL_LIGHT) && (vis || !(ent->flags & ENTITY_FLAG_MOVABLE))) {
+
+        vec_pentity_push(&s_gs.light_visible, ent);
+    }
+}
+
 static void g_clear_map_state(void)
 {
     if(s_gs.map) {
@@ -645,6 +690,7 @@ static void g_clear_map_state(void)
         G_Resource_Shutdown();
         G_Harvester_Shutdown();
         G_ClearPath_Shutdown();
+        G_Cull_Shutdown();
         G_Pos_Shutdown();
         G_Fog_Shutdown();
         s_gs.map = NULL;
@@ -700,7 +746,7 @@ static void g_change_simstate(void)
     if(s_gs.ss == s_gs.requested_ss)
         return;
 
-    uint32_t curr_tick = SDL_GetTicks();
+    uint32_t curr_tick = Engine_GetTicks();
     if(s_gs.requested_ss == G_RUNNING) {
     
         uint32_t key;
@@ -759,6 +805,7 @@ bool G_Init(void)
     G_Sel_Init();
     G_Sel_Enable();
     G_Timer_Init();
+    G_Resource_InitNames();
     G_StorageSite_Init();
 
     R_PushCmd((struct rcmd){ R_GL_WaterInit, 0 });
@@ -802,6 +849,18 @@ bool G_Init(void)
     });
     assert(status == SS_OKAY);
 
+    status = Settings_Create((struct setting){
+        .name = "pf.video.animation_blending",
+        .val = (struct sval) {
+            .type = ST_TYPE_BOOL,
+            .as_bool = false
+        },
+        .prio = 0,
+        .validate = bool_val_validate,
+        .commit = NULL,
+    });
+    assert(status == SS_OKAY);
+
     status = Settings_Create((struct setting){
         .name = "pf.debug.show_navigation_cost_base",
         .val = (struct sval) {
@@ -944,7 +1003,7 @@ fail_active:
     return false;
 }
 
-bool G_LoadMap(SDL_RWops *stream, bool update_navgrid)
+bool G_LoadMap(SDL_RWops *stream, const char *path, bool update_navgrid)
 {
     PERF_ENTER();
     ASSERT_IN_MAIN_THREAD();
@@ -956,7 +1015,7 @@ bool G_LoadMap(SDL_RWops *stream, bool update_navgrid)
     if(!s_gs.prev_tick_map)
         PERF_RETURN(false);
 
-    s_gs.map = AL_MapFromPFMapStream(stream, update_navgrid);
+    s_gs.map = AL_MapFromPFMapStream(stream, path, update_navgrid);
     if(!s_gs.map)
         PERF_RETURN(false);
 
@@ -999,12 +1058,18 @@ void G_ClearState(void)
 
     kh_clear(entity, s_gs.active);
     kh_clear(entity, s_gs.dynamic);
+    G_Cull_Clear();
     vec_pentity_reset(&s_gs.visible);
     vec_pentity_reset(&s_gs.light_visible);
     vec_obb_reset(&s_gs.visible_obbs);
 
     g_clear_map_state();
 
+    /* No entities refer to the resource IDs anymore, so the next session 
+     * gets all MAX_RESOURCE_TYPES of them. */
+    G_StorageSite_Clear();
+    G_Resource_ClearNames();
+
     g_reset_camera(s_gs.active_cam);
     G_SetActiveCamera(s_gs.active_cam, CAM_MODE_RTS);
 
@@ -1012,6 +1077,7 @@ void G_ClearState(void)
     G_Fog_Enable();
 
     s_gs.factions_allocd = 0;
+    g_update_war_masks();
     s_gs.hide_healthbars = false;
 
     R_PushCmd((struct rcmd) { R_GL_Batch_Reset, 0 });
@@ -1141,8 +1207,9 @@ void G_BakeNavDataForScene(void)
         M_NavCutoutStaticObject(s_gs.map, &obb);
     });
 
-    M_NavUpdatePortals(s_gs.map);
-    M_NavUpdateIslandsField(s_gs.map);
+    /* Only the chunks touched by the cutouts need to be re-baked, so the
+     * rest of the map keeps the navigation data loaded with it */
+    M_NavUpdateDirtyCosts(s_gs.map);
     PERF_RETURN_VOID();
 }
 
@@ -1170,6 +1237,7 @@ void G_Shutdown(void)
     R_PushCmd((struct rcmd){ R_GL_WaterShutdown, 0 });
 
     G_StorageSite_Shutdown();
+    G_Resource_ShutdownNames();
     G_Timer_Shutdown();
     G_Sel_Shutdown();
 
@@ -1206,36 +1274,25 @@ void G_Update(void)
     struct frustum light_frust;
     R_LightFrustum(s_gs.light_pos, pos, dir, &light_frust);
 
-    uint16_t pm = g_player_mask();
-
     uint32_t key;
     struct entity *curr;
     (void)key;
 
     kh_foreach(s_gs.active, key, curr, {
 
-        if(s_gs.ss == G_RUNNING && curr->flags & ENTITY_FLAG_ANIMATED)
-            A_Update(curr);
-
-        bool vis = false;
-        struct obb obb;
-        Entity_CurrentOBB(curr, &obb, false);
-
-        /* Note that there may be some false positives due to using the fast frustum cull. */
-        if(C_FrustumOBBIntersectionFast(&cam_frust, &obb) != VOLUME_INTERSEC_OUTSIDE
-        && (vis = g_ent_visible(pm, curr, &obb))) {
-
-            vec_pentity_push(&s_gs.visible, curr);
-            vec_obb_push(&s_gs.visible_obbs, obb);
-        }
+        if(!(curr->flags & ENTITY_FLAG_ANIMATED))
+            continue;
 
-        if(C_FrustumOBBIntersectionFast(&light_frust, &obb) != VOLUME_INTERSEC_OUTSIDE 
-        && (vis || !(curr->flags & ENTITY_FLAG_MOVABLE))) {
+        if(s_gs.ss == G_RUNNING)
+            A_Update(curr);
 
-            vec_pentity_push(&s_gs.light_visible, curr);
-        }
+        /* The bounds of animated entities change with their pose */
+        G_Cull_Invalidate(curr);
     });
 
+    uint16_t pm = g_player_mask();
+    G_Cull_Update(&cam_frust, &light_frust, g_add_visible, &pm);
+
     G_Sel_Update(s_gs.active_cam, &s_gs.visible, &s_gs.visible_obbs);
     g_set_contextual_cursor();
 
@@ -1363,6 +1420,7 @@ bool G_AddEntity(struct entity *ent, vec3_t pos)
     kh_value(s_gs.active, k) = ent;
 
     G_Pos_Set(ent, pos);
+    G_Cull_AddEntity(ent);
 
     if(ent->flags & ENTITY_FLAG_STORAGE_SITE)
         G_StorageSite_AddEntity(ent);
@@ -1417,6 +1475,7 @@ bool G_RemoveEntity(struct entity *ent)
     G_Harvester_RemoveEntity(ent->uid);
     G_Resource_RemoveEntity(ent);
     G_StorageSite_RemoveEntity(ent);
+    G_Cull_RemoveEntity(ent);
     G_Pos_Delete(ent->uid);
     return true;
 }
@@ -1469,6 +1528,7 @@ bool G_AddFaction(const char *name, vec3_t color)
         s_gs.diplomacy_table[new_fac_id][i] = DIPLOMACY_STATE_PEACE;
     }
 
+    g_update_war_masks();
     return true;
 }
 
@@ -1489,6 +1549,7 @@ bool G_RemoveFaction(int faction_id)
     });
 
     s_gs.factions_allocd &= ~(0x1 << faction_id);
+    g_update_war_masks();
     return true;
 }
 
@@ -1561,6 +1622,7 @@ bool G_SetDiplomacyState(int fac_id_a, int fac_id_b, enum diplomacy_state ds)
 
     s_gs.diplomacy_table[fac_id_a][fac_id_b] = ds;
     s_gs.diplomacy_table[fac_id_b][fac_id_a] = ds;
+    g_update_war_masks();
     return true;
 }
 
@@ -1579,6 +1641,12 @@ bool G_GetDiplomacyState(int fac_id_a, int fac_id_b, enum diplomacy_state *out)
     return true;
 }
 
+uint16_t G_GetEnemyFactions(int faction_id)
+{
+    assert(faction_id >= 0 && faction_id < MAX_FACTIONS);
+    return s_gs.war_masks[faction_id];
+}
+
 void G_SetActiveCamera(struct camera *cam, enum cam_mode mode)
 {
     ASSERT_IN_MAIN_THREAD();
@@ -1746,6 +1814,9 @@ void G_Zombiefy(struct entity *ent)
 
     ent->flags |= ENTITY_FLAG_INVISIBLE;
     ent->flags |= ENTITY_FLAG_ZOMBIE;
+
+    /* The entity is no longer animated */
+    G_Cull_Invalidate(ent);
 }
 
 struct entity *G_EntityForUID(uint32_t uid)
@@ -1787,6 +1858,11 @@ void G_SwapBuffers(void)
     }
     vec_pentity_reset(&s_gs.deleted);
 
+    /* There is no render thread to consume the commands in headless mode */
+    if(Engine_Headless()) {
+        R_ClearWS(&s_gs.ws[sim_idx]);
+    }
+
     assert(queue_size(s_gs.ws[render_idx].commands) == 0);
     R_ClearWS(&s_gs.ws[render_idx]);
     s_gs.curr_ws_idx = render_idx;
@@ -1841,6 +1917,7 @@ void G_UpdateBounds(const struct entity *ent)
 
     G_Building_UpdateBounds(ent);
     G_Resource_UpdateBounds(ent);
+    G_Cull_Invalidate(ent);
 }
 
 bool G_SaveGlobalState(SDL_RWops *stream)
@@ -2001,7 +2078,7 @@ bool G_LoadGlobalState(SDL_RWops *stream)
     CHK_TRUE_RET(attr.type == TYPE_BOOL);
 
     if(attr.val.as_bool) {
-        CHK_TRUE_RET(G_LoadMap(stream, true));
+        CHK_TRUE_RET(G_LoadMap(stream, NULL, true));
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_VEC2);
@@ -2065,6 +2142,7 @@ bool G_LoadGlobalState(SDL_RWops *stream)
         CHK_TRUE_RET(attr.type == TYPE_INT);
         s_gs.diplomacy_table[i][j] = attr.val.as_int;
     }}
+    g_update_war_masks();
 
     CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
     CHK_TRUE_RET(attr.type == TYPE_FLOAT);
@@ -124,6 +124,12 @@ struct gamestate{
      *-------------------------------------------------------------------------
      */
     enum diplomacy_state    diplomacy_table[MAX_FACTIONS][MAX_FACTIONS];
+    /*-------------------------------------------------------------------------
+     * For every faction, the set of allocated factions that it is at war with.
+     * Derived from the 'diplomacy_table' and kept in sync with it.
+     *-------------------------------------------------------------------------
+     */
+    uint16_t                war_masks[MAX_FACTIONS];
     /*-------------------------------------------------------------------------
      * The index indo the 'ws' field, where the rendering commands are stored.
      * The previous frame workspace is owned by the render thread. The render
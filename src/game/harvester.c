@@ -46,7 +46,6 @@
 #include "../lib/public/mpool.h"
 #include "../lib/public/khash.h"
 #include "../lib/public/pf_string.h"
-#include "../lib/public/string_intern.h"
 #include "../lib/public/attr.h"
 
 #include <stddef.h>
@@ -79,9 +78,6 @@ static void  pfree(void *ptr);
 #define krealloc prealloc
 #define kfree    pfree
 
-KHASH_MAP_INIT_STR(int, int)
-KHASH_MAP_INIT_STR(float, float)
-
 VEC_TYPE(name, const char*)
 VEC_IMPL(static, name, const char*)
 
@@ -103,9 +99,9 @@ struct hstate{
     uint32_t    res_uid;
     vec2_t      res_last_pos;
     const char *res_name;         /* borrowed */
-    kh_float_t *gather_speeds;    /* How much of each resource the entity gets each cycle */
-    kh_int_t   *max_carry;        /* The maximum amount of each resource the entity can carry */
-    kh_int_t   *curr_carry;       /* The amount of each resource the entity currently holds */
+    struct res_ftable gather_speeds; /* How much of each resource the entity gets each cycle */
+    struct res_table  max_carry;     /* The maximum amount of each resource the entity can carry */
+    struct res_table  curr_carry;    /* The amount of each resource the entity currently holds */
     vec_name_t  priority;         /* The order in which the harvester will transport resources */
     bool        drop_off_only;
     float       accum;            /* How much we gathered - only integer amounts are taken */ 
@@ -125,7 +121,7 @@ struct hstate{
 
 struct searcharg{
     const struct entity *ent;
-    const char *rname;
+    int rid;
     enum tstrategy strat;
 };
 
@@ -162,8 +158,6 @@ static void on_harvest_anim_finished_source(void *user, void *event);
 /*****************************************************************************/
 
 static mp_buff_t         s_mpool;
-static khash_t(stridx)  *s_stridx;
-static mp_strbuff_t      s_stringpool;
 static khash_t(state)   *s_entity_state_table;
 static const struct map *s_map;
 
@@ -209,22 +203,30 @@ static void pfree(void *ptr)
     mp_buff_free(&s_mpool, ref);
 }
 
+static const char *intern(const char *rname)
+{
+    /* Resource names are interned by the resource module, so the returned 
+     * strings can be compared by address */
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return NULL;
+    return G_Resource_IDName(id);
+}
+
 static int ss_desired(uint32_t uid, const char *rname)
 {
-    if(G_StorageSite_GetUseAlt(uid)) {
-        return G_StorageSite_GetAltDesired(uid, rname);
-    }else{
-        return G_StorageSite_GetDesired(uid, rname);
-    }
+    int rid = G_Resource_NameID(rname);
+    if(rid < 0)
+        return DEFAULT_CAPACITY;
+    return G_StorageSite_GetInUseDesiredByID(uid, rid);
 }
 
 static int ss_capacity(uint32_t uid, const char *rname)
 {
-    if(G_StorageSite_GetUseAlt(uid)) {
-        return G_StorageSite_GetAltCapacity(uid, rname);
-    }else{
-        return G_StorageSite_GetCapacity(uid, rname);
-    }
+    int rid = G_Resource_NameID(rname);
+    if(rid < 0)
+        return DEFAULT_CAPACITY;
+    return G_StorageSite_GetInUseCapacityByID(uid, rid);
 }
 
 static struct hstate *hstate_get(uint32_t uid)
@@ -256,9 +258,6 @@ static void hstate_remove(uint32_t uid)
 static void hstate_destroy(struct hstate *hs)
 {
     vec_name_destroy(&hs->priority);
-    kh_destroy(float, hs->gather_speeds);
-    kh_destroy(int, hs->max_carry);
-    kh_destroy(int, hs->curr_carry);
 }
 
 static bool hstate_init(struct hstate *hs)
@@ -267,15 +266,9 @@ static bool hstate_init(struct hstate *hs)
     if(!vec_name_resize(&hs->priority, sizeof(buff_t) / sizeof(char*)))
         return false;
 
-    hs->gather_speeds = kh_init(float);
-    hs->max_carry = kh_init(int);
-    hs->curr_carry = kh_init(int);
-
-    if(!hs->gather_speeds || !hs->max_carry || !hs->curr_carry) {
-
-        hstate_destroy(hs);
-        return false;
-    }
+    res_clear(&hs->gather_speeds);
+    res_clear(&hs->max_carry);
+    res_clear(&hs->curr_carry);
 
     hs->ss_uid = UID_NONE;
     hs->res_uid = UID_NONE;
@@ -291,75 +284,43 @@ static bool hstate_init(struct hstate *hs)
     return true;
 }
 
-static bool hstate_set_key_int(khash_t(int) *table, const char *name, int val)
+static bool hstate_set_key_int(struct res_table *table, const char *name, int val)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_Resource_NameID(name);
+    if(id < 0)
         return false;
 
-    khiter_t k = kh_get(int, table, key);
-    if(k != kh_end(table)) {
-        kh_value(table, k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(int, table, key, &status);
-    if(status == -1) {
-        return false;
-    }
-
-    assert(status == 1);
-    kh_value(table, k) = val;
+    res_set(table, id, val);
     return true;
 }
 
-static bool hstate_get_key_int(khash_t(int) *table, const char *name, int *out)
+static bool hstate_get_key_int(const struct res_table *table, const char *name, int *out)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_Resource_NameID(name);
+    if(id < 0 || !res_exists(table, id))
         return false;
 
-    khiter_t k = kh_get(int, table, key);
-    if(k == kh_end(table))
-        return false;
-    *out = kh_value(table, k);
+    *out = table->vals[id];
     return true;
 }
 
-static bool hstate_set_key_float(khash_t(float) *table, const char *name, float val)
+static bool hstate_set_key_float(struct res_ftable *table, const char *name, float val)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_Resource_NameID(name);
+    if(id < 0)
         return false;
 
-    khiter_t k = kh_get(float, table, key);
-    if(k != kh_end(table)) {
-        kh_value(table, k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(float, table, key, &status);
-    if(status == -1) {
-        return false;
-    }
-
-    assert(status == 1);
-    kh_value(table, k) = val;
+    res_set(table, id, val);
     return true;
 }
 
-static bool hstate_get_key_float(khash_t(float) *table, const char *name, float *out)
+static bool hstate_get_key_float(const struct res_ftable *table, const char *name, float *out)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
+    int id = G_Resource_NameID(name);
+    if(id < 0 || !res_exists(table, id))
         return false;
 
-    khiter_t k = kh_get(float, table, key);
-    if(k == kh_end(table))
-        return false;
-    *out = kh_value(table, k);
+    *out = table->vals[id];
     return true;
 }
 
@@ -403,21 +364,16 @@ static void hstate_insert_prio(struct hstate *hs, const char *name)
     }
 }
 
+/* The storage site index only yields the sites of the harvester's faction 
+ * which have a non-zero capacity for the resource */
+
 static bool valid_storage_site_dropoff(const struct entity *curr, void *arg)
 {
     struct searcharg *sarg = arg;
-    struct hstate *hs = hstate_get(sarg->ent->uid);
-
-    if(!(curr->flags & ENTITY_FLAG_STORAGE_SITE))
-        return false;
-    if(sarg->ent->faction_id != curr->faction_id)
-        return false;
 
-    int stored = G_StorageSite_GetCurr(curr->uid, sarg->rname);
-    int cap = ss_capacity(curr->uid, sarg->rname);
+    int stored = G_StorageSite_GetCurrByID(curr->uid, sarg->rid);
+    int cap = G_StorageSite_GetInUseCapacityByID(curr->uid, sarg->rid);
 
-    if(cap == 0)
-        return false;
     if(stored == cap)
         return false;
 
@@ -427,63 +383,57 @@ static bool valid_storage_site_dropoff(const struct entity *curr, void *arg)
 static bool valid_storage_site_source(const struct entity *curr, void *arg)
 {
     struct searcharg *sarg = arg;
-    struct hstate *hs = hstate_get(sarg->ent->uid);
 
-    if(!(curr->flags & ENTITY_FLAG_STORAGE_SITE))
-        return false;
-    if(sarg->ent->faction_id != curr->faction_id)
-        return false;
     if(curr == sarg->ent)
         return false;
 
-    int stored = G_StorageSite_GetCurr(curr->uid, sarg->rname);
-    int cap = ss_capacity(curr->uid, sarg->rname);
-    int desired = ss_desired(curr->uid, sarg->rname);
+    int stored = G_StorageSite_GetCurrByID(curr->uid, sarg->rid);
+    int desired = G_StorageSite_GetInUseDesiredByID(curr->uid, sarg->rid);
 
     if(sarg->strat == TRANSPORT_STRATEGY_EXCESS && (desired >= stored))
         return false;
-    if(cap == 0)
-        return false;
     if(stored == 0)
         return false;
 
     return true;
 }
 
-static bool valid_resource(const struct entity *curr, void *arg)
-{
-    const char *name = arg;
-    if(!(curr->flags & ENTITY_FLAG_RESOURCE))
-        return false;
-    if(strcmp(name, G_Resource_GetName(curr->uid)))
-        return false;
-    return true;
-}
-
 struct entity *nearest_storage_site_dropoff(const struct entity *ent, const char *rname)
 {
+    int rid = rname ? G_Resource_NameID(rname) : -1;
+    if(rid < 0)
+        return NULL;
+
     vec2_t pos = G_Pos_GetXZ(ent->uid);
-    struct searcharg arg = (struct searcharg){ent, rname};
-    return G_Pos_NearestWithPred(pos, valid_storage_site_dropoff, (void*)&arg, 0.0f);
+    struct searcharg arg = (struct searcharg){ent, rid};
+    return G_StorageSite_Nearest(pos, ent->faction_id, rid, valid_storage_site_dropoff, (void*)&arg);
 }
 
 struct entity *nearest_storage_site_source(const struct entity *ent, const char *rname, enum tstrategy strat)
 {
+    int rid = rname ? G_Resource_NameID(rname) : -1;
+    if(rid < 0)
+        return NULL;
+
     vec2_t pos = G_Pos_GetXZ(ent->uid);
-    struct searcharg arg = (struct searcharg){ent, rname, strat};
-    struct entity *ret = G_Pos_NearestWithPred(pos, valid_storage_site_source, (void*)&arg, 0.0f);
+    struct searcharg arg = (struct searcharg){ent, rid, strat};
+    struct entity *ret = G_StorageSite_Nearest(pos, ent->faction_id, rid, valid_storage_site_source, (void*)&arg);
 
     if(!ret && (strat == TRANSPORT_STRATEGY_EXCESS)) {
-        arg = (struct searcharg){ent, rname, TRANSPORT_STRATEGY_NEAREST};
-        ret = G_Pos_NearestWithPred(pos, valid_storage_site_source, (void*)&arg, 0.0f);
+        arg = (struct searcharg){ent, rid, TRANSPORT_STRATEGY_NEAREST};
+        ret = G_StorageSite_Nearest(pos, ent->faction_id, rid, valid_storage_site_source, (void*)&arg);
     }
     return ret;
 }
 
 struct entity *nearest_resource(const struct entity *ent, const char *name)
 {
+    int rid = G_Resource_NameID(name);
+    if(rid < 0)
+        return NULL;
+
     vec2_t pos = G_Pos_GetXZ(ent->uid);
-    return G_Pos_NearestWithPred(pos, valid_resource, (void*)name, REACQUIRE_RADIUS);
+    return G_Resource_Nearest(pos, rid, REACQUIRE_RADIUS);
 }
 
 static void finish_harvesting(struct hstate *hs, uint32_t uid)
@@ -505,12 +455,12 @@ static void finish_harvesting(struct hstate *hs, uint32_t uid)
 
 static const char *carried_resource_name(struct hstate *hs)
 {
-    const char *key;
+    int id;
     int curr;
 
-    kh_foreach(hs->curr_carry, key, curr, {
+    res_foreach(&hs->curr_carry, id, curr, {
         if(curr > 0)
-            return key;
+            return G_Resource_IDName(id);
     });
     return NULL;
 }
@@ -576,8 +526,10 @@ static struct entity *target_resource(struct hstate *hs, const char *rname)
         resource = NULL;
     }
     if(!resource) {
-        resource = G_Pos_NearestWithPred(hs->res_last_pos, valid_resource, 
-            (void*)rname, REACQUIRE_RADIUS);
+        int rid = G_Resource_NameID(rname);
+        if(rid >= 0) {
+            resource = G_Resource_Nearest(hs->res_last_pos, rid, REACQUIRE_RADIUS);
+        }
     }
     return resource;
 }
@@ -1167,7 +1119,7 @@ static const char *transport_resource(struct hstate *hs, struct entity *target)
 static bool harvester_can_gather(struct hstate *hs, const char *rname)
 {
     float speed = 0.0f;
-    hstate_get_key_float(hs->gather_speeds, rname, &speed);
+    hstate_get_key_float(&hs->gather_speeds, rname, &speed);
     return (speed > 0.0f);
 }
 
@@ -1353,8 +1305,12 @@ static bool harvester_transport_from_resources(struct entity *harvester, struct
     const char *rname = transport_resource(hs, storage);
     assert(rname);
 
+    int rid = G_Resource_NameID(rname);
+    if(rid < 0)
+        return false;
+
     vec2_t pos = G_Pos_GetXZ(harvester->uid);
-    struct entity *resource = G_Pos_NearestWithPred(pos, valid_resource, (void*)rname, 0);
+    struct entity *resource = G_Resource_Nearest(pos, rid, 0.0f);
     if(!resource)
         return false;
 
@@ -1393,15 +1349,11 @@ bool G_Harvester_Init(const struct map *map)
         goto fail_mpool; 
     if(!(s_entity_state_table = kh_init(state)))
         goto fail_table;
-    if(!si_init(&s_stringpool, &s_stridx, 512))
-        goto fail_strintern;
 
     s_map = map;
     E_Global_Register(SDL_MOUSEBUTTONDOWN, on_mousedown, NULL, G_RUNNING);
     return true;
 
-fail_strintern:
-    kh_destroy(state, s_entity_state_table);
 fail_table:
     mp_buff_destroy(&s_mpool);
 fail_mpool:
@@ -1413,7 +1365,6 @@ void G_Harvester_Shutdown(void)
     s_map = NULL;
     E_Global_Unregister(SDL_MOUSEBUTTONDOWN, on_mousedown);
 
-    si_shutdown(&s_stringpool, s_stridx);
     kh_destroy(state, s_entity_state_table);
     mp_buff_destroy(&s_mpool);
 }
@@ -1443,7 +1394,7 @@ bool G_Harvester_SetGatherSpeed(uint32_t uid, const char *rname, float speed)
 {
     struct hstate *hs = hstate_get(uid);
     assert(hs);
-    return hstate_set_key_float(hs->gather_speeds, rname, speed);
+    return hstate_set_key_float(&hs->gather_speeds, rname, speed);
 }
 
 float G_Harvester_GetGatherSpeed(uint32_t uid, const char *rname)
@@ -1452,7 +1403,7 @@ float G_Harvester_GetGatherSpeed(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    hstate_get_key_float(hs->gather_speeds, rname, &ret);
+    hstate_get_key_float(&hs->gather_speeds, rname, &ret);
     return ret;
 }
 
@@ -1461,7 +1412,7 @@ bool G_Harvester_SetMaxCarry(uint32_t uid, const char *rname, int max)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
+    const char *key = intern(rname);
     if(!key)
         return false;
 
@@ -1470,7 +1421,7 @@ bool G_Harvester_SetMaxCarry(uint32_t uid, const char *rname, int max)
     }else{
         hstate_insert_prio(hs, key);
     }
-    return hstate_set_key_int(hs->max_carry, rname, max);
+    return hstate_set_key_int(&hs->max_carry, rname, max);
 }
 
 int G_Harvester_GetMaxCarry(uint32_t uid, const char *rname)
@@ -1479,7 +1430,7 @@ int G_Harvester_GetMaxCarry(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    hstate_get_key_int(hs->max_carry, rname, &ret);
+    hstate_get_key_int(&hs->max_carry, rname, &ret);
     return ret;
 }
 
@@ -1487,7 +1438,7 @@ bool G_Harvester_SetCurrCarry(uint32_t uid, const char *rname, int curr)
 {
     struct hstate *hs = hstate_get(uid);
     assert(hs);
-    return hstate_set_key_int(hs->curr_carry, rname, curr);
+    return hstate_set_key_int(&hs->curr_carry, rname, curr);
 }
 
 int G_Harvester_GetCurrCarry(uint32_t uid, const char *rname)
@@ -1496,7 +1447,7 @@ int G_Harvester_GetCurrCarry(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    hstate_get_key_int(hs->curr_carry, rname, &ret);
+    hstate_get_key_int(&hs->curr_carry, rname, &ret);
     return ret;
 }
 
@@ -1519,7 +1470,7 @@ bool G_Harvester_IncreaseTransportPrio(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
+    const char *key = intern(rname);
     if(!key)
         return false;
 
@@ -1541,7 +1492,7 @@ bool G_Harvester_DecreaseTransportPrio(uint32_t uid, const char *rname)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
+    const char *key = intern(rname);
     if(!key)
         return false;
 
@@ -1574,11 +1525,11 @@ int G_Harvester_GetCurrTotalCarry(uint32_t uid)
     struct hstate *hs = hstate_get(uid);
     assert(hs);
 
-    const char *key;
-    (void)key;
+    int id;
+    (void)id;
     int curr;
 
-    kh_foreach(hs->curr_carry, key, curr, {
+    res_foreach(&hs->curr_carry, id, curr, {
         ret += curr;
     });
 
@@ -1918,16 +1869,16 @@ bool G_Harvester_SaveState(struct SDL_RWops *stream)
 
         struct attr num_speeds = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.gather_speeds)
+            .val.as_int = res_size(&curr.gather_speeds)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_speeds, "num_speeds"));
 
-        const char *speed_key;
+        int speed_id;
         float speed_amount;
-        kh_foreach(curr.gather_speeds, speed_key, speed_amount, {
+        res_foreach(&curr.gather_speeds, speed_id, speed_amount, {
         
             struct attr speed_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(speed_key_attr.val.as_string, speed_key, sizeof(speed_key_attr.val.as_string));
+            pf_strlcpy(speed_key_attr.val.as_string, G_Resource_IDName(speed_id), sizeof(speed_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &speed_key_attr, "speed_key"));
 
             struct attr speed_amount_attr = (struct attr){
@@ -1939,16 +1890,16 @@ bool G_Harvester_SaveState(struct SDL_RWops *stream)
 
         struct attr num_max = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.max_carry)
+            .val.as_int = res_size(&curr.max_carry)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_max, "num_max"));
 
-        const char *max_key;
+        int max_id;
         int max_amount;
-        kh_foreach(curr.max_carry, max_key, max_amount, {
+        res_foreach(&curr.max_carry, max_id, max_amount, {
         
             struct attr max_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(max_key_attr.val.as_string, max_key, sizeof(max_key_attr.val.as_string));
+            pf_strlcpy(max_key_attr.val.as_string, G_Resource_IDName(max_id), sizeof(max_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &max_key_attr, "max_key"));
 
             struct attr max_amount_attr = (struct attr){
@@ -1960,16 +1911,16 @@ bool G_Harvester_SaveState(struct SDL_RWops *stream)
 
         struct attr num_carry = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.curr_carry)
+            .val.as_int = res_size(&curr.curr_carry)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_carry, "num_carry"));
 
-        const char *curr_key;
+        int curr_id;
         int curr_amount;
-        kh_foreach(curr.curr_carry, curr_key, curr_amount, {
+        res_foreach(&curr.curr_carry, curr_id, curr_amount, {
         
             struct attr curr_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(curr_key_attr.val.as_string, curr_key, sizeof(curr_key_attr.val.as_string));
+            pf_strlcpy(curr_key_attr.val.as_string, G_Resource_IDName(curr_id), sizeof(curr_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &curr_key_attr, "curr_key"));
 
             struct attr curr_amount_attr = (struct attr){
@@ -2130,7 +2081,7 @@ bool G_Harvester_LoadState(struct SDL_RWops *stream)
         
             CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
             CHK_TRUE_RET(attr.type == TYPE_STRING);
-            const char *key = si_intern(attr.val.as_string, &s_stringpool, s_stridx);
+            const char *key = intern(attr.val.as_string);
             hs->res_name = key;
         }
 
@@ -2199,7 +2150,7 @@ bool G_Harvester_LoadState(struct SDL_RWops *stream)
             CHK_TRUE_RET(Attr_Parse(stream, &keyattr, true));
             CHK_TRUE_RET(keyattr.type == TYPE_STRING);
 
-            const char *key = si_intern(keyattr.val.as_string, &s_stringpool, s_stridx);
+            const char *key = intern(keyattr.val.as_string);
             vec_name_push(&hs->priority, key);
         }
 
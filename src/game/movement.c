@@ -58,6 +58,7 @@
 #include "../lib/public/attr.h"
 #include "../lib/public/pf_string.h"
 #include "../lib/public/stalloc.h"
+#include "../lib/public/comp_store.h"
 #include "../anim/public/anim.h"
 
 #include <assert.h>
@@ -88,8 +89,11 @@
             goto _label;                \
     }while(0)
 
-#define VEL_HIST_LEN (14)
-#define MAX_CP_TASKS (64)
+#define VEL_HIST_LEN   (14)
+#define MAX_MOVE_TASKS (64)
+/* The number of ticks between the updates of the maps guiding the 
+ * units seeking enemies */
+#define THREAT_TICKS   (10)
 
 enum arrival_state{
     /* Entity is moving towards the flock's destination point */
@@ -135,36 +139,88 @@ struct flock{
     dest_id_t        dest_id;
 };
 
-struct cp_work_in{
-    struct       cp_ent ent;
-    uint32_t     ent_uid;
-    vec2_t       ent_des_v;
-    vec_cp_ent_t dyn_neighbs;
-    vec_cp_ent_t stat_neighbs;
-    bool         save_debug;
+/* A read-only copy of the movement-related state of a single entity, taken
+ * on the main thread at the start of the tick. The steering of all entities 
+ * is computed in parallel using only this data. */
+struct ent_snapshot{
+    uint32_t uid;
+    vec2_t   xz_pos;
+    vec2_t   velocity;
+    float    radius;
+    bool     still;
 };
 
-struct cp_work_out{
+struct flock_snapshot{
+    vec2_t     target_xz; 
+    dest_id_t  dest_id;
+    size_t     nmembers;
+    /* Indices into the entity snapshot array */
+    size_t    *members;
+};
+
+KHASH_SET_INIT_INT64(field)
+
+struct move_work_in{
+    size_t             snap_idx;
+    int                flock_idx;
+    int                faction_id;
+    enum arrival_state state;
+    float              max_speed;
+    /* The result of the enemy query, which is made for all the entities 
+     * at once before the tasks are submitted */
+    bool               has_enemy;
+    vec2_t             enemy_xz;
+    bool               save_debug;
+    /* Filled in by the task, from the navigation fields */
+    vec2_t             vdes;
+    bool               dest_los;
+    bool               enemy_los;
+};
+
+struct move_work_out{
     uint32_t ent_uid;
     vec2_t   ent_vel;
+    vec2_t   vdes;
+    /* The desired velocity could not be sampled from the existing fields. 
+     * The steering is then computed on the main thread, after the tasks. */
+    bool     deferred;
 };
 
-struct cp_task_arg{
+struct move_task_arg{
     size_t begin_idx;
     size_t end_idx;
+    int    task_idx;
 };
 
-struct cp_work{
-    struct memstack     mem;
-    struct cp_work_in  *in;
-    struct cp_work_out *out;
-    size_t              nwork;
-    size_t              ntasks;
-    uint32_t            tids[MAX_CP_TASKS];
-    struct future       futures[MAX_CP_TASKS];
+struct move_work{
+    struct memstack        mem;
+    /* The snapshot of all dynamic entities, bucketed into a uniform grid 
+     * for the neighbour queries. */
+    struct ent_snapshot   *snap;
+    size_t                 nsnap;
+    size_t                *cell_begin;
+    size_t                *cell_ents;
+    vec2_t                 grid_min;
+    int                    grid_width;
+    int                    grid_height;
+    struct flock_snapshot *flocks;
+    struct move_work_in   *in;
+    struct move_work_out  *out;
+    size_t                 nwork;
+    /* The (flock or faction, chunk) keys of the fields already ensured 
+     * during this tick */
+    khash_t(field)        *ensured;
+    size_t                 ntasks;
+    uint32_t               tids[MAX_MOVE_TASKS];
+    struct future          futures[MAX_MOVE_TASKS];
+    /* Per-task buffers for gathering the ClearPath neighbours */
+    vec_cp_ent_t           dyn_scratch[MAX_MOVE_TASKS];
+    vec_cp_ent_t           stat_scratch[MAX_MOVE_TASKS];
 };
 
-KHASH_MAP_INIT_INT(state, struct movestate)
+COMP_STORE_TYPE(state, struct movestate)
+COMP_STORE_PROTOTYPES(static, state, struct movestate)
+COMP_STORE_IMPL(static, state, struct movestate)
 
 VEC_TYPE(flock, struct flock)
 VEC_IMPL(static inline, flock, struct flock)
@@ -184,6 +240,11 @@ VEC_IMPL(static inline, flock, struct flock)
 #define COLLISION_MAX_SEE_AHEAD         (10.0f)
 #define WAIT_TICKS                      (60)
 
+/* The largest radius of the neighbour queries made on the snapshot (the 
+ * separation and ClearPath queries). A query spans at most 2 * radius, so 
+ * each one touches at most 3x3 cells. */
+#define SNAPSHOT_CELL_SIZE              (MAX(SEPARATION_NEIGHB_RADIUS, CLEARPATH_NEIGHBOUR_RADIUS))
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
@@ -194,13 +255,14 @@ static bool                    s_move_on_lclick = false;
 
 static vec_pentity_t           s_move_markers;
 static vec_flock_t             s_flocks;
-static khash_t(state)         *s_entity_state_table;
+static cs(state)               s_entity_states;
 
 /* Store the most recently issued move command location for debug rendering */
 static bool                    s_last_cmd_dest_valid = false;
 static dest_id_t               s_last_cmd_dest;
 
-static struct cp_work          s_cp_work;
+static struct move_work        s_move_work;
+static unsigned                s_threat_ticks;
 
 static const char *s_state_str[] = {
     [STATE_MOVING]          = STR(STATE_MOVING),
@@ -215,14 +277,11 @@ static const char *s_state_str[] = {
 /*****************************************************************************/
 
 /* The returned pointer is guaranteed to be valid to write to for
- * so long as we don't add anything to the table. At that point, there
+ * so long as we don't add anything to the store. At that point, there
  * is a case that a 'realloc' might take place. */
 static struct movestate *movestate_get(const struct entity *ent)
 {
-    khiter_t k = kh_get(state, s_entity_state_table, ent->uid);
-    if(k == kh_end(s_entity_state_table))
-        return NULL;
-    return &kh_value(s_entity_state_table, k);
+    return cs_state_get(&s_entity_states, ent->uid);
 }
 
 static void flock_try_remove(struct flock *flock, const struct entity *ent)
@@ -715,21 +774,111 @@ static vec2_t ent_desired_velocity(const struct entity *ent)
     }
 }
 
+static const struct ent_snapshot *work_snap(const struct move_work_in *in)
+{
+    return &s_move_work.snap[in->snap_idx];
+}
+
+static int snapshot_cell_clamp(float coord, float min, int dim)
+{
+    int ret = (coord - min) / SNAPSHOT_CELL_SIZE;
+    return MAX(0, MIN(ret, dim - 1));
+}
+
+/* Must be called from the main thread before any neighbour queries, after all 
+ * the entities have been added to the snapshot. */
+static void snapshot_bucket(void)
+{
+    if(s_move_work.nsnap == 0)
+        return;
+
+    vec2_t min = s_move_work.snap[0].xz_pos;
+    vec2_t max = s_move_work.snap[0].xz_pos;
+
+    for(int i = 1; i < s_move_work.nsnap; i++) {
+        vec2_t pos = s_move_work.snap[i].xz_pos;
+        min = (vec2_t){MIN(min.x, pos.x), MIN(min.z, pos.z)};
+        max = (vec2_t){MAX(max.x, pos.x), MAX(max.z, pos.z)};
+    }
+
+    s_move_work.grid_min = min;
+    s_move_work.grid_width = (max.x - min.x) / SNAPSHOT_CELL_SIZE + 1;
+    s_move_work.grid_height = (max.z - min.z) / SNAPSHOT_CELL_SIZE + 1;
+
+    size_t ncells = s_move_work.grid_width * s_move_work.grid_height;
+    s_move_work.cell_begin = stalloc(&s_move_work.mem, (ncells + 1) * sizeof(size_t));
+    s_move_work.cell_ents = stalloc(&s_move_work.mem, s_move_work.nsnap * sizeof(size_t));
+    size_t *cell_cursor = stalloc(&s_move_work.mem, ncells * sizeof(size_t));
+    size_t *ent_cell = stalloc(&s_move_work.mem, s_move_work.nsnap * sizeof(size_t));
+    memset(s_move_work.cell_begin, 0, (ncells + 1) * sizeof(size_t));
+
+    for(int i = 0; i < s_move_work.nsnap; i++) {
+
+        vec2_t pos = s_move_work.snap[i].xz_pos;
+        int cx = snapshot_cell_clamp(pos.x, min.x, s_move_work.grid_width);
+        int cz = snapshot_cell_clamp(pos.z, min.z, s_move_work.grid_height);
+
+        ent_cell[i] = cz * s_move_work.grid_width + cx;
+        s_move_work.cell_begin[ent_cell[i] + 1]++;
+    }
+
+    for(int i = 0; i < ncells; i++) {
+        s_move_work.cell_begin[i + 1] += s_move_work.cell_begin[i];
+    }
+    memcpy(cell_cursor, s_move_work.cell_begin, ncells * sizeof(size_t));
+
+    for(int i = 0; i < s_move_work.nsnap; i++) {
+        s_move_work.cell_ents[cell_cursor[ent_cell[i]]++] = i;
+    }
+}
+
+/* Thread-safe equivalent of 'G_Pos_EntsInCircle' which only considers the 
+ * dynamic entities in the snapshot. The snapshot indices are written to 'out'. */
+static size_t snapshot_ents_in_circle(vec2_t xz_point, float range, size_t *out, size_t maxout)
+{
+    if(s_move_work.nsnap == 0)
+        return 0;
+
+    vec2_t min = s_move_work.grid_min;
+    int minx = snapshot_cell_clamp(xz_point.x - range, min.x, s_move_work.grid_width);
+    int maxx = snapshot_cell_clamp(xz_point.x + range, min.x, s_move_work.grid_width);
+    int minz = snapshot_cell_clamp(xz_point.z - range, min.z, s_move_work.grid_height);
+    int maxz = snapshot_cell_clamp(xz_point.z + range, min.z, s_move_work.grid_height);
+    size_t ret = 0;
+
+    for(int cz = minz; cz <= maxz; cz++) {
+    for(int cx = minx; cx <= maxx; cx++) {
+
+        int cell = cz * s_move_work.grid_width + cx;
+        for(size_t i = s_move_work.cell_begin[cell]; i < s_move_work.cell_begin[cell + 1]; i++) {
+
+            size_t idx = s_move_work.cell_ents[i];
+            vec2_t diff;
+            PFM_Vec2_Sub(&s_move_work.snap[idx].xz_pos, &xz_point, &diff);
+
+            if(PFM_Vec2_Len(&diff) > range)
+                continue;
+            if(ret == maxout)
+                return ret;
+            out[ret++] = idx;
+        }
+    }}
+    return ret;
+}
+
 /* Seek behaviour makes the entity target and approach a particular destination point.
  */
-static vec2_t seek_force(const struct entity *ent, vec2_t target_xz)
+static vec2_t seek_force(const struct move_work_in *in, vec2_t target_xz)
 {
     vec2_t ret, desired_velocity;
-    vec2_t pos_xz = G_Pos_GetXZ(ent->uid);
+    vec2_t pos_xz = work_snap(in)->xz_pos;
+    vec2_t vel = work_snap(in)->velocity;
 
     PFM_Vec2_Sub(&target_xz, &pos_xz, &desired_velocity);
     PFM_Vec2_Normal(&desired_velocity, &desired_velocity);
-    PFM_Vec2_Scale(&desired_velocity, ent->max_speed / MOVE_TICK_RES, &desired_velocity);
+    PFM_Vec2_Scale(&desired_velocity, in->max_speed / MOVE_TICK_RES, &desired_velocity);
 
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    PFM_Vec2_Sub(&desired_velocity, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&desired_velocity, &vel, &ret);
     return ret;
 }
 
@@ -739,21 +888,21 @@ static vec2_t seek_force(const struct entity *ent, vec2_t target_xz)
  * When not within line of sight of the destination, this will steer the entity along the 
  * flow field.
  */
-static vec2_t arrive_force_point(const struct entity *ent, dest_id_t dest_id, vec2_t target_xz)
+static vec2_t arrive_force_point(const struct move_work_in *in, const struct flock_snapshot *flock)
 {
     vec2_t ret, desired_velocity;
-    vec2_t pos_xz = G_Pos_GetXZ(ent->uid);
+    vec2_t pos_xz = work_snap(in)->xz_pos;
+    vec2_t vel = work_snap(in)->velocity;
+    vec2_t vdes = in->vdes;
+    vec2_t target_xz = flock->target_xz;
     float distance;
 
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    if(M_NavHasDestLOS(s_map, dest_id, pos_xz)) {
+    if(in->dest_los) {
 
         PFM_Vec2_Sub(&target_xz, &pos_xz, &desired_velocity);
         distance = PFM_Vec2_Len(&desired_velocity);
         PFM_Vec2_Normal(&desired_velocity, &desired_velocity);
-        PFM_Vec2_Scale(&desired_velocity, ent->max_speed / MOVE_TICK_RES, &desired_velocity);
+        PFM_Vec2_Scale(&desired_velocity, in->max_speed / MOVE_TICK_RES, &desired_velocity);
 
         if(distance < ARRIVE_SLOWING_RADIUS) {
             PFM_Vec2_Scale(&desired_velocity, distance / ARRIVE_SLOWING_RADIUS, &desired_velocity);
@@ -761,117 +910,102 @@ static vec2_t arrive_force_point(const struct entity *ent, dest_id_t dest_id, ve
 
     }else{
 
-        PFM_Vec2_Scale(&ms->vdes, ent->max_speed / MOVE_TICK_RES, &desired_velocity);
+        PFM_Vec2_Scale(&vdes, in->max_speed / MOVE_TICK_RES, &desired_velocity);
     }
 
-    PFM_Vec2_Sub(&desired_velocity, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&desired_velocity, &vel, &ret);
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
-static vec2_t arrive_force_enemies(const struct entity *ent)
+static vec2_t arrive_force_enemies(const struct move_work_in *in)
 {
     vec2_t ret, desired_velocity;
-    vec2_t pos_xz = G_Pos_GetXZ(ent->uid);
+    vec2_t pos_xz = work_snap(in)->xz_pos;
+    vec2_t vel = work_snap(in)->velocity;
+    vec2_t vdes = in->vdes;
+    vec2_t enemy_xz = in->enemy_xz;
     float distance;
 
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    struct entity *enemy = G_Combat_ClosestEligibleEnemy(ent);
-    if(!enemy) {
+    if(!in->has_enemy) {
 
-        PFM_Vec2_Scale(&ms->vdes, ent->max_speed / MOVE_TICK_RES, &desired_velocity);
-        PFM_Vec2_Sub(&desired_velocity, &ms->velocity, &ret);
+        PFM_Vec2_Scale(&vdes, in->max_speed / MOVE_TICK_RES, &desired_velocity);
+        PFM_Vec2_Sub(&desired_velocity, &vel, &ret);
         vec2_truncate(&ret, MAX_FORCE);
         return ret;
     }
 
-    vec2_t enemy_pos = G_Pos_GetXZ(enemy->uid);
-    if(M_NavHasEntityLOS(s_map, pos_xz, enemy)) {
+    if(in->enemy_los) {
     
-        PFM_Vec2_Sub(&enemy_pos, &pos_xz, &desired_velocity);
+        PFM_Vec2_Sub(&enemy_xz, &pos_xz, &desired_velocity);
         distance = PFM_Vec2_Len(&desired_velocity);
         PFM_Vec2_Normal(&desired_velocity, &desired_velocity);
-        PFM_Vec2_Scale(&desired_velocity, ent->max_speed / MOVE_TICK_RES, &desired_velocity);
+        PFM_Vec2_Scale(&desired_velocity, in->max_speed / MOVE_TICK_RES, &desired_velocity);
 
         if(distance < ARRIVE_SLOWING_RADIUS) {
             PFM_Vec2_Scale(&desired_velocity, distance / ARRIVE_SLOWING_RADIUS, &desired_velocity);
         }
     }else{
-        PFM_Vec2_Scale(&ms->vdes, ent->max_speed / MOVE_TICK_RES, &desired_velocity);
+        PFM_Vec2_Scale(&vdes, in->max_speed / MOVE_TICK_RES, &desired_velocity);
     }
 
-    PFM_Vec2_Sub(&desired_velocity, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&desired_velocity, &vel, &ret);
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
 /* Alignment is a behaviour that causes a particular agent to line up with agents close by.
  */
-static vec2_t alignment_force(const struct entity *ent, const struct flock *flock)
+static vec2_t alignment_force(const struct move_work_in *in, const struct flock_snapshot *flock)
 {
     vec2_t ret = (vec2_t){0.0f};
     size_t neighbour_count = 0;
+    vec2_t pos_xz = work_snap(in)->xz_pos;
+    vec2_t vel = work_snap(in)->velocity;
 
-    uint32_t key;
-    struct entity *curr;
-    (void)key;
-
-    kh_foreach(flock->ents, key, curr, {
+    for(int i = 0; i < flock->nmembers; i++) {
 
-        if(curr == ent)
+        if(flock->members[i] == in->snap_idx)
             continue;
 
         vec2_t diff;
-        vec2_t ent_xz_pos = G_Pos_GetXZ(ent->uid);
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
+        vec2_t curr_xz_pos = s_move_work.snap[flock->members[i]].xz_pos;
 
-        PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
+        PFM_Vec2_Sub(&curr_xz_pos, &pos_xz, &diff);
         if(PFM_Vec2_Len(&diff) < ALIGN_NEIGHBOUR_RADIUS) {
 
-            struct movestate *ms = movestate_get(ent);
-            assert(ms);
-
-            if(PFM_Vec2_Len(&ms->velocity) < EPSILON)
+            if(PFM_Vec2_Len(&vel) < EPSILON)
                 continue; 
 
-            PFM_Vec2_Add(&ret, &ms->velocity, &ret);
+            PFM_Vec2_Add(&ret, &vel, &ret);
             neighbour_count++;
         }
-    });
+    }
 
     if(0 == neighbour_count)
         return (vec2_t){0.0f};
 
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
     PFM_Vec2_Scale(&ret, 1.0f / neighbour_count, &ret);
-    PFM_Vec2_Sub(&ret, &ms->velocity, &ret);
+    PFM_Vec2_Sub(&ret, &vel, &ret);
     vec2_truncate(&ret, MAX_FORCE);
     return ret;
 }
 
 /* Cohesion is a behaviour that causes agents to steer towards the center of mass of nearby agents.
  */
-static vec2_t cohesion_force(const struct entity *ent, const struct flock *flock)
+static vec2_t cohesion_force(const struct move_work_in *in, const struct flock_snapshot *flock)
 {
     vec2_t COM = (vec2_t){0.0f};
     size_t neighbour_count = 0;
-    vec2_t ent_xz_pos = G_Pos_GetXZ(ent->uid);
+    vec2_t ent_xz_pos = work_snap(in)->xz_pos;
 
-    uint32_t key;
-    struct entity *curr;
-    (void)key;
+    for(int i = 0; i < flock->nmembers; i++) {
 
-    kh_foreach(flock->ents, key, curr, {
-
-        if(curr == ent)
+        if(flock->members[i] == in->snap_idx)
             continue;
 
         vec2_t diff;
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
+        vec2_t curr_xz_pos = s_move_work.snap[flock->members[i]].xz_pos;
         PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
 
         float t = (PFM_Vec2_Len(&diff) - COHESION_NEIGHBOUR_RADIUS*0.75) / COHESION_NEIGHBOUR_RADIUS;
@@ -880,7 +1014,7 @@ static vec2_t cohesion_force(const struct entity *ent, const struct flock *flock
         PFM_Vec2_Scale(&curr_xz_pos, scale, &curr_xz_pos);
         PFM_Vec2_Add(&COM, &curr_xz_pos, &COM);
         neighbour_count++;
-    });
+    }
 
     if(0 == neighbour_count)
         return (vec2_t){0.0f};
@@ -894,27 +1028,27 @@ static vec2_t cohesion_force(const struct entity *ent, const struct flock *flock
 
 /* Separation is a behaviour that causes agents to steer away from nearby agents.
  */
-static vec2_t separation_force(const struct entity *ent, float buffer_dist)
+static vec2_t separation_force(const struct move_work_in *in, float buffer_dist)
 {
     vec2_t ret = (vec2_t){0.0f};
-    struct entity *near_ents[128];
-    int num_near = G_Pos_EntsInCircle(G_Pos_GetXZ(ent->uid), 
+    const struct ent_snapshot *snap = work_snap(in);
+    vec2_t pos_xz = snap->xz_pos;
+
+    size_t near_ents[128];
+    size_t num_near = snapshot_ents_in_circle(pos_xz, 
         SEPARATION_NEIGHB_RADIUS, near_ents, ARR_SIZE(near_ents));
 
     for(int i = 0; i < num_near; i++) {
 
-        struct entity *curr = near_ents[i];
-        if(curr == ent)
-            continue;
-        if(!(curr->flags & ENTITY_FLAG_MOVABLE))
+        if(near_ents[i] == in->snap_idx)
             continue;
 
         vec2_t diff;
-        vec2_t ent_xz_pos = G_Pos_GetXZ(ent->uid);
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
+        const struct ent_snapshot *curr = &s_move_work.snap[near_ents[i]];
+        vec2_t curr_xz_pos = curr->xz_pos;
 
-        float radius = ent->selection_radius + curr->selection_radius + buffer_dist;
-        PFM_Vec2_Sub(&curr_xz_pos, &ent_xz_pos, &diff);
+        float radius = snap->radius + curr->radius + buffer_dist;
+        PFM_Vec2_Sub(&curr_xz_pos, &pos_xz, &diff);
 
         /* Exponential decay with y=1 when diff = radius*0.85 
          * Use smooth decay curves in order to curb the 'toggling' or oscillating 
@@ -935,21 +1069,18 @@ static vec2_t separation_force(const struct entity *ent, float buffer_dist)
     return ret;
 }
 
-static vec2_t point_seek_total_force(const struct entity *ent, const struct flock *flock)
+static vec2_t point_seek_total_force(const struct move_work_in *in, const struct flock_snapshot *flock)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    vec2_t arrive = arrive_force_point(ent, flock->dest_id, flock->target_xz);
-    vec2_t cohesion = cohesion_force(ent, flock);
-    vec2_t separation = separation_force(ent, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force_point(in, flock);
+    vec2_t cohesion = cohesion_force(in, flock);
+    vec2_t separation = separation_force(in, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&cohesion,   MOVE_COHESION_FORCE_SCALE, &cohesion);
     PFM_Vec2_Scale(&separation, SEPARATION_FORCE_SCALE,    &separation);
 
     vec2_t ret = (vec2_t){0.0f};
-    assert(!ent_still(ms));
+    assert(!work_snap(in)->still);
 
     PFM_Vec2_Add(&ret, &arrive, &ret);
     PFM_Vec2_Add(&ret, &separation, &ret);
@@ -959,13 +1090,10 @@ static vec2_t point_seek_total_force(const struct entity *ent, const struct floc
     return ret;
 }
 
-static vec2_t enemy_seek_total_force(const struct entity *ent)
+static vec2_t enemy_seek_total_force(const struct move_work_in *in)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    vec2_t arrive = arrive_force_enemies(ent);
-    vec2_t separation = separation_force(ent, SEPARATION_BUFFER_DIST);
+    vec2_t arrive = arrive_force_enemies(in);
+    vec2_t separation = separation_force(in, SEPARATION_BUFFER_DIST);
 
     PFM_Vec2_Scale(&arrive,     MOVE_ARRIVE_FORCE_SCALE,   &arrive);
     PFM_Vec2_Scale(&separation, SEPARATION_FORCE_SCALE,    &separation);
@@ -989,14 +1117,15 @@ static vec2_t new_pos_for_vel(const struct entity *ent, vec2_t velocity)
 
 /* Nullify the components of the force which would guide
  * the entity towards an impassable tile. */
-static void nullify_impass_components(const struct entity *ent, vec2_t *inout_force)
+static void nullify_impass_components(const struct move_work_in *in, vec2_t *inout_force)
 {
     vec2_t nt_dims = N_TileDims();
+    vec2_t pos = work_snap(in)->xz_pos;
 
-    vec2_t left =  (vec2_t){G_Pos_Get(ent->uid).x + nt_dims.x, G_Pos_Get(ent->uid).z};
-    vec2_t right = (vec2_t){G_Pos_Get(ent->uid).x - nt_dims.x, G_Pos_Get(ent->uid).z};
-    vec2_t top =   (vec2_t){G_Pos_Get(ent->uid).x, G_Pos_Get(ent->uid).z + nt_dims.z};
-    vec2_t bot =   (vec2_t){G_Pos_Get(ent->uid).x, G_Pos_Get(ent->uid).z - nt_dims.z};
+    vec2_t left =  (vec2_t){pos.x + nt_dims.x, pos.z};
+    vec2_t right = (vec2_t){pos.x - nt_dims.x, pos.z};
+    vec2_t top =   (vec2_t){pos.x, pos.z + nt_dims.z};
+    vec2_t bot =   (vec2_t){pos.x, pos.z - nt_dims.z};
 
     if((inout_force->x > 0 && !M_NavPositionPathable(s_map, left))
     || (inout_force->x < 0 && !M_NavPositionPathable(s_map, right)))
@@ -1007,46 +1136,42 @@ static void nullify_impass_components(const struct entity *ent, vec2_t *inout_fo
         inout_force->z = 0.0f;
 }
 
-static vec2_t point_seek_vpref(const struct entity *ent, const struct flock *flock)
+static vec2_t point_seek_vpref(const struct move_work_in *in, const struct flock_snapshot *flock)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
     vec2_t steer_force;
     for(int prio = 0; prio < 3; prio++) {
 
         switch(prio) {
-        case 0: steer_force = point_seek_total_force(ent, flock); break;
-        case 1: steer_force = separation_force(ent, SEPARATION_BUFFER_DIST); break;
-        case 2: steer_force = arrive_force_point(ent, flock->dest_id, flock->target_xz); break;
+        case 0: steer_force = point_seek_total_force(in, flock); break;
+        case 1: steer_force = separation_force(in, SEPARATION_BUFFER_DIST); break;
+        case 2: steer_force = arrive_force_point(in, flock); break;
         }
 
-        nullify_impass_components(ent, &steer_force);
+        nullify_impass_components(in, &steer_force);
         if(PFM_Vec2_Len(&steer_force) > MAX_FORCE * 0.01)
             break;
     }
 
     vec2_t accel, new_vel; 
+    vec2_t vel = work_snap(in)->velocity;
     PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &accel);
 
-    PFM_Vec2_Add(&ms->velocity, &accel, &new_vel);
-    vec2_truncate(&new_vel, ent->max_speed / MOVE_TICK_RES);
+    PFM_Vec2_Add(&vel, &accel, &new_vel);
+    vec2_truncate(&new_vel, in->max_speed / MOVE_TICK_RES);
 
     return new_vel;
 }
 
-static vec2_t enemy_seek_vpref(const struct entity *ent)
+static vec2_t enemy_seek_vpref(const struct move_work_in *in)
 {
-    struct movestate *ms = movestate_get(ent);
-    assert(ms);
-
-    vec2_t steer_force = enemy_seek_total_force(ent);
+    vec2_t steer_force = enemy_seek_total_force(in);
 
     vec2_t accel, new_vel; 
+    vec2_t vel = work_snap(in)->velocity;
     PFM_Vec2_Scale(&steer_force, 1.0f / ENTITY_MASS, &accel);
 
-    PFM_Vec2_Add(&ms->velocity, &accel, &new_vel);
-    vec2_truncate(&new_vel, ent->max_speed / MOVE_TICK_RES);
+    PFM_Vec2_Add(&vel, &accel, &new_vel);
+    vec2_truncate(&new_vel, in->max_speed / MOVE_TICK_RES);
 
     return new_vel;
 }
@@ -1238,7 +1363,7 @@ static void entity_update(struct entity *ent, vec2_t new_vel)
     }
 }
 
-static void find_neighbours(const struct entity *ent,
+static void find_neighbours(const struct move_work_in *in,
                             vec_cp_ent_t *out_dyn,
                             vec_cp_ent_t *out_stat)
 {
@@ -1247,35 +1372,28 @@ static void find_neighbours(const struct entity *ent,
      * to be avoided during moving. Here, 'static' entites refer
      * to those entites that are not currently in a 'moving' state,
      * meaning they will not perform collision avoidance maneuvers of
-     * their own. */
+     * their own. All movable entities are present in the snapshot. */
 
-    struct entity *near_ents[512];
-    int num_near = G_Pos_EntsInCircle(G_Pos_GetXZ(ent->uid), 
+    size_t near_ents[512];
+    size_t num_near = snapshot_ents_in_circle(work_snap(in)->xz_pos, 
         CLEARPATH_NEIGHBOUR_RADIUS, near_ents, ARR_SIZE(near_ents));
 
     for(int i = 0; i < num_near; i++) {
-        struct entity *curr = near_ents[i];
-
-        if(curr->uid == ent->uid)
-            continue;
 
-        if(!(curr->flags & ENTITY_FLAG_MOVABLE))
+        if(near_ents[i] == in->snap_idx)
             continue;
 
-        if(curr->selection_radius == 0.0f)
+        const struct ent_snapshot *curr = &s_move_work.snap[near_ents[i]];
+        if(curr->radius == 0.0f)
             continue;
 
-        struct movestate *ms = movestate_get(curr);
-        assert(ms);
-
-        vec2_t curr_xz_pos = G_Pos_GetXZ(curr->uid);
         struct cp_ent newdesc = (struct cp_ent) {
-            .xz_pos = curr_xz_pos,
-            .xz_vel = ms->velocity,
-            .radius = curr->selection_radius
+            .xz_pos = curr->xz_pos,
+            .xz_vel = curr->velocity,
+            .radius = curr->radius
         };
 
-        if(ent_still(ms))
+        if(curr->still)
             vec_cp_ent_push(out_stat, newdesc);
         else
             vec_cp_ent_push(out_dyn, newdesc);
@@ -1312,38 +1430,91 @@ static void disband_empty_flocks(void)
     }
 }
 
-static void *cp_vec_realloc(void *ptr, size_t size)
+/* Look up the desired velocity from the fields ensured by 'move_snapshot'. 
+ * Returns false if the fields must be updated first, which may only be 
+ * done from the main thread. */
+static bool move_sample_vdes(struct move_work_in *in)
 {
-    if(!ptr)
-        return stalloc(&s_cp_work.mem, size);
+    const struct ent_snapshot *snap = work_snap(in);
 
-    void *ret = stalloc(&s_cp_work.mem, size);
-    if(!ret)
-        return NULL;
+    switch(in->state) {
+    case STATE_SEEK_ENEMIES: 
+        return M_NavSampleEnemySeekVelocity(s_map, snap->xz_pos, in->faction_id, &in->vdes);
+    default:
+        assert(in->flock_idx >= 0);
+        return M_NavSamplePointSeekVelocity(s_map, 
+            s_move_work.flocks[in->flock_idx].dest_id, snap->xz_pos, &in->vdes);
+    }
+}
 
-    memcpy(ret, ptr, size / 2);
-    return ret;
+static void move_los_queries(struct move_work_in *in)
+{
+    const struct ent_snapshot *snap = work_snap(in);
+
+    switch(in->state) {
+    case STATE_SEEK_ENEMIES: 
+        if(in->has_enemy)
+            in->enemy_los = M_NavHasLOSBetween(s_map, snap->xz_pos, in->enemy_xz);
+        break;
+    default:
+        assert(in->flock_idx >= 0);
+        in->dest_los = M_NavHasDestLOS(s_map, 
+            s_move_work.flocks[in->flock_idx].dest_id, snap->xz_pos);
+    }
 }
 
-static void cp_vec_free(void *ptr)
+static vec2_t move_steer(const struct move_work_in *in, vec_cp_ent_t *dyn, vec_cp_ent_t *stat)
 {
-    /* no-op */
+    const struct ent_snapshot *snap = work_snap(in);
+
+    vec2_t vpref = (vec2_t){-1,-1};
+    switch(in->state) {
+    case STATE_SEEK_ENEMIES: 
+        assert(in->flock_idx == -1);
+        vpref = enemy_seek_vpref(in);
+        break;
+    default:
+        assert(in->flock_idx >= 0);
+        vpref = point_seek_vpref(in, &s_move_work.flocks[in->flock_idx]);
+    }
+    assert(vpref.x != -1 || vpref.z != -1);
+    assert(vpref.x != NAN && vpref.z != NAN);
+
+    vec_cp_ent_reset(dyn);
+    vec_cp_ent_reset(stat);
+    find_neighbours(in, dyn, stat);
+
+    struct cp_ent ent = (struct cp_ent) {
+        .xz_pos = snap->xz_pos,
+        .xz_vel = snap->velocity,
+        .radius = snap->radius,
+    };
+
+    return G_ClearPath_NewVelocity(ent, snap->uid, 
+        vpref, *dyn, *stat, in->save_debug);
 }
 
-static struct result clearpath_task(void *arg)
+static struct result move_task(void *arg)
 {
-    struct cp_task_arg *cp_arg = arg;
+    struct move_task_arg *move_arg = arg;
+    vec_cp_ent_t *dyn = &s_move_work.dyn_scratch[move_arg->task_idx];
+    vec_cp_ent_t *stat = &s_move_work.stat_scratch[move_arg->task_idx];
     size_t ncomputed = 0;
 
-    for(int i = cp_arg->begin_idx; i <= cp_arg->end_idx; i++) {
+    for(int i = move_arg->begin_idx; i <= move_arg->end_idx; i++) {
 
-        struct cp_work_in *in = &s_cp_work.in[i];
-        struct cp_work_out *out = &s_cp_work.out[i];
+        struct move_work_in *in = &s_move_work.in[i];
+        struct move_work_out *out = &s_move_work.out[i];
+        const struct ent_snapshot *snap = work_snap(in);
 
-        vec2_t new_vel = G_ClearPath_NewVelocity(in->ent, in->ent_uid, 
-            in->ent_des_v, in->dyn_neighbs, in->stat_neighbs, in->save_debug);
-        out->ent_uid = in->ent_uid;
-        out->ent_vel = new_vel;
+        out->ent_uid = snap->uid;
+        out->deferred = !move_sample_vdes(in);
+        if(out->deferred)
+            continue;
+
+        move_los_queries(in);
+        out->vdes = in->vdes;
+        out->ent_vel = move_steer(in, dyn, stat);
 
         ncomputed++;
         if(ncomputed % 64 == 0)
@@ -1352,34 +1523,55 @@ static struct result clearpath_task(void *arg)
     return NULL_RESULT;
 }
 
-static void clearpath_run_to_completion(int idx)
+static void move_run_to_completion(int idx)
 {
-    while(!Sched_FutureIsReady(&s_cp_work.futures[idx])) {
-        Sched_RunSync(s_cp_work.tids[idx]);
+    while(!Sched_FutureIsReady(&s_move_work.futures[idx])) {
+        Sched_RunSync(s_move_work.tids[idx]);
     }
 }
 
-static void clearpath_finish_work(void)
+static void move_finish_work(void)
 {
     PERF_ENTER();
 
-    if(s_cp_work.ntasks == 0)
-        PERF_RETURN_VOID();
+    if(s_move_work.ntasks == 0)
+        goto done;
+
+    for(int i = 0; i < s_move_work.ntasks; i++) {
+        move_run_to_completion(i);    
+    }
+
+    /* The deferred entities are handled in the same order as they would be
+     * had all the desired velocities been computed serially. */
+    Perf_Push("deferred steering");
+    for(int i = 0; i < s_move_work.nwork; i++) {
+
+        struct move_work_in *in = &s_move_work.in[i];
+        struct move_work_out *out = &s_move_work.out[i];
+        if(!out->deferred)
+            continue;
 
-    for(int i = 0; i < s_cp_work.ntasks; i++) {
-        clearpath_run_to_completion(i);    
+        struct entity *ent = G_EntityForUID(out->ent_uid);
+        assert(ent);
+
+        in->vdes = ent_desired_velocity(ent);
+        move_los_queries(in);
+        out->vdes = in->vdes;
+        out->ent_vel = move_steer(in, &s_move_work.dyn_scratch[0], &s_move_work.stat_scratch[0]);
     }
+    Perf_Pop();
 
     Perf_Push("velocity updates");
-    for(int i = 0; i < s_cp_work.nwork; i++) {
+    for(int i = 0; i < s_move_work.nwork; i++) {
 
-        struct entity *ent = G_EntityForUID(s_cp_work.out[i].ent_uid);
+        struct entity *ent = G_EntityForUID(s_move_work.out[i].ent_uid);
         assert(ent);
 
         struct movestate *ms = movestate_get(ent);
         assert(ms);
 
-        ms->vnew = s_cp_work.out[i].ent_vel;
+        ms->vdes = s_move_work.out[i].vdes;
+        ms->vnew = s_move_work.out[i].ent_vel;
         update_vel_hist(ms, ms->vnew);
 
         vec2_t vel_diff;
@@ -1403,114 +1595,222 @@ static void clearpath_finish_work(void)
     });
     Perf_Pop();
 
-    stalloc_clear(&s_cp_work.mem);
-    s_cp_work.in = NULL;
-    s_cp_work.out = NULL;
-    s_cp_work.nwork = 0;
-    s_cp_work.ntasks = 0;
+done:
+    stalloc_clear(&s_move_work.mem);
+    s_move_work.snap = NULL;
+    s_move_work.nsnap = 0;
+    s_move_work.cell_begin = NULL;
+    s_move_work.cell_ents = NULL;
+    s_move_work.flocks = NULL;
+    s_move_work.in = NULL;
+    s_move_work.out = NULL;
+    s_move_work.nwork = 0;
+    s_move_work.ntasks = 0;
 
     PERF_RETURN_VOID();
 }
 
-static void clearpath_prepare_work(void)
+/* Take a snapshot of all the state needed to compute the new velocities of 
+ * the moving entities. Building a flow field or requesting a path for it 
+ * may only be done from the main thread. So this is done here, up-front, 
+ * once for every flock (or faction) and chunk that has moving entities. 
+ * The tasks then only sample the fields. The closest enemies are queried 
+ * here as well, all at once, as the query relies on the game state. */
+/* Returns true the first time during the tick that the field of a particular 
+ * flock or faction is asked for in the chunk of 'td'. */
+static bool ensure_field(int kind, int id, struct tile_desc td)
 {
-    size_t ndynamic = kh_size(G_GetDynamicEntsSet());
-    s_cp_work.in = stalloc(&s_cp_work.mem, ndynamic * sizeof(struct cp_work_in));
-    s_cp_work.out = stalloc(&s_cp_work.mem, ndynamic * sizeof(struct cp_work_out));
-}
+    uint64_t key = ((uint64_t)kind << 63)
+                 | ((uint64_t)(id & 0x7fffffff) << 32)
+                 | ((uint64_t)(td.chunk_r & 0xffff) << 16)
+                 | ((uint64_t)(td.chunk_c & 0xffff) << 0);
 
-static void clearpath_push_work(struct cp_work_in in)
-{
-    s_cp_work.in[s_cp_work.nwork++] = in;
+    int ret;
+    kh_put(field, s_move_work.ensured, key, &ret);
+    /* On allocation failure, just ensure the field again */
+    return (ret != 0);
 }
 
-static void clearpath_submit_work(void)
+static void move_snapshot(void)
 {
-    if(s_cp_work.nwork == 0)
-        return;
+    PERF_ENTER();
 
-    size_t ntasks = SDL_GetCPUCount();
-    if(s_cp_work.nwork < 64)
-        ntasks = 1;
+    const khash_t(entity) *dynamic = G_GetDynamicEntsSet();
+    size_t ndynamic = kh_size(dynamic);
+    size_t nflocks = vec_size(&s_flocks);
 
-    for(int i = 0; i < ntasks; i++) {
+    s_move_work.snap = stalloc(&s_move_work.mem, ndynamic * sizeof(struct ent_snapshot));
+    s_move_work.in = stalloc(&s_move_work.mem, ndynamic * sizeof(struct move_work_in));
+    s_move_work.out = stalloc(&s_move_work.mem, ndynamic * sizeof(struct move_work_out));
+    s_move_work.flocks = stalloc(&s_move_work.mem, nflocks * sizeof(struct flock_snapshot));
 
-        struct cp_task_arg *arg = stalloc(&s_cp_work.mem, sizeof(struct cp_task_arg));
-        size_t nitems = ceil((float)s_cp_work.nwork / ntasks);
+    vec2_t *enemy_query_pos = stalloc(&s_move_work.mem, ndynamic * sizeof(vec2_t));
+    struct entity **enemy_query_ents = stalloc(&s_move_work.mem, ndynamic * sizeof(struct entity*));
+    struct entity **enemy_query_res = stalloc(&s_move_work.mem, ndynamic * sizeof(struct entity*));
+    size_t *enemy_query_idx = stalloc(&s_move_work.mem, ndynamic * sizeof(size_t));
+    size_t nenemy_queries = 0;
 
-        arg->begin_idx = nitems * i;
-        arg->end_idx = MIN(nitems * (i + 1) - 1, s_cp_work.nwork-1);
+    kh_clear(field, s_move_work.ensured);
 
-        SDL_AtomicSet(&s_cp_work.futures[i].status, FUTURE_INCOMPLETE);
-        s_cp_work.tids[s_cp_work.ntasks] = Sched_Create(4, clearpath_task, arg, 
-            &s_cp_work.futures[i], TASK_BIG_STACK);
-        assert(s_cp_work.tids[s_cp_work.ntasks]);
-        s_cp_work.ntasks++;
-    }
-    s_cp_work.ntasks = ntasks;
-}
+    for(int i = 0; i < nflocks; i++) {
 
-static void on_20hz_tick(void *user, void *event)
-{
-    PERF_ENTER();
+        struct flock *curr = &vec_AT(&s_flocks, i);
+        s_move_work.flocks[i] = (struct flock_snapshot){
+            .target_xz = curr->target_xz,
+            .dest_id = curr->dest_id,
+            .nmembers = 0,
+            .members = stalloc(&s_move_work.mem, kh_size(curr->ents) * sizeof(size_t)),
+        };
+    }
 
     uint32_t key;
     struct entity *curr;
 
-    disband_empty_flocks();
-    clearpath_prepare_work();
-
-    kh_foreach(G_GetDynamicEntsSet(), key, curr, {
+    kh_foreach(dynamic, key, curr, {
 
         struct movestate *ms = movestate_get(curr);
         assert(ms);
 
+        size_t idx = s_move_work.nsnap++;
+        vec2_t pos_xz = G_Pos_GetXZ(key);
+
+        s_move_work.snap[idx] = (struct ent_snapshot){
+            .uid = key,
+            .xz_pos = pos_xz,
+            .velocity = ms->velocity,
+            .radius = curr->selection_radius,
+            .still = ent_still(ms),
+        };
+
+        struct flock *flock = flock_for_ent(curr);
+        int flock_idx = flock ? flock - &vec_AT(&s_flocks, 0) : -1;
+
+        if(flock) {
+            struct flock_snapshot *fs = &s_move_work.flocks[flock_idx];
+            fs->members[fs->nmembers++] = idx;
+        }
+
         if(ent_still(ms))
             continue;
 
-        struct flock *flock = flock_for_ent(curr);
-        vec2_t vpref = (vec2_t){-1,-1};
-        ms->vdes = ent_desired_velocity(curr);
+        struct move_work_in in = (struct move_work_in){
+            .snap_idx = idx,
+            .flock_idx = flock_idx,
+            .faction_id = curr->faction_id,
+            .state = ms->state,
+            .max_speed = curr->max_speed,
+            .save_debug = G_ClearPath_ShouldSaveDebug(key),
+        };
+
+        struct tile_desc td;
+        bool result = M_DescForPoint2D(s_map, pos_xz, &td);
+        assert(result);
 
         switch(ms->state) {
-        case STATE_SEEK_ENEMIES: 
-            assert(!flock);
-            vpref = enemy_seek_vpref(curr);
+        case STATE_SEEK_ENEMIES: {
+
+            enemy_query_pos[nenemy_queries] = pos_xz;
+            enemy_query_ents[nenemy_queries] = curr;
+            enemy_query_idx[nenemy_queries] = s_move_work.nwork;
+            nenemy_queries++;
+
+            if(ensure_field(1, curr->faction_id, td))
+                M_NavEnsureEnemySeekField(s_map, pos_xz, curr->faction_id);
             break;
+        }
         default:
             assert(flock);
-            vpref = point_seek_vpref(curr, flock);
+            if(ensure_field(0, flock_idx, td))
+                M_NavEnsurePointSeekFields(s_map, flock->dest_id, pos_xz, flock->target_xz);
         }
-        assert(vpref.x != -1 || vpref.z != -1);
 
-        struct cp_ent curr_cp = (struct cp_ent) {
-            .xz_pos = G_Pos_GetXZ(curr->uid),
-            .xz_vel = ms->velocity,
-            .radius = curr->selection_radius,
-        };
+        s_move_work.in[s_move_work.nwork++] = in;
+    });
 
-        vec_cp_ent_t *dyn, *stat;
-        dyn = stalloc(&s_cp_work.mem, sizeof(vec_cp_ent_t));
-        stat = stalloc(&s_cp_work.mem, sizeof(vec_cp_ent_t));
+    G_Combat_ClosestEligibleEnemyBatch(nenemy_queries, enemy_query_pos, 
+        enemy_query_ents, enemy_query_res);
 
-        vec_cp_ent_init_alloc(dyn, cp_vec_realloc, cp_vec_free);
-        vec_cp_ent_init_alloc(stat, cp_vec_realloc, cp_vec_free);
+    for(int i = 0; i < nenemy_queries; i++) {
 
-        find_neighbours(curr, dyn, stat);
+        struct entity *enemy = enemy_query_res[i];
+        if(!enemy)
+            continue;
 
-        assert(vpref.x != NAN && vpref.z != NAN);
-        clearpath_push_work((struct cp_work_in){
-            .ent = curr_cp,
-            .ent_uid = key,
-            .ent_des_v = vpref,
-            .dyn_neighbs = *dyn,
-            .stat_neighbs = *stat,
-            .save_debug = G_ClearPath_ShouldSaveDebug(key)
-        });
+        struct move_work_in *in = &s_move_work.in[enemy_query_idx[i]];
+        in->has_enemy = true;
+        in->enemy_xz = G_Pos_GetXZ(enemy->uid);
+    }
+
+    snapshot_bucket();
+    PERF_RETURN_VOID();
+}
+
+static void threat_update(void)
+{
+    if(s_threat_ticks++ % THREAT_TICKS)
+        return;
+
+    PERF_ENTER();
+
+    const khash_t(entity) *all = G_GetAllEntsSet();
+    vec2_t *positions = stalloc(&s_move_work.mem, kh_size(all) * sizeof(vec2_t));
+    int *factions = stalloc(&s_move_work.mem, kh_size(all) * sizeof(int));
+    size_t nents = 0;
+
+    uint32_t key;
+    struct entity *curr;
+
+    kh_foreach(all, key, curr, {
+
+        if(!(curr->flags & ENTITY_FLAG_COMBATABLE))
+            continue;
+
+        positions[nents] = G_Pos_GetXZ(key);
+        factions[nents] = curr->faction_id;
+        nents++;
     });
 
-    clearpath_submit_work();
-    clearpath_finish_work();
+    M_NavUpdateThreatMaps(s_map, nents, positions, factions);
+    PERF_RETURN_VOID();
+}
+
+static void move_submit_work(void)
+{
+    if(s_move_work.nwork == 0)
+        return;
+
+    size_t ntasks = MIN(SDL_GetCPUCount(), MAX_MOVE_TASKS);
+    if(s_move_work.nwork < 64)
+        ntasks = 1;
+
+    for(int i = 0; i < ntasks; i++) {
+
+        struct move_task_arg *arg = stalloc(&s_move_work.mem, sizeof(struct move_task_arg));
+        size_t nitems = ceil((float)s_move_work.nwork / ntasks);
+
+        arg->begin_idx = nitems * i;
+        arg->end_idx = MIN(nitems * (i + 1) - 1, s_move_work.nwork-1);
+        arg->task_idx = i;
+
+        SDL_AtomicSet(&s_move_work.futures[i].status, FUTURE_INCOMPLETE);
+        s_move_work.tids[s_move_work.ntasks] = Sched_Create(4, move_task, arg, 
+            &s_move_work.futures[i], TASK_BIG_STACK);
+        assert(s_move_work.tids[s_move_work.ntasks]);
+        s_move_work.ntasks++;
+    }
+    s_move_work.ntasks = ntasks;
+}
+
+static void on_20hz_tick(void *user, void *event)
+{
+    PERF_ENTER();
+
+    disband_empty_flocks();
+
+    threat_update();
+    move_snapshot();
+    move_submit_work();
+    move_finish_work();
 
     PERF_RETURN_VOID();
 }
@@ -1522,13 +1822,22 @@ static void on_20hz_tick(void *user, void *event)
 bool G_Move_Init(const struct map *map)
 {
     assert(map);
-    if(NULL == (s_entity_state_table = kh_init(state))) {
+    cs_state_init(&s_entity_states);
+
+    if(!stalloc_init(&s_move_work.mem)) {
+        cs_state_destroy(&s_entity_states);
+        return NULL;
+    }
+
+    if(!(s_move_work.ensured = kh_init(field))) {
+        stalloc_destroy(&s_move_work.mem);
+        cs_state_destroy(&s_entity_states);
         return false;
     }
 
-    if(!stalloc_init(&s_cp_work.mem)) {
-        kh_destroy(state, s_entity_state_table);
-        return NULL;
+    for(int i = 0; i < MAX_MOVE_TASKS; i++) {
+        vec_cp_ent_init(&s_move_work.dyn_scratch[i]);
+        vec_cp_ent_init(&s_move_work.stat_scratch[i]);
     }
 
     vec_pentity_init(&s_move_markers);
@@ -1541,6 +1850,7 @@ bool G_Move_Init(const struct map *map)
     s_map = map;
     s_attack_on_lclick = false;
     s_move_on_lclick = false;
+    s_threat_ticks = 0;
     return true;
 }
 
@@ -1560,8 +1870,13 @@ void G_Move_Shutdown(void)
 
     vec_flock_destroy(&s_flocks);
     vec_pentity_destroy(&s_move_markers);
-    stalloc_destroy(&s_cp_work.mem);
-    kh_destroy(state, s_entity_state_table);
+    for(int i = 0; i < MAX_MOVE_TASKS; i++) {
+        vec_cp_ent_destroy(&s_move_work.dyn_scratch[i]);
+        vec_cp_ent_destroy(&s_move_work.stat_scratch[i]);
+    }
+    kh_destroy(field, s_move_work.ensured);
+    stalloc_destroy(&s_move_work.mem);
+    cs_state_destroy(&s_entity_states);
 }
 
 void G_Move_AddEntity(const struct entity *ent)
@@ -1575,24 +1890,22 @@ void G_Move_AddEntity(const struct entity *ent)
     };
     memset(new_ms.vel_hist, 0, sizeof(new_ms.vel_hist));
 
-    int ret;
-    khiter_t k = kh_put(state, s_entity_state_table, ent->uid, &ret);
-    assert(ret != -1 && ret != 0);
-    kh_value(s_entity_state_table, k) = new_ms;
+    assert(!cs_state_contains(&s_entity_states, ent->uid));
+    bool ret = cs_state_put(&s_entity_states, ent->uid, &new_ms);
+    assert(ret);
 
     entity_block(ent);
 }
 
 void G_Move_RemoveEntity(const struct entity *ent)
 {
-    khiter_t k = kh_get(state, s_entity_state_table, ent->uid);
-    if(k == kh_end(s_entity_state_table))
+    if(!cs_state_contains(&s_entity_states, ent->uid))
         return;
 
     G_Move_Stop(ent);
     entity_unblock(ent);
 
-    kh_del(state, s_entity_state_table, k);
+    cs_state_remove(&s_entity_states, ent->uid);
 }
 
 void G_Move_Stop(const struct entity *ent)
@@ -1814,14 +2127,14 @@ bool G_Move_SaveState(struct SDL_RWops *stream)
     /* save the movement state */
     struct attr num_ents = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = kh_size(s_entity_state_table)
+        .val.as_int = cs_size(&s_entity_states)
     };
     CHK_TRUE_RET(Attr_Write(stream, &num_ents, "num_ents"));
 
     uint32_t key;
     struct movestate curr;
 
-    kh_foreach(s_entity_state_table, key, curr, {
+    cs_foreach(&s_entity_states, key, curr, {
 
         struct attr uid = (struct attr){
             .type = TYPE_INT,
@@ -1955,9 +2268,8 @@ bool G_Move_LoadState(struct SDL_RWops *stream)
         uid = attr.val.as_int;
 
         /* The entity should have already been loaded by the scripting state */
-        khiter_t k = kh_get(state, s_entity_state_table, uid);
-        CHK_TRUE_RET(k != kh_end(s_entity_state_table));
-        ms = &kh_value(s_entity_state_table, k);
+        ms = cs_state_get(&s_entity_states, uid);
+        CHK_TRUE_RET(ms);
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_INT);
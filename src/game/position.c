@@ -43,8 +43,10 @@
 #include "../main.h"
 #include "../pf_math.h"
 #include "../perf.h"
-#include "../lib/public/quadtree.h"
+#include "../sched.h"
+#include "../lib/public/ugrid.h"
 #include "../lib/public/khash.h"
+#include "../lib/public/vec.h"
 #include "../map/public/map.h"
 #include "../map/public/tile.h"
 
@@ -52,25 +54,48 @@
 #include <float.h>
 
 
-QUADTREE_TYPE(ent, uint32_t)
-QUADTREE_PROTOTYPES(static, ent, uint32_t)
-QUADTREE_IMPL(static, ent, uint32_t)
+struct pos_rec{
+    vec3_t   pos;
+    /* The location of the entity in the grid. It is only brought up to
+     * date with 'pos' when the grid is flushed. */
+    uint32_t cell;
+    uint32_t slot;
+    bool     dirty;
+};
 
-KHASH_MAP_INIT_INT(pos, vec3_t)
+KHASH_MAP_INIT_INT(pos, struct pos_rec)
+
+VEC_TYPE(uid, uint32_t)
+VEC_IMPL(static inline, uid, uint32_t)
 
 #define POSBUF_INIT_SIZE (16384)
-#define MAX_SEARCH_ENTS  (8192)
+#define GRID_CELL_SZ     ((TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / 8.0f)
+#define MAX_QUERY_TASKS  (64)
 #define MAX(a, b)        ((a) > (b) ? (a) : (b))
 #define MIN(a, b)        ((a) < (b) ? (a) : (b))
-#define ARR_SIZE(a)      (sizeof(a)/sizeof(a[0]))
+
+struct nearest_batch{
+    const khash_t(entity) *ents;
+    const vec2_t          *xz_points;
+    bool                 (*predicate)(const struct entity *ent, void *arg);
+    void *const           *args;
+    float                  max_range;
+    struct entity        **out;
+    size_t                 begin_idx;
+    size_t                 end_idx;
+};
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static khash_t(pos) *s_postable;
-/* The quadtree is always synchronized with the postable, at function call boundaries */
-static qt_ent_t      s_postree;
+/* The grid is synchronized with the postable lazily: setting a position only 
+ * marks the entity as dirty, and all the dirty entities are moved in a single 
+ * batch before the next query. Since the positions of all the moving entities 
+ * are set together, this is once per tick in the common case. */
+static struct ugrid  s_posgrid;
+static vec_uid_t     s_dirty;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -81,6 +106,93 @@ static bool any_ent(const struct entity *ent, void *arg)
     return true;
 }
 
+static void pos_grid_remove(uint32_t cell, uint32_t slot)
+{
+    uint32_t moved;
+    if(ugrid_remove(&s_posgrid, cell, slot, &moved)) {
+
+        khiter_t k = kh_get(pos, s_postable, moved);
+        assert(k != kh_end(s_postable));
+        kh_val(s_postable, k).slot = slot;
+    }
+}
+
+static void pos_grid_flush(void)
+{
+    for(int i = 0; i < vec_size(&s_dirty); i++) {
+
+        uint32_t uid = vec_AT(&s_dirty, i);
+        khiter_t k = kh_get(pos, s_postable, uid);
+        if(k == kh_end(s_postable))
+            continue;
+
+        struct pos_rec *rec = &kh_val(s_postable, k);
+        if(!rec->dirty)
+            continue;
+        rec->dirty = false;
+
+        uint32_t cell = ugrid_cell_for(&s_posgrid, rec->pos.x, rec->pos.z);
+        if(cell == rec->cell) {
+            ugrid_move(&s_posgrid, cell, rec->slot, rec->pos.x, rec->pos.z);
+            continue;
+        }
+
+        /* Insert into the new cell before removing from the old one, so that 
+         * the entity stays indexed at its last position if we run out of memory. */
+        uint32_t slot;
+        if(!ugrid_insert(&s_posgrid, cell, rec->pos.x, rec->pos.z, uid, &slot)) {
+            ugrid_move(&s_posgrid, rec->cell, rec->slot, rec->pos.x, rec->pos.z);
+            continue;
+        }
+        pos_grid_remove(rec->cell, rec->slot);
+
+        /* The record may have been updated by the removal */
+        rec = &kh_val(s_postable, k);
+        rec->cell = cell;
+        rec->slot = slot;
+    }
+    vec_uid_reset(&s_dirty);
+    assert(kh_size(s_postable) == s_posgrid.nrecs);
+}
+
+struct pred_ctx{
+    const khash_t(entity) *ents;
+    bool (*predicate)(const struct entity *ent, void *arg);
+    void *arg;
+};
+
+static bool pos_ent_pred(uint32_t uid, void *arg)
+{
+    struct pred_ctx *ctx = arg;
+    khiter_t k = kh_get(entity, ctx->ents, uid);
+    assert(k != kh_end(ctx->ents));
+    return ctx->predicate(kh_val(ctx->ents, k), ctx->arg);
+}
+
+static void nearest_batch_run(struct nearest_batch *batch)
+{
+    for(size_t i = batch->begin_idx; i < batch->end_idx; i++) {
+
+        uint32_t uid;
+        vec2_t xz_point = batch->xz_points[i];
+        struct pred_ctx ctx = (struct pred_ctx){batch->ents, batch->predicate, batch->args[i]};
+
+        batch->out[i] = NULL;
+        if(ugrid_nearest(&s_posgrid, xz_point.x, xz_point.z, batch->max_range, pos_ent_pred, &ctx, &uid)) {
+
+            khiter_t k = kh_get(entity, batch->ents, uid);
+            assert(k != kh_end(batch->ents));
+            batch->out[i] = kh_val(batch->ents, k);
+        }
+    }
+}
+
+static struct result nearest_task(void *arg)
+{
+    nearest_batch_run(arg);
+    return NULL_RESULT;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -91,37 +203,50 @@ bool G_Pos_Set(const struct entity *ent, vec3_t pos)
 
     khiter_t k = kh_get(pos, s_postable, ent->uid);
     bool overwrite = (k != kh_end(s_postable));
+    vec3_t old_pos = overwrite ? kh_val(s_postable, k).pos : (vec3_t){0};
 
     if(overwrite) {
-        vec3_t old_pos = kh_val(s_postable, k);
-        bool ret = qt_ent_delete(&s_postree, old_pos.x, old_pos.z, ent->uid);
-        assert(ret);
-
         G_Combat_RemoveRef(ent->faction_id, (vec2_t){old_pos.x, old_pos.z});
-        G_Fog_RemoveVision((vec2_t){old_pos.x, old_pos.z}, ent->faction_id, ent->vision_range);
     }
 
-    if(!qt_ent_insert(&s_postree, pos.x, pos.z, ent->uid))
-        return false;
-
     if(!overwrite) {
+        /* New entities are added to the grid right away */
+        uint32_t cell = ugrid_cell_for(&s_posgrid, pos.x, pos.z), slot;
+        if(!ugrid_insert(&s_posgrid, cell, pos.x, pos.z, ent->uid, &slot))
+            return false;
+
         int ret;
-        kh_put(pos, s_postable, ent->uid, &ret); 
+        k = kh_put(pos, s_postable, ent->uid, &ret); 
         if(ret == -1) {
-            qt_ent_delete(&s_postree, pos.x, pos.z, ent->uid);
+            pos_grid_remove(cell, slot);
             return false;
         }
-        k = kh_get(pos, s_postable, ent->uid);
+        kh_val(s_postable, k) = (struct pos_rec){
+            .pos = pos,
+            .cell = cell,
+            .slot = slot,
+            .dirty = false
+        };
+    }else{
+        struct pos_rec *rec = &kh_val(s_postable, k);
+        rec->pos = pos;
+        /* If the entity could not be queued, it is left clean so that the 
+         * next update of its' position will try again */
+        if(!rec->dirty && vec_uid_push(&s_dirty, ent->uid)) {
+            rec->dirty = true;
+        }
     }
 
-    kh_val(s_postable, k) = pos;
-    assert(kh_size(s_postable) == s_postree.nrecs);
-
     G_Move_UpdatePos(ent, (vec2_t){pos.x, pos.z});
     G_Combat_AddRef(ent->faction_id, (vec2_t){pos.x, pos.z});
-    G_Building_UpdateBounds(ent);
-    G_Resource_UpdateBounds(ent);
-    G_Fog_AddVision((vec2_t){pos.x, pos.z}, ent->faction_id, ent->vision_range);
+    G_UpdateBounds(ent);
+
+    if(overwrite) {
+        G_Fog_MoveVision((vec2_t){old_pos.x, old_pos.z}, (vec2_t){pos.x, pos.z}, 
+            ent->faction_id, ent->vision_range);
+    }else{
+        G_Fog_AddVision((vec2_t){pos.x, pos.z}, ent->faction_id, ent->vision_range);
+    }
 
     return true; 
 }
@@ -132,7 +257,7 @@ vec3_t G_Pos_Get(uint32_t uid)
 
     khiter_t k = kh_get(pos, s_postable, uid);
     assert(k != kh_end(s_postable));
-    return kh_val(s_postable, k);
+    return kh_val(s_postable, k).pos;
 }
 
 vec2_t G_Pos_GetXZ(uint32_t uid)
@@ -141,7 +266,7 @@ vec2_t G_Pos_GetXZ(uint32_t uid)
 
     khiter_t k = kh_get(pos, s_postable, uid);
     assert(k != kh_end(s_postable));
-    vec3_t pos = kh_val(s_postable, k);
+    vec3_t pos = kh_val(s_postable, k).pos;
     return (vec2_t){pos.x, pos.z};
 }
 
@@ -152,12 +277,12 @@ void G_Pos_Delete(uint32_t uid)
     khiter_t k = kh_get(pos, s_postable, uid);
     assert(k != kh_end(s_postable));
 
-    vec3_t pos = kh_val(s_postable, k);
+    /* The record is still in the cell it was last flushed to */
+    struct pos_rec rec = kh_val(s_postable, k);
     kh_del(pos, s_postable, k);
 
-    bool ret = qt_ent_delete(&s_postree, pos.x, pos.z, uid);
-    assert(ret);
-    assert(kh_size(s_postable) == s_postree.nrecs);
+    pos_grid_remove(rec.cell, rec.slot);
+    assert(kh_size(s_postable) == s_posgrid.nrecs);
 }
 
 bool G_Pos_Init(const struct map *map)
@@ -179,8 +304,14 @@ bool G_Pos_Init(const struct map *map)
     float zmin = center.z - (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
     float zmax = center.z + (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
 
-    qt_ent_init(&s_postree, xmin, xmax, zmin, zmax);
-    if(!qt_ent_reserve(&s_postree, POSBUF_INIT_SIZE)) {
+    if(!ugrid_init(&s_posgrid, xmin, xmax, zmin, zmax, GRID_CELL_SZ)) {
+        kh_destroy(pos, s_postable);
+        return false;
+    }
+
+    vec_uid_init(&s_dirty);
+    if(!vec_uid_resize(&s_dirty, POSBUF_INIT_SIZE)) {
+        ugrid_destroy(&s_posgrid);
         kh_destroy(pos, s_postable);
         return false;
     }
@@ -193,7 +324,8 @@ void G_Pos_Shutdown(void)
     ASSERT_IN_MAIN_THREAD();
 
     kh_destroy(pos, s_postable);
-    qt_ent_destroy(&s_postree);
+    ugrid_destroy(&s_posgrid);
+    vec_uid_destroy(&s_dirty);
 }
 
 int G_Pos_EntsInRect(vec2_t xz_min, vec2_t xz_max, struct entity **out, size_t maxout)
@@ -214,7 +346,8 @@ int G_Pos_EntsInRectWithPred(vec2_t xz_min, vec2_t xz_max, struct entity **out,
     uint32_t ent_ids[maxout];
     const khash_t(entity) *ents = G_GetAllEntsSet();
 
-    int ntotal = qt_ent_inrange_rect(&s_postree, 
+    pos_grid_flush();
+    int ntotal = ugrid_inrange_rect(&s_posgrid, 
         xz_min.x, xz_max.x, xz_min.z, xz_max.z, ent_ids, maxout);
     int ret = 0;
 
@@ -249,15 +382,13 @@ int G_Pos_EntsInCircleWithPred(vec2_t xz_point, float range, struct entity **out
 
     uint32_t ent_ids[maxout];
     const khash_t(entity) *ents = G_GetAllEntsSet();
-    for(int i = 0; i < maxout; i++)
-        ent_ids[i] = (uint32_t)-1;
 
-    int ntotal = qt_ent_inrange_circle(&s_postree, 
+    pos_grid_flush();
+    int ntotal = ugrid_inrange_circle(&s_posgrid, 
         xz_point.x, xz_point.z, range, ent_ids, maxout);
     int ret = 0;
 
     for(int i = 0; i < ntotal; i++) {
-        assert(ent_ids[i] != (uint32_t)-1);
         khiter_t k = kh_get(entity, ents, ent_ids[i]);
         assert(k != kh_end(s_postable));
         struct entity *curr = kh_val(ents, k);
@@ -277,50 +408,87 @@ struct entity *G_Pos_NearestWithPred(vec2_t xz_point,
     PERF_ENTER();
     ASSERT_IN_MAIN_THREAD();
 
-    uint32_t ent_ids[MAX_SEARCH_ENTS];
     const khash_t(entity) *ents = G_GetAllEntsSet();
-
-    const float qt_len = MAX(s_postree.xmax - s_postree.xmin, s_postree.ymax - s_postree.ymin);
-    float len = (TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / 8.0f;
+    const float grid_len = MAX(s_posgrid.xmax - s_posgrid.xmin, s_posgrid.zmax - s_posgrid.zmin);
 
     if(max_range == 0.0) {
-        max_range = qt_len;
+        max_range = grid_len;
     }
-    max_range = MIN(qt_len, max_range);
+    max_range = MIN(grid_len, max_range);
 
-    while(len <= max_range) {
+    pos_grid_flush();
 
-        float min_dist = FLT_MAX;
-        struct entity *ret = NULL;
+    uint32_t uid;
+    struct pred_ctx ctx = (struct pred_ctx){ents, predicate, arg};
+    if(!ugrid_nearest(&s_posgrid, xz_point.x, xz_point.z, max_range, pos_ent_pred, &ctx, &uid))
+        PERF_RETURN(NULL);
 
-        int num_cands = qt_ent_inrange_circle(&s_postree, xz_point.x, xz_point.z,
-            len, ent_ids, ARR_SIZE(ent_ids));
+    khiter_t k = kh_get(entity, ents, uid);
+    assert(k != kh_end(ents));
+    PERF_RETURN(kh_val(ents, k));
+}
 
-        for(int i = 0; i < num_cands; i++) {
-        
-            khiter_t k = kh_get(entity, ents, ent_ids[i]);
-            assert(k != kh_end(s_postable));
-            struct entity *curr = kh_val(ents, k);
+void G_Pos_NearestWithPredBatch(size_t nqueries, const vec2_t *xz_points, 
+                                bool (*predicate)(const struct entity *ent, void *arg), 
+                                void *const *args, float max_range, struct entity **out)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
 
-            vec2_t delta, can_pos_xz = G_Pos_GetXZ(curr->uid);
-            PFM_Vec2_Sub(&xz_point, &can_pos_xz, &delta);
+    if(nqueries == 0)
+        PERF_RETURN_VOID();
 
-            if(PFM_Vec2_Len(&delta) < min_dist && predicate(curr, arg)) {
-                min_dist = PFM_Vec2_Len(&delta);
-                ret = curr;
-            }
+    const float grid_len = MAX(s_posgrid.xmax - s_posgrid.xmin, s_posgrid.zmax - s_posgrid.zmin);
+    if(max_range == 0.0) {
+        max_range = grid_len;
+    }
+    max_range = MIN(grid_len, max_range);
+
+    /* The grid is only read from here on, so the queries can be answered 
+     * concurrently. No positions may be set until they all complete. */
+    pos_grid_flush();
+
+    size_t ntasks = MIN(SDL_GetCPUCount(), MAX_QUERY_TASKS);
+    if(nqueries < 64)
+        ntasks = 1;
+
+    struct nearest_batch batches[MAX_QUERY_TASKS];
+    uint32_t tids[MAX_QUERY_TASKS];
+    struct future futures[MAX_QUERY_TASKS];
+    size_t nitems = ceil((float)nqueries / ntasks);
+
+    for(int i = 0; i < ntasks; i++) {
+
+        batches[i] = (struct nearest_batch){
+            .ents = G_GetAllEntsSet(),
+            .xz_points = xz_points,
+            .predicate = predicate,
+            .args = args,
+            .max_range = max_range,
+            .out = out,
+            .begin_idx = MIN(nitems * i, nqueries),
+            .end_idx = MIN(nitems * (i + 1), nqueries),
+        };
+
+        tids[i] = 0;
+        if(ntasks > 1) {
+            SDL_AtomicSet(&futures[i].status, FUTURE_INCOMPLETE);
+            tids[i] = Sched_Create(4, nearest_task, &batches[i], &futures[i], 0);
         }
+        if(!tids[i]) {
+            nearest_batch_run(&batches[i]);
+        }
+    }
 
-        if(ret)
-            PERF_RETURN(ret);
-
-        if(len == max_range)
-            break;
+    for(int i = 0; i < ntasks; i++) {
 
-        len *= 2.0f; 
-        len = MIN(max_range, len);
+        if(!tids[i])
+            continue;
+        while(!Sched_FutureIsReady(&futures[i])) {
+            Sched_RunSync(tids[i]);
+        }
     }
-    PERF_RETURN(NULL);
+    PERF_RETURN_VOID();
 }
 
 struct entity *G_Pos_Nearest(vec2_t xz_point)
@@ -103,7 +103,7 @@ struct render_input{
 /*###########################################################################*/
 
 bool            G_Init(void);
-bool            G_LoadMap(SDL_RWops *stream, bool update_navgrid);
+bool            G_LoadMap(SDL_RWops *stream, const char *path, bool update_navgrid);
 void            G_Shutdown(void);
 
 void            G_ClearState(void);
@@ -146,6 +146,10 @@ uint16_t        G_GetPlayerControlledFactions(void);
 
 bool            G_SetDiplomacyState(int fac_id_a, int fac_id_b, enum diplomacy_state ds);
 bool            G_GetDiplomacyState(int fac_id_a, int fac_id_b, enum diplomacy_state *out);
+/* Returns the set of factions that the faction is at war with. Unlike the other 
+ * faction queries, it can be called from any thread, so long as the diplomatic 
+ * state is not being concurrently modified. */
+uint16_t        G_GetEnemyFactions(int faction_id);
 
 void            G_SetActiveCamera(struct camera *cam, enum cam_mode mode);
 struct camera  *G_GetActiveCamera(void);
@@ -248,6 +252,11 @@ struct entity *G_Pos_Nearest(vec2_t xz_point);
 struct entity *G_Pos_NearestWithPred(vec2_t xz_point, 
                                      bool (*predicate)(const struct entity *ent, void *arg), 
                                      void *arg, float max_range);
+/* Answers many 'G_Pos_NearestWithPred' queries at once, using the worker threads. 
+ * The predicate is called concurrently and must not modify any shared state. */
+void           G_Pos_NearestWithPredBatch(size_t nqueries, const vec2_t *xz_points, 
+                                          bool (*predicate)(const struct entity *ent, void *arg), 
+                                          void *const *args, float max_range, struct entity **out);
 
 /*###########################################################################*/
 /* GAME FOG-OF-WAR                                                           */
@@ -365,6 +374,7 @@ int  G_StorageSite_GetPlayerCapacity(const char *rname);
 void G_StorageSite_SetFontColor(const struct nk_color *clr);
 void G_StorageSite_SetBorderColor(const struct nk_color *clr);
 void G_StorageSite_SetBackgroundStyle(const struct nk_style_item *style);
+void G_StorageSite_UpdateFaction(const struct entity *ent);
 
 #endif
 
@@ -37,13 +37,19 @@
 #include "game_private.h"
 #include "../entity.h"
 #include "../collision.h"
+#include "../perf.h"
 #include "../map/public/map.h"
 #include "../lib/public/khash.h"
+#include "../lib/public/ugrid.h"
 #include "../lib/public/string_intern.h"
 #include "../lib/public/attr.h"
 #include "../lib/public/pf_string.h"
 
 
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define GRID_CELL_SZ    ((TILES_PER_CHUNK_WIDTH * X_COORDS_PER_TILE) / 4.0f)
+
 #define CHK_TRUE_RET(_pred)             \
     do{                                 \
         if(!(_pred))                    \
@@ -53,10 +59,15 @@
 
 struct rstate{
     const char *name;
+    int         name_id;
     const char *cursor;
     int         amount;
     vec2_t      blocking_pos;
     int         blocking_radius;
+    /* The location of the entity in the grid of its' resource type. Only 
+     * valid once the entity has been given a name. */
+    uint32_t    cell;
+    uint32_t    slot;
 };
 
 KHASH_MAP_INIT_INT(state, struct rstate)
@@ -72,6 +83,15 @@ static khash_t(state)   *s_entity_state_table;
 static const struct map *s_map;
 /* The set of all resources that exist (or have existed) in the current session */
 static khash_t(name)    *s_all_names;
+/* Resource names are additionally interned to small integer IDs which stay 
+ * valid until the game state is cleared, so that per-entity inventories 
+ * can be kept in fixed-size arrays indexed by them. */
+static khash_t(stridx)  *s_id_stridx;
+static mp_strbuff_t      s_id_stringpool;
+/* A separate grid of the resource entities of each type, so that the 
+ * nearest resource of a type is found without visiting any other entities. 
+ * A grid is only allocated once the first resource of its' type is named. */
+static struct ugrid      s_grids[MAX_RESOURCE_TYPES];
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -103,6 +123,54 @@ static void rstate_remove(uint32_t uid)
         kh_del(state, s_entity_state_table, k);
 }
 
+static struct ugrid *res_grid(int id)
+{
+    struct ugrid *grid = &s_grids[id];
+    if(grid->cells)
+        return grid;
+
+    struct map_resolution res;
+    M_GetResolution(s_map, &res);
+    vec3_t center = M_GetCenterPos(s_map);
+
+    float xmin = center.x - (res.tile_w * res.chunk_w * X_COORDS_PER_TILE) / 2.0f;
+    float xmax = center.x + (res.tile_w * res.chunk_w * X_COORDS_PER_TILE) / 2.0f;
+    float zmin = center.z - (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
+    float zmax = center.z + (res.tile_h * res.chunk_h * Z_COORDS_PER_TILE) / 2.0f;
+
+    if(!ugrid_init(grid, xmin, xmax, zmin, zmax, GRID_CELL_SZ))
+        return NULL;
+    return grid;
+}
+
+static bool res_grid_insert(uint32_t uid, struct rstate *rs)
+{
+    struct ugrid *grid = res_grid(rs->name_id);
+    if(!grid)
+        return false;
+
+    vec2_t pos = G_Pos_GetXZ(uid);
+    rs->cell = ugrid_cell_for(grid, pos.x, pos.z);
+    return ugrid_insert(grid, rs->cell, pos.x, pos.z, uid, &rs->slot);
+}
+
+static void res_grid_remove(struct rstate *rs)
+{
+    uint32_t moved;
+    if(ugrid_remove(&s_grids[rs->name_id], rs->cell, rs->slot, &moved)) {
+
+        struct rstate *mrs = rstate_get(moved);
+        assert(mrs);
+        mrs->slot = rs->slot;
+    }
+}
+
+static bool res_grid_pred(uint32_t uid, void *arg)
+{
+    struct entity *ent = G_EntityForUID(uid);
+    return ent && (ent->flags & ENTITY_FLAG_RESOURCE);
+}
+
 static int compare_keys(const void *a, const void *b)
 {
     char *stra = *(char**)a;
@@ -136,15 +204,49 @@ fail_table:
 
 void G_Resource_Shutdown(void)
 {
+    for(int i = 0; i < MAX_RESOURCE_TYPES; i++) {
+        if(s_grids[i].cells)
+            ugrid_destroy(&s_grids[i]);
+    }
     kh_destroy(name, s_all_names);
     si_shutdown(&s_stringpool, s_stridx);
     kh_destroy(state, s_entity_state_table);
 }
 
+bool G_Resource_InitNames(void)
+{
+    return si_init(&s_id_stringpool, &s_id_stridx, MAX_RESOURCE_TYPES);
+}
+
+void G_Resource_ShutdownNames(void)
+{
+    si_shutdown(&s_id_stringpool, s_id_stridx);
+}
+
+void G_Resource_ClearNames(void)
+{
+    si_clear(&s_id_stringpool, s_id_stridx);
+}
+
+int G_Resource_NameID(const char *name)
+{
+    mp_ref_t ref = si_intern_ref(name, &s_id_stringpool, s_id_stridx);
+    if(ref == 0 || ref > MAX_RESOURCE_TYPES)
+        return -1;
+    return ref - 1;
+}
+
+const char *G_Resource_IDName(int id)
+{
+    assert(id >= 0 && id < MAX_RESOURCE_TYPES);
+    return si_string(&s_id_stringpool, id + 1);
+}
+
 bool G_Resource_AddEntity(const struct entity *ent)
 {
     struct rstate rs = (struct rstate) {
         .name = "",
+        .name_id = -1,
         .cursor = "",
         .amount = 0,
         .blocking_pos = G_Pos_GetXZ(ent->uid),
@@ -170,6 +272,9 @@ void G_Resource_RemoveEntity(struct entity *ent)
         M_NavBlockersDecref(rs->blocking_pos, rs->blocking_radius, s_map);
     }
 
+    if(rs->name_id >= 0) {
+        res_grid_remove(rs);
+    }
     rstate_remove(ent->uid);
 }
 
@@ -184,6 +289,29 @@ void G_Resource_UpdateBounds(const struct entity *ent)
         rs->blocking_pos = G_Pos_GetXZ(ent->uid);
         M_NavBlockersIncref(rs->blocking_pos, rs->blocking_radius, s_map);
     }
+
+    if(rs->name_id < 0)
+        return;
+
+    struct ugrid *grid = &s_grids[rs->name_id];
+    vec2_t pos = G_Pos_GetXZ(ent->uid);
+    uint32_t cell = ugrid_cell_for(grid, pos.x, pos.z);
+
+    if(cell == rs->cell) {
+        ugrid_move(grid, rs->cell, rs->slot, pos.x, pos.z);
+        return;
+    }
+
+    /* Insert into the new cell first, so that the entity stays indexed at 
+     * its' last position if we run out of memory. */
+    uint32_t slot;
+    if(!ugrid_insert(grid, cell, pos.x, pos.z, ent->uid, &slot)) {
+        ugrid_move(grid, rs->cell, rs->slot, pos.x, pos.z);
+        return;
+    }
+    res_grid_remove(rs);
+    rs->cell = cell;
+    rs->slot = slot;
 }
 
 void G_Resource_UpdateSelectionRadius(const struct entity *ent, float radius)
@@ -220,6 +348,34 @@ const char *G_Resource_GetName(uint32_t uid)
     return rs->name;
 }
 
+struct entity *G_Resource_Nearest(vec2_t xz_point, int rid, float max_range)
+{
+    PERF_ENTER();
+    assert(rid >= 0 && rid < MAX_RESOURCE_TYPES);
+
+    const struct ugrid *grid = &s_grids[rid];
+    if(!grid->cells)
+        PERF_RETURN(NULL);
+
+    const float grid_len = MAX(grid->xmax - grid->xmin, grid->zmax - grid->zmin);
+    if(max_range == 0.0) {
+        max_range = grid_len;
+    }
+    max_range = MIN(grid_len, max_range);
+
+    uint32_t uid;
+    if(!ugrid_nearest(grid, xz_point.x, xz_point.z, max_range, res_grid_pred, NULL, &uid))
+        PERF_RETURN(NULL);
+    PERF_RETURN(G_EntityForUID(uid));
+}
+
+int G_Resource_GetNameID(uint32_t uid)
+{
+    struct rstate *rs = rstate_get(uid);
+    assert(rs);
+    return rs->name_id;
+}
+
 bool G_Resource_SetName(uint32_t uid, const char *name)
 {
     struct rstate *rs = rstate_get(uid);
@@ -229,6 +385,22 @@ bool G_Resource_SetName(uint32_t uid, const char *name)
     if(!key)
         return false;
 
+    int id = G_Resource_NameID(name);
+    if(id < 0)
+        return false;
+
+    if(id != rs->name_id) {
+
+        if(rs->name_id >= 0) {
+            res_grid_remove(rs);
+        }
+        rs->name_id = id;
+        if(!res_grid_insert(uid, rs)) {
+            rs->name_id = -1;
+            return false;
+        }
+    }
+
     rs->name = key;
     kh_put(name, s_all_names, key, &(int){0});
     return true;
@@ -342,7 +514,7 @@ bool G_Resource_LoadState(struct SDL_RWops *stream)
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_STRING);
-        G_Resource_SetName(uid, attr.val.as_string);
+        CHK_TRUE_RET(G_Resource_SetName(uid, attr.val.as_string));
 
         CHK_TRUE_RET(Attr_Parse(stream, &attr, true));
         CHK_TRUE_RET(attr.type == TYPE_STRING);
@@ -36,19 +36,68 @@
 #ifndef RESOURCE_H
 #define RESOURCE_H
 
+#include "../pf_math.h"
 #include <stdint.h>
 #include <stdbool.h>
 
+/* The maximum number of distinct resource names that can be used in a session */
+#define MAX_RESOURCE_TYPES  (32)
+
 struct map;
 struct entity;
 struct SDL_RWops;
 
+/* Per-entity tables of resource amounts, indexed by the resource name ID. 
+ * The 'present' mask has a bit set for every ID that has been given a value. */
+struct res_table{
+    uint32_t present;
+    int      vals[MAX_RESOURCE_TYPES];
+};
+
+struct res_ftable{
+    uint32_t present;
+    float    vals[MAX_RESOURCE_TYPES];
+};
+
+#define res_exists(t, id)   (!!((t)->present & (1u << (id))))
+#define res_size(t)         (__builtin_popcount((t)->present))
+#define res_clear(t)        ((t)->present = 0)
+#define res_set(t, id, v)                       \
+    do{                                         \
+        (t)->vals[(id)] = (v);                  \
+        (t)->present |= (1u << (id));           \
+    }while(0)
+
+/* Visits the present entries in the order of ascending IDs */
+#define res_foreach(t, idvar, vvar, ...)                            \
+    do{                                                             \
+        for(uint32_t __m = (t)->present; __m; __m &= __m - 1) {     \
+            (idvar) = __builtin_ctz(__m);                           \
+            (vvar) = (t)->vals[(idvar)];                            \
+            __VA_ARGS__;                                            \
+        }                                                           \
+    }while(0)
+
 bool G_Resource_Init(const struct map *map);
 void G_Resource_Shutdown(void);
 bool G_Resource_AddEntity(const struct entity *ent);
 void G_Resource_RemoveEntity(struct entity *ent);
 void G_Resource_UpdateBounds(const struct entity *ent);
 
+bool        G_Resource_InitNames(void);
+void        G_Resource_ShutdownNames(void);
+/* Forgets the IDs of all the resource names. Must only be called once no 
+ * entities (or any other state) refer to the IDs anymore. */
+void        G_Resource_ClearNames(void);
+/* Returns the small integer ID in the range [0, MAX_RESOURCE_TYPES) that the 
+ * resource name is interned to, or -1 if the name could not be interned. */
+int         G_Resource_NameID(const char *name);
+const char *G_Resource_IDName(int id);
+int         G_Resource_GetNameID(uint32_t uid);
+/* Returns the closest resource entity of the type within 'max_range', or 
+ * anywhere on the map when 'max_range' is 0. */
+struct entity *G_Resource_Nearest(vec2_t xz_point, int rid, float max_range);
+
 bool G_Resource_SaveState(struct SDL_RWops *stream);
 bool G_Resource_LoadState(struct SDL_RWops *stream);
 
@@ -298,6 +298,7 @@ static bool allied_to_player_controllabe(const bool *controllable,
                                          uint16_t fac_mask, int faction_id)
 {
     assert(!controllable[faction_id]);
+    uint16_t enemies = G_GetEnemyFactions(faction_id);
 
     for(int i = 0; fac_mask; fac_mask >>= 1, i++) {
     
@@ -306,10 +307,7 @@ static bool allied_to_player_controllabe(const bool *controllable,
         if(i == faction_id)
             continue;
 
-        enum diplomacy_state ds;
-        G_GetDiplomacyState(faction_id, i, &ds);
-
-        if(controllable[i] && ds != DIPLOMACY_STATE_WAR)
+        if(controllable[i] && !(enemies & (0x1 << i)))
             return true;
     }
     return false;
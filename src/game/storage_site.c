@@ -34,32 +34,19 @@
  */
 
 #include "storage_site.h"
+#include "resource.h"
 #include "game_private.h"
 #include "../ui.h"
 #include "../event.h"
+#include "../perf.h"
 #include "../lib/public/pf_nuklear.h"
 #include "../lib/public/pf_string.h"
-#include "../lib/public/mpool.h"
 #include "../lib/public/khash.h"
-#include "../lib/public/string_intern.h"
+#include "../lib/public/vec.h"
 #include "../lib/public/attr.h"
 
 #include <assert.h>
-
-static void *pmalloc(size_t size);
-static void *pcalloc(size_t n, size_t size);
-static void *prealloc(void *ptr, size_t size);
-static void  pfree(void *ptr);
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  pmalloc
-#define kcalloc  pcalloc
-#define krealloc prealloc
-#define kfree    pfree
+#include <float.h>
 
 #define ARR_SIZE(a) (sizeof(a)/sizeof((a)[0]))
 #define MAX(a, b)   ((a) > (b) ? (a) : (b))
@@ -71,49 +58,39 @@ static void  pfree(void *ptr);
             return false;               \
     }while(0)
 
-KHASH_MAP_INIT_STR(int, int)
-
 struct ss_state{
-    kh_int_t              *capacity;
-    kh_int_t              *curr;
-    kh_int_t              *desired;
+    struct res_table       capacity;
+    struct res_table       curr;
+    struct res_table       desired;
     struct ss_delta_event  last_change;
     /* Alternative capacity/desired parameters that 
      *can be turned on/off */
     bool                   use_alt;
-    kh_int_t              *alt_capacity;
-    kh_int_t              *alt_desired;
+    struct res_table       alt_capacity;
+    struct res_table       alt_desired;
+    /* The resources under which the site is currently listed in the 
+     * nearest storage site index, and the faction it is listed for */
+    uint32_t               indexed;
+    int                    indexed_faction;
 };
 
-typedef char buff_t[512];
-
-MPOOL_TYPE(buff, buff_t)
-MPOOL_PROTOTYPES(static, buff, buff_t)
-MPOOL_IMPL(static, buff, buff_t)
-
-#undef kmalloc
-#undef kcalloc
-#undef krealloc
-#undef kfree
-
-#define kmalloc  malloc
-#define kcalloc  calloc
-#define krealloc realloc
-#define kfree    free
-
 KHASH_MAP_INIT_INT(state, struct ss_state)
-KHASH_MAP_INIT_STR(res, int)
+
+VEC_TYPE(uid, uint32_t)
+VEC_IMPL(static inline, uid, uint32_t)
 
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
-static mp_buff_t        s_mpool;
-static khash_t(stridx) *s_stridx;
-static mp_strbuff_t     s_stringpool;
 static khash_t(state)  *s_entity_state_table;
-static khash_t(res)    *s_global_resource_tables[MAX_FACTIONS];
-static khash_t(res)    *s_global_capacity_tables[MAX_FACTIONS];
+static struct res_table s_global_resource_tables[MAX_FACTIONS];
+static struct res_table s_global_capacity_tables[MAX_FACTIONS];
+/* For every faction and resource, the storage sites which have a non-zero 
+ * capacity (in the parameters currently in use) for that resource. There 
+ * are few storage sites compared to other entities, so the nearest site 
+ * is found by scanning the list instead of searching the position grid. */
+static vec_uid_t        s_site_index[MAX_FACTIONS][MAX_RESOURCE_TYPES];
 
 static struct nk_style_item s_bg_style = {0};
 static struct nk_color      s_border_clr = {0};
@@ -123,40 +100,6 @@ static struct nk_color      s_font_clr = {0};
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static void *pmalloc(size_t size)
-{
-    mp_ref_t ref = mp_buff_alloc(&s_mpool);
-    if(ref == 0)
-        return NULL;
-    return mp_buff_entry(&s_mpool, ref);
-}
-
-static void *pcalloc(size_t n, size_t size)
-{
-    void *ret = pmalloc(n * size);
-    if(!ret)
-        return NULL;
-    memset(ret, 0, n * size);
-    return ret;
-}
-
-static void *prealloc(void *ptr, size_t size)
-{
-    if(!ptr)
-        return pmalloc(size);
-    if(size <= sizeof(buff_t))
-        return ptr;
-    return NULL;
-}
-
-static void pfree(void *ptr)
-{
-    if(!ptr)
-        return;
-    mp_ref_t ref = mp_buff_ref(&s_mpool, ptr);
-    mp_buff_free(&s_mpool, ref);
-}
-
 static struct ss_state *ss_state_get(uint32_t uid)
 {
     khiter_t k = kh_get(state, s_entity_state_table, uid);
@@ -183,34 +126,61 @@ static void ss_state_remove(uint32_t uid)
         kh_del(state, s_entity_state_table, k);
 }
 
-static void ss_state_destroy(struct ss_state *hs)
+static void ss_state_init(struct ss_state *hs)
 {
-    kh_destroy(int, hs->capacity);
-    kh_destroy(int, hs->curr);
-    kh_destroy(int, hs->desired);
+    res_clear(&hs->capacity);
+    res_clear(&hs->curr);
+    res_clear(&hs->desired);
+    res_clear(&hs->alt_capacity);
+    res_clear(&hs->alt_desired);
 
-    kh_destroy(int, hs->alt_capacity);
-    kh_destroy(int, hs->alt_desired);
+    hs->last_change = (struct ss_delta_event){0};
+    hs->use_alt = false;
+    hs->indexed = 0;
+    hs->indexed_faction = 0;
 }
 
-static bool ss_state_init(struct ss_state *hs)
+static bool compare_uids(uint32_t *a, uint32_t *b)
 {
-    hs->capacity = kh_init(int);
-    hs->curr = kh_init(int);
-    hs->desired = kh_init(int);
-    hs->alt_capacity = kh_init(int);
-    hs->alt_desired = kh_init(int);
+    return (*a == *b);
+}
 
-    if(!hs->capacity || !hs->curr || !hs->desired
-    || !hs->alt_capacity || !hs->alt_desired) {
+static void ss_index_set(uint32_t uid, struct ss_state *ss, int faction_id, uint32_t mask)
+{
+    if(faction_id != ss->indexed_faction) {
+        ss_index_set(uid, ss, ss->indexed_faction, 0);
+        ss->indexed_faction = faction_id;
+    }
 
-        ss_state_destroy(hs);
-        return false;
+    uint32_t del = ss->indexed & ~mask;
+    uint32_t add = mask & ~ss->indexed;
+
+    for(; del; del &= del - 1) {
+        vec_uid_t *sites = &s_site_index[faction_id][__builtin_ctz(del)];
+        int idx = vec_uid_indexof(sites, uid, compare_uids);
+        assert(idx != -1);
+        vec_uid_del(sites, idx);
+    }
+    for(; add; add &= add - 1) {
+        vec_uid_t *sites = &s_site_index[faction_id][__builtin_ctz(add)];
+        if(!vec_uid_push(sites, uid))
+            mask &= ~(1u << __builtin_ctz(add));
     }
+    ss->indexed = mask;
+}
 
-    hs->last_change = (struct ss_delta_event){0};
-    hs->use_alt = false;
-    return true;
+static void ss_index_update(const struct entity *ent, struct ss_state *ss)
+{
+    int id;
+    int amount;
+    uint32_t mask = 0;
+    struct res_table *cap = ss->use_alt ? &ss->alt_capacity : &ss->capacity;
+
+    res_foreach(cap, id, amount, {
+        if(amount != 0)
+            mask |= (1u << id);
+    });
+    ss_index_set(ent->uid, ss, ent->faction_id, mask);
 }
 
 static int compare_keys(const void *a, const void *b)
@@ -224,114 +194,72 @@ static size_t ss_get_keys(struct ss_state *hs, const char **out, size_t maxout)
 {
     size_t ret = 0;
 
-    const char *key;
+    int id;
     int amount;
-    khash_t(int) *table = (hs->use_alt) ? hs->alt_capacity : hs->capacity;
+    struct res_table *table = (hs->use_alt) ? &hs->alt_capacity : &hs->capacity;
 
-    kh_foreach(table, key, amount, {
+    res_foreach(table, id, amount, {
         if(ret == maxout)
             break;
         if(amount == 0)
             continue;
-        out[ret++] = key;
+        out[ret++] = G_Resource_IDName(id);
     });
 
     qsort(out, ret, sizeof(char*), compare_keys);
     return ret;
 }
 
-static bool ss_state_set_key(khash_t(int) *table, const char *name, int val)
+static bool ss_state_get_key(const struct res_table *table, int id, int *out)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(int, table, key);
-    if(k != kh_end(table)) {
-        kh_value(table, k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(int, table, key, &status);
-    if(status == -1)
+    if(!res_exists(table, id))
         return false;
-
-    assert(status == 1);
-    kh_value(table, k) = val;
+    *out = table->vals[id];
     return true;
 }
 
-static bool ss_state_get_key(khash_t(int) *table, const char *name, int *out)
+static void update_res_delta(int id, int delta, int faction_id)
 {
-    const char *key = si_intern(name, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(int, table, key);
-    if(k == kh_end(table))
-        return false;
-    *out = kh_value(table, k);
-    return true;
+    struct res_table *table = &s_global_resource_tables[faction_id];
+    int val = res_exists(table, id) ? table->vals[id] : 0;
+    res_set(table, id, val + delta);
 }
 
-static bool update_res_delta(const char *rname, int delta, int faction_id)
+static void update_cap_delta(int id, int delta, int faction_id)
 {
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(res, s_global_resource_tables[faction_id], key);
-    if(k != kh_end(s_global_resource_tables[faction_id])) {
-        int val = kh_value(s_global_resource_tables[faction_id], k);
-        val += delta;
-        kh_value(s_global_resource_tables[faction_id], k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(res, s_global_resource_tables[faction_id], key, &status);
-    if(status == -1)
-        return false;
-
-    assert(status == 1);
-    kh_value(s_global_resource_tables[faction_id], k) = delta;
-    return true;
+    struct res_table *table = &s_global_capacity_tables[faction_id];
+    int val = res_exists(table, id) ? table->vals[id] : 0;
+    res_set(table, id, val + delta);
 }
 
-static bool update_cap_delta(const char *rname, int delta, int faction_id)
+static void constrain_desired(struct ss_state *ss, int id)
 {
-    const char *key = si_intern(rname, &s_stringpool, s_stridx);
-    if(!key)
-        return false;
-
-    khiter_t k = kh_get(res, s_global_capacity_tables[faction_id], key);
-    if(k != kh_end(s_global_capacity_tables[faction_id])) {
-        int val = kh_value(s_global_capacity_tables[faction_id], k);
-        val += delta;
-        kh_value(s_global_capacity_tables[faction_id], k) = val;
-        return true;
-    }
-
-    int status;
-    k = kh_put(res, s_global_capacity_tables[faction_id], key, &status);
-    if(status == -1)
-        return false;
+    int cap = 0, desired = 0;
+    ss_state_get_key(&ss->capacity, id, &cap);
+    ss_state_get_key(&ss->desired, id, &desired);
 
-    assert(status == 1);
-    kh_value(s_global_capacity_tables[faction_id], k) = delta;
-    return true;
+    desired = MIN(desired, cap);
+    desired = MAX(desired, 0);
+    res_set(&ss->desired, id, desired);
 }
 
-static void constrain_desired(struct ss_state *ss, const char *rname)
+static int player_total(const struct res_table tables[static MAX_FACTIONS], const char *rname)
 {
-    int cap = 0, desired = 0;
-    ss_state_get_key(ss->capacity, rname, &cap);
-    ss_state_get_key(ss->desired, rname, &desired);
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return 0;
 
-    desired = MIN(desired, cap);
-    desired = MAX(desired, 0);
-    ss_state_set_key(ss->desired, rname, desired);
+    int ret = 0;
+    uint16_t pfacs = G_GetPlayerControlledFactions();
+
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        if(!(pfacs & (0x1 << i)))
+            continue;
+        if(!res_exists(&tables[i], id))
+            continue;
+        ret += tables[i].vals[id];
+    }
+    return ret;
 }
 
 static void on_update_ui(void *user, void *event)
@@ -350,10 +278,10 @@ static void on_update_ui(void *user, void *event)
 
         const struct entity *ent = G_EntityForUID(key);
         vec2_t ss_pos = Entity_TopScreenPos(ent);
-        khash_t(int) *table = (curr.use_alt) ? curr.alt_capacity : curr.capacity;
+        const struct res_table *table = (curr.use_alt) ? &curr.alt_capacity : &curr.capacity;
 
         const int width = 224;
-        const int height = MIN(kh_size(table), 16) * 20 + 4;
+        const int height = MIN(res_size(table), 16) * 20 + 4;
         const vec2_t pos = (vec2_t){ss_pos.x - width/2, ss_pos.y + 20};
         const int flags = NK_WINDOW_NOT_INTERACTIVE | NK_WINDOW_BORDER | NK_WINDOW_BACKGROUND | NK_WINDOW_NO_SCROLLBAR;
 
@@ -467,17 +395,17 @@ static bool save_global_resources(int i, SDL_RWops *stream)
 {
     struct attr num_global_resources = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = kh_size(s_global_resource_tables[i])
+        .val.as_int = res_size(&s_global_resource_tables[i])
     };
     CHK_TRUE_RET(Attr_Write(stream, &num_global_resources, "num_global_resources"));
 
-    const char *resource_key;
+    int resource_id;
     int resource_amount;
 
-    kh_foreach(s_global_resource_tables[i], resource_key, resource_amount, {
+    res_foreach(&s_global_resource_tables[i], resource_id, resource_amount, {
     
         struct attr resource_key_attr = (struct attr){ .type = TYPE_STRING, };
-        pf_strlcpy(resource_key_attr.val.as_string, resource_key, sizeof(resource_key_attr.val.as_string));
+        pf_strlcpy(resource_key_attr.val.as_string, G_Resource_IDName(resource_id), sizeof(resource_key_attr.val.as_string));
         CHK_TRUE_RET(Attr_Write(stream, &resource_key_attr, "resource_key"));
 
         struct attr resource_amount_attr = (struct attr){
@@ -508,11 +436,9 @@ static bool load_global_resources(int i, SDL_RWops *stream)
         CHK_TRUE_RET(attr.type == TYPE_INT);
         int val = attr.val.as_int;
 
-        khiter_t k = kh_get(res, s_global_resource_tables[i], key);
-        if(k == kh_end(s_global_resource_tables[i])) {
-            k = kh_put(res, s_global_resource_tables[i], key, &(int){0});
-        }
-        kh_value(s_global_resource_tables[i], k) = val;
+        int id = G_Resource_NameID(key);
+        CHK_TRUE_RET(id >= 0);
+        res_set(&s_global_resource_tables[i], id, val);
     }
     return true;
 }
@@ -521,17 +447,17 @@ static bool save_global_capacities(int i, SDL_RWops *stream)
 {
     struct attr num_global_capacities = (struct attr){
         .type = TYPE_INT,
-        .val.as_int = kh_size(s_global_capacity_tables[i])
+        .val.as_int = res_size(&s_global_capacity_tables[i])
     };
     CHK_TRUE_RET(Attr_Write(stream, &num_global_capacities, "num_global_capacities"));
 
-    const char *capacity_key;
+    int capacity_id;
     int capacity_amount;
 
-    kh_foreach(s_global_capacity_tables[i], capacity_key, capacity_amount, {
+    res_foreach(&s_global_capacity_tables[i], capacity_id, capacity_amount, {
     
         struct attr capacity_key_attr = (struct attr){ .type = TYPE_STRING, };
-        pf_strlcpy(capacity_key_attr.val.as_string, capacity_key, sizeof(capacity_key_attr.val.as_string));
+        pf_strlcpy(capacity_key_attr.val.as_string, G_Resource_IDName(capacity_id), sizeof(capacity_key_attr.val.as_string));
         CHK_TRUE_RET(Attr_Write(stream, &capacity_key_attr, "capacity_key"));
 
         struct attr capacity_amount_attr = (struct attr){
@@ -562,11 +488,9 @@ static bool load_global_capacities(int i, SDL_RWops *stream)
         CHK_TRUE_RET(attr.type == TYPE_INT);
         int val = attr.val.as_int;
 
-        khiter_t k = kh_get(res, s_global_capacity_tables[i], key);
-        if(k == kh_end(s_global_capacity_tables[i])) {
-            k = kh_put(res, s_global_capacity_tables[i], key, &(int){0});
-        }
-        kh_value(s_global_capacity_tables[i], k) = val;
+        int id = G_Resource_NameID(key);
+        CHK_TRUE_RET(id >= 0);
+        res_set(&s_global_capacity_tables[i], id, val);
     }
     return true;
 }
@@ -577,34 +501,19 @@ static bool load_global_capacities(int i, SDL_RWops *stream)
 
 bool G_StorageSite_Init(void)
 {
-    mp_buff_init(&s_mpool);
-
-    if(!mp_buff_reserve(&s_mpool, 4096 * 3))
-        goto fail_mpool; 
     if(!(s_entity_state_table = kh_init(state)))
         goto fail_table;
     if(0 != kh_resize(state, s_entity_state_table, 4096))
         goto fail_res;
 
     for(int i = 0; i < MAX_FACTIONS; i++) {
-        if(!(s_global_resource_tables[i] = kh_init(res))) {
-            for(--i; i; i--)
-                kh_destroy(res, s_global_resource_tables[i]);
-            goto fail_res;
-        }
-    }
-
-    for(int i = 0; i < MAX_FACTIONS; i++) {
-        if(!(s_global_capacity_tables[i] = kh_init(res))) {
-            for(--i; i; i--)
-                kh_destroy(res, s_global_capacity_tables[i]);
-            goto fail_cap;
+        res_clear(&s_global_resource_tables[i]);
+        res_clear(&s_global_capacity_tables[i]);
+        for(int j = 0; j < MAX_RESOURCE_TYPES; j++) {
+            vec_uid_init(&s_site_index[i][j]);
         }
     }
 
-    if(!si_init(&s_stringpool, &s_stridx, 512))
-        goto fail_strintern;
-
     struct nk_context ctx;
     nk_style_default(&ctx);
 
@@ -615,17 +524,9 @@ bool G_StorageSite_Init(void)
     E_Global_Register(EVENT_UPDATE_UI, on_update_ui, NULL, G_RUNNING | G_PAUSED_UI_RUNNING | G_PAUSED_FULL);
     return true;
 
-fail_strintern:
-    for(int i = 0; i < MAX_FACTIONS; i++)
-        kh_destroy(res, s_global_capacity_tables[i]);
-fail_cap:
-    for(int i = 0; i < MAX_FACTIONS; i++)
-        kh_destroy(res, s_global_resource_tables[i]);
 fail_res:
     kh_destroy(state, s_entity_state_table);
 fail_table:
-    mp_buff_destroy(&s_mpool);
-fail_mpool:
     return false;
 }
 
@@ -633,21 +534,29 @@ void G_StorageSite_Shutdown(void)
 {
     E_Global_Unregister(EVENT_UPDATE_UI, on_update_ui);
 
-    for(int i = 0; i < MAX_FACTIONS; i++)
-        kh_destroy(res, s_global_capacity_tables[i]);
-    for(int i = 0; i < MAX_FACTIONS; i++)
-        kh_destroy(res, s_global_resource_tables[i]);
-
-    si_shutdown(&s_stringpool, s_stridx);
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        for(int j = 0; j < MAX_RESOURCE_TYPES; j++) {
+            vec_uid_destroy(&s_site_index[i][j]);
+        }
+    }
     kh_destroy(state, s_entity_state_table);
-    mp_buff_destroy(&s_mpool);
+}
+
+void G_StorageSite_Clear(void)
+{
+    for(int i = 0; i < MAX_FACTIONS; i++) {
+        res_clear(&s_global_resource_tables[i]);
+        res_clear(&s_global_capacity_tables[i]);
+        for(int j = 0; j < MAX_RESOURCE_TYPES; j++) {
+            assert(vec_size(&s_site_index[i][j]) == 0);
+        }
+    }
 }
 
 bool G_StorageSite_AddEntity(const struct entity *ent)
 {
     struct ss_state ss;
-    if(!ss_state_init(&ss))
-        return false;
+    ss_state_init(&ss);
     if(!ss_state_set(ent->uid, ss))
         return false;
     return true;
@@ -659,19 +568,19 @@ void G_StorageSite_RemoveEntity(const struct entity *ent)
     if(!ss)
         return;
 
-    const char *key;
+    int id;
     int amount;
 
-    kh_foreach(ss->curr, key, amount, {
-        update_res_delta(key, -amount, ent->faction_id);
+    res_foreach(&ss->curr, id, amount, {
+        update_res_delta(id, -amount, ent->faction_id);
     });
 
-    khash_t(int) *cap = ss->use_alt ? ss->alt_capacity : ss->capacity;
-    kh_foreach(cap, key, amount, {
-        update_cap_delta(key, -amount, ent->faction_id);
+    struct res_table *cap = ss->use_alt ? &ss->alt_capacity : &ss->capacity;
+    res_foreach(cap, id, amount, {
+        update_cap_delta(id, -amount, ent->faction_id);
     });
 
-    ss_state_destroy(ss);
+    ss_index_set(ent->uid, ss, ss->indexed_faction, 0);
     ss_state_remove(ent->uid);
 }
 
@@ -680,12 +589,13 @@ bool G_StorageSite_IsSaturated(uint32_t uid)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    const char *key;
+    int id;
     int amount;
-    khash_t(int) *table = ss->use_alt ? ss->alt_capacity : ss->capacity;
+    struct res_table *table = ss->use_alt ? &ss->alt_capacity : &ss->capacity;
 
-    kh_foreach(table, key, amount, {
-        int curr = G_StorageSite_GetCurr(uid, key);
+    res_foreach(table, id, amount, {
+        int curr = 0;
+        ss_state_get_key(&ss->curr, id, &curr);
         if(curr < amount)
             return false;
     });
@@ -697,17 +607,22 @@ bool G_StorageSite_SetCapacity(const struct entity *ent, const char *rname, int
     struct ss_state *ss = ss_state_get(ent->uid);
     assert(ss);
 
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return false;
+
     int prev = 0;
-    ss_state_get_key(ss->curr, rname, &prev);
+    ss_state_get_key(&ss->curr, id, &prev);
     int delta = max - prev;
 
     if(!ss->use_alt) {
-        update_cap_delta(rname, delta, ent->faction_id);
+        update_cap_delta(id, delta, ent->faction_id);
     }
 
-    bool ret = ss_state_set_key(ss->capacity, rname, max);
-    constrain_desired(ss, rname);
-    return ret;
+    res_set(&ss->capacity, id, max);
+    constrain_desired(ss, id);
+    ss_index_update(ent, ss);
+    return true;
 }
 
 int G_StorageSite_GetCapacity(uint32_t uid, const char *rname)
@@ -716,7 +631,11 @@ int G_StorageSite_GetCapacity(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    ss_state_get_key(ss->capacity, rname, &ret);
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return ret;
+
+    ss_state_get_key(&ss->capacity, id, &ret);
     return ret;
 }
 
@@ -725,20 +644,25 @@ bool G_StorageSite_SetCurr(const struct entity *ent, const char *rname, int curr
     struct ss_state *ss = ss_state_get(ent->uid);
     assert(ss);
 
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return false;
+
     int prev = 0;
-    ss_state_get_key(ss->curr, rname, &prev);
+    ss_state_get_key(&ss->curr, id, &prev);
     int delta = curr - prev;
-    update_res_delta(rname, delta, ent->faction_id);
+    update_res_delta(id, delta, ent->faction_id);
 
     if(delta) {
         ss->last_change = (struct ss_delta_event){
-            .name = si_intern(rname, &s_stringpool, s_stridx),
+            .name = G_Resource_IDName(id),
             .delta = delta
         };
         E_Entity_Notify(EVENT_STORAGE_SITE_AMOUNT_CHANGED, ent->uid, &ss->last_change, ES_ENGINE);
     }
 
-    return ss_state_set_key(ss->curr, rname, curr);
+    res_set(&ss->curr, id, curr);
+    return true;
 }
 
 int G_StorageSite_GetCurr(uint32_t uid, const char *rname)
@@ -747,7 +671,11 @@ int G_StorageSite_GetCurr(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    ss_state_get_key(ss->curr, rname, &ret);
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return ret;
+
+    ss_state_get_key(&ss->curr, id, &ret);
     return ret;
 }
 
@@ -755,9 +683,14 @@ bool G_StorageSite_SetDesired(uint32_t uid, const char *rname, int des)
 {
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
-    bool ret = ss_state_set_key(ss->desired, rname, des);
-    constrain_desired(ss, rname);
-    return ret;
+
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return false;
+
+    res_set(&ss->desired, id, des);
+    constrain_desired(ss, id);
+    return true;
 }
 
 int G_StorageSite_GetDesired(uint32_t uid, const char *rname)
@@ -766,40 +699,94 @@ int G_StorageSite_GetDesired(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    ss_state_get_key(ss->desired, rname, &ret);
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return ret;
+
+    ss_state_get_key(&ss->desired, id, &ret);
     return ret;
 }
 
 int G_StorageSite_GetPlayerStored(const char *rname)
+{
+    return player_total(s_global_resource_tables, rname);
+}
+
+int G_StorageSite_GetPlayerCapacity(const char *rname)
+{
+    return player_total(s_global_capacity_tables, rname);
+}
+
+int G_StorageSite_GetCurrByID(uint32_t uid, int rid)
 {
     int ret = 0;
-    uint16_t pfacs = G_GetPlayerControlledFactions();
+    struct ss_state *ss = ss_state_get(uid);
+    assert(ss);
 
-    for(int i = 0; i < MAX_FACTIONS; i++) {
-        if(!(pfacs & (0x1 << i)))
-            continue;
-        khiter_t k = kh_get(res, s_global_resource_tables[i], rname);
-        if(k == kh_end(s_global_resource_tables[i]))
-            continue;
-        ret += kh_value(s_global_resource_tables[i], k);
-    }
+    ss_state_get_key(&ss->curr, rid, &ret);
     return ret;
 }
 
-int G_StorageSite_GetPlayerCapacity(const char *rname)
+int G_StorageSite_GetInUseCapacityByID(uint32_t uid, int rid)
 {
-    int ret = 0;
-    uint16_t pfacs = G_GetPlayerControlledFactions();
+    int ret = DEFAULT_CAPACITY;
+    struct ss_state *ss = ss_state_get(uid);
+    assert(ss);
 
-    for(int i = 0; i < MAX_FACTIONS; i++) {
-        if(!(pfacs & (0x1 << i)))
+    ss_state_get_key(ss->use_alt ? &ss->alt_capacity : &ss->capacity, rid, &ret);
+    return ret;
+}
+
+int G_StorageSite_GetInUseDesiredByID(uint32_t uid, int rid)
+{
+    int ret = DEFAULT_CAPACITY;
+    struct ss_state *ss = ss_state_get(uid);
+    assert(ss);
+
+    ss_state_get_key(ss->use_alt ? &ss->alt_desired : &ss->desired, rid, &ret);
+    return ret;
+}
+
+struct entity *G_StorageSite_Nearest(vec2_t xz_point, int faction_id, int rid,
+                                     bool (*predicate)(const struct entity *ent, void *arg), 
+                                     void *arg)
+{
+    PERF_ENTER();
+    assert(faction_id >= 0 && faction_id < MAX_FACTIONS);
+    assert(rid >= 0 && rid < MAX_RESOURCE_TYPES);
+
+    const vec_uid_t *sites = &s_site_index[faction_id][rid];
+    struct entity *ret = NULL;
+    float best2 = FLT_MAX;
+
+    for(int i = 0; i < vec_size(sites); i++) {
+
+        uint32_t uid = vec_AT(sites, i);
+        vec2_t pos = G_Pos_GetXZ(uid);
+        vec2_t delta;
+        PFM_Vec2_Sub(&pos, &xz_point, &delta);
+
+        float dist2 = PFM_Vec2_Dot(&delta, &delta);
+        if(dist2 >= best2)
             continue;
-        khiter_t k = kh_get(res, s_global_capacity_tables[i], rname);
-        if(k == kh_end(s_global_capacity_tables[i]))
+
+        struct entity *ent = G_EntityForUID(uid);
+        assert(ent);
+        if(!predicate(ent, arg))
             continue;
-        ret += kh_value(s_global_capacity_tables[i], k);
+
+        best2 = dist2;
+        ret = ent;
     }
-    return ret;
+    PERF_RETURN(ret);
+}
+
+void G_StorageSite_UpdateFaction(const struct entity *ent)
+{
+    struct ss_state *ss = ss_state_get(ent->uid);
+    if(!ss)
+        return;
+    ss_index_update(ent, ss);
 }
 
 int G_StorageSite_GetStorableResources(uint32_t uid, size_t maxout, const char *out[static maxout])
@@ -832,25 +819,26 @@ void G_StorageSite_SetUseAlt(const struct entity *ent, bool use)
     if(use == ss->use_alt)
         return;
 
-    const char *key;
+    int id;
     int amount;
 
     if(use) {
-        kh_foreach(ss->capacity, key, amount, {
-            update_cap_delta(key, -amount, ent->faction_id);
+        res_foreach(&ss->capacity, id, amount, {
+            update_cap_delta(id, -amount, ent->faction_id);
         });
-        kh_foreach(ss->alt_capacity, key, amount, {
-            update_cap_delta(key, amount, ent->faction_id);
+        res_foreach(&ss->alt_capacity, id, amount, {
+            update_cap_delta(id, amount, ent->faction_id);
         });
     }else{
-        kh_foreach(ss->alt_capacity, key, amount, {
-            update_cap_delta(key, -amount, ent->faction_id);
+        res_foreach(&ss->alt_capacity, id, amount, {
+            update_cap_delta(id, -amount, ent->faction_id);
         });
-        kh_foreach(ss->capacity, key, amount, {
-            update_cap_delta(key, amount, ent->faction_id);
+        res_foreach(&ss->capacity, id, amount, {
+            update_cap_delta(id, amount, ent->faction_id);
         });
     }
     ss->use_alt = use;
+    ss_index_update(ent, ss);
 }
 
 bool G_StorageSite_GetUseAlt(uint32_t uid)
@@ -866,16 +854,17 @@ void G_StorageSite_ClearAlt(const struct entity *ent)
     assert(ss);
 
     if(ss->use_alt) {
-        const char *key;
+        int id;
         int amount;
 
-        kh_foreach(ss->alt_capacity, key, amount, {
-            update_cap_delta(key, -amount, ent->faction_id);
+        res_foreach(&ss->alt_capacity, id, amount, {
+            update_cap_delta(id, -amount, ent->faction_id);
         });
     }
 
-    kh_clear(int, ss->alt_capacity);
-    kh_clear(int, ss->alt_desired);
+    res_clear(&ss->alt_capacity);
+    res_clear(&ss->alt_desired);
+    ss_index_update(ent, ss);
 }
 
 void G_StorageSite_ClearCurr(const struct entity *ent)
@@ -883,14 +872,14 @@ void G_StorageSite_ClearCurr(const struct entity *ent)
     struct ss_state *ss = ss_state_get(ent->uid);
     assert(ss);
 
-    const char *key;
+    int id;
     int amount;
 
-    kh_foreach(ss->alt_capacity, key, amount, {
-        update_cap_delta(key, -amount, ent->faction_id);
+    res_foreach(&ss->alt_capacity, id, amount, {
+        update_cap_delta(id, -amount, ent->faction_id);
     });
 
-    kh_clear(int, ss->curr);
+    res_clear(&ss->curr);
 }
 
 bool G_StorageSite_SetAltCapacity(const struct entity *ent, const char *rname, int max)
@@ -898,17 +887,22 @@ bool G_StorageSite_SetAltCapacity(const struct entity *ent, const char *rname, i
     struct ss_state *ss = ss_state_get(ent->uid);
     assert(ss);
 
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return false;
+
     int prev = 0;
-    ss_state_get_key(ss->curr, rname, &prev);
+    ss_state_get_key(&ss->curr, id, &prev);
     int delta = max - prev;
 
     if(ss->use_alt) {
-        update_cap_delta(rname, delta, ent->faction_id);
+        update_cap_delta(id, delta, ent->faction_id);
     }
 
-    bool ret = ss_state_set_key(ss->alt_capacity, rname, max);
-    constrain_desired(ss, rname);
-    return ret;
+    res_set(&ss->alt_capacity, id, max);
+    constrain_desired(ss, id);
+    ss_index_update(ent, ss);
+    return true;
 }
 
 int G_StorageSite_GetAltCapacity(uint32_t uid, const char *rname)
@@ -917,7 +911,11 @@ int G_StorageSite_GetAltCapacity(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    ss_state_get_key(ss->alt_capacity, rname, &ret);
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return ret;
+
+    ss_state_get_key(&ss->alt_capacity, id, &ret);
     return ret;
 }
 
@@ -925,9 +923,14 @@ bool G_StorageSite_SetAltDesired(uint32_t uid, const char *rname, int des)
 {
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
-    bool ret = ss_state_set_key(ss->alt_desired, rname, des);
-    constrain_desired(ss, rname);
-    return ret;
+
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return false;
+
+    res_set(&ss->alt_desired, id, des);
+    constrain_desired(ss, id);
+    return true;
 }
 
 int G_StorageSite_GetAltDesired(uint32_t uid, const char *rname)
@@ -936,7 +939,11 @@ int G_StorageSite_GetAltDesired(uint32_t uid, const char *rname)
     struct ss_state *ss = ss_state_get(uid);
     assert(ss);
 
-    ss_state_get_key(ss->alt_desired, rname, &ret);
+    int id = G_Resource_NameID(rname);
+    if(id < 0)
+        return ret;
+
+    ss_state_get_key(&ss->alt_desired, id, &ret);
     return ret;
 }
 
@@ -967,16 +974,16 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr num_capacity = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.capacity)
+            .val.as_int = res_size(&curr.capacity)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_capacity, "num_capacity"));
 
-        const char *cap_key;
+        int cap_id;
         int cap_amount;
-        kh_foreach(curr.capacity, cap_key, cap_amount, {
+        res_foreach(&curr.capacity, cap_id, cap_amount, {
         
             struct attr cap_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(cap_key_attr.val.as_string, cap_key, sizeof(cap_key_attr.val.as_string));
+            pf_strlcpy(cap_key_attr.val.as_string, G_Resource_IDName(cap_id), sizeof(cap_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &cap_key_attr, "cap_key"));
 
             struct attr cap_amount_attr = (struct attr){
@@ -988,16 +995,16 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr num_curr = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.curr)
+            .val.as_int = res_size(&curr.curr)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_curr, "num_curr"));
 
-        const char *curr_key;
+        int curr_id;
         int curr_amount;
-        kh_foreach(curr.curr, curr_key, curr_amount, {
+        res_foreach(&curr.curr, curr_id, curr_amount, {
         
             struct attr curr_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(curr_key_attr.val.as_string, curr_key, sizeof(curr_key_attr.val.as_string));
+            pf_strlcpy(curr_key_attr.val.as_string, G_Resource_IDName(curr_id), sizeof(curr_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &curr_key_attr, "curr_key"));
 
             struct attr curr_amount_attr = (struct attr){
@@ -1009,16 +1016,16 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr num_desired = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.desired)
+            .val.as_int = res_size(&curr.desired)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_desired, "num_desired"));
 
-        const char *desired_key;
+        int desired_id;
         int desired_amount;
-        kh_foreach(curr.desired, desired_key, desired_amount, {
+        res_foreach(&curr.desired, desired_id, desired_amount, {
         
             struct attr desired_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(desired_key_attr.val.as_string, desired_key, sizeof(desired_key_attr.val.as_string));
+            pf_strlcpy(desired_key_attr.val.as_string, G_Resource_IDName(desired_id), sizeof(desired_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &desired_key_attr, "desired_key"));
 
             struct attr desired_amount_attr = (struct attr){
@@ -1030,16 +1037,16 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr num_alt_cap = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.alt_capacity)
+            .val.as_int = res_size(&curr.alt_capacity)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_alt_cap, "num_alt_cap"));
 
-        const char *alt_cap_key;
+        int alt_cap_id;
         int alt_cap_amount;
-        kh_foreach(curr.alt_capacity, alt_cap_key, alt_cap_amount, {
+        res_foreach(&curr.alt_capacity, alt_cap_id, alt_cap_amount, {
         
             struct attr alt_cap_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(alt_cap_key_attr.val.as_string, alt_cap_key, sizeof(alt_cap_key_attr.val.as_string));
+            pf_strlcpy(alt_cap_key_attr.val.as_string, G_Resource_IDName(alt_cap_id), sizeof(alt_cap_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &alt_cap_key_attr, "alt_cap_key"));
 
             struct attr alt_cap_amount_attr = (struct attr){
@@ -1051,16 +1058,16 @@ bool G_StorageSite_SaveState(struct SDL_RWops *stream)
 
         struct attr num_alt_desired = (struct attr){
             .type = TYPE_INT,
-            .val.as_int = kh_size(curr.alt_desired)
+            .val.as_int = res_size(&curr.alt_desired)
         };
         CHK_TRUE_RET(Attr_Write(stream, &num_alt_desired, "num_alt_desired"));
 
-        const char *alt_desired_key;
+        int alt_desired_id;
         int alt_desired_amount;
-        kh_foreach(curr.alt_desired, alt_desired_key, alt_desired_amount, {
+        res_foreach(&curr.alt_desired, alt_desired_id, alt_desired_amount, {
         
             struct attr alt_desired_key_attr = (struct attr){ .type = TYPE_STRING, };
-            pf_strlcpy(alt_desired_key_attr.val.as_string, alt_desired_key, sizeof(alt_desired_key_attr.val.as_string));
+            pf_strlcpy(alt_desired_key_attr.val.as_string, G_Resource_IDName(alt_desired_id), sizeof(alt_desired_key_attr.val.as_string));
             CHK_TRUE_RET(Attr_Write(stream, &alt_desired_key_attr, "alt_desired_key"));
 
             struct attr alt_desired_amount_attr = (struct attr){
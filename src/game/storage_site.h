@@ -40,6 +40,8 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "../pf_math.h"
+
 #define DEFAULT_CAPACITY (0)
 
 struct entity;
@@ -47,6 +49,9 @@ struct SDL_RWops;
 
 bool G_StorageSite_Init(void);
 void G_StorageSite_Shutdown(void);
+/* Forget the global resource totals of all factions. Called once all the 
+ * storage sites have been removed. */
+void G_StorageSite_Clear(void);
 bool G_StorageSite_AddEntity(const struct entity *ent);
 void G_StorageSite_RemoveEntity(const struct entity *ent);
 bool G_StorageSite_IsSaturated(uint32_t uid);
@@ -64,5 +69,17 @@ int  G_StorageSite_GetAltCapacity(uint32_t uid, const char *rname);
 bool G_StorageSite_SetAltDesired(uint32_t uid, const char *rname, int des);
 int  G_StorageSite_GetAltDesired(uint32_t uid, const char *rname);
 
+/* Lookups by resource name ID (see G_Resource_NameID). The 'InUse' variants 
+ * return the alternative parameters when they are turned on. */
+int  G_StorageSite_GetCurrByID(uint32_t uid, int rid);
+int  G_StorageSite_GetInUseCapacityByID(uint32_t uid, int rid);
+int  G_StorageSite_GetInUseDesiredByID(uint32_t uid, int rid);
+
+/* Returns the closest storage site of the faction that satisfies the predicate. 
+ * Only the sites with a non-zero capacity for the resource are considered. */
+struct entity *G_StorageSite_Nearest(vec2_t xz_point, int faction_id, int rid,
+                                     bool (*predicate)(const struct entity *ent, void *arg), 
+                                     void *arg);
+
 #endif
 
@@ -36,6 +36,7 @@
 #include "public/game.h"
 #include "timer_events.h"
 #include "../event.h"
+#include "../main.h"
 
 #include <math.h>
 #include <assert.h>
@@ -110,9 +111,13 @@ static void timer_60hz_handler(void *unused1, void *unused2)
 
 bool G_Timer_Init(void)
 {
-    s_60hz_timer = SDL_AddTimer(TIMER_INTERVAL, timer_callback, NULL);
-    if(0 == s_60hz_timer)
-        return false;
+    /* In headless mode, the 60Hz ticks are driven by the virtual clock of
+     * the main loop instead */
+    if(!Engine_Headless()) {
+        s_60hz_timer = SDL_AddTimer(TIMER_INTERVAL, timer_callback, NULL);
+        if(0 == s_60hz_timer)
+            return false;
+    }
 
     /* We will still generate timer events while the simulation is paused.
      * Most handlers should be masked out, however. */
@@ -124,6 +129,8 @@ bool G_Timer_Init(void)
 void G_Timer_Shutdown(void)
 {
     E_Global_Unregister(EVENT_60HZ_TICK, timer_60hz_handler);
-    SDL_RemoveTimer(s_60hz_timer);
+    if(s_60hz_timer) {
+        SDL_RemoveTimer(s_60hz_timer);
+    }
 }
 
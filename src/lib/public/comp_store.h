@@ -0,0 +1,277 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef COMP_STORE_H
+#define COMP_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* A store of per-entity components, keyed by UID. The components are kept 
+ * packed in a single array, so that iterating over them touches contiguous 
+ * memory. The UID of an entity is mapped to the slot of its' component via 
+ * a paged sparse array, which takes two loads rather than a hash probe. 
+ *
+ * A slot is not moved for as long as the component is in the store. Freed 
+ * slots are recycled before the array grows, keeping it dense. Since the 
+ * engine doesn't reuse UIDs, the UID itself disambiguates the successive 
+ * owners of a slot. */
+
+#define CS_PAGE_SHIFT (10)
+#define CS_PAGE_SIZE  (1 << CS_PAGE_SHIFT)
+#define CS_PAGE_MASK  (CS_PAGE_SIZE - 1)
+
+struct cs_page{
+    uint32_t nused;
+    /* The slot index plus one, or zero for UIDs not in the store */
+    uint32_t slots[CS_PAGE_SIZE];
+};
+
+/***********************************************************************************************/
+
+#define COMP_STORE_TYPE(name, type)                                                             \
+                                                                                                \
+    typedef struct cs_##name##_s {                                                              \
+        size_t           size;                                                                  \
+        size_t           nslots;                                                                \
+        size_t           capacity;                                                              \
+        uint32_t         free_head;                                                             \
+        /* For a live slot, the owner's UID. For a free slot, the next free slot plus one */    \
+        uint32_t        *uids;                                                                  \
+        bool            *live;                                                                  \
+        type            *items;                                                                 \
+        size_t           npages;                                                                \
+        struct cs_page **pages;                                                                 \
+    } cs_##name##_t;
+
+/***********************************************************************************************/
+
+#define cs(name)                                                                                \
+    cs_##name##_t
+
+#define cs_size(cs)                                                                             \
+    ((cs)->size)
+
+/* Iterate over the components in slot order. The component is copied into 'vvar'. */
+#define cs_foreach(cs, kvar, vvar, ...)                                                         \
+    {                                                                                           \
+        for(size_t __i = 0; __i < (cs)->nslots; __i++) {                                        \
+            if(!(cs)->live[__i]) continue;                                                      \
+            (kvar) = (cs)->uids[__i];                                                           \
+            (vvar) = (cs)->items[__i];                                                          \
+            __VA_ARGS__;                                                                        \
+        }                                                                                       \
+    }
+
+/* Same as 'cs_foreach', but 'pvar' is set to point to the component */
+#define cs_foreach_ptr(cs, kvar, pvar, ...)                                                     \
+    {                                                                                           \
+        for(size_t __i = 0; __i < (cs)->nslots; __i++) {                                        \
+            if(!(cs)->live[__i]) continue;                                                      \
+            (kvar) = (cs)->uids[__i];                                                           \
+            (pvar) = &(cs)->items[__i];                                                         \
+            __VA_ARGS__;                                                                        \
+        }                                                                                       \
+    }
+
+/***********************************************************************************************/
+
+#define COMP_STORE_PROTOTYPES(scope, name, type)                                                \
+                                                                                                \
+    scope void  cs_##name##_init    (cs(name) *cs);                                             \
+    scope void  cs_##name##_destroy (cs(name) *cs);                                             \
+    scope void  cs_##name##_clear   (cs(name) *cs);                                             \
+    /* The returned pointer is invalidated when new components are added */                    \
+    scope type *cs_##name##_get     (const cs(name) *cs, uint32_t uid);                         \
+    scope bool  cs_##name##_contains(const cs(name) *cs, uint32_t uid);                         \
+    scope bool  cs_##name##_put     (cs(name) *cs, uint32_t uid, const type *in);               \
+    scope bool  cs_##name##_remove  (cs(name) *cs, uint32_t uid);                               \
+
+/***********************************************************************************************/
+
+#define COMP_STORE_IMPL(scope, name, type)                                                      \
+                                                                                                \
+    static uint32_t *_cs_##name##_slotref(const cs(name) *cs, uint32_t uid)                     \
+    {                                                                                           \
+        size_t ipage = uid >> CS_PAGE_SHIFT;                                                    \
+        if(ipage >= cs->npages || !cs->pages[ipage])                                            \
+            return NULL;                                                                        \
+        return &cs->pages[ipage]->slots[uid & CS_PAGE_MASK];                                    \
+    }                                                                                           \
+                                                                                                \
+    static bool _cs_##name##_reserve(cs(name) *cs, size_t new_cap)                              \
+    {                                                                                           \
+        if(new_cap <= cs->capacity)                                                             \
+            return true;                                                                        \
+                                                                                                \
+        uint32_t *uids = realloc(cs->uids, new_cap * sizeof(uint32_t));                         \
+        if(!uids)                                                                               \
+            return false;                                                                       \
+        cs->uids = uids;                                                                        \
+                                                                                                \
+        bool *live = realloc(cs->live, new_cap * sizeof(bool));                                 \
+        if(!live)                                                                               \
+            return false;                                                                       \
+        cs->live = live;                                                                        \
+                                                                                                \
+        type *items = realloc(cs->items, new_cap * sizeof(type));                               \
+        if(!items)                                                                              \
+            return false;                                                                       \
+        cs->items = items;                                                                      \
+                                                                                                \
+        cs->capacity = new_cap;                                                                 \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    static struct cs_page *_cs_##name##_page(cs(name) *cs, uint32_t uid)                        \
+    {                                                                                           \
+        size_t ipage = uid >> CS_PAGE_SHIFT;                                                    \
+        if(ipage >= cs->npages) {                                                               \
+                                                                                                \
+            size_t new_npages = ipage + 1;                                                      \
+            struct cs_page **pages = realloc(cs->pages, new_npages * sizeof(struct cs_page*));  \
+            if(!pages)                                                                          \
+                return NULL;                                                                    \
+            memset(pages + cs->npages, 0, (new_npages - cs->npages) * sizeof(struct cs_page*)); \
+            cs->pages = pages;                                                                  \
+            cs->npages = new_npages;                                                            \
+        }                                                                                       \
+        if(!cs->pages[ipage]) {                                                                 \
+            cs->pages[ipage] = calloc(1, sizeof(struct cs_page));                               \
+        }                                                                                       \
+        return cs->pages[ipage];                                                                \
+    }                                                                                           \
+                                                                                                \
+    scope void cs_##name##_init(cs(name) *cs)                                                   \
+    {                                                                                           \
+        memset(cs, 0, sizeof(*cs));                                                             \
+    }                                                                                           \
+                                                                                                \
+    scope void cs_##name##_destroy(cs(name) *cs)                                                \
+    {                                                                                           \
+        for(size_t i = 0; i < cs->npages; i++)                                                  \
+            free(cs->pages[i]);                                                                 \
+        free(cs->pages);                                                                        \
+        free(cs->uids);                                                                         \
+        free(cs->live);                                                                         \
+        free(cs->items);                                                                        \
+        memset(cs, 0, sizeof(*cs));                                                             \
+    }                                                                                           \
+                                                                                                \
+    scope void cs_##name##_clear(cs(name) *cs)                                                  \
+    {                                                                                           \
+        for(size_t i = 0; i < cs->npages; i++) {                                                \
+            free(cs->pages[i]);                                                                 \
+            cs->pages[i] = NULL;                                                                \
+        }                                                                                       \
+        cs->size = 0;                                                                           \
+        cs->nslots = 0;                                                                         \
+        cs->free_head = 0;                                                                      \
+    }                                                                                           \
+                                                                                                \
+    scope type *cs_##name##_get(const cs(name) *cs, uint32_t uid)                               \
+    {                                                                                           \
+        const uint32_t *ref = _cs_##name##_slotref(cs, uid);                                    \
+        if(!ref || !*ref)                                                                       \
+            return NULL;                                                                        \
+        return &cs->items[*ref - 1];                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool cs_##name##_contains(const cs(name) *cs, uint32_t uid)                           \
+    {                                                                                           \
+        const uint32_t *ref = _cs_##name##_slotref(cs, uid);                                    \
+        return (ref && *ref);                                                                   \
+    }                                                                                           \
+                                                                                                \
+    scope bool cs_##name##_put(cs(name) *cs, uint32_t uid, const type *in)                      \
+    {                                                                                           \
+        type *existing = cs_##name##_get(cs, uid);                                              \
+        if(existing) {                                                                          \
+            *existing = *in;                                                                    \
+            return true;                                                                        \
+        }                                                                                       \
+                                                                                                \
+        struct cs_page *page = _cs_##name##_page(cs, uid);                                      \
+        if(!page)                                                                               \
+            return false;                                                                       \
+                                                                                                \
+        uint32_t slot;                                                                          \
+        if(cs->free_head) {                                                                     \
+            slot = cs->free_head - 1;                                                           \
+            cs->free_head = cs->uids[slot];                                                     \
+        }else {                                                                                 \
+            if(cs->nslots == cs->capacity                                                       \
+            && !_cs_##name##_reserve(cs, cs->capacity ? cs->capacity * 2 : 64))                 \
+                return false;                                                                   \
+            slot = cs->nslots++;                                                                \
+        }                                                                                       \
+                                                                                                \
+        cs->uids[slot] = uid;                                                                   \
+        cs->live[slot] = true;                                                                  \
+        cs->items[slot] = *in;                                                                  \
+        cs->size++;                                                                             \
+                                                                                                \
+        page->slots[uid & CS_PAGE_MASK] = slot + 1;                                             \
+        page->nused++;                                                                          \
+        return true;                                                                            \
+    }                                                                                           \
+                                                                                                \
+    scope bool cs_##name##_remove(cs(name) *cs, uint32_t uid)                                   \
+    {                                                                                           \
+        uint32_t *ref = _cs_##name##_slotref(cs, uid);                                          \
+        if(!ref || !*ref)                                                                       \
+            return false;                                                                       \
+                                                                                                \
+        uint32_t slot = *ref - 1;                                                               \
+        cs->live[slot] = false;                                                                 \
+        cs->uids[slot] = cs->free_head;                                                         \
+        cs->free_head = slot + 1;                                                               \
+        cs->size--;                                                                             \
+        *ref = 0;                                                                               \
+                                                                                                \
+        size_t ipage = uid >> CS_PAGE_SHIFT;                                                    \
+        if(--cs->pages[ipage]->nused == 0) {                                                    \
+            free(cs->pages[ipage]);                                                             \
+            cs->pages[ipage] = NULL;                                                            \
+        }                                                                                       \
+        return true;                                                                            \
+    }                                                                                           \
+
+#endif
+
@@ -106,16 +106,11 @@ typedef uint16_t mp_ref_t;
         for(int i = old_cap; i < new_cap; ++i) {                                                \
             new_entry[i].inext_free = i + 1;                                                    \
         }                                                                                       \
-        new_entry[new_cap].inext_free = 0;                                                      \
-                                                                                                \
-        if(!mp->ifree_head) {                                                                   \
-            /* Skip the first node - index 0 is used as NULL */                                 \
-            mp->ifree_head = 1;                                                                 \
-        }else {                                                                                 \
-            /* Append at the front */                                                           \
-            new_entry[new_cap].inext_free = mp->ifree_head;                                     \
-            mp->ifree_head = old_cap + 1;                                                       \
-        }                                                                                       \
+                                                                                                \
+        /* Append at the front. Index 0 is used as NULL, so the first node is skipped. When   \
+         * the pool is full, the old free list is empty and the new nodes make up all of it. */ \
+        new_entry[new_cap].inext_free = mp->ifree_head;                                         \
+        mp->ifree_head = old_cap + 1;                                                           \
                                                                                                 \
         mp->pool = new_entry;                                                                   \
         mp->capacity = new_cap;                                                                 \
@@ -53,6 +53,13 @@ __KHASH_TYPE(stridx, khint32_t, mp_ref_t)
 
 bool        si_init(mp_strbuff_t *pool, khash_t(stridx) **index, size_t size);
 const char *si_intern(const char *str, mp_strbuff_t *pool, khash_t(stridx) *index);
+/* Interns the string and returns its' reference in the pool. References are handed 
+ * out densely starting from 1, so they can be used as small integer IDs. Returns 0 
+ * on failure. */
+mp_ref_t    si_intern_ref(const char *str, mp_strbuff_t *pool, khash_t(stridx) *index);
+const char *si_string(mp_strbuff_t *pool, mp_ref_t ref);
+/* Forgets all the interned strings. The references are handed out from 1 again. */
+void        si_clear(mp_strbuff_t *pool, khash_t(stridx) *index);
 void        si_shutdown(mp_strbuff_t *pool, khash_t(stridx) *index);
 
 #endif
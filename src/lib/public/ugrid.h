@@ -0,0 +1,102 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef UGRID_H
+#define UGRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UGRID_NO_CELL ((uint32_t)-1)
+
+/* The uniform grid is a flat spatial index for points that move every frame. 
+ * The area is divided into square cells. Every cell keeps its records in 
+ * tightly-packed arrays of the X and Z coordinates, so that range queries 
+ * only scan a few contiguous arrays, and the distance tests can be done 
+ * several records at a time.
+ *
+ * Moving a record within the same cell is a single write, and moving it to 
+ * another cell is a swap-remove followed by an append. The grid doesn't keep 
+ * a mapping from records to their location. Instead, the client is handed 
+ * the (cell, slot) pair on insertion and is notified when a removal causes 
+ * a record to change slots.
+ *
+ * Points outside of the bounds are placed in the nearest edge cell. All the 
+ * queries still test the exact coordinates.
+ */
+
+struct ugrid_cell{
+    uint32_t  size;
+    uint32_t  capacity;
+    float    *xs;
+    float    *zs;
+    uint32_t *recs;
+};
+
+struct ugrid{
+    float              xmin, xmax;
+    float              zmin, zmax;
+    float              cell_size;
+    int                ncols, nrows;
+    size_t             nrecs;
+    struct ugrid_cell *cells;
+};
+
+bool     ugrid_init(struct ugrid *grid, float xmin, float xmax, 
+                    float zmin, float zmax, float cell_size);
+void     ugrid_destroy(struct ugrid *grid);
+void     ugrid_clear(struct ugrid *grid);
+
+uint32_t ugrid_cell_for(const struct ugrid *grid, float x, float z);
+bool     ugrid_insert(struct ugrid *grid, uint32_t cell, float x, float z, 
+                      uint32_t rec, uint32_t *out_slot);
+/* Removes the record at 'slot'. When the last record of the cell is moved 
+ * into the freed slot, it is written to 'out_moved' and true is returned. */
+bool     ugrid_remove(struct ugrid *grid, uint32_t cell, uint32_t slot, uint32_t *out_moved);
+void     ugrid_move(struct ugrid *grid, uint32_t cell, uint32_t slot, float x, float z);
+
+int      ugrid_inrange_circle(const struct ugrid *grid, float x, float z, float range, 
+                              uint32_t *out, int maxout);
+int      ugrid_inrange_rect(const struct ugrid *grid, float minx, float maxx, 
+                            float minz, float maxz, uint32_t *out, int maxout);
+/* Finds the closest record within 'max_range' which satisfies the predicate, 
+ * searching outwards in rings of cells. */
+bool     ugrid_nearest(const struct ugrid *grid, float x, float z, float max_range,
+                       bool (*predicate)(uint32_t rec, void *arg), void *arg, 
+                       uint32_t *out);
+
+#endif
+
@@ -68,38 +68,52 @@ fail_stringpool:
     return false;
 }
 
-const char *si_intern(const char *str, mp_strbuff_t *pool, khash_t(stridx) *index)
+mp_ref_t si_intern_ref(const char *str, mp_strbuff_t *pool, khash_t(stridx) *index)
 {
     khint_t hash = kh_str_hash_func(str);
     khiter_t k = kh_get(stridx, index, hash);
 
-    if(k != kh_end(index)) {
-        mp_ref_t ref = kh_value(index, k);
-        return (const char *)mp_strbuff_entry(pool, ref);
-    }
+    if(k != kh_end(index))
+        return kh_value(index, k);
+
+    if(strlen(str) > sizeof(strbuff_t)-1)
+        return 0;
 
     mp_ref_t ref = mp_strbuff_alloc(pool);
     if(ref == 0)
-        return NULL;
+        return 0;
 
     int status;
     k = kh_put(stridx, index, hash, &status);
     if(status == -1) {
         mp_strbuff_free(pool, ref);
-        return NULL;
+        return 0;
     }
     assert(status == 1);
     kh_value(index, k) = ref;
 
-    if(strlen(str) > sizeof(strbuff_t)-1) {
-        kh_del(stridx, index, k);
-        mp_strbuff_free(pool, ref);
-        return NULL;
-    }
-
     char *ret = (char *)mp_strbuff_entry(pool, ref);
     pf_strlcpy(ret, str, sizeof(strbuff_t));
-    return ret;
+    return ref;
+}
+
+const char *si_intern(const char *str, mp_strbuff_t *pool, khash_t(stridx) *index)
+{
+    mp_ref_t ref = si_intern_ref(str, pool, index);
+    if(ref == 0)
+        return NULL;
+    return (const char *)mp_strbuff_entry(pool, ref);
+}
+
+const char *si_string(mp_strbuff_t *pool, mp_ref_t ref)
+{
+    return (const char *)mp_strbuff_entry(pool, ref);
+}
+
+void si_clear(mp_strbuff_t *pool, khash_t(stridx) *index)
+{
+    kh_clear(stridx, index);
+    mp_strbuff_clear(pool);
 }
 
 void si_shutdown(mp_strbuff_t *pool, khash_t(stridx) *index)
@@ -0,0 +1,393 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "public/ugrid.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <float.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+#define UGRID_BATCH     (64)
+#define UGRID_INIT_CAP  (8)
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+/* Clamping is done before the conversion, since the coordinates of a 
+ * query can be arbitrarily far outside the grid */
+static int ugrid_clamp(float val, int lo, int hi)
+{
+    return (int)MIN(MAX(floorf(val), (float)lo), (float)hi);
+}
+
+static int ugrid_col(const struct ugrid *grid, float x)
+{
+    return ugrid_clamp((x - grid->xmin) / grid->cell_size, 0, grid->ncols - 1);
+}
+
+static int ugrid_row(const struct ugrid *grid, float z)
+{
+    return ugrid_clamp((z - grid->zmin) / grid->cell_size, 0, grid->nrows - 1);
+}
+
+/* Computes the squared distance from (x, z) of 'n' records, starting at 
+ * index 'base' of the cell, 4 at a time when SSE is available. 
+ */
+static void ugrid_dist2(const struct ugrid_cell *cell, uint32_t base, uint32_t n, 
+                        float x, float z, float *out)
+{
+    const float *xs = cell->xs + base;
+    const float *zs = cell->zs + base;
+    uint32_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128 px = _mm_set1_ps(x);
+    const __m128 pz = _mm_set1_ps(z);
+
+    for(; i + 4 <= n; i += 4) {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), px);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(zs + i), pz);
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+    }
+#endif
+
+    for(; i < n; i++) {
+        float dx = xs[i] - x;
+        float dz = zs[i] - z;
+        out[i] = dx * dx + dz * dz;
+    }
+}
+
+static int ugrid_cell_inrange_circle(const struct ugrid_cell *cell, float x, float z, float r2,
+                                     uint32_t *out, int maxout)
+{
+    float d2[UGRID_BATCH];
+    int ret = 0;
+
+    for(uint32_t base = 0; base < cell->size && ret < maxout; base += UGRID_BATCH) {
+
+        uint32_t n = MIN(UGRID_BATCH, cell->size - base);
+        ugrid_dist2(cell, base, n, x, z, d2);
+
+        for(uint32_t i = 0; i < n && ret < maxout; i++) {
+            if(d2[i] <= r2)
+                out[ret++] = cell->recs[base + i];
+        }
+    }
+    return ret;
+}
+
+static int ugrid_cell_inrange_rect(const struct ugrid_cell *cell, float minx, float maxx,
+                                   float minz, float maxz, uint32_t *out, int maxout)
+{
+    int ret = 0;
+    for(uint32_t i = 0; i < cell->size && ret < maxout; i++) {
+
+        float x = cell->xs[i], z = cell->zs[i];
+        if(x < minx || x > maxx || z < minz || z > maxz)
+            continue;
+        out[ret++] = cell->recs[i];
+    }
+    return ret;
+}
+
+static bool ugrid_cell_reserve(struct ugrid_cell *cell, uint32_t capacity)
+{
+    if(cell->capacity >= capacity)
+        return true;
+
+    uint32_t newcap = MAX(UGRID_INIT_CAP, cell->capacity * 2);
+    newcap = MAX(newcap, capacity);
+
+    float *xs = realloc(cell->xs, newcap * sizeof(float));
+    if(!xs)
+        return false;
+    cell->xs = xs;
+
+    float *zs = realloc(cell->zs, newcap * sizeof(float));
+    if(!zs)
+        return false;
+    cell->zs = zs;
+
+    uint32_t *recs = realloc(cell->recs, newcap * sizeof(uint32_t));
+    if(!recs)
+        return false;
+    cell->recs = recs;
+
+    cell->capacity = newcap;
+    return true;
+}
+
+/* Returns the distance from (x, z) to the closest point of the grid that is 
+ * outside of the block of cells [c0, c1] x [r0, r1]. Sides of the block that 
+ * lie on the edge of the grid are ignored, since there is nothing beyond them.
+ */
+static float ugrid_unvisited_dist(const struct ugrid *grid, float x, float z,
+                                  int c0, int c1, int r0, int r1)
+{
+    float ret = FLT_MAX;
+
+    if(c0 > 0)
+        ret = MIN(ret, MAX(0.0f, x - (grid->xmin + c0 * grid->cell_size)));
+    if(c1 < grid->ncols - 1)
+        ret = MIN(ret, MAX(0.0f, (grid->xmin + (c1 + 1) * grid->cell_size) - x));
+    if(r0 > 0)
+        ret = MIN(ret, MAX(0.0f, z - (grid->zmin + r0 * grid->cell_size)));
+    if(r1 < grid->nrows - 1)
+        ret = MIN(ret, MAX(0.0f, (grid->zmin + (r1 + 1) * grid->cell_size) - z));
+
+    return ret;
+}
+
+static void ugrid_nearest_in_cell(const struct ugrid_cell *cell, float x, float z,
+                                  bool (*predicate)(uint32_t rec, void *arg), void *arg, 
+                                  float *inout_best2, uint32_t *inout_best, bool *inout_found)
+{
+    float d2[UGRID_BATCH];
+
+    for(uint32_t base = 0; base < cell->size; base += UGRID_BATCH) {
+
+        uint32_t n = MIN(UGRID_BATCH, cell->size - base);
+        ugrid_dist2(cell, base, n, x, z, d2);
+
+        for(uint32_t i = 0; i < n; i++) {
+
+            if(d2[i] > *inout_best2)
+                continue;
+            if(d2[i] == *inout_best2 && *inout_found)
+                continue;
+            if(!predicate(cell->recs[base + i], arg))
+                continue;
+
+            *inout_best2 = d2[i];
+            *inout_best = cell->recs[base + i];
+            *inout_found = true;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool ugrid_init(struct ugrid *grid, float xmin, float xmax, 
+                float zmin, float zmax, float cell_size)
+{
+    assert(cell_size > 0.0f);
+    assert(xmax >= xmin && zmax >= zmin);
+
+    grid->xmin = xmin;
+    grid->xmax = xmax;
+    grid->zmin = zmin;
+    grid->zmax = zmax;
+    grid->cell_size = cell_size;
+    grid->ncols = MAX(1, (int)ceilf((xmax - xmin) / cell_size));
+    grid->nrows = MAX(1, (int)ceilf((zmax - zmin) / cell_size));
+    grid->nrecs = 0;
+
+    grid->cells = calloc(grid->ncols * grid->nrows, sizeof(struct ugrid_cell));
+    return (grid->cells != NULL);
+}
+
+void ugrid_destroy(struct ugrid *grid)
+{
+    for(int i = 0; i < grid->ncols * grid->nrows; i++) {
+        free(grid->cells[i].xs);
+        free(grid->cells[i].zs);
+        free(grid->cells[i].recs);
+    }
+    free(grid->cells);
+    grid->cells = NULL;
+}
+
+void ugrid_clear(struct ugrid *grid)
+{
+    for(int i = 0; i < grid->ncols * grid->nrows; i++) {
+        grid->cells[i].size = 0;
+    }
+    grid->nrecs = 0;
+}
+
+uint32_t ugrid_cell_for(const struct ugrid *grid, float x, float z)
+{
+    return ugrid_row(grid, z) * grid->ncols + ugrid_col(grid, x);
+}
+
+bool ugrid_insert(struct ugrid *grid, uint32_t cell, float x, float z, 
+                  uint32_t rec, uint32_t *out_slot)
+{
+    assert(cell < grid->ncols * grid->nrows);
+    struct ugrid_cell *curr = &grid->cells[cell];
+
+    if(!ugrid_cell_reserve(curr, curr->size + 1))
+        return false;
+
+    uint32_t slot = curr->size++;
+    curr->xs[slot] = x;
+    curr->zs[slot] = z;
+    curr->recs[slot] = rec;
+    grid->nrecs++;
+
+    *out_slot = slot;
+    return true;
+}
+
+bool ugrid_remove(struct ugrid *grid, uint32_t cell, uint32_t slot, uint32_t *out_moved)
+{
+    assert(cell < grid->ncols * grid->nrows);
+    struct ugrid_cell *curr = &grid->cells[cell];
+    assert(slot < curr->size);
+
+    uint32_t last = --curr->size;
+    grid->nrecs--;
+
+    if(slot == last)
+        return false;
+
+    curr->xs[slot] = curr->xs[last];
+    curr->zs[slot] = curr->zs[last];
+    curr->recs[slot] = curr->recs[last];
+    *out_moved = curr->recs[slot];
+    return true;
+}
+
+void ugrid_move(struct ugrid *grid, uint32_t cell, uint32_t slot, float x, float z)
+{
+    assert(cell < grid->ncols * grid->nrows);
+    assert(slot < grid->cells[cell].size);
+
+    grid->cells[cell].xs[slot] = x;
+    grid->cells[cell].zs[slot] = z;
+}
+
+int ugrid_inrange_circle(const struct ugrid *grid, float x, float z, float range, 
+                         uint32_t *out, int maxout)
+{
+    int c0 = ugrid_col(grid, x - range), c1 = ugrid_col(grid, x + range);
+    int r0 = ugrid_row(grid, z - range), r1 = ugrid_row(grid, z + range);
+    int ret = 0;
+
+    for(int r = r0; r <= r1; r++) {
+    for(int c = c0; c <= c1; c++) {
+
+        if(ret == maxout)
+            return ret;
+
+        const struct ugrid_cell *cell = &grid->cells[r * grid->ncols + c];
+        ret += ugrid_cell_inrange_circle(cell, x, z, range * range, out + ret, maxout - ret);
+    }}
+    return ret;
+}
+
+int ugrid_inrange_rect(const struct ugrid *grid, float minx, float maxx, 
+                       float minz, float maxz, uint32_t *out, int maxout)
+{
+    int c0 = ugrid_col(grid, minx), c1 = ugrid_col(grid, maxx);
+    int r0 = ugrid_row(grid, minz), r1 = ugrid_row(grid, maxz);
+    int ret = 0;
+
+    for(int r = r0; r <= r1; r++) {
+    for(int c = c0; c <= c1; c++) {
+
+        if(ret == maxout)
+            return ret;
+
+        const struct ugrid_cell *cell = &grid->cells[r * grid->ncols + c];
+        ret += ugrid_cell_inrange_rect(cell, minx, maxx, minz, maxz, out + ret, maxout - ret);
+    }}
+    return ret;
+}
+
+bool ugrid_nearest(const struct ugrid *grid, float x, float z, float max_range,
+                   bool (*predicate)(uint32_t rec, void *arg), void *arg, 
+                   uint32_t *out)
+{
+    const int cc = ugrid_col(grid, x);
+    const int cr = ugrid_row(grid, z);
+
+    float best2 = max_range * max_range;
+    uint32_t best = 0;
+    bool found = false;
+
+    for(int ring = 0;; ring++) {
+
+        int c0 = cc - ring, c1 = cc + ring;
+        int r0 = cr - ring, r1 = cr + ring;
+
+        /* Only visit the cells on the perimeter of the ring, in row-major order: 
+         * the whole top and bottom rows, and the two end cells of the rows 
+         * in between. */
+        for(int r = MAX(r0, 0); r <= MIN(r1, grid->nrows - 1); r++) {
+
+            const struct ugrid_cell *row = &grid->cells[r * grid->ncols];
+
+            if(r == r0 || r == r1) {
+                for(int c = MAX(c0, 0); c <= MIN(c1, grid->ncols - 1); c++) {
+                    ugrid_nearest_in_cell(&row[c], x, z, predicate, arg, &best2, &best, &found);
+                }
+                continue;
+            }
+
+            if(c0 >= 0)
+                ugrid_nearest_in_cell(&row[c0], x, z, predicate, arg, &best2, &best, &found);
+            if(c1 < grid->ncols)
+                ugrid_nearest_in_cell(&row[c1], x, z, predicate, arg, &best2, &best, &found);
+        }
+
+        /* Every record that hasn't been visited yet is at least this far away */
+        float bound = ugrid_unvisited_dist(grid, x, z, 
+            MAX(c0, 0), MIN(c1, grid->ncols - 1), MAX(r0, 0), MIN(r1, grid->nrows - 1));
+
+        if(bound == FLT_MAX || bound * bound > best2)
+            break;
+    }
+
+    if(!found)
+        return false;
+
+    *out = best;
+    return true;
+}
+
@@ -41,6 +41,7 @@
 #include "render/public/render_ctrl.h"
 #include "lib/public/stb_image.h"
 #include "lib/public/vec.h"
+#include "lib/public/pf_string.h"
 #include "script/public/script.h"
 #include "game/public/game.h"
 #include "navigation/public/nav.h"
@@ -51,6 +52,7 @@
 #include "session.h"
 #include "perf.h"
 #include "sched.h"
+#include "bench.h"
 
 #include <stdbool.h>
 #include <assert.h>
@@ -97,6 +99,16 @@ static vec_event_t         s_prev_tick_events;
 static SDL_Thread               *s_render_thread;
 static struct render_sync_state  s_rstate;
 
+/* In headless mode, only the simulation is run. There is no window and no
+ * render thread, and time is driven by a virtual clock that is advanced by 
+ * a fixed step every tick, rather than by the wall clock.
+ */
+static bool                      s_headless = false;
+static unsigned long             s_headless_ticks = 0; /* 0 means 'until quit' */
+static const char               *s_bench_path = NULL;
+static double                    s_virtual_ms = 0.0;
+static int                       s_headless_res[2];
+
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -313,6 +325,12 @@ static bool engine_init(char **argv)
             Settings_GetFile(), status);
     }
 
+    /* The dummy driver still allows querying the display, keyboard and mouse
+     * state without a display server or a GPU. */
+    if(s_headless) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+    }
+
     if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) < 0) {
         fprintf(stderr, "Failed to initialize SDL: %s\n", SDL_GetError());
         goto fail_sdl;
@@ -337,6 +355,12 @@ static bool engine_init(char **argv)
         extra_flags = setting.as_bool ? SDL_WINDOW_ALWAYS_ON_TOP : 0;
     }
 
+    if(s_headless) {
+        s_headless_res[0] = res[0];
+        s_headless_res[1] = res[1];
+        goto init_subsystems;
+    }
+
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
@@ -393,9 +417,11 @@ static bool engine_init(char **argv)
     if(!rarg.out_success)
         goto fail_render_init;
 
-    Perf_RegisterThread(g_main_thread_id, "main");
     Perf_RegisterThread(g_render_thread_id, "render");
 
+init_subsystems:
+    Perf_RegisterThread(g_main_thread_id, "main");
+
     if(!Sched_Init()) {
         fprintf(stderr, "Failed to initialize scheduling module.\n");
         goto fail_sched;
@@ -472,6 +498,8 @@ fail_al:
 fail_sesh:
     Sched_Shutdown();
 fail_sched:
+    if(s_headless)
+        goto fail_headless;
 fail_render_init:
     render_thread_quit();
 fail_rthread:
@@ -481,6 +509,7 @@ fail_rstate:
         SDL_FreeSurface(s_loading_screen);
     }
     SDL_DestroyWindow(s_window);
+fail_headless:
     SDL_Quit();
 fail_sdl:
     Settings_Shutdown();
@@ -498,9 +527,11 @@ static void engine_shutdown(void)
     /* Execute the last batch of commands that may have been queued by the 
      * shutdown routines. 
      */
-    render_thread_start_work();
-    wait_render_work_done();
-    render_thread_quit();
+    if(!s_headless) {
+        render_thread_start_work();
+        wait_render_work_done();
+        render_thread_quit();
+    }
 
     /* 'Game' must shut down after 'Scripting'. There are still 
      * references to game entities in the Python interpreter that should get
@@ -518,17 +549,136 @@ static void engine_shutdown(void)
     Perf_Shutdown();
 
     vec_event_destroy(&s_prev_tick_events);
-    rstate_destroy(&s_rstate);
 
-    if(s_loading_screen) {
-        SDL_FreeSurface(s_loading_screen);
+    if(!s_headless) {
+        rstate_destroy(&s_rstate);
+        if(s_loading_screen) {
+            SDL_FreeSurface(s_loading_screen);
+        }
+        SDL_DestroyWindow(s_window); 
     }
-    SDL_DestroyWindow(s_window); 
     SDL_Quit();
 
     Settings_Shutdown();
 }
 
+static bool engine_parse_opts(int argc, char **argv)
+{
+    for(int i = 3; i < argc; i++) {
+
+        const char *arg = argv[i];
+        if(!strcmp(arg, "--headless")) {
+            s_headless = true;
+        }else if(!strncmp(arg, "--ticks=", strlen("--ticks="))) {
+            char *end;
+            const char *val = arg + strlen("--ticks=");
+            s_headless_ticks = strtoul(val, &end, 10);
+            if(end == val || *end != '\0')
+                return false;
+        }else if(!strncmp(arg, "--bench=", strlen("--bench="))) {
+            s_bench_path = arg + strlen("--bench=");
+            if(!strlen(s_bench_path))
+                return false;
+        }else{
+            return false;
+        }
+    }
+
+    /* The tick limit and report only make sense with a deterministic clock */
+    if(!s_headless && (s_headless_ticks || s_bench_path))
+        return false;
+    return true;
+}
+
+static bool engine_cook_assets(void)
+{
+    char assets_path[512];
+    pf_snprintf(assets_path, sizeof(assets_path), "%s/assets", g_basepath);
+
+    size_t ncooked = 0, nfailed = 0;
+    AL_CookDirectory(assets_path, &ncooked, &nfailed);
+
+    printf("Cooked %lu asset(s) with %lu failure(s).\n", 
+        (unsigned long)ncooked, (unsigned long)nfailed);
+    return (nfailed == 0);
+}
+
+static void engine_run_headless(void)
+{
+    const double freq = SDL_GetPerformanceFrequency();
+
+    while(!s_quit && (!s_headless_ticks || g_frame_idx < s_headless_ticks)) {
+
+        uint64_t begin = SDL_GetPerformanceCounter();
+        Perf_BeginTick();
+
+        /* Every iteration is exactly one 60Hz tick of virtual time. This 
+         * replaces the SDL timer that drives the simulation in the regular 
+         * mode, and makes every run of a scenario identical. */
+        s_virtual_ms += CONFIG_HEADLESS_TICK_MS;
+        E_Global_Notify(EVENT_60HZ_TICK, NULL, ES_ENGINE);
+
+        Sched_StartBackgroundTasks();
+
+        E_ServiceQueue();
+        Session_ServiceRequests();
+        G_Update();
+        Sched_Tick();
+
+        G_SwapBuffers();
+        Perf_FinishTick();
+
+        uint64_t end = SDL_GetPerformanceCounter();
+        Bench_RecordTick(g_frame_idx, (end - begin) * 1000.0 / freq);
+
+        ++g_frame_idx;
+    }
+}
+
+static void engine_run(void)
+{
+    /* Run the first frame of the simulation, and prepare the buffers for rendering. */
+    E_ServiceQueue();
+    G_Update();
+    G_Render();
+    G_SwapBuffers();
+    Perf_FinishTick();
+
+    while(!s_quit) {
+
+        Perf_BeginTick();
+        enum simstate curr_ss = G_GetSimState();
+        bool prev_step_frame = s_step_frame;
+
+        if(prev_step_frame) {
+            assert(curr_ss != G_RUNNING); 
+            G_SetSimState(G_RUNNING);
+        }
+
+        render_thread_start_work();
+        Sched_StartBackgroundTasks();
+
+        process_sdl_events();
+        E_ServiceQueue();
+        Session_ServiceRequests();
+        G_Update();
+        G_Render();
+        Sched_Tick();
+
+        wait_render_work_done();
+
+        G_SwapBuffers();
+        Perf_FinishTick();
+
+        if(prev_step_frame) {
+            G_SetSimState(curr_ss);
+            s_step_frame = false;
+        }
+
+        ++g_frame_idx;
+    }
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -539,6 +689,8 @@ static void engine_shutdown(void)
 void Engine_LoadingScreen(void)
 {
     ASSERT_IN_MAIN_THREAD();
+    if(s_headless)
+        return;
     assert(s_window);
 
     /* Make sure the render therad doesn't overwrite the screen... */
@@ -565,6 +717,12 @@ void Engine_LoadingScreen(void)
 
 int Engine_SetRes(int w, int h)
 {
+    if(s_headless) {
+        s_headless_res[0] = w;
+        s_headless_res[1] = h;
+        return 0;
+    }
+
     SDL_DisplayMode dm = (SDL_DisplayMode) {
         .format = SDL_PIXELFORMAT_UNKNOWN,
         .w = w,
@@ -580,6 +738,9 @@ int Engine_SetRes(int w, int h)
 
 void Engine_SetDispMode(enum pf_window_flags wf)
 {
+    if(s_headless)
+        return;
+
     SDL_SetWindowFullscreen(s_window, wf & SDL_WINDOW_FULLSCREEN);
     SDL_SetWindowBordered(s_window, !(wf & (SDL_WINDOW_BORDERLESS | SDL_WINDOW_FULLSCREEN)));
     SDL_SetWindowPosition(s_window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
@@ -587,6 +748,11 @@ void Engine_SetDispMode(enum pf_window_flags wf)
 
 void Engine_WinDrawableSize(int *out_w, int *out_h)
 {
+    if(s_headless) {
+        *out_w = s_headless_res[0];
+        *out_h = s_headless_res[1];
+        return;
+    }
     SDL_GL_GetDrawableSize(s_window, out_w, out_h);
 }
 
@@ -595,8 +761,10 @@ void Engine_FlushRenderWorkQueue(void)
     assert(g_frame_idx == 0);
     G_SwapBuffers();
 
-    render_thread_start_work();
-    wait_render_work_done();
+    if(!s_headless) {
+        render_thread_start_work();
+        wait_render_work_done();
+    }
 
     G_SwapBuffers();
 }
@@ -604,7 +772,7 @@ void Engine_FlushRenderWorkQueue(void)
 void Engine_WaitRenderWorkDone(void)
 {
     PERF_ENTER();
-    if(s_quit) {
+    if(s_quit || s_headless) {
         PERF_RETURN_VOID();
     }
 
@@ -624,6 +792,18 @@ void Engine_ClearPendingEvents(void)
     E_ClearPendingEvents();
 }
 
+bool Engine_Headless(void)
+{
+    return s_headless;
+}
+
+uint32_t Engine_GetTicks(void)
+{
+    if(s_headless)
+        return (uint32_t)s_virtual_ms;
+    return SDL_GetTicks();
+}
+
 #if defined(_WIN32)
 int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, 
                      LPSTR lpCmdLine, int nCmdShow)
@@ -638,8 +818,17 @@ int main(int argc, char **argv)
 
     int ret = EXIT_SUCCESS;
 
-    if(argc != 3) {
-        printf("Usage: %s [base directory path (containing 'assets', 'shaders' and 'scripts' folders)] [script path]\n", argv[0]);
+    /* In the cooker mode, all the assets are converted to the binary format 
+     * and the engine exits without running anything. */
+    if(argc == 3 && !strcmp(argv[2], "--cook")) {
+        g_basepath = argv[1];
+        exit(engine_cook_assets() ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if(argc < 3 || !engine_parse_opts(argc, argv)) {
+        printf("Usage: %s [base directory path (containing 'assets', 'shaders' and 'scripts' folders)] [script path] "
+            "[--headless [--ticks=N] [--bench=report.csv|report.json]]\n", argv[0]);
+        printf("       %s [base directory path] --cook\n", argv[0]);
         ret = EXIT_FAILURE;
         goto fail_args;
     }
@@ -651,55 +840,32 @@ int main(int argc, char **argv)
         goto fail_init;
     }
 
-    S_RunFile(argv[2], 0, NULL);
-
-    /* Run the first frame of the simulation, and prepare the buffers for rendering. */
-    E_ServiceQueue();
-    G_Update();
-    G_Render();
-    G_SwapBuffers();
-    Perf_FinishTick();
-
-    while(!s_quit) {
-
-        Perf_BeginTick();
-        enum simstate curr_ss = G_GetSimState();
-        bool prev_step_frame = s_step_frame;
-
-        if(prev_step_frame) {
-            assert(curr_ss != G_RUNNING); 
-            G_SetSimState(G_RUNNING);
-        }
-
-        render_thread_start_work();
-        Sched_StartBackgroundTasks();
-
-        process_sdl_events();
-        E_ServiceQueue();
-        Session_ServiceRequests();
-        G_Update();
-        G_Render();
-        Sched_Tick();
-
-        wait_render_work_done();
+    if(s_bench_path && !Bench_Init(s_bench_path)) {
+        fprintf(stderr, "Failed to open benchmark report file: %s\n", s_bench_path);
+        ret = EXIT_FAILURE;
+        goto fail_bench;
+    }
 
-        G_SwapBuffers();
-        Perf_FinishTick();
+    S_RunFile(argv[2], 0, NULL);
 
-        if(prev_step_frame) {
-            G_SetSimState(curr_ss);
-            s_step_frame = false;
-        }
+    if(s_headless) {
+        engine_run_headless();
+    }else{
+        engine_run();
+    }
 
-        ++g_frame_idx;
+    if(s_bench_path) {
+        Bench_Shutdown();
     }
 
+    /* Don't clobber the user's settings with the ones of a benchmark run */
     ss_e status;
-    if((status = Settings_SaveToFile()) != SS_OKAY) {
+    if(!s_headless && (status = Settings_SaveToFile()) != SS_OKAY) {
         fprintf(stderr, "Could not save settings to file: %s [status: %d]\n", 
             Settings_GetFile(), status);
     }
 
+fail_bench:
     engine_shutdown();
 fail_init:
 fail_args:
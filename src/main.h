@@ -38,6 +38,8 @@
 
 #include <SDL.h>
 #include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 extern const char    *g_basepath;      /* readonly */
 extern unsigned       g_last_frame_ms; /* readonly */
@@ -77,5 +79,14 @@ void Engine_FlushRenderWorkQueue(void);
 void Engine_WaitRenderWorkDone(void);
 void Engine_ClearPendingEvents(void);
 
+/* Returns true when the engine is running only the simulation, without a
+ * window or a render thread. */
+bool     Engine_Headless(void);
+/* Milliseconds since initialization, to be used for all simulation timing. 
+ * In headless mode, this is a virtual clock that advances by a fixed step
+ * every tick, making simulation runs reproducible. 
+ */
+uint32_t Engine_GetTicks(void);
+
 #endif
 
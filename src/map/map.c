@@ -405,6 +405,11 @@ void M_NavCutoutStaticObject(const struct map *map, const struct obb *obb)
     N_CutoutStaticObject(map->nav_private, map->pos, obb);
 }
 
+void M_NavUpdateDirtyCosts(const struct map *map)
+{
+    N_UpdateDirtyCosts(map->nav_private);
+}
+
 void M_NavUpdatePortals(const struct map *map)
 {
     N_UpdatePortals(map->nav_private);
@@ -527,11 +532,37 @@ vec2_t M_NavDesiredPointSeekVelocity(const struct map *map, dest_id_t id, vec2_t
     return N_DesiredPointSeekVelocity(id, curr_pos, xz_dest, map->nav_private, map->pos);
 }
 
+void M_NavEnsurePointSeekFields(const struct map *map, dest_id_t id, vec2_t curr_pos, vec2_t xz_dest)
+{
+    N_EnsurePointSeekFields(id, curr_pos, xz_dest, map->nav_private, map->pos);
+}
+
+bool M_NavSamplePointSeekVelocity(const struct map *map, dest_id_t id, vec2_t curr_pos, vec2_t *out)
+{
+    return N_SamplePointSeekVelocity(id, curr_pos, map->nav_private, map->pos, out);
+}
+
 vec2_t M_NavDesiredEnemySeekVelocity(const struct map *map, vec2_t curr_pos, int faction_id)
 {
     return N_DesiredEnemySeekVelocity(curr_pos, map->nav_private, map->pos, faction_id);
 }
 
+void M_NavEnsureEnemySeekField(const struct map *map, vec2_t curr_pos, int faction_id)
+{
+    N_EnsureEnemySeekField(curr_pos, map->nav_private, map->pos, faction_id);
+}
+
+bool M_NavSampleEnemySeekVelocity(const struct map *map, vec2_t curr_pos, int faction_id, vec2_t *out)
+{
+    return N_SampleEnemySeekVelocity(curr_pos, map->nav_private, map->pos, faction_id, out);
+}
+
+void M_NavUpdateThreatMaps(const struct map *map, size_t nents, 
+                           const vec2_t *xz_positions, const int *faction_ids)
+{
+    N_UpdateThreatMaps(map->nav_private, map->pos, nents, xz_positions, faction_ids);
+}
+
 bool M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos)
 {
     return N_HasDestLOS(id, curr_pos, map->nav_private, map->pos);
@@ -651,6 +682,11 @@ vec3_t M_GetPos(const struct map *map)
     return map->pos;
 }
 
+void M_GetChunkAABB(const struct map *map, int chunk_r, int chunk_c, struct aabb *out)
+{
+    m_aabb_for_chunk(map, (struct chunkpos){chunk_r, chunk_c}, out);
+}
+
 bool M_NavIsMaximallyClose(const struct map *map, vec2_t xz_pos, vec2_t xz_dest, float tolerance)
 {
     return N_IsMaximallyClose(map->nav_private, map->pos, xz_pos, xz_dest, tolerance);
@@ -690,3 +726,8 @@ bool M_NavHasEntityLOS(const struct map *map, vec2_t xz_pos, const struct entity
     return N_HasEntityLOS(xz_pos, ent, map->nav_private, map->pos);
 }
 
+bool M_NavHasLOSBetween(const struct map *map, vec2_t xz_pos, vec2_t target)
+{
+    return N_HasLOSBetween(xz_pos, target, map->nav_private, map->pos);
+}
+
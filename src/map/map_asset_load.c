@@ -204,30 +204,52 @@ static void set_minimap_defaults(struct map *map)
     map->minimap_resize_mask = ANCHOR_X_LEFT | ANCHOR_Y_BOT;
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
- 
-bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
-                            SDL_RWops *stream, void *outmap, bool update_navgrid)
+static void *m_al_init_nav(const struct map *map, const char *navpath, bool update_navgrid)
 {
-    struct map *map = outmap;
+    const struct tile *chunk_tiles[map->width * map->height];
+
+    for(int r = 0; r < map->height; r++) {
+    for(int c = 0; c < map->width; c++) {
+        chunk_tiles[r * map->width + c] = map->chunks[r * map->width + c].tiles;
+    }}
+
+    uint64_t hash = N_BakeHash(map->width, map->height, 
+        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk_tiles, update_navgrid);
+
+    SDL_RWops *stream = navpath ? AL_OpenMapped(navpath) : NULL;
+    if(stream) {
+        void *ret = N_LoadBaked(stream, hash);
+        SDL_RWclose(stream);
+        if(ret)
+            return ret;
+    }
+
+    void *ret = N_BuildForMapData(map->width, map->height, 
+        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk_tiles, update_navgrid);
+    if(!ret || !navpath)
+        return ret;
+
+    /* Failing to save the data only means that it will be baked again */
+    stream = SDL_RWFromFile(navpath, "wb");
+    if(!stream)
+        return ret;
+
+    bool saved = N_SaveBaked(ret, hash, stream);
+    SDL_RWclose(stream);
+    if(!saved) {
+        remove(navpath);
+    }
+    return ret;
+}
 
+static bool m_al_init_map(const struct pfmap_hdr *header, const char *basedir,
+                          const char *navpath, struct map *map, bool update_navgrid)
+{
     map->width = header->num_cols;
     map->height = header->num_rows;
     map->pos = (vec3_t) {0.0f, 0.0f, 0.0f};
-    set_minimap_defaults(map);
-
-    /* Read materials */
-    char texnames[header->num_materials][256];
-    for(int i = 0; i < header->num_materials; i++) {
-        if(i >= MAX_NUM_MATS)
-            return false;
-        if(!m_al_read_material(stream, texnames[i]))
-            return false;
-        strcpy(map->texnames[i], texnames[i]);
-    }
     map->num_mats = header->num_materials;
+    set_minimap_defaults(map);
 
     struct map_resolution res = (struct map_resolution){
         header->num_cols,
@@ -240,23 +262,16 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
         .func = R_GL_MapInit,
         .nargs = 3,
         .args = {
-            R_PushArg(texnames, sizeof(texnames)),
+            R_PushArg(map->texnames, sizeof(map->texnames[0]) * header->num_materials),
             R_PushArg(&header->num_materials, sizeof(header->num_materials)),
             R_PushArg(&res, sizeof(res)),
         },
     });
 
-    /* Read chunks */
     size_t num_chunks = header->num_rows * header->num_cols;
     char *unused_base = (char*)(map + 1);
     unused_base += num_chunks * sizeof(struct pfchunk);
 
-    for(int i = 0; i < num_chunks; i++) {
-
-        if(!m_al_read_pfchunk(stream, map->chunks + i))
-            return false;
-    }
-
     for(int i = 0; i < num_chunks; i++) {
     
         map->chunks[i].render_private = (void*)unused_base;
@@ -274,19 +289,116 @@ bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
     m_al_patch_adjacency_info(map);
 
     /* Build navigation grid */
-    const struct tile *chunk_tiles[map->width * map->height];
+    map->nav_private = m_al_init_nav(map, navpath, update_navgrid);
+    if(!map->nav_private)
+        return false;
 
-    for(int r = 0; r < map->height; r++) {
-    for(int c = 0; c < map->width; c++) {
-        chunk_tiles[r * map->width + c] = map->chunks[r * map->width + c].tiles;
-    }}
+    return true;
+}
 
-    map->nav_private = N_BuildForMapData(map->width, map->height, 
-        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT, chunk_tiles, update_navgrid);
-    if(!map->nav_private)
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+ 
+bool M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
+                            const char *navpath, SDL_RWops *stream, void *outmap, 
+                            bool update_navgrid)
+{
+    struct map *map = outmap;
+
+    /* Read materials */
+    for(int i = 0; i < header->num_materials; i++) {
+        if(i >= MAX_NUM_MATS)
+            return false;
+        if(!m_al_read_material(stream, map->texnames[i]))
+            return false;
+    }
+
+    /* Read chunks */
+    size_t num_chunks = header->num_rows * header->num_cols;
+    for(int i = 0; i < num_chunks; i++) {
+
+        if(!m_al_read_pfchunk(stream, map->chunks + i))
+            return false;
+    }
+
+    return m_al_init_map(header, basedir, navpath, map, update_navgrid);
+}
+
+/*
+ * Cooked PFMAP layout (following the header):
+ *
+ *  +---------------------------------+
+ *  | char[num_materials][256]        |
+ *  +---------------------------------+
+ *  | struct tile[num_chunks *        |
+ *  |    TILES_PER_CHUNK]             |
+ *  |    (stored in chunk order)      |
+ *  +---------------------------------+
+ *
+ */
+
+bool M_AL_InitMapFromCooked(const struct pfmap_hdr *header, const char *basedir,
+                            const char *navpath, SDL_RWops *stream, void *outmap, 
+                            bool update_navgrid)
+{
+    struct map *map = outmap;
+
+    if(header->num_materials > MAX_NUM_MATS)
+        return false;
+
+    for(int i = 0; i < header->num_materials; i++) {
+        if(!SDL_RWread(stream, map->texnames[i], sizeof(map->texnames[i]), 1))
+            return false;
+        map->texnames[i][sizeof(map->texnames[i])-1] = '\0';
+    }
+
+    /* The tiles are stored in the same layout as in memory, so every chunk 
+     * is populated with a single copy */
+    size_t num_chunks = header->num_rows * header->num_cols;
+    for(int i = 0; i < num_chunks; i++) {
+
+        if(!SDL_RWread(stream, map->chunks[i].tiles, sizeof(map->chunks[i].tiles), 1))
+            return false;
+    }
+
+    return m_al_init_map(header, basedir, navpath, map, update_navgrid);
+}
+
+bool M_AL_CookPFMap(const struct pfmap_hdr *header, SDL_RWops *in, SDL_RWops *out)
+{
+    if(header->num_materials > MAX_NUM_MATS)
+        return false;
+
+    for(int i = 0; i < header->num_materials; i++) {
+
+        char texname[256] = {0};
+        if(!m_al_read_material(in, texname))
+            return false;
+        texname[sizeof(texname)-1] = '\0';
+        if(!SDL_RWwrite(out, texname, sizeof(texname), 1))
+            return false;
+    }
+
+    size_t num_chunks = header->num_rows * header->num_cols;
+    struct pfchunk *chunk = malloc(sizeof(struct pfchunk));
+    if(!chunk)
         return false;
 
+    for(int i = 0; i < num_chunks; i++) {
+
+        if(!m_al_read_pfchunk(in, chunk))
+            goto fail;
+        if(!SDL_RWwrite(out, chunk->tiles, sizeof(chunk->tiles), 1))
+            goto fail;
+    }
+
+    free(chunk);
     return true;
+
+fail:
+    free(chunk);
+    return false;
 }
 
 size_t M_AL_BuffSizeFromHeader(const struct pfmap_hdr *header)
@@ -306,6 +418,14 @@ bool M_AL_UpdateTile(struct map *map, const struct tile_desc *desc, const struct
     struct pfchunk *chunk = &map->chunks[desc->chunk_r * map->width + desc->chunk_c];
     chunk->tiles[desc->tile_r * TILES_PER_CHUNK_WIDTH + desc->tile_c] = *tile;
 
+    const struct tile *chunk_tiles[map->width * map->height];
+    for(int r = 0; r < map->height; r++) {
+    for(int c = 0; c < map->width; c++) {
+        chunk_tiles[r * map->width + c] = map->chunks[r * map->width + c].tiles;
+    }}
+    N_UpdateTile(map->nav_private, desc, chunk_tiles, 
+        TILES_PER_CHUNK_WIDTH, TILES_PER_CHUNK_HEIGHT);
+
     struct map_resolution res;
     M_GetResolution(map, &res);
 
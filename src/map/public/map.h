@@ -54,6 +54,7 @@ struct camera;
 struct tile;
 struct tile_desc;
 struct obb;
+struct aabb;
 enum render_pass;
 struct map_resolution;
 
@@ -218,6 +219,13 @@ bool   M_DescForPoint2D(const struct map *map, vec2_t point_xz, struct tile_desc
  */
 void   M_NavCutoutStaticObject(const struct map *map, const struct obb *obb);
 
+/* ------------------------------------------------------------------------
+ * Update navigation private data of only the chunks whose cost field was 
+ * changed (ex. by cutting out static objects) since the last update.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavUpdateDirtyCosts(const struct map *map);
+
 /* ------------------------------------------------------------------------
  * Update navigation private data after changes to the cost field.
  * (ex. to remove a path in case it was blocked off by a placed object)
@@ -265,6 +273,23 @@ void   M_RenderChunkVisibility(const struct map *map, const struct camera *cam,
 vec2_t M_NavDesiredPointSeekVelocity(const struct map *map, dest_id_t id, 
                                      vec2_t curr_pos, vec2_t xz_dest);
 
+/* ------------------------------------------------------------------------
+ * Make sure the flow field (or a pending request for it) guiding towards 
+ * the destination exists for the chunk under 'curr_pos'. 
+ * ------------------------------------------------------------------------
+ */
+void   M_NavEnsurePointSeekFields(const struct map *map, dest_id_t id, 
+                                  vec2_t curr_pos, vec2_t xz_dest);
+
+/* ------------------------------------------------------------------------
+ * Thread-safe lookup of the desired velocity towards a destination from 
+ * the existing flow fields. Returns false if the fields must be updated
+ * first, in which case 'M_NavDesiredPointSeekVelocity' must be used.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavSamplePointSeekVelocity(const struct map *map, dest_id_t id, 
+                                    vec2_t curr_pos, vec2_t *out);
+
 /* ------------------------------------------------------------------------
  * Returns the desired velocity vector for moving with the flow field 
  * for approaching enemies of a particular faction.
@@ -272,6 +297,31 @@ vec2_t M_NavDesiredPointSeekVelocity(const struct map *map, dest_id_t id,
  */
 vec2_t M_NavDesiredEnemySeekVelocity(const struct map *map, vec2_t curr_pos, int faction_id);
 
+/* ------------------------------------------------------------------------
+ * Make sure the flow field for approaching the enemies of the faction 
+ * exists for the chunk under 'curr_pos'.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavEnsureEnemySeekField(const struct map *map, vec2_t curr_pos, int faction_id);
+
+/* ------------------------------------------------------------------------
+ * Thread-safe lookup of the desired velocity towards the enemies of the 
+ * faction from the existing flow fields. Returns false if the fields must 
+ * be updated first, in which case 'M_NavDesiredEnemySeekVelocity' must be
+ * used.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavSampleEnemySeekVelocity(const struct map *map, vec2_t curr_pos, 
+                                    int faction_id, vec2_t *out);
+
+/* ------------------------------------------------------------------------
+ * Update the maps guiding the units of every faction towards their enemies
+ * with the current positions of all the combatable entities.
+ * ------------------------------------------------------------------------
+ */
+void   M_NavUpdateThreatMaps(const struct map *map, size_t nents, 
+                             const vec2_t *xz_positions, const int *faction_ids);
+
 /* ------------------------------------------------------------------------
  * Returns true if the specified coordinate is in direct line of sight of 
  * the specified destination.
@@ -286,6 +336,13 @@ bool   M_NavHasDestLOS(const struct map *map, dest_id_t id, vec2_t curr_pos);
  */
 bool   M_NavHasEntityLOS(const struct map *map, vec2_t xz_pos, const struct entity *ent);
 
+/* ------------------------------------------------------------------------
+ * Returns true if the 'target' position is in direct line of sight of the 
+ * specified position. Safe to call from worker threads.
+ * ------------------------------------------------------------------------
+ */
+bool   M_NavHasLOSBetween(const struct map *map, vec2_t xz_pos, vec2_t target);
+
 /* ------------------------------------------------------------------------
  * Returns true if the specified positions is pathable (i.e. a unit is 
  * allowed to stand on this region of the map)
@@ -373,6 +430,12 @@ vec3_t M_GetCenterPos(const struct map *map);
  */
 vec3_t M_GetPos(const struct map *map);
 
+/* ------------------------------------------------------------------------
+ * Returns the world-space bounding box of the terrain of the chunk.
+ * ------------------------------------------------------------------------
+ */
+void   M_GetChunkAABB(const struct map *map, int chunk_r, int chunk_c, struct aabb *out);
+
 
 /*###########################################################################*/
 /* MINIMAP                                                                   */
@@ -449,11 +512,29 @@ bool   M_MouseOverMinimap(const struct map *map);
 
 /* ------------------------------------------------------------------------
  * Initialize private map data ('outmap', which is allocated by the calleer) 
- * from PFMAP stream.
+ * from PFMAP stream. If 'navpath' is not NULL, the navigation data is loaded
+ * from that file when it is up-to-date with the map's tiles. Otherwise, it 
+ * is baked from the tiles and saved to 'navpath'.
  * ------------------------------------------------------------------------
  */
 bool   M_AL_InitMapFromStream(const struct pfmap_hdr *header, const char *basedir,
-                              SDL_RWops *stream, void *outmap, bool update_navgrid);
+                              const char *navpath, SDL_RWops *stream, void *outmap, 
+                              bool update_navgrid);
+
+/* ------------------------------------------------------------------------
+ * Same as 'M_AL_InitMapFromStream', but for a cooked PFMAP stream.
+ * ------------------------------------------------------------------------
+ */
+bool   M_AL_InitMapFromCooked(const struct pfmap_hdr *header, const char *basedir,
+                              const char *navpath, SDL_RWops *stream, void *outmap, 
+                              bool update_navgrid);
+
+/* ------------------------------------------------------------------------
+ * Consumes the body of a PFMAP stream and writes it to 'out' in cooked 
+ * form.
+ * ------------------------------------------------------------------------
+ */
+bool   M_AL_CookPFMap(const struct pfmap_hdr *header, SDL_RWops *in, SDL_RWops *out);
 
 /* ------------------------------------------------------------------------
  * Returns the size, in bytes, needed to store the private map data
@@ -36,52 +36,310 @@
 #include "a_star.h"
 #include "nav_private.h"
 #include "../perf.h"
-#include "../lib/public/pqueue.h"
-#include "../lib/public/khash.h"
+#include "../lib/public/vec.h"
 #include "fieldcache.h"
 
+#include <SDL_atomic.h>
+
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
 
-PQUEUE_TYPE(coord, struct coord)
-PQUEUE_IMPL(static, coord, struct coord)
-
-PQUEUE_TYPE(portal, const struct portal*)
-PQUEUE_IMPL(static, portal, const struct portal*)
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define MAX(a, b)       ((a) > (b) ? (a) : (b))
+#define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
+#define GRID_NODES      (FIELD_RES_R * FIELD_RES_C)
+#define NODE_NONE       (~((uint32_t)0))
+/* One bucket for keys equal to the last popped key, and one for 
+ * every bit position in which a key can first differ from it */
+#define RADIX_BUCKETS   (33)
+
+struct heap_node{
+    uint32_t key;
+    uint32_t id;
+    /* The cost to reach the node at the time it was pushed. When this 
+     * is greater than the current cost, the entry is stale. */
+    float    cost;
+};
+
+VEC_TYPE(hnode, struct heap_node)
+VEC_IMPL(static inline, hnode, struct heap_node)
+
+/* A monotone priority queue: every key pushed must be no less than the 
+ * last key popped, which holds for Dijkstra's algorithm and for A* with 
+ * a consistent heuristic. The bit patterns of non-negative floats order 
+ * the same way as the floats themselves, so the priorities are used as 
+ * the keys directly. Every key is kept in the bucket of the highest bit
+ * in which it differs from the last popped key. Popping only ever needs 
+ * to scan a single bucket, after which its' nodes are redistributed to 
+ * lower buckets. */
+struct radix_heap{
+    uint32_t    last;
+    size_t      size;
+    vec_hnode_t buckets[RADIX_BUCKETS];
+};
+
+/* The state of a single search. The per-node arrays are only valid for 
+ * the entries stamped with the current generation, so they never need 
+ * to be cleared between searches. */
+struct astar_scratch{
+    struct astar_scratch *next;
+    uint32_t              generation;
+    struct radix_heap     heap;
+    uint32_t              grid_stamp[GRID_NODES];
+    float                 grid_cost[GRID_NODES];
+    uint32_t              grid_from[GRID_NODES];
+    /* Indexed by the global portal index, sized for the current map */
+    size_t                portal_capacity;
+    uint32_t             *portal_stamp;
+    float                *portal_cost;
+    uint32_t             *portal_from;
+    /* The portal path with the region hops expanded */
+    vec_portal_t          path;
+};
+
+VEC_TYPE(redge, struct region_edge)
+VEC_IMPL(static inline, redge, struct region_edge)
 
-KHASH_MAP_INIT_INT64(key_coord, struct coord)
-KHASH_MAP_INIT_INT64(key_portal, const struct portal*)
-KHASH_MAP_INIT_INT64(key_float, float)
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
 
-#define MIN(a, b) ((a) < (b) ? (a) : (b))
-#define kh_put_val(name, table, key, val)               \
-    do{                                                 \
-        int ret;                                        \
-        khiter_t k = kh_put(name, table, key, &ret);    \
-        assert(ret != -1);                              \
-        kh_value(table, k) = val;                       \
-    }while(0)
+/* The searches are run on the worker threads as well as on the main 
+ * thread. Each search takes a scratch buffer from the pool for its' 
+ * duration, so there are only ever as many as there are concurrent 
+ * searches. */
+static SDL_SpinLock          s_scratch_lock;
+static struct astar_scratch *s_scratch_pool;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
 /*****************************************************************************/
 
-static uint64_t coord_to_key(struct coord c)
+static uint32_t float_key(float f)
+{
+    assert(f >= 0.0f);
+    uint32_t ret;
+    memcpy(&ret, &f, sizeof(ret));
+    return ret;
+}
+
+static int rheap_bucket(uint32_t last, uint32_t key)
+{
+    if(key == last)
+        return 0;
+    return 32 - __builtin_clz(key ^ last);
+}
+
+static void rheap_init(struct radix_heap *heap)
+{
+    heap->last = 0;
+    heap->size = 0;
+    for(int i = 0; i < RADIX_BUCKETS; i++)
+        vec_hnode_init(&heap->buckets[i]);
+}
+
+static void rheap_destroy(struct radix_heap *heap)
+{
+    for(int i = 0; i < RADIX_BUCKETS; i++)
+        vec_hnode_destroy(&heap->buckets[i]);
+}
+
+static void rheap_reset(struct radix_heap *heap)
+{
+    heap->last = 0;
+    heap->size = 0;
+    for(int i = 0; i < RADIX_BUCKETS; i++)
+        vec_hnode_reset(&heap->buckets[i]);
+}
+
+static bool rheap_push(struct radix_heap *heap, float prio, uint32_t id, float cost)
+{
+    /* Rounding errors (or an inconsistent heuristic over zero-cost tiles) 
+     * can produce a priority that is just under the last one popped. Such
+     * nodes are simply visited next. */
+    uint32_t key = float_key(prio);
+    if(key < heap->last)
+        key = heap->last;
+
+    struct heap_node node = (struct heap_node){key, id, cost};
+    if(!vec_hnode_push(&heap->buckets[rheap_bucket(heap->last, key)], node))
+        return false;
+    heap->size++;
+    return true;
+}
+
+static bool rheap_empty(const struct radix_heap *heap)
+{
+    return (heap->size == 0);
+}
+
+/* Returns false when the heap is empty, or when the nodes could not be
+ * moved into the lower buckets, in which case the heap is left unchanged 
+ * and 'rheap_empty' tells the two apart. */
+static bool rheap_pop(struct radix_heap *heap, struct heap_node *out)
 {
-    return (((uint64_t)c.r) << 32) | (((uint64_t)c.c) & ~((uint32_t)0));
+    if(rheap_empty(heap))
+        return false;
+
+    if(vec_size(&heap->buckets[0]) == 0) {
+
+        int i = 1;
+        while(vec_size(&heap->buckets[i]) == 0)
+            i++;
+
+        vec_hnode_t *bucket = &heap->buckets[i];
+        uint32_t min = vec_AT(bucket, 0).key;
+        for(int j = 1; j < vec_size(bucket); j++) {
+            min = MIN(min, vec_AT(bucket, j).key);
+        }
+
+        /* All the nodes of the bucket now differ from the new minimum 
+         * in a lower bit, so they end up in lower buckets. Make room for 
+         * them up-front so that no node can be lost part-way through. */
+        size_t counts[RADIX_BUCKETS] = {0};
+        for(int j = 0; j < vec_size(bucket); j++) {
+            counts[rheap_bucket(min, vec_AT(bucket, j).key)]++;
+        }
+        for(int j = 0; j < i; j++) {
+            if(!counts[j])
+                continue;
+            if(!vec_hnode_resize(&heap->buckets[j], vec_size(&heap->buckets[j]) + counts[j]))
+                return false;
+        }
+
+        heap->last = min;
+        for(int j = 0; j < vec_size(bucket); j++) {
+            struct heap_node node = vec_AT(bucket, j);
+            bool ret = vec_hnode_push(&heap->buckets[rheap_bucket(min, node.key)], node);
+            assert(ret);
+            (void)ret;
+        }
+        vec_hnode_reset(bucket);
+    }
+
+    *out = vec_hnode_pop(&heap->buckets[0]);
+    heap->size--;
+    return true;
 }
 
-static uint64_t portal_to_key(const struct portal *p)
+/* Start a new generation, invalidating all the per-node entries */
+static void scratch_next_generation(struct astar_scratch *scratch)
 {
-    return (((uint64_t)p->chunk.r & 0xffff)      << 48)
-         | (((uint64_t)p->chunk.c & 0xffff)      << 32)
-         | (((uint64_t)p->endpoints[0].r & 0xff) << 24)
-         | (((uint64_t)p->endpoints[0].c & 0xff) << 16)
-         | (((uint64_t)p->endpoints[1].r & 0xff) <<  8)
-         | (((uint64_t)p->endpoints[1].c & 0xff) <<  0);
+    if(++scratch->generation == 0) {
+        memset(scratch->grid_stamp, 0, sizeof(scratch->grid_stamp));
+        memset(scratch->portal_stamp, 0, scratch->portal_capacity * sizeof(scratch->portal_stamp[0]));
+        scratch->generation = 1;
+    }
+    rheap_reset(&scratch->heap);
+}
+
+static struct astar_scratch *scratch_acquire(void)
+{
+    SDL_AtomicLock(&s_scratch_lock);
+    struct astar_scratch *ret = s_scratch_pool;
+    if(ret) {
+        s_scratch_pool = ret->next;
+    }
+    SDL_AtomicUnlock(&s_scratch_lock);
+
+    if(!ret) {
+        ret = calloc(1, sizeof(struct astar_scratch));
+        if(!ret)
+            return NULL;
+        rheap_init(&ret->heap);
+        vec_portal_init(&ret->path);
+    }
+
+    scratch_next_generation(ret);
+    return ret;
+}
+
+static void scratch_release(struct astar_scratch *scratch)
+{
+    SDL_AtomicLock(&s_scratch_lock);
+    scratch->next = s_scratch_pool;
+    s_scratch_pool = scratch;
+    SDL_AtomicUnlock(&s_scratch_lock);
+}
+
+static void scratch_free(struct astar_scratch *scratch)
+{
+    rheap_destroy(&scratch->heap);
+    vec_portal_destroy(&scratch->path);
+    free(scratch->portal_stamp);
+    free(scratch->portal_cost);
+    free(scratch->portal_from);
+    free(scratch);
+}
+
+static bool scratch_reserve_portals(struct astar_scratch *scratch, size_t nportals)
+{
+    if(nportals <= scratch->portal_capacity)
+        return true;
+
+    uint32_t *stamp = realloc(scratch->portal_stamp, nportals * sizeof(uint32_t));
+    if(!stamp)
+        return false;
+    scratch->portal_stamp = stamp;
+
+    float *cost = realloc(scratch->portal_cost, nportals * sizeof(float));
+    if(!cost)
+        return false;
+    scratch->portal_cost = cost;
+
+    uint32_t *from = realloc(scratch->portal_from, nportals * sizeof(uint32_t));
+    if(!from)
+        return false;
+    scratch->portal_from = from;
+
+    /* The new entries must not alias the current generation */
+    memset(stamp + scratch->portal_capacity, 0, 
+        (nportals - scratch->portal_capacity) * sizeof(uint32_t));
+    scratch->portal_capacity = nportals;
+    return true;
+}
+
+static uint32_t grid_index(struct coord c)
+{
+    return c.r * FIELD_RES_C + c.c;
+}
+
+static struct coord grid_coord(uint32_t idx)
+{
+    return (struct coord){idx / FIELD_RES_C, idx % FIELD_RES_C};
+}
+
+static uint32_t portal_index(const struct nav_private *priv, const struct portal *p)
+{
+    size_t chunk_idx = p->chunk.r * priv->width + p->chunk.c;
+    return chunk_idx * MAX_PORTALS_PER_CHUNK + (p - priv->chunks[chunk_idx].portals);
+}
+
+static const struct portal *index_portal(const struct nav_private *priv, uint32_t idx)
+{
+    return &priv->chunks[idx / MAX_PORTALS_PER_CHUNK].portals[idx % MAX_PORTALS_PER_CHUNK];
+}
+
+static int region_index(const struct nav_private *priv, struct coord chunk)
+{
+    return (chunk.r / REGION_CHUNKS) * priv->region_w + (chunk.c / REGION_CHUNKS);
+}
+
+static void relax_portal(struct astar_scratch *scratch, uint32_t from, uint32_t next, float new_cost)
+{
+    const uint32_t gen = scratch->generation;
+    if(scratch->portal_stamp[next] == gen && new_cost >= scratch->portal_cost[next])
+        return;
+
+    scratch->portal_stamp[next] = gen;
+    scratch->portal_cost[next] = new_cost;
+    scratch->portal_from[next] = from;
+
+    /* No heuristic used - effectively Dijkstra's algorithm */
+    rheap_push(&scratch->heap, new_cost, next, new_cost);
 }
 
 static int neighbours_grid(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord coord, 
@@ -119,30 +377,6 @@ static int neighbours_grid(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], s
     return ret;
 }
 
-static int neighbours_portal_graph(const struct portal *portal,
-                                   const struct portal **out_neighbours, float *out_costs)
-{
-    int ret = 0;
-
-    for(int i = 0; i < portal->num_neighbours; i++) {
-
-        const struct edge *edge = &portal->edges[i];
-        if(edge->es == EDGE_STATE_BLOCKED)
-            continue;
-
-        out_neighbours[ret] = edge->neighbour;
-        out_costs[ret] = edge->cost;
-        ret++;
-    }
-
-    out_neighbours[ret] = portal->connected;
-    out_costs[ret] = 1;
-    ret++;
-
-    assert(ret <= MAX_PORTALS_PER_CHUNK);
-    return ret;
-}
-
 static float heuristic(struct coord a, struct coord b)
 {
     /* Octile Distance:
@@ -171,6 +405,127 @@ static float portal_node_penalty(void)
     return sqrt(pow(FIELD_RES_R, 2.0f) + pow(FIELD_RES_C, 2.0f));
 }
 
+/* Visit the neighbours of the portal in the lower level of the graph. When 
+ * 'region' is not negative, only the portals inside that region are visited. */
+static void expand_portal(const struct nav_private *priv, struct astar_scratch *scratch,
+                          uint32_t idx, float cost, int region)
+{
+    const struct portal *portal = index_portal(priv, idx);
+    const uint32_t chunk_base = idx - (idx % MAX_PORTALS_PER_CHUNK);
+    const float penalty = portal_node_penalty();
+
+    for(int i = 0; i < portal->num_neighbours; i++) {
+
+        const struct edge *edge = &portal->edges[i];
+        if(edge->es == EDGE_STATE_BLOCKED)
+            continue;
+        relax_portal(scratch, idx, chunk_base + edge->neighbour, cost + edge->cost + penalty);
+    }
+
+    if(region >= 0 && region_index(priv, portal->connected->chunk) != region)
+        return;
+    relax_portal(scratch, idx, portal_index(priv, portal->connected), cost + 1 + penalty);
+}
+
+/* Visit the neighbours of a border portal in the upper level of the graph */
+static void expand_region_node(const struct nav_private *priv, struct astar_scratch *scratch,
+                               uint32_t idx, float cost)
+{
+    const struct portal *portal = index_portal(priv, idx);
+    const struct nav_region *region = &priv->regions[region_index(priv, portal->chunk)];
+
+    for(int i = region->offsets[portal->region_node]; i < region->offsets[portal->region_node + 1]; i++) {
+
+        const struct region_edge *edge = &region->edges[i];
+        relax_portal(scratch, idx, region->nodes[edge->neighbour], cost + edge->cost);
+    }
+    relax_portal(scratch, idx, portal_index(priv, portal->connected), cost + 1 + portal_node_penalty());
+}
+
+/* Regions other than the ones holding the endpoints of the path are crossed 
+ * using the upper level of the graph. A region that could not be built is 
+ * left without any nodes, and falls back to the lower level. */
+static bool crosses_region(const struct nav_private *priv, const struct portal *portal, 
+                           int src_region, int dst_region)
+{
+    if(!priv->regions || portal->region_node == REGION_NODE_NONE)
+        return false;
+    int region = region_index(priv, portal->chunk);
+    return (region != src_region) && (region != dst_region);
+}
+
+/* Find the shortest path from the source portal to every other portal 
+ * of the region (or only to the target portal, if there is one) without 
+ * leaving the region. Returns false if the search ran out of memory. */
+static bool region_search(const struct nav_private *priv, struct astar_scratch *scratch,
+                          int region, uint32_t source, uint32_t target)
+{
+    scratch_next_generation(scratch);
+    const uint32_t gen = scratch->generation;
+
+    scratch->portal_stamp[source] = gen;
+    scratch->portal_cost[source] = 0.0f;
+    scratch->portal_from[source] = NODE_NONE;
+    rheap_push(&scratch->heap, 0.0f, source, 0.0f);
+
+    struct heap_node top;
+    while(rheap_pop(&scratch->heap, &top)) {
+
+        if(top.id == target)
+            return true;
+
+        float curr_cost = scratch->portal_cost[top.id];
+        if(top.cost > curr_cost)
+            continue;
+
+        expand_portal(priv, scratch, top.id, curr_cost, region);
+    }
+    return rheap_empty(&scratch->heap);
+}
+
+/* Replace every hop across a region in the path with the portals 
+ * that it passes through. */
+static bool refine_path(const struct nav_private *priv, struct astar_scratch *scratch,
+                        int src_region, int dst_region, vec_portal_t *inout_path)
+{
+    vec_portal_reset(&scratch->path);
+
+    for(int i = 0; i < vec_size(inout_path); i++) {
+
+        const struct portal *curr = vec_AT(inout_path, i);
+        vec_portal_push(&scratch->path, (struct portal*)curr);
+
+        if(i == vec_size(inout_path) - 1)
+            break;
+
+        const struct portal *next = vec_AT(inout_path, i + 1);
+        if(next == curr->connected || !crosses_region(priv, curr, src_region, dst_region))
+            continue;
+
+        const int region = region_index(priv, curr->chunk);
+        const uint32_t curr_idx = portal_index(priv, curr);
+        const uint32_t next_idx = portal_index(priv, next);
+        assert(region == region_index(priv, next->chunk));
+
+        if(!region_search(priv, scratch, region, curr_idx, next_idx))
+            return false;
+        assert(scratch->portal_stamp[next_idx] == scratch->generation);
+
+        size_t begin = vec_size(&scratch->path);
+        for(uint32_t idx = scratch->portal_from[next_idx]; idx != curr_idx; idx = scratch->portal_from[idx]) {
+            vec_portal_push(&scratch->path, (struct portal*)index_portal(priv, idx));
+        }
+
+        for(int j = begin, k = vec_size(&scratch->path) - 1; j < k; j++, k--) {
+            struct portal *tmp = vec_AT(&scratch->path, j);
+            vec_AT(&scratch->path, j) = vec_AT(&scratch->path, k);
+            vec_AT(&scratch->path, k) = tmp;
+        }
+    }
+
+    return vec_portal_copy(inout_path, &scratch->path);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -186,71 +541,81 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
 
     if(N_FC_GetGridPath(start, finish, chunk, &gp)) {
 
-        if(!gp.exists)
+        if(!gp.exists) {
+            vec_coord_destroy(&gp.path);
             PERF_RETURN(false);
+        }
 
         *out_cost = gp.cost;
         vec_coord_copy(out_path, &gp.path);
+        vec_coord_destroy(&gp.path);
         PERF_RETURN(true);
     }
 
-    pq_coord_t          frontier;
-    khash_t(key_coord) *came_from;
-    khash_t(key_float) *running_cost;
-    
-    pq_coord_init(&frontier);
-    if(NULL == (came_from = kh_init(key_coord)))
-        goto fail_came_from;
-    if(NULL == (running_cost = kh_init(key_float)))
-        goto fail_running_cost;
+    struct astar_scratch *scratch = scratch_acquire();
+    if(!scratch) {
+        vec_coord_destroy(&gp.path);
+        PERF_RETURN(false);
+    }
 
-    kh_put_val(key_float, running_cost, coord_to_key(start), 0.0f);
-    pq_coord_push(&frontier, 0.0f, start);
+    const uint32_t gen = scratch->generation;
+    const uint32_t start_idx = grid_index(start);
+    const uint32_t finish_idx = grid_index(finish);
 
-    while(pq_size(&frontier) > 0) {
+    scratch->grid_stamp[start_idx] = gen;
+    scratch->grid_cost[start_idx] = 0.0f;
+    scratch->grid_from[start_idx] = NODE_NONE;
+    rheap_push(&scratch->heap, 0.0f, start_idx, 0.0f);
 
-        struct coord curr;
-        pq_coord_pop(&frontier, &curr);
+    struct heap_node top = {.id = NODE_NONE};
+    while(rheap_pop(&scratch->heap, &top)) {
 
-        if(0 == memcmp(&curr, &finish, sizeof(struct coord)))
+        if(top.id == finish_idx)
             break;
 
+        float curr_cost = scratch->grid_cost[top.id];
+        if(top.cost > curr_cost)
+            continue;
+
         struct coord neighbours[8];
         float neighbour_costs[8];
-        int num_neighbours = neighbours_grid(cost_field, curr, neighbours, neighbour_costs);
+        int num_neighbours = neighbours_grid(cost_field, grid_coord(top.id), neighbours, neighbour_costs);
 
         for(int i = 0; i < num_neighbours; i++) {
 
-            struct coord *next = &neighbours[i];
-            khiter_t k = kh_get(key_float, running_cost, coord_to_key(curr));
-            assert(k != kh_end(running_cost));
-            float new_cost = kh_value(running_cost, k) + neighbour_costs[i];
+            uint32_t next = grid_index(neighbours[i]);
+            float new_cost = curr_cost + neighbour_costs[i];
+
+            if(scratch->grid_stamp[next] != gen || new_cost < scratch->grid_cost[next]) {
 
-            if((k = kh_get(key_float, running_cost, coord_to_key(*next))) == kh_end(running_cost)
-            || new_cost < kh_value(running_cost, k)) {
+                scratch->grid_stamp[next] = gen;
+                scratch->grid_cost[next] = new_cost;
+                scratch->grid_from[next] = top.id;
 
-                kh_put_val(key_float, running_cost, coord_to_key(*next), new_cost);
-                float priority = new_cost + heuristic(finish, *next);
-                pq_coord_push(&frontier, priority, *next);
-                kh_put_val(key_coord, came_from, coord_to_key(*next), curr);
+                float priority = new_cost + heuristic(finish, neighbours[i]);
+                rheap_push(&scratch->heap, priority, next, new_cost);
             }
         }
     }
+
+    /* Running out of memory does not mean that there is no path, 
+     * so that result must not be cached */
+    if(top.id != finish_idx && !rheap_empty(&scratch->heap))
+        goto fail_heap;
     
-    if(kh_get(key_coord, came_from, coord_to_key(finish)) == kh_end(came_from))
+    if(scratch->grid_stamp[finish_idx] != gen || scratch->grid_from[finish_idx] == NODE_NONE)
         goto fail_find_path;
 
     vec_coord_reset(out_path);
 
     /* We have our path at this point. Walk backwards along the path to build a 
      * vector of the nodes along the path. */
-    struct coord curr = finish;
-    while(0 != memcmp(&curr, &start, sizeof(struct coord))) {
+    uint32_t curr = finish_idx;
+    while(curr != start_idx) {
 
-        vec_coord_push(out_path, curr);
-        khiter_t k = kh_get(key_coord, came_from, coord_to_key(curr));
-        assert(k != kh_end(came_from));
-        curr = kh_value(came_from, k);
+        vec_coord_push(out_path, grid_coord(curr));
+        curr = scratch->grid_from[curr];
+        assert(curr != NODE_NONE);
     }
     vec_coord_push(out_path, start);
 
@@ -261,13 +626,8 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
         vec_AT(out_path, j) = tmp;
     }
 
-    khiter_t k = kh_get(key_float, running_cost, coord_to_key(finish));
-    assert(k != kh_end(running_cost));
-    *out_cost = kh_value(running_cost, k);
-
-    pq_coord_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-    kh_destroy(key_coord, came_from);
+    *out_cost = scratch->grid_cost[finish_idx];
+    scratch_release(scratch);
 
     /* Cache the result */
     gp.exists = true;
@@ -277,14 +637,14 @@ bool AStar_GridPath(struct coord start, struct coord finish, struct coord chunk,
     PERF_RETURN(true);
 
 fail_find_path:
+    scratch_release(scratch);
     gp.exists = false;
     N_FC_PutGridPath(start, finish, chunk, &gp);
+    PERF_RETURN(false);
 
-    pq_coord_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-fail_running_cost:
-    kh_destroy(key_coord, came_from);
-fail_came_from:
+fail_heap:
+    scratch_release(scratch);
+    vec_coord_destroy(&gp.path);
     PERF_RETURN(false);
 }
 
@@ -294,19 +654,21 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
 {
     PERF_ENTER();
 
-    pq_portal_t          frontier;
-    khash_t(key_portal) *came_from;
-    khash_t(key_float)  *running_cost;
-    
-    pq_portal_init(&frontier);
-    if(NULL == (came_from = kh_init(key_portal)))
-        goto fail_came_from;
-    if(NULL == (running_cost = kh_init(key_float)))
-        goto fail_running_cost;
+    struct astar_scratch *scratch = scratch_acquire();
+    if(!scratch)
+        PERF_RETURN(false);
+
+    if(!scratch_reserve_portals(scratch, priv->width * priv->height * MAX_PORTALS_PER_CHUNK)) {
+        scratch_release(scratch);
+        PERF_RETURN(false);
+    }
 
+    const uint32_t gen = scratch->generation;
     const struct nav_chunk *chunk = &priv->chunks[start_tile.chunk_r * priv->width + start_tile.chunk_c];
-    vec_coord_t path;
-    vec_coord_init(&path);
+    const int src_region = priv->regions 
+                         ? region_index(priv, (struct coord){start_tile.chunk_r, start_tile.chunk_c}) 
+                         : -1;
+    const int dst_region = priv->regions ? region_index(priv, finish->chunk) : -1;
 
     /* Intitialize the frontier with all the portals in the source chunk that are 
      * reachable from the source tile. */
@@ -317,62 +679,56 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
 
         if(N_PortalReachableFromTile(port, tile_coord, chunk)) {
 
-            float cost = chunk->portal_travel_costs[i][tile_coord.r][tile_coord.c];
+            float cost = N_PortalTravelCost(chunk, i, tile_coord);
             if(cost != FLT_MAX) {
-            
-                kh_put_val(key_float, running_cost, portal_to_key(port), cost);
-                pq_portal_push(&frontier, cost, port);
+
+                uint32_t idx = portal_index(priv, port);
+                scratch->portal_stamp[idx] = gen;
+                scratch->portal_cost[idx] = cost;
+                scratch->portal_from[idx] = NODE_NONE;
+                rheap_push(&scratch->heap, cost, idx, cost);
             }
         }
     }
-    vec_coord_destroy(&path);
 
-    while(pq_size(&frontier) > 0) {
+    const uint32_t finish_idx = portal_index(priv, finish);
+    struct heap_node top = {.id = NODE_NONE};
 
-        const struct portal *curr;
-        pq_portal_pop(&frontier, &curr);
+    while(rheap_pop(&scratch->heap, &top)) {
 
-        if(curr == finish)
+        if(top.id == finish_idx)
             break;
 
-        const struct portal *neighbours[MAX_PORTALS_PER_CHUNK];
-        float neighbour_costs[MAX_PORTALS_PER_CHUNK];
-        int num_neighbours = neighbours_portal_graph(curr, neighbours, neighbour_costs);
-
-        for(int i = 0; i < num_neighbours; i++) {
-
-            const struct portal *next = neighbours[i];
-            khiter_t k = kh_get(key_float, running_cost, portal_to_key(curr));
-            assert(k != kh_end(running_cost));
-            float new_cost = kh_value(running_cost, k) + neighbour_costs[i] + portal_node_penalty();
-
-            if((k = kh_get(key_float, running_cost, portal_to_key(next))) == kh_end(running_cost)
-            || new_cost < kh_value(running_cost, k)) {
+        float curr_cost = scratch->portal_cost[top.id];
+        if(top.cost > curr_cost)
+            continue;
 
-                kh_put_val(key_float, running_cost, portal_to_key(next), new_cost);
-                /* No heuristic used - effectively Dijkstra's algorithm */
-                float priority = new_cost;
-                pq_portal_push(&frontier, priority, next);
-                kh_put_val(key_portal, came_from, portal_to_key(next), curr);
-            }
+        if(crosses_region(priv, index_portal(priv, top.id), src_region, dst_region)) {
+            expand_region_node(priv, scratch, top.id, curr_cost);
+        }else{
+            expand_portal(priv, scratch, top.id, curr_cost, -1);
         }
     }
     
-    if(kh_get(key_portal, came_from, portal_to_key(finish)) == kh_end(came_from))
-        goto fail_find_path;
+    if(top.id != finish_idx && !rheap_empty(&scratch->heap)) {
+        scratch_release(scratch);
+        PERF_RETURN(false);
+    }
+
+    if(scratch->portal_stamp[finish_idx] != gen || scratch->portal_from[finish_idx] == NODE_NONE) {
+        scratch_release(scratch);
+        PERF_RETURN(false);
+    }
 
     vec_portal_reset(out_path);
 
     /* We have our path at this point. Walk backwards along the path to build a 
      * vector of the nodes along the path. */
-    const struct portal *curr = finish;
-    while(true) {
+    uint32_t curr = finish_idx;
+    while(curr != NODE_NONE) {
 
-        vec_portal_push(out_path, (struct portal*)curr);
-        khiter_t k = kh_get(key_portal, came_from, portal_to_key(curr));
-        if(k == kh_end(came_from))
-            break;
-        curr = kh_value(came_from, k);
+        vec_portal_push(out_path, (struct portal*)index_portal(priv, curr));
+        curr = scratch->portal_from[curr];
     }
 
     /* Reverse the path vector */
@@ -382,22 +738,130 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
         vec_AT(out_path, j) = tmp;
     }
 
-    khiter_t k = kh_get(key_float, running_cost, portal_to_key(finish));
-    assert(k != kh_end(running_cost));
-    *out_cost = kh_value(running_cost, k);
+    *out_cost = scratch->portal_cost[finish_idx];
+    if(priv->regions) {
+        if(!refine_path(priv, scratch, src_region, dst_region, out_path)) {
+            scratch_release(scratch);
+            PERF_RETURN(false);
+        }
+    }
+
+    scratch_release(scratch);
+    PERF_RETURN(true);
+}
+
+bool AStar_BuildRegion(struct nav_private *priv, int region_idx)
+{
+    PERF_ENTER();
+
+    struct nav_region *region = &priv->regions[region_idx];
+    const int min_r = (region_idx / priv->region_w) * REGION_CHUNKS;
+    const int min_c = (region_idx % priv->region_w) * REGION_CHUNKS;
+    const int max_r = MIN(min_r + REGION_CHUNKS, priv->height);
+    const int max_c = MIN(min_c + REGION_CHUNKS, priv->width);
 
-    pq_portal_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-    kh_destroy(key_portal, came_from);
+    free(region->nodes);
+    free(region->offsets);
+    free(region->edges);
+    *region = (struct nav_region){0};
 
+    size_t nnodes = 0;
+    for(int r = min_r; r < max_r; r++) {
+    for(int c = min_c; c < max_c; c++) {
+
+        struct nav_chunk *chunk = &priv->chunks[r * priv->width + c];
+        for(int i = 0; i < chunk->num_portals; i++) {
+
+            struct portal *port = &chunk->portals[i];
+            port->region_node = REGION_NODE_NONE;
+            if(port->connected && region_index(priv, port->connected->chunk) != region_idx)
+                nnodes++;
+        }
+    }}
+
+    struct astar_scratch *scratch = scratch_acquire();
+    if(!scratch)
+        goto fail_scratch;
+    if(!scratch_reserve_portals(scratch, priv->width * priv->height * MAX_PORTALS_PER_CHUNK))
+        goto fail_alloc;
+
+    region->nodes = malloc(MAX(nnodes, 1) * sizeof(uint32_t));
+    region->offsets = malloc((nnodes + 1) * sizeof(uint32_t));
+    if(!region->nodes || !region->offsets)
+        goto fail_alloc;
+
+    for(int r = min_r; r < max_r; r++) {
+    for(int c = min_c; c < max_c; c++) {
+
+        struct nav_chunk *chunk = &priv->chunks[r * priv->width + c];
+        for(int i = 0; i < chunk->num_portals; i++) {
+
+            const struct portal *port = &chunk->portals[i];
+            if(port->connected && region_index(priv, port->connected->chunk) != region_idx)
+                region->nodes[region->num_nodes++] = portal_index(priv, port);
+        }
+    }}
+    assert(region->num_nodes == nnodes);
+
+    vec_redge_t edges;
+    vec_redge_init(&edges);
+
+    for(int i = 0; i < nnodes; i++) {
+
+        region->offsets[i] = vec_size(&edges);
+        if(!region_search(priv, scratch, region_idx, region->nodes[i], NODE_NONE))
+            goto fail_edges;
+
+        for(int j = 0; j < nnodes; j++) {
+
+            uint32_t other = region->nodes[j];
+            if(j == i || scratch->portal_stamp[other] != scratch->generation)
+                continue;
+
+            struct region_edge edge = (struct region_edge){j, scratch->portal_cost[other]};
+            if(!vec_redge_push(&edges, edge))
+                goto fail_edges;
+        }
+    }
+    region->offsets[nnodes] = vec_size(&edges);
+
+    region->edges = malloc(MAX(vec_size(&edges), 1) * sizeof(struct region_edge));
+    if(!region->edges)
+        goto fail_edges;
+    memcpy(region->edges, edges.array, vec_size(&edges) * sizeof(struct region_edge));
+
+    /* The nodes are only made visible to the searches once the region is complete */
+    for(int i = 0; i < nnodes; i++) {
+        struct portal *port = (struct portal*)index_portal(priv, region->nodes[i]);
+        port->region_node = i;
+    }
+
+    vec_redge_destroy(&edges);
+    scratch_release(scratch);
     PERF_RETURN(true);
 
-fail_find_path:
-    pq_portal_destroy(&frontier);
-    kh_destroy(key_float, running_cost);
-fail_running_cost:
-    kh_destroy(key_portal, came_from);
-fail_came_from:
+fail_edges:
+    vec_redge_destroy(&edges);
+fail_alloc:
+    free(region->nodes);
+    free(region->offsets);
+    *region = (struct nav_region){0};
+    scratch_release(scratch);
+fail_scratch:
     PERF_RETURN(false);
 }
 
+void AStar_Shutdown(void)
+{
+    SDL_AtomicLock(&s_scratch_lock);
+    struct astar_scratch *curr = s_scratch_pool;
+    s_scratch_pool = NULL;
+    SDL_AtomicUnlock(&s_scratch_lock);
+
+    while(curr) {
+        struct astar_scratch *next = curr->next;
+        scratch_free(curr);
+        curr = next;
+    }
+}
+
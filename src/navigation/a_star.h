@@ -71,5 +71,20 @@ bool AStar_PortalGraphPath(struct tile_desc start_tile, const struct portal *fin
                            const struct nav_private *priv, 
                            vec_portal_t *out_path, float *out_cost);
 
+/* ------------------------------------------------------------------------
+ * Find the border portals of the region and the costs of travelling between
+ * them. This must be done for every region whose portals or edges have 
+ * changed before the next search. Returns false if the region could not be 
+ * built, in which case the searches fall back to visiting all its' portals.
+ * ------------------------------------------------------------------------
+ */
+bool AStar_BuildRegion(struct nav_private *priv, int region_idx);
+
+/* ------------------------------------------------------------------------
+ * Free the scratch buffers that are kept around for re-use by the searches.
+ * ------------------------------------------------------------------------
+ */
+void AStar_Shutdown(void);
+
 #endif
 
@@ -35,6 +35,7 @@
 
 #include "field.h"
 #include "nav_private.h"
+#include "sweep.h"
 #include "../entity.h"
 #include "../map/public/tile.h"
 #include "../game/public/game.h"
@@ -270,14 +271,9 @@ static bool is_LOS_corner(struct coord cell, const uint8_t cost_field[FIELD_RES_
 }
 
 static void create_wavefront_blocked_line(struct tile_desc target, struct tile_desc corner, 
-                                          const struct nav_private *priv, vec3_t map_pos, 
+                                          struct map_resolution res, vec3_t map_pos, 
                                           struct LOS_field *out_los)
 {
-    struct map_resolution res = {
-        priv->width, priv->height,
-        FIELD_RES_C, FIELD_RES_R
-    };
-
     /* First determine the slope of the LOS blocker line in the XZ plane */
     struct box target_bounds = M_Tile_Bounds(res, map_pos, target);
     struct box corner_bounds = M_Tile_Bounds(res, map_pos, corner);
@@ -344,33 +340,8 @@ static void pad_wavefront(struct LOS_field *out_los)
     }}
 }
 
-static void build_integration_field(pq_coord_t *frontier, const struct nav_chunk *chunk, 
-                                    float inout[FIELD_RES_R][FIELD_RES_C])
-{
-    while(pq_size(frontier) > 0) {
-
-        struct coord curr;
-        pq_coord_pop(frontier, &curr);
-
-        struct coord neighbours[8];
-        uint8_t neighbour_costs[8];
-        int num_neighbours = neighbours_grid(chunk, curr, true, neighbours, neighbour_costs);
-
-        for(int i = 0; i < num_neighbours; i++) {
-
-            float total_cost = inout[curr.r][curr.c] + neighbour_costs[i];
-            if(total_cost < inout[neighbours[i].r][neighbours[i].c]) {
-
-                inout[neighbours[i].r][neighbours[i].c] = total_cost;
-                if(!pq_coord_contains(frontier, compare_tiles, neighbours[i]))
-                    pq_coord_push(frontier, total_cost, neighbours[i]);
-            }
-        }
-    }
-}
-
-/* same as 'build_integration_field' but only impassable tiles 
- * will be added to the frontier 
+/* Dijkstra search from the tiles in the frontier, through only 
+ * the impassable tiles 
  */
 static void build_integration_field_nonpass(pq_coord_t *frontier, const struct nav_chunk *chunk, 
                                             float inout[FIELD_RES_R][FIELD_RES_C])
@@ -415,11 +386,11 @@ static void build_flow_field(float intf[FIELD_RES_R][FIELD_RES_C], struct flow_f
 
         if(intf[r][c] == 0.0f) {
 
-            inout_flow->field[r][c].dir_idx = FD_NONE;
+            N_SetFlowDir(inout_flow, r, c, FD_NONE);
             continue;
         }
 
-        inout_flow->field[r][c].dir_idx = flow_dir(intf, (struct coord){r, c});
+        N_SetFlowDir(inout_flow, r, c, flow_dir(intf, (struct coord){r, c}));
     }}
 }
 
@@ -438,13 +409,13 @@ static void fixup_portal_edges(float intf[FIELD_RES_R][FIELD_RES_C], struct flow
         if(intf[r][c] == 0.0f) {
 
             if(up)
-                inout_flow->field[r][c].dir_idx = FD_N;
+                N_SetFlowDir(inout_flow, r, c, FD_N);
             else if(down)
-                inout_flow->field[r][c].dir_idx = FD_S;
+                N_SetFlowDir(inout_flow, r, c, FD_S);
             else if(left)
-                inout_flow->field[r][c].dir_idx = FD_W;
+                N_SetFlowDir(inout_flow, r, c, FD_W);
             else if(right)
-                inout_flow->field[r][c].dir_idx = FD_E;
+                N_SetFlowDir(inout_flow, r, c, FD_E);
             else
                 assert(0);
         }
@@ -494,11 +465,7 @@ static bool enemy_ent(int faction_id, const struct entity *ent)
     if(!(ent->flags & ENTITY_FLAG_COMBATABLE))
         return false;
 
-    enum diplomacy_state ds;
-    bool result = G_GetDiplomacyState(faction_id, ent->faction_id, &ds);
-    assert(result);
-
-    if(ds != DIPLOMACY_STATE_WAR)
+    if(!(G_GetEnemyFactions(faction_id) & (0x1 << ent->faction_id)))
         return false;
 
     struct obb obb;
@@ -660,7 +627,6 @@ static size_t enemies_initial_frontier(struct enemies_desc *enemies, const struc
         (vec2_t){bounds.x_max + SEARCH_BUFFER, bounds.z_max + SEARCH_BUFFER},
         ents, ARR_SIZE(ents)
     );
-    assert(num_ents);
 
     struct map_resolution res = {
         priv->width, priv->height,
@@ -833,60 +799,9 @@ static size_t passable_frontier(const struct nav_chunk *chunk, struct coord star
     return ret;
 }
 
-/*****************************************************************************/
-/* EXTERN FUNCTIONS                                                          */
-/*****************************************************************************/
-
-ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target)
-{
-    if(target.type == TARGET_PORTAL) {
-
-        return (((uint64_t)target.type)                 << 56)
-             | (((uint64_t)target.port->endpoints[0].r) << 40)
-             | (((uint64_t)target.port->endpoints[0].c) << 32)
-             | (((uint64_t)target.port->endpoints[1].r) << 24)
-             | (((uint64_t)target.port->endpoints[1].c) << 16)
-             | (((uint64_t)chunk.r)                     <<  8)
-             | (((uint64_t)chunk.c)                     <<  0);
-
-    }else if(target.type == TARGET_TILE){
-
-        return (((uint64_t)target.type)                 << 56)
-             | (((uint64_t)target.tile.r)               << 24)
-             | (((uint64_t)target.tile.c)               << 16)
-             | (((uint64_t)chunk.r)                     <<  8)
-             | (((uint64_t)chunk.c)                     <<  0);
-
-    }else if(target.type == TARGET_ENEMIES){
-
-        return (((uint64_t)target.type)                 << 56)
-             | (((uint64_t)target.enemies.faction_id)   << 24)
-             | (((uint64_t)chunk.r)                     <<  8)
-             | (((uint64_t)chunk.c)                     <<  0);
-    }else {
-        assert(0);
-        return 0;
-    }
-}
-
-void N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, struct flow_field *out)
+static void flow_field_update(const struct nav_chunk *chunk, const struct nav_private *priv,
+                              struct field_target target, struct flow_field *inout_flow)
 {
-    for(int r = 0; r < FIELD_RES_R; r++) {
-        for(int c = 0; c < FIELD_RES_C; c++) {
-
-            out->field[r][c].dir_idx = FD_NONE;
-        }
-    }
-    out->chunk = chunk_coord;
-}
-
-void N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
-                       struct field_target target, struct flow_field *inout_flow)
-{
-    const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
-
     float integration_field[FIELD_RES_R][FIELD_RES_C];
     for(int r = 0; r < FIELD_RES_R; r++)
         for(int c = 0; c < FIELD_RES_C; c++)
@@ -898,28 +813,25 @@ void N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
     for(int i = 0; i < ninit; i++) {
 
         struct coord curr = init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
     inout_flow->target = target;
-    build_integration_field(&frontier, chunk, integration_field);
+    Sweep_IntegrationField(chunk, integration_field);
     build_flow_field(integration_field, inout_flow);
     fixup_field(target, integration_field, inout_flow, chunk);
-
-    pq_coord_destroy(&frontier);
 }
 
-void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc target,
-                      const struct nav_private *priv, vec3_t map_pos, 
-                      struct LOS_field *out_los, const struct LOS_field *prev_los)
+static void los_field_create(struct coord chunk_coord, struct tile_desc target,
+                             const struct nav_chunk *chunk, struct map_resolution res, 
+                             vec3_t map_pos, struct LOS_field *out_los, 
+                             const struct LOS_field *prev_los)
 {
     out_los->chunk = chunk_coord;
     memset(out_los->field, 0x00, sizeof(out_los->field));
 
     pq_coord_t frontier;
     pq_coord_init(&frontier);
-    const struct nav_chunk *chunk = &priv->chunks[chunk_coord.r * priv->width + chunk_coord.c];
 
     float integration_field[FIELD_RES_R][FIELD_RES_C];
     for(int r = 0; r < FIELD_RES_R; r++)
@@ -949,7 +861,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                 if(out_los->field[0][c].wavefront_blocked) {
 
                     struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, 0, c};
-                    create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
+                    create_wavefront_blocked_line(target, src_desc, res, map_pos, out_los);
                 }
                 if(out_los->field[0][c].visible) {
 
@@ -965,7 +877,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                 if(out_los->field[FIELD_RES_R-1][c].wavefront_blocked) {
 
                     struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, FIELD_RES_R-1, c};
-                    create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
+                    create_wavefront_blocked_line(target, src_desc, res, map_pos, out_los);
                 }
                 if(out_los->field[FIELD_RES_R-1][c].visible) {
 
@@ -981,7 +893,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                 if(out_los->field[r][0].wavefront_blocked) {
 
                     struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, r, 0};
-                    create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
+                    create_wavefront_blocked_line(target, src_desc, res, map_pos, out_los);
                 }
                 if(out_los->field[r][0].visible) {
 
@@ -997,7 +909,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                 if(out_los->field[r][FIELD_RES_C-1].wavefront_blocked) {
 
                     struct tile_desc src_desc = (struct tile_desc) {chunk_coord.r, chunk_coord.c, r, FIELD_RES_C-1};
-                    create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
+                    create_wavefront_blocked_line(target, src_desc, res, map_pos, out_los);
                 }
                 if(out_los->field[r][FIELD_RES_C-1].visible) {
 
@@ -1033,7 +945,7 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
                     .tile_r = neighbours[i].r,
                     .tile_c = neighbours[i].c
                 };
-                create_wavefront_blocked_line(target, src_desc, priv, map_pos, out_los);
+                create_wavefront_blocked_line(target, src_desc, res, map_pos, out_los);
             }else{
 
                 float new_cost = integration_field[curr.r][curr.c] + 1;
@@ -1058,6 +970,83 @@ void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc t
     pad_wavefront(out_los);
 }
 
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target)
+{
+    if(target.type == TARGET_PORTAL) {
+
+        return (((uint64_t)target.type)                 << 56)
+             | (((uint64_t)target.port->endpoints[0].r) << 40)
+             | (((uint64_t)target.port->endpoints[0].c) << 32)
+             | (((uint64_t)target.port->endpoints[1].r) << 24)
+             | (((uint64_t)target.port->endpoints[1].c) << 16)
+             | (((uint64_t)chunk.r)                     <<  8)
+             | (((uint64_t)chunk.c)                     <<  0);
+
+    }else if(target.type == TARGET_TILE){
+
+        return (((uint64_t)target.type)                 << 56)
+             | (((uint64_t)target.tile.r)               << 24)
+             | (((uint64_t)target.tile.c)               << 16)
+             | (((uint64_t)chunk.r)                     <<  8)
+             | (((uint64_t)chunk.c)                     <<  0);
+
+    }else if(target.type == TARGET_ENEMIES){
+
+        return (((uint64_t)target.type)                 << 56)
+             | (((uint64_t)target.enemies.version)      << 32)
+             | (((uint64_t)target.enemies.faction_id)   << 24)
+             | (((uint64_t)chunk.r)                     <<  8)
+             | (((uint64_t)chunk.c)                     <<  0);
+    }else {
+        assert(0);
+        return 0;
+    }
+}
+
+void N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, struct flow_field *out)
+{
+    memset(out->dirs, FD_NONE, sizeof(out->dirs));
+    out->chunk = chunk_coord;
+}
+
+void N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
+                       struct field_target target, struct flow_field *inout_flow)
+{
+    const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
+    flow_field_update(chunk, priv, target, inout_flow);
+}
+
+void N_FlowFieldUpdateChunk(const struct nav_chunk *chunk, struct field_target target, 
+                            struct flow_field *inout_flow)
+{
+    assert(target.type != TARGET_ENEMIES);
+    flow_field_update(chunk, NULL, target, inout_flow);
+}
+
+void N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_desc target,
+                      const struct nav_private *priv, vec3_t map_pos, 
+                      struct LOS_field *out_los, const struct LOS_field *prev_los)
+{
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+    const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
+    los_field_create(chunk_coord, target, chunk, res, map_pos, out_los, prev_los);
+}
+
+void N_LOSFieldCreateChunk(struct coord chunk_coord, struct tile_desc target, 
+                           const struct nav_chunk *chunk, struct map_resolution res,
+                           vec3_t map_pos, struct LOS_field *out_los, 
+                           const struct LOS_field *prev_los)
+{
+    los_field_create(chunk_coord, target, chunk, res, map_pos, out_los, prev_los);
+}
+
 void N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct coord start, 
                                         struct flow_field *inout_flow)
 {
@@ -1088,7 +1077,7 @@ void N_FlowFieldUpdateToNearestPathable(const struct nav_chunk *chunk, struct co
             continue;
         if(integration_field[r][c] == 0.0f)
             continue;
-        inout_flow->field[r][c].dir_idx = flow_dir(integration_field, (struct coord){r, c});
+        N_SetFlowDir(inout_flow, r, c, flow_dir(integration_field, (struct coord){r, c}));
     }}
 
     pq_coord_destroy(&frontier);
@@ -1100,9 +1089,6 @@ void N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_priva
     struct coord chunk_coord = inout_flow->chunk;
     const struct nav_chunk *chunk = &priv->chunks[IDX(chunk_coord.r, priv->width, chunk_coord.c)];
 
-    pq_coord_t frontier;
-    pq_coord_init(&frontier);
-
     struct coord init_frontier[FIELD_RES_R * FIELD_RES_C];
     size_t ninit = initial_frontier(inout_flow->target, chunk, priv, false, init_frontier, ARR_SIZE(init_frontier));
 
@@ -1156,14 +1142,11 @@ void N_FlowFieldUpdateIslandToNearest(uint16_t local_iid, const struct nav_priva
     for(int i = 0; i < new_ninit; i++) {
 
         struct coord curr = new_init_frontier[i];
-        pq_coord_push(&frontier, 0.0f, curr); 
         integration_field[curr.r][curr.c] = 0.0f;
     }
 
-    build_integration_field(&frontier, chunk, integration_field);
+    Sweep_IntegrationField(chunk, integration_field);
     build_flow_field(integration_field, inout_flow);
     fixup_field(inout_flow->target, integration_field, inout_flow, chunk);
-
-    pq_coord_destroy(&frontier);
 }
 
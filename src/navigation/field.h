@@ -69,17 +69,19 @@ struct field_target{
             int          faction_id;
             vec3_t       map_pos;
             struct coord chunk;
+            /* The version of the chunk in the faction's threat map */
+            uint16_t     version;
         }enemies;
         uint64_t portalmask;
     };
 };
 
+/* The directions are packed two to a byte, with the even column in the 
+ * low nibble. They should be accessed via 'N_FlowDir' and 'N_SetFlowDir'. */
 struct flow_field{
     struct coord chunk;
     struct field_target target;
-    struct{
-        unsigned dir_idx : 4;
-    }field[FIELD_RES_R][FIELD_RES_C];
+    uint8_t dirs[FIELD_RES_R][FIELD_RES_C / 2];
 };
 
 enum flow_dir{
@@ -96,11 +98,33 @@ enum flow_dir{
 
 extern vec2_t g_flow_dir_lookup[];
 
+static inline enum flow_dir N_FlowDir(const struct flow_field *ff, int r, int c)
+{
+    return (ff->dirs[r][c >> 1] >> ((c & 1) << 2)) & 0xf;
+}
+
+static inline void N_SetFlowDir(struct flow_field *ff, int r, int c, enum flow_dir dir)
+{
+    int shift = (c & 1) << 2;
+    uint8_t *byte = &ff->dirs[r][c >> 1];
+    *byte = (*byte & ~(0xf << shift)) | (dir << shift);
+}
+
 ff_id_t N_FlowField_ID(struct coord chunk, struct field_target target);
 void    N_FlowFieldInit(struct coord chunk_coord, const void *nav_private, struct flow_field *out);
 void    N_FlowFieldUpdate(struct coord chunk_coord, const struct nav_private *priv,
                           struct field_target target, struct flow_field *inout_flow);
 
+/* ------------------------------------------------------------------------
+ * Same as 'N_FlowFieldUpdate', but the field is built from the provided 
+ * chunk, which may be a private copy of the navigation data. Only the 
+ * per-tile costs and blockers of the chunk are read, so this is safe to 
+ * call off the main thread. Enemy targets are not supported.
+ * ------------------------------------------------------------------------
+ */
+void    N_FlowFieldUpdateChunk(const struct nav_chunk *chunk, struct field_target target, 
+                               struct flow_field *inout_flow);
+
 /* ------------------------------------------------------------------------
  * Update all tiles with a specific local island ID from the
  * 'local_islands' field for the chunk. The new directions will guide to
@@ -137,5 +161,15 @@ void    N_LOSFieldCreate(dest_id_t id, struct coord chunk_coord, struct tile_des
                          const struct nav_private *priv, vec3_t map_pos, 
                          struct LOS_field *out_los, const struct LOS_field *prev_los);
 
+/* ------------------------------------------------------------------------
+ * Same as 'N_LOSFieldCreate', but the field is built from the provided 
+ * chunk, under the same constraints as 'N_FlowFieldUpdateChunk'.
+ * ------------------------------------------------------------------------
+ */
+void    N_LOSFieldCreateChunk(struct coord chunk_coord, struct tile_desc target, 
+                              const struct nav_chunk *chunk, struct map_resolution res,
+                              vec3_t map_pos, struct LOS_field *out_los, 
+                              const struct LOS_field *prev_los);
+
 #endif
 
@@ -41,15 +41,38 @@
 #include "../config.h"
 
 #include <assert.h>
+#include <stdlib.h>
+#include <stddef.h>
 
 
-LRU_CACHE_TYPE(los, struct LOS_field)
-LRU_CACHE_PROTOTYPES(static, los, struct LOS_field)
-LRU_CACHE_IMPL(static, los, struct LOS_field)
+#define MIN(a, b)   ((a) < (b) ? (a) : (b))
+#define MAX(a, b)   ((a) > (b) ? (a) : (b))
 
-LRU_CACHE_TYPE(flow, struct flow_field)
-LRU_CACHE_PROTOTYPES(static, flow, struct flow_field)
-LRU_CACHE_IMPL(static, flow, struct flow_field)
+/* LOS and flow fields are stored in reference-counted blocks. The cache holds 
+ * one reference, which it drops on eviction. Any thread which has acquired a 
+ * field holds another, so the field remains readable after the shard lock is 
+ * released, even if the entry gets evicted in the meantime. */
+
+struct fc_los{
+    SDL_atomic_t      refcount;
+    struct LOS_field  lf;
+};
+
+struct fc_flow{
+    SDL_atomic_t      refcount;
+    struct flow_field ff;
+};
+
+typedef struct fc_los  *los_ref_t;
+typedef struct fc_flow *flow_ref_t;
+
+LRU_CACHE_TYPE(los, los_ref_t)
+LRU_CACHE_PROTOTYPES(static, los, los_ref_t)
+LRU_CACHE_IMPL(static, los, los_ref_t)
+
+LRU_CACHE_TYPE(flow, flow_ref_t)
+LRU_CACHE_PROTOTYPES(static, flow, flow_ref_t)
+LRU_CACHE_IMPL(static, flow, flow_ref_t)
 
 LRU_CACHE_TYPE(ffid, ff_id_t)
 LRU_CACHE_PROTOTYPES(static, ffid, ff_id_t)
@@ -65,24 +88,7 @@ VEC_IMPL(static, id, uint64_t)
 
 KHASH_MAP_INIT_INT64(idvec, vec_id_t)
 
-/*****************************************************************************/
-/* STATIC VARIABLES                                                          */
-/*****************************************************************************/
-
-static lru(los)          s_los_cache;       /* key: (dest_id, chunk coord) */
-static lru(flow)         s_flow_cache;      /* key: (ffid) */
-/* The ffid cache maps a (dest_id, chunk coordinate) tuple to a flow field ID,
- * which could be used to retreive the relevant field from the flow cache. 
- * The reason for this is that the same flow field chunk can be shared between
- * many different paths. */
-static lru(ffid)         s_ffid_cache;      /* key: (dest_id, chunk_coord) */
-static lru(grid_path)    s_grid_path_cache; /* key: (chunk coord, tile start coord, tile dest coord) */
-
-/* The following structures are maintained for efficient invalidation of entries:*/
-static khash_t(idvec)   *s_chunk_ffield_map; /* key: (chunk coord) */
-static khash_t(idvec)   *s_chunk_lfield_map; /* key: (chunk coord) */
-
-static struct priv_fc_stats{
+struct priv_fc_stats{
     unsigned los_query;
     unsigned los_hit;
     unsigned los_invalidated;
@@ -93,7 +99,40 @@ static struct priv_fc_stats{
     unsigned ffid_hit;
     unsigned grid_path_query;
     unsigned grid_path_hit;
-}s_perfstats = {0};
+};
+
+/* Every key is owned by exactly one shard, selected by hashing the key. Each 
+ * shard is an independent set of LRU caches (each with a proportional slice
+ * of the total capacity) behind its' own lock, so that lookups and insertions 
+ * from different threads will rarely contend. */
+
+struct fc_shard{
+    SDL_SpinLock          lock;
+    lru(los)              los_cache;       /* key: (dest_id, chunk coord) */
+    lru(flow)             flow_cache;      /* key: (ffid) */
+    /* The ffid cache maps a (dest_id, chunk coordinate) tuple to a flow field ID,
+     * which could be used to retreive the relevant field from the flow cache. 
+     * The reason for this is that the same flow field chunk can be shared between
+     * many different paths. */
+    lru(ffid)             ffid_cache;      /* key: (dest_id, chunk_coord) */
+    lru(grid_path)        grid_path_cache; /* key: (chunk coord, tile start coord, tile dest coord) */
+    struct priv_fc_stats  perfstats;
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static struct fc_shard   s_shards[CONFIG_FC_SHARDS];
+static bool              s_inited = false;
+/* The flow field cache is sized by its' memory footprint rather than the 
+ * number of entries. */
+static size_t            s_flow_budget = CONFIG_FLOW_CACHE_MB * 1024 * 1024;
+
+/* The following structures are maintained for efficient invalidation of entries:*/
+static SDL_SpinLock      s_map_lock;
+static khash_t(idvec)   *s_chunk_ffield_map; /* key: (chunk coord) */
+static khash_t(idvec)   *s_chunk_lfield_map; /* key: (chunk coord) */
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -133,11 +172,143 @@ uint64_t grid_path_key(struct coord local_start, struct coord local_dest,
          |  (( ((uint64_t)chunk.c)       & 0xffff) << 48));
 }
 
+static struct fc_shard *shard_for_key(uint64_t key)
+{
+    /* Fibonacci hashing - the keys are densely packed bitfields, so the 
+     * higher bits of the product are much better distributed than the key */
+    uint64_t hash = key * 0x9e3779b97f4a7c15ull;
+    return &s_shards[(hash >> 32) % CONFIG_FC_SHARDS];
+}
+
+static void los_ref_release(struct fc_los *ref)
+{
+    if(SDL_AtomicDecRef(&ref->refcount))
+        free(ref);
+}
+
+static void flow_ref_release(struct fc_flow *ref)
+{
+    if(SDL_AtomicDecRef(&ref->refcount))
+        free(ref);
+}
+
+static void on_los_evict(los_ref_t *victim)
+{
+    los_ref_release(*victim);
+}
+
+static void on_flow_evict(flow_ref_t *victim)
+{
+    flow_ref_release(*victim);
+}
+
 static void on_grid_path_evict(struct grid_path_desc *victim)
 {
     vec_coord_destroy(&victim->path);
 }
 
+static size_t flow_shard_capacity(size_t budget)
+{
+    /* Each entry is a separately allocated block, referenced from a node in 
+     * the cache's pool. The nodes are indexed by 16-bit references. */
+    size_t entry_sz = sizeof(struct fc_flow) + sizeof(lru_node(flow));
+    size_t ret = budget / entry_sz / CONFIG_FC_SHARDS;
+    return MAX(1, MIN(ret, UINT16_MAX - 1));
+}
+
+/* Move the entries of the shard's flow cache to a cache of a different capacity,
+ * preserving their order. When shrinking, the least recently used entries are 
+ * evicted. Must be called with the shard lock held. */
+static bool shard_flow_resize(struct fc_shard *shard, size_t capacity)
+{
+    lru(flow) *old = &shard->flow_cache;
+    lru(flow) new;
+
+    if(old->capacity == capacity)
+        return true;
+
+    if(!lru_flow_init(&new, capacity, on_flow_evict))
+        return false;
+
+    mp_ref_t curr = old->used ? old->ilru_tail : 0;
+    while(curr) {
+        lru_node(flow) *node = mp_flow_entry(&old->node_pool, curr);
+        lru_flow_put(&new, node->key, &node->entry);
+        curr = node->prev;
+    }
+
+    /* The references have been handed over to the new cache */
+    old->on_evict = NULL;
+    lru_flow_destroy(old);
+    *old = new;
+    return true;
+}
+
+static bool shard_init(struct fc_shard *shard)
+{
+    memset(shard, 0, sizeof(*shard));
+
+    if(!lru_los_init(&shard->los_cache, CONFIG_LOS_CACHE_SZ / CONFIG_FC_SHARDS, on_los_evict))
+        goto fail_los;
+
+    if(!lru_flow_init(&shard->flow_cache, flow_shard_capacity(s_flow_budget), on_flow_evict))
+        goto fail_flow;
+
+    if(!lru_ffid_init(&shard->ffid_cache, CONFIG_MAPPING_CACHE_SZ / CONFIG_FC_SHARDS, NULL))
+        goto fail_ffid;
+
+    if(!lru_grid_path_init(&shard->grid_path_cache, CONFIG_GRID_PATH_CACHE_SZ / CONFIG_FC_SHARDS, 
+        on_grid_path_evict))
+        goto fail_grid_path;
+
+    return true;
+
+fail_grid_path:
+    lru_ffid_destroy(&shard->ffid_cache);
+fail_ffid:
+    lru_flow_destroy(&shard->flow_cache);
+fail_flow:
+    lru_los_destroy(&shard->los_cache);
+fail_los:
+    return false;
+}
+
+static void shard_destroy(struct fc_shard *shard)
+{
+    lru_los_destroy(&shard->los_cache);
+    lru_flow_destroy(&shard->flow_cache);
+    lru_ffid_destroy(&shard->ffid_cache);
+    lru_grid_path_destroy(&shard->grid_path_cache);
+}
+
+/* The following must be called with the shard lock held */
+
+static bool shard_los_remove(struct fc_shard *shard, uint64_t key)
+{
+    const los_ref_t *ref = lru_los_at(&shard->los_cache, key);
+    if(!ref)
+        return false;
+
+    los_ref_t victim = *ref;
+    lru_los_remove(&shard->los_cache, key);
+    los_ref_release(victim);
+    shard->perfstats.los_invalidated++;
+    return true;
+}
+
+static bool shard_flow_remove(struct fc_shard *shard, uint64_t key)
+{
+    const flow_ref_t *ref = lru_flow_at(&shard->flow_cache, key);
+    if(!ref)
+        return false;
+
+    flow_ref_t victim = *ref;
+    lru_flow_remove(&shard->flow_cache, key);
+    flow_ref_release(victim);
+    shard->perfstats.flow_invalidated++;
+    return true;
+}
+
 static void destroy_all_entries(khash_t(idvec) *hash)
 {
     uint32_t key;
@@ -151,6 +322,8 @@ static void destroy_all_entries(khash_t(idvec) *hash)
 
 static void field_map_add(khash_t(idvec) *hash, uint64_t key, uint64_t id)
 {
+    SDL_AtomicLock(&s_map_lock);
+
     khiter_t k = kh_get(idvec, hash, key);
     if(k != kh_end(hash)) {
 
@@ -167,6 +340,23 @@ static void field_map_add(khash_t(idvec) *hash, uint64_t key, uint64_t id)
         k = kh_get(idvec, hash, key);
         kh_val(hash, k) = newvec;
     }
+
+    SDL_AtomicUnlock(&s_map_lock);
+}
+
+static bool field_map_take(khash_t(idvec) *hash, uint64_t key, vec_id_t *out)
+{
+    SDL_AtomicLock(&s_map_lock);
+
+    khiter_t k = kh_get(idvec, hash, key);
+    bool ret = (k != kh_end(hash));
+    if(ret) {
+        *out = kh_val(hash, k);
+        kh_del(idvec, hash, k);
+    }
+
+    SDL_AtomicUnlock(&s_map_lock);
+    return ret;
 }
 
 static bool dest_array_contains(dest_id_t *array, size_t size, dest_id_t item)
@@ -184,17 +374,11 @@ static bool dest_array_contains(dest_id_t *array, size_t size, dest_id_t item)
 
 bool N_FC_Init(void)
 {
-    if(!lru_los_init(&s_los_cache, CONFIG_LOS_CACHE_SZ, NULL))
-        goto fail_los;
-
-    if(!lru_flow_init(&s_flow_cache, CONFIG_FLOW_CAHCE_SZ, NULL))
-        goto fail_flow;
-
-    if(!lru_ffid_init(&s_ffid_cache, CONFIG_MAPPING_CACHE_SZ, NULL))
-        goto fail_ffid;
-
-    if(!lru_grid_path_init(&s_grid_path_cache, CONFIG_GRID_PATH_CACHE_SZ, on_grid_path_evict))
-        goto fail_grid_path;
+    int nshards = 0;
+    for(; nshards < CONFIG_FC_SHARDS; nshards++) {
+        if(!shard_init(&s_shards[nshards]))
+            goto fail_shards;
+    }
 
     if(NULL == (s_chunk_ffield_map = kh_init(idvec)))
         goto fail_chunk_ffield;
@@ -202,28 +386,23 @@ bool N_FC_Init(void)
     if(NULL == (s_chunk_lfield_map = kh_init(idvec)))
         goto fail_chunk_lfield;
 
+    s_inited = true;
     return true;
 
 fail_chunk_lfield:
     kh_destroy(idvec, s_chunk_ffield_map);
 fail_chunk_ffield:
-    lru_grid_path_destroy(&s_grid_path_cache);
-fail_grid_path:
-    lru_ffid_destroy(&s_ffid_cache);
-fail_ffid:
-    lru_flow_destroy(&s_flow_cache);
-fail_flow:
-    lru_los_destroy(&s_los_cache);
-fail_los:
+fail_shards:
+    for(int i = 0; i < nshards; i++)
+        shard_destroy(&s_shards[i]);
     return false;
 }
 
 void N_FC_Shutdown(void)
 {
-    lru_los_destroy(&s_los_cache);
-    lru_flow_destroy(&s_flow_cache);
-    lru_ffid_destroy(&s_ffid_cache);
-    lru_grid_path_destroy(&s_grid_path_cache);
+    s_inited = false;
+    for(int i = 0; i < CONFIG_FC_SHARDS; i++)
+        shard_destroy(&s_shards[i]);
 
     destroy_all_entries(s_chunk_ffield_map);
     kh_destroy(idvec, s_chunk_ffield_map);
@@ -232,90 +411,254 @@ void N_FC_Shutdown(void)
     kh_destroy(idvec, s_chunk_lfield_map);
 }
 
+bool N_FC_SetFlowCacheBudget(size_t bytes)
+{
+    s_flow_budget = bytes;
+    if(!s_inited)
+        return true;
+
+    bool ret = true;
+    size_t capacity = flow_shard_capacity(bytes);
+
+    for(int i = 0; i < CONFIG_FC_SHARDS; i++) {
+
+        struct fc_shard *shard = &s_shards[i];
+        SDL_AtomicLock(&shard->lock);
+        ret &= shard_flow_resize(shard, capacity);
+        SDL_AtomicUnlock(&shard->lock);
+    }
+    return ret;
+}
+
 void N_FC_ClearAll(void)
 {
-    lru_los_clear(&s_los_cache);
-    lru_flow_clear(&s_flow_cache);
-    lru_ffid_clear(&s_ffid_cache);
-    lru_grid_path_clear(&s_grid_path_cache);
+    for(int i = 0; i < CONFIG_FC_SHARDS; i++) {
+
+        struct fc_shard *shard = &s_shards[i];
+        SDL_AtomicLock(&shard->lock);
+
+        lru_los_clear(&shard->los_cache);
+        lru_flow_clear(&shard->flow_cache);
+        lru_ffid_clear(&shard->ffid_cache);
+        lru_grid_path_clear(&shard->grid_path_cache);
+
+        SDL_AtomicUnlock(&shard->lock);
+    }
+
+    SDL_AtomicLock(&s_map_lock);
 
     destroy_all_entries(s_chunk_ffield_map);
     kh_clear(idvec, s_chunk_ffield_map);
 
     destroy_all_entries(s_chunk_lfield_map);
     kh_clear(idvec, s_chunk_lfield_map);
+
+    SDL_AtomicUnlock(&s_map_lock);
 }
 
 void N_FC_ClearStats(void)
 {
-    memset(&s_perfstats, 0, sizeof(s_perfstats));
+    for(int i = 0; i < CONFIG_FC_SHARDS; i++) {
+
+        struct fc_shard *shard = &s_shards[i];
+        SDL_AtomicLock(&shard->lock);
+        memset(&shard->perfstats, 0, sizeof(shard->perfstats));
+        SDL_AtomicUnlock(&shard->lock);
+    }
 }
 
 void N_FC_GetStats(struct fc_stats *out_stats)
 {
-    out_stats->los_used = s_los_cache.used;
-    out_stats->los_max = s_los_cache.capacity;
-    out_stats->los_hit_rate = !s_perfstats.los_query ? 0
-        : ((float)s_perfstats.los_hit) / s_perfstats.los_query;
-    out_stats->los_invalidated = s_perfstats.los_invalidated;
+    struct fc_shard_stats total = {0};
+    unsigned los_max = 0, flow_max = 0, ffid_max = 0, grid_path_max = 0;
+
+    for(int i = 0; i < CONFIG_FC_SHARDS; i++) {
+
+        struct fc_shard_stats curr;
+        N_FC_GetShardStats(i, &curr);
+
+        total.los_used          += curr.los_used;
+        total.los_query         += curr.los_query;
+        total.los_hit           += curr.los_hit;
+        total.los_invalidated   += curr.los_invalidated;
+        total.flow_used         += curr.flow_used;
+        total.flow_query        += curr.flow_query;
+        total.flow_hit          += curr.flow_hit;
+        total.flow_invalidated  += curr.flow_invalidated;
+        total.ffid_used         += curr.ffid_used;
+        total.ffid_query        += curr.ffid_query;
+        total.ffid_hit          += curr.ffid_hit;
+        total.grid_path_used    += curr.grid_path_used;
+        total.grid_path_query   += curr.grid_path_query;
+        total.grid_path_hit     += curr.grid_path_hit;
+
+        los_max       += s_shards[i].los_cache.capacity;
+        flow_max      += s_shards[i].flow_cache.capacity;
+        ffid_max      += s_shards[i].ffid_cache.capacity;
+        grid_path_max += s_shards[i].grid_path_cache.capacity;
+    }
+
+    out_stats->los_used = total.los_used;
+    out_stats->los_max = los_max;
+    out_stats->los_hit_rate = !total.los_query ? 0
+        : ((float)total.los_hit) / total.los_query;
+    out_stats->los_invalidated = total.los_invalidated;
+
+    out_stats->flow_used = total.flow_used;
+    out_stats->flow_max = flow_max;
+    out_stats->flow_hit_rate = !total.flow_query ? 0
+        : ((float)total.flow_hit) / total.flow_query;
+    out_stats->flow_invalidated = total.flow_invalidated;
+
+    out_stats->ffid_used = total.ffid_used;
+    out_stats->ffid_max = ffid_max;
+    out_stats->ffid_hit_rate = !total.ffid_query ? 0
+        : ((float)total.ffid_hit) / total.ffid_query;
+
+    out_stats->grid_path_used = total.grid_path_used;
+    out_stats->grid_path_max = grid_path_max;
+    out_stats->grid_path_hit_rate = !total.grid_path_query ? 0
+        : ((float)total.grid_path_hit) / total.grid_path_query;
+}
+
+int N_FC_NumShards(void)
+{
+    return CONFIG_FC_SHARDS;
+}
 
-    out_stats->flow_used = s_flow_cache.used;
-    out_stats->flow_max = s_flow_cache.capacity;
-    out_stats->flow_hit_rate = !s_perfstats.flow_query ? 0
-        : ((float)s_perfstats.flow_hit) / s_perfstats.flow_query;
-    out_stats->flow_invalidated = s_perfstats.flow_invalidated;
+void N_FC_GetShardStats(int idx, struct fc_shard_stats *out_stats)
+{
+    assert(idx >= 0 && idx < CONFIG_FC_SHARDS);
+    struct fc_shard *shard = &s_shards[idx];
 
-    out_stats->ffid_used = s_ffid_cache.used;
-    out_stats->ffid_max = s_ffid_cache.capacity;
-    out_stats->ffid_hit_rate = !s_perfstats.ffid_hit ? 0
-        : ((float)s_perfstats.ffid_hit) / s_perfstats.ffid_query;
+    SDL_AtomicLock(&shard->lock);
 
-    out_stats->grid_path_used = s_grid_path_cache.used;
-    out_stats->grid_path_max = s_grid_path_cache.capacity;
-    out_stats->grid_path_hit_rate = !s_perfstats.grid_path_hit ? 0
-        : ((float)s_perfstats.grid_path_hit) / s_perfstats.grid_path_query;
+    out_stats->los_used = shard->los_cache.used;
+    out_stats->los_query = shard->perfstats.los_query;
+    out_stats->los_hit = shard->perfstats.los_hit;
+    out_stats->los_invalidated = shard->perfstats.los_invalidated;
+
+    out_stats->flow_used = shard->flow_cache.used;
+    out_stats->flow_query = shard->perfstats.flow_query;
+    out_stats->flow_hit = shard->perfstats.flow_hit;
+    out_stats->flow_invalidated = shard->perfstats.flow_invalidated;
+
+    out_stats->ffid_used = shard->ffid_cache.used;
+    out_stats->ffid_query = shard->perfstats.ffid_query;
+    out_stats->ffid_hit = shard->perfstats.ffid_hit;
+
+    out_stats->grid_path_used = shard->grid_path_cache.used;
+    out_stats->grid_path_query = shard->perfstats.grid_path_query;
+    out_stats->grid_path_hit = shard->perfstats.grid_path_hit;
+
+    SDL_AtomicUnlock(&shard->lock);
 }
 
 bool N_FC_ContainsLOSField(dest_id_t id, struct coord chunk_coord)
 {
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    bool ret = lru_los_contains(&s_los_cache, key);
+    struct fc_shard *shard = shard_for_key(key);
+
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_los_contains(&shard->los_cache, key);
+    shard->perfstats.los_query++;
+    shard->perfstats.los_hit += !!ret;
+    SDL_AtomicUnlock(&shard->lock);
 
-    s_perfstats.los_query++;
-    s_perfstats.los_hit += !!ret;
     return ret;
 }
 
-const struct LOS_field *N_FC_LOSFieldAt(dest_id_t id, struct coord chunk_coord)
+const struct LOS_field *N_FC_LOSFieldAcquire(dest_id_t id, struct coord chunk_coord)
 {
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    return lru_los_at(&s_los_cache, key);
+    struct fc_shard *shard = shard_for_key(key);
+    struct fc_los *ret = NULL;
+
+    SDL_AtomicLock(&shard->lock);
+    const los_ref_t *ref = lru_los_at(&shard->los_cache, key);
+    if(ref) {
+        ret = *ref;
+        SDL_AtomicIncRef(&ret->refcount);
+    }
+    SDL_AtomicUnlock(&shard->lock);
+
+    return ret ? &ret->lf : NULL;
+}
+
+void N_FC_LOSFieldRelease(const struct LOS_field *lf)
+{
+    if(!lf)
+        return;
+    los_ref_release((struct fc_los*)((char*)lf - offsetof(struct fc_los, lf)));
 }
 
 void N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_field *lf)
 {
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    lru_los_put(&s_los_cache, key, lf);
+    struct fc_shard *shard = shard_for_key(key);
+
+    los_ref_t ref = malloc(sizeof(struct fc_los));
+    if(!ref)
+        return;
+    SDL_AtomicSet(&ref->refcount, 1);
+    ref->lf = *lf;
+
+    SDL_AtomicLock(&shard->lock);
+    lru_los_put(&shard->los_cache, key, &ref);
+    SDL_AtomicUnlock(&shard->lock);
+
     field_map_add(s_chunk_lfield_map, key_for_chunk(chunk_coord), key);
 }
 
 bool N_FC_ContainsFlowField(ff_id_t ffid)
 {
-    bool ret = lru_flow_contains(&s_flow_cache, ffid);
+    struct fc_shard *shard = shard_for_key(ffid);
+
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_flow_contains(&shard->flow_cache, ffid);
+    shard->perfstats.flow_query++;
+    shard->perfstats.flow_hit += !!ret;
+    SDL_AtomicUnlock(&shard->lock);
 
-    s_perfstats.flow_query++;
-    s_perfstats.flow_hit += !!ret;
     return ret;
 }
 
-const struct flow_field *N_FC_FlowFieldAt(ff_id_t ffid)
+const struct flow_field *N_FC_FlowFieldAcquire(ff_id_t ffid)
+{
+    struct fc_shard *shard = shard_for_key(ffid);
+    struct fc_flow *ret = NULL;
+
+    SDL_AtomicLock(&shard->lock);
+    const flow_ref_t *ref = lru_flow_at(&shard->flow_cache, ffid);
+    if(ref) {
+        ret = *ref;
+        SDL_AtomicIncRef(&ret->refcount);
+    }
+    SDL_AtomicUnlock(&shard->lock);
+
+    return ret ? &ret->ff : NULL;
+}
+
+void N_FC_FlowFieldRelease(const struct flow_field *ff)
 {
-    return lru_flow_at(&s_flow_cache, ffid);
+    if(!ff)
+        return;
+    flow_ref_release((struct fc_flow*)((char*)ff - offsetof(struct fc_flow, ff)));
 }
 
 void N_FC_PutFlowField(ff_id_t ffid, const struct flow_field *ff)
 {
-    lru_flow_put(&s_flow_cache, ffid, ff);
+    struct fc_shard *shard = shard_for_key(ffid);
+
+    flow_ref_t ref = malloc(sizeof(struct fc_flow));
+    if(!ref)
+        return;
+    SDL_AtomicSet(&ref->refcount, 1);
+    ref->ff = *ff;
+
+    SDL_AtomicLock(&shard->lock);
+    lru_flow_put(&shard->flow_cache, ffid, &ref);
+    SDL_AtomicUnlock(&shard->lock);
 
     struct coord chunk = (struct coord){(ffid >> 8) & 0xff, ffid & 0xff};
     field_map_add(s_chunk_ffield_map, key_for_chunk(chunk), ffid);
@@ -324,27 +667,47 @@ void N_FC_PutFlowField(ff_id_t ffid, const struct flow_field *ff)
 bool N_FC_GetDestFFMapping(dest_id_t id, struct coord chunk_coord, ff_id_t *out_ff)
 {
     uint64_t key = key_for_dest_and_chunk(id, chunk_coord);
-    bool ret = lru_ffid_get(&s_ffid_cache, key, out_ff);
+    struct fc_shard *shard = shard_for_key(key);
+
+    SDL_AtomicLock(&shard->lock);
+    bool ret = lru_ffid_get(&shard->ffid_cache, key, out_ff);
+    shard->perfstats.ffid_query++;
+    shard->perfstats.ffid_hit += !!ret;
+    SDL_AtomicUnlock(&shard->lock);
 
-    s_perfstats.ffid_query++;
-    s_perfstats.ffid_hit += !!ret;
     return ret;
 }
 
 void N_FC_PutDestFFMapping(dest_id_t dest_id, struct coord chunk_coord, ff_id_t ffid)
 {
     uint64_t key = key_for_dest_and_chunk(dest_id, chunk_coord);
-    lru_ffid_put(&s_ffid_cache, key, &ffid);
+    struct fc_shard *shard = shard_for_key(key);
+
+    SDL_AtomicLock(&shard->lock);
+    lru_ffid_put(&shard->ffid_cache, key, &ffid);
+    SDL_AtomicUnlock(&shard->lock);
 }
 
 bool N_FC_GetGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, struct grid_path_desc *out)
 {
     uint64_t key = grid_path_key(local_start, local_dest, chunk);
-    bool ret = lru_grid_path_get(&s_grid_path_cache, key, out);
+    struct fc_shard *shard = shard_for_key(key);
 
-    s_perfstats.grid_path_query++;
-    s_perfstats.grid_path_hit += !!ret;
+    SDL_AtomicLock(&shard->lock);
+
+    const struct grid_path_desc *gp = lru_grid_path_at(&shard->grid_path_cache, key);
+    bool ret = (gp != NULL);
+    if(ret) {
+        /* The cached path may be freed as soon as the lock is released */
+        out->exists = gp->exists;
+        out->cost = gp->cost;
+        vec_coord_copy(&out->path, (vec_coord_t*)&gp->path);
+    }
+    shard->perfstats.grid_path_query++;
+    shard->perfstats.grid_path_hit += !!ret;
+
+    SDL_AtomicUnlock(&shard->lock);
     return ret;
 }
 
@@ -352,7 +715,11 @@ void N_FC_PutGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, const struct grid_path_desc *in)
 {
     uint64_t key = grid_path_key(local_start, local_dest, chunk);
-    lru_grid_path_put(&s_grid_path_cache, key, in);
+    struct fc_shard *shard = shard_for_key(key);
+
+    SDL_AtomicLock(&shard->lock);
+    lru_grid_path_put(&shard->grid_path_cache, key, in);
+    SDL_AtomicUnlock(&shard->lock);
 }
 
 void N_FC_InvalidateAllAtChunk(struct coord chunk)
@@ -364,35 +731,36 @@ void N_FC_InvalidateAllAtChunk(struct coord chunk)
      * necessarily be in the caches. */
 
     uint64_t key = key_for_chunk(chunk);
+    vec_id_t keys;
+
+    if(field_map_take(s_chunk_lfield_map, key, &keys)) {
 
-    khiter_t k = kh_get(idvec, s_chunk_lfield_map, key);
-    if(k != kh_end(s_chunk_lfield_map)) {
+        for(int i = 0; i < vec_size(&keys); i++) {
 
-        vec_id_t *keys = &kh_val(s_chunk_lfield_map, k);
-        for(int i = 0; i < vec_size(keys); i++) {
-            bool found = lru_los_remove(&s_los_cache, vec_AT(keys, i));
-            s_perfstats.los_invalidated += !!found;
+            struct fc_shard *shard = shard_for_key(vec_AT(&keys, i));
+            SDL_AtomicLock(&shard->lock);
+            shard_los_remove(shard, vec_AT(&keys, i));
+            SDL_AtomicUnlock(&shard->lock);
         }
-        vec_id_destroy(keys);
-        kh_del(idvec, s_chunk_lfield_map, k);
+        vec_id_destroy(&keys);
     }
 
-    k = kh_get(idvec, s_chunk_ffield_map, key);
-    if(k != kh_end(s_chunk_ffield_map)) {
+    if(field_map_take(s_chunk_ffield_map, key, &keys)) {
+
+        for(int i = 0; i < vec_size(&keys); i++) {
 
-        vec_id_t *keys = &kh_val(s_chunk_ffield_map, k);
-        for(int i = 0; i < vec_size(keys); i++) {
-            bool found = lru_flow_remove(&s_flow_cache, vec_AT(keys, i));
-            s_perfstats.flow_invalidated += !!found;
+            struct fc_shard *shard = shard_for_key(vec_AT(&keys, i));
+            SDL_AtomicLock(&shard->lock);
+            shard_flow_remove(shard, vec_AT(&keys, i));
+            SDL_AtomicUnlock(&shard->lock);
         }
-        vec_id_destroy(keys);
-        kh_del(idvec, s_chunk_ffield_map, k);
+        vec_id_destroy(&keys);
     }
 }
 
 void N_FC_InvalidateAllThroughChunk(struct coord chunk)
 {
-    dest_id_t paths[CONFIG_FLOW_CAHCE_SZ];
+    dest_id_t paths[CONFIG_MAPPING_CACHE_SZ];
     size_t npaths = 0;
 
     uint64_t key;
@@ -400,46 +768,79 @@ void N_FC_InvalidateAllThroughChunk(struct coord chunk)
 
     /* Make sure not to actually query the caches, in order to not mess up the age history */
     /* First find all the paths going through the chunk. */
-    LRU_FOREACH_SAFE_REMOVE(ffid, &s_ffid_cache, key, ffid_val, {
+    for(int i = 0; i < CONFIG_FC_SHARDS; i++) {
 
-        (void)ffid_val;
-        dest_id_t curr_dest = key_dest(key);
-        struct coord curr_chunk = key_chunk(key);
+        struct fc_shard *shard = &s_shards[i];
+        SDL_AtomicLock(&shard->lock);
 
-        if(0 == memcmp(&curr_chunk, &chunk, sizeof(chunk))
-        && !dest_array_contains(paths, npaths, curr_dest)) {
+        LRU_FOREACH_SAFE_REMOVE(ffid, &shard->ffid_cache, key, ffid_val, {
 
-            paths[npaths++] = curr_dest;
-        }
-    });
+            (void)ffid_val;
+            dest_id_t curr_dest = key_dest(key);
+            struct coord curr_chunk = key_chunk(key);
+
+            if(0 == memcmp(&curr_chunk, &chunk, sizeof(chunk))
+            && !dest_array_contains(paths, npaths, curr_dest)) {
+
+                paths[npaths++] = curr_dest;
+            }
+        });
+
+        SDL_AtomicUnlock(&shard->lock);
+    }
 
     /* Now that we know all the paths, find and remove all the flow 
-     * fields belonging to them */
-    struct flow_field ff_val;
-    LRU_FOREACH_SAFE_REMOVE(flow, &s_flow_cache, key, ff_val, {
-    
-        (void)ff_val;
-        dest_id_t curr_dest = key_dest(key);
-
-        if(dest_array_contains(paths, npaths, curr_dest)) {
+     * and LOS fields belonging to them */
+    for(int i = 0; i < CONFIG_FC_SHARDS; i++) {
+
+        struct fc_shard *shard = &s_shards[i];
+        SDL_AtomicLock(&shard->lock);
+
+        flow_ref_t ff_val;
+        LRU_FOREACH_SAFE_REMOVE(flow, &shard->flow_cache, key, ff_val, {
         
-            bool found = lru_flow_remove(&s_flow_cache, key);
-            s_perfstats.flow_invalidated += !!found;
-        }
-    });
+            (void)ff_val;
+            dest_id_t curr_dest = key_dest(key);
 
-    /* And remove all the LOS fields as well */
-    struct LOS_field los_val;
-    LRU_FOREACH_SAFE_REMOVE(los, &s_los_cache, key, los_val, {
+            if(dest_array_contains(paths, npaths, curr_dest))
+                shard_flow_remove(shard, key);
+        });
 
-        (void)los_val;
-        dest_id_t curr_dest = key_dest(key);
+        los_ref_t los_val;
+        LRU_FOREACH_SAFE_REMOVE(los, &shard->los_cache, key, los_val, {
 
-        if(dest_array_contains(paths, npaths, curr_dest)) {
-        
-            bool found = lru_los_remove(&s_los_cache, key);
-            s_perfstats.los_invalidated += !!found;
-        }
-    });
+            (void)los_val;
+            dest_id_t curr_dest = key_dest(key);
+
+            if(dest_array_contains(paths, npaths, curr_dest))
+                shard_los_remove(shard, key);
+        });
+
+        SDL_AtomicUnlock(&shard->lock);
+    }
+}
+
+void N_FC_InvalidateGridPathsAtChunk(struct coord chunk)
+{
+    uint64_t key;
+    struct grid_path_desc gp_val;
+
+    for(int i = 0; i < CONFIG_FC_SHARDS; i++) {
+
+        struct fc_shard *shard = &s_shards[i];
+        SDL_AtomicLock(&shard->lock);
+
+        LRU_FOREACH_SAFE_REMOVE(grid_path, &shard->grid_path_cache, key, gp_val, {
+
+            if(((key >> 32) & 0xffff) != chunk.r
+            || ((key >> 48) & 0xffff) != chunk.c)
+                continue;
+
+            lru_grid_path_remove(&shard->grid_path_cache, key);
+            on_grid_path_evict(&gp_val);
+        });
+
+        SDL_AtomicUnlock(&shard->lock);
+    }
 }
 
@@ -51,6 +51,12 @@
 bool N_FC_Init(void);
 void N_FC_Shutdown(void);
 
+/* Set the amount of memory that the cached flow fields may take up. May be 
+ * called before 'N_FC_Init'. Resizing the cache keeps the most recently used
+ * fields which fit in the new budget.
+ */
+bool N_FC_SetFlowCacheBudget(size_t bytes);
+
 /* Invalidate all LOS and Flow fields for a particular chunk 
  */
 void N_FC_InvalidateAllAtChunk(struct coord chunk);
@@ -60,13 +66,20 @@ void N_FC_InvalidateAllAtChunk(struct coord chunk);
  */
 void N_FC_InvalidateAllThroughChunk(struct coord chunk);
 
+/* Invalidate all the cached grid paths within a particular chunk 
+ */
+void N_FC_InvalidateGridPathsAtChunk(struct coord chunk);
+
 /*###########################################################################*/
 /* LOS FIELD CACHING                                                         */
 /*###########################################################################*/
 
-/* Returned pointer should not be cached, as it may become invalid after eviction. 
+/* Returns a reference to the cached field, or NULL if there is none. The field
+ * remains valid (even if it gets evicted) until it is released. Safe to call 
+ * from any thread.
  */
-const struct LOS_field  *N_FC_LOSFieldAt(dest_id_t id, struct coord chunk_coord);
+const struct LOS_field  *N_FC_LOSFieldAcquire(dest_id_t id, struct coord chunk_coord);
+void                     N_FC_LOSFieldRelease(const struct LOS_field *lf);
 
 bool N_FC_ContainsLOSField(dest_id_t id, struct coord chunk_coord);
 void N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_field *lf);
@@ -76,9 +89,12 @@ void N_FC_PutLOSField(dest_id_t id, struct coord chunk_coord, const struct LOS_f
 /* FLOW FIELD CACHING                                                        */
 /*###########################################################################*/
 
-/* Returned pointer should not be cached, as it may become invalid after eviction. 
+/* Returns a reference to the cached field, or NULL if there is none. The field
+ * remains valid (even if it gets evicted) until it is released. Safe to call 
+ * from any thread.
  */
-const struct flow_field *N_FC_FlowFieldAt(ff_id_t ffid);
+const struct flow_field *N_FC_FlowFieldAcquire(ff_id_t ffid);
+void                     N_FC_FlowFieldRelease(const struct flow_field *ff);
 
 bool N_FC_ContainsFlowField(ff_id_t ffid);
 void N_FC_PutFlowField(ff_id_t ffid, const struct flow_field *ff);
@@ -97,6 +113,8 @@ struct grid_path_desc{
     float cost;
 };
 
+/* The cached path is copied into 'out->path', which must be initialized. 
+ */
 bool N_FC_GetGridPath(struct coord local_start, struct coord local_dest,
                       struct coord chunk, struct grid_path_desc *out);
 void N_FC_PutGridPath(struct coord local_start, struct coord local_dest,
@@ -38,6 +38,7 @@
 #include "a_star.h"
 #include "field.h"
 #include "fieldcache.h"
+#include "sweep.h"
 #include "../map/public/tile.h"
 #include "../game/public/game.h"
 #include "../render/public/render.h"
@@ -48,7 +49,11 @@
 #include "../event.h"
 #include "../main.h"
 #include "../perf.h"
+#include "../sched.h"
+#include "../settings.h"
+#include "../config.h"
 #include "../lib/public/queue.h"
+#include "../lib/public/vec.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -66,6 +71,11 @@
 #define CLAMP(a, min, max)       (MIN(MAX((a), (min)), (max)))
 
 #define EPSILON                  (1.0f / 1024)
+#define MAX_BAKE_TASKS           (64)
+#define MAX_FLOW_CACHE_MB        (512)
+
+#define FNV_OFFSET_BASIS         (0xcbf29ce484222325ull)
+#define FNV_PRIME                (0x100000001b3ull)
 
 #define FOREACH_PORTAL(_priv, _local, ...)                                                      \
     do{                                                                                         \
@@ -92,6 +102,13 @@ struct cost_coord{
 QUEUE_TYPE(cc, struct cost_coord)
 QUEUE_IMPL(static, cc, struct cost_coord)
 
+/* A portal through which a chunk is entered, and the chunk's distance from 
+ * the enemies along that way */
+struct threat_node{
+    const struct portal *port;
+    uint16_t             dist;
+};
+
 enum edge_type{
     EDGE_BOT   = (1 << 0),
     EDGE_LEFT  = (1 << 1),
@@ -102,12 +119,100 @@ enum edge_type{
 KHASH_SET_INIT_INT(coord)
 KHASH_SET_INIT_INT64(td)
 
+struct chunk_snapshot{
+    struct coord      coord;
+    struct nav_chunk *chunk;
+};
+
+struct field_job{
+    struct coord            chunk;
+    const struct nav_chunk *snapshot;
+    struct field_target     target;
+    ff_id_t                 id;
+    /* The point that entities in this chunk will head towards 
+     * until the field is ready */
+    vec2_t                  steer_xz;
+    struct flow_field       ff;
+    uint32_t                tid;
+    struct future           future;
+};
+
+struct los_job{
+    struct coord            chunk;
+    const struct nav_chunk *snapshot;
+    /* The index of the job building the field for the previous 
+     * chunk along the path, or -1 */
+    int                     prev_idx;
+    /* Set when the field for the previous chunk is taken from the 
+     * cache instead */
+    bool                    has_prev;
+    struct LOS_field        prev;
+    struct LOS_field        lf;
+};
+
+VEC_TYPE(snap, struct chunk_snapshot)
+VEC_IMPL(static inline, snap, struct chunk_snapshot)
+
+VEC_TYPE(fjob, struct field_job*)
+VEC_IMPL(static inline, fjob, struct field_job*)
+
+VEC_TYPE(ljob, struct los_job*)
+VEC_IMPL(static inline, ljob, struct los_job*)
+
+/* The fields of an asynchronous path request are built by tasks from 
+ * snapshots of the navigation data, and are published to the field 
+ * cache in a single step on a later update. */
+struct path_request{
+    dest_id_t             dest_id;
+    struct tile_desc      dst_desc;
+    struct map_resolution res;
+    vec3_t                map_pos;
+    unsigned long         submitted;
+    /* Set when the navigation data of one of the snapshotted chunks 
+     * has changed, making the results out of date */
+    bool                  stale;
+    vec_snap_t            snapshots;
+    vec_fjob_t            jobs;
+    vec_ljob_t            los;
+    uint32_t              los_tid;
+    struct future         los_future;
+};
+
+VEC_TYPE(req, struct path_request*)
+VEC_IMPL(static inline, req, struct path_request*)
+
+/* The shared inputs of the map load-time baking of the navigation data */
+struct bake_ctx{
+    struct nav_private  *priv;
+    const struct tile  **chunk_tiles;
+    size_t               chunk_w;
+    size_t               chunk_h;
+    bool                 update;
+};
+
+typedef void (*bake_func_t)(const struct bake_ctx *ctx, struct coord chunk);
+
+/* A contiguous range of chunks [begin, end) processed by a single task */
+struct bake_job{
+    const struct bake_ctx *ctx;
+    bake_func_t            func;
+    size_t                 begin;
+    size_t                 end;
+    uint32_t               tid;
+    struct future          future;
+};
+
 /*****************************************************************************/
 /* STATIC VARIABLES                                                          */
 /*****************************************************************************/
 
 static khash_t(coord) *s_dirty_chunks;
 static bool            s_local_islands_dirty = false;
+/* The chunks whose cost fields have been modified since the last update */
+static khash_t(coord) *s_dirty_costs;
+/* The asynchronous path requests whose fields haven't been published yet */
+static vec_req_t       s_pending;
+static unsigned long   s_nupdates;
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -228,6 +333,24 @@ static void n_clear_cost_for_tile(struct nav_chunk *chunk,
     }}
 }
 
+static void n_apply_cutouts_for_tile(struct nav_chunk *chunk, 
+                                     size_t chunk_w, size_t chunk_h,
+                                     size_t tile_r,  size_t tile_c)
+{
+    assert(FIELD_RES_R / chunk_h == 2);
+    assert(FIELD_RES_C / chunk_w == 2);
+
+    size_t r_base = tile_r * 2;
+    size_t c_base = tile_c * 2;
+
+    for(int r = 0; r < 2; r++) {
+    for(int c = 0; c < 2; c++) {
+
+        if(chunk->cutouts[r_base + r][c_base + c])
+            chunk->cost_base[r_base + r][c_base + c] = COST_IMPASSABLE;
+    }}
+}
+
 static void n_set_cost_edge(struct nav_chunk *chunk,
                             size_t chunk_w, size_t chunk_h,
                             size_t tile_r,  size_t tile_c,
@@ -296,151 +419,197 @@ static bool n_cliff_edge(const struct tile *a, const struct tile *b)
     return (a->base_height != b->base_height);
 }
 
-static void n_make_cliff_edges(struct nav_private *priv, const struct tile **tiles,
-                               size_t chunk_w, size_t chunk_h)
+static void n_make_tile_cliff_edges(struct nav_private *priv, const struct tile **tiles,
+                                    size_t chunk_w, size_t chunk_h, struct tile_desc td)
 {
-    for(int r = 0; r < priv->height; r++) {
-    for(int c = 0; c < priv->width; c++) {
-            
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(r, priv->width, c)];
-
-        const struct tile *bot_tiles = (r < priv->height-1)  ? tiles[IDX(r+1, priv->width, c)] : NULL;
-        const struct tile *top_tiles = (r > 0)               ? tiles[IDX(r-1, priv->width, c)] : NULL;
-        const struct tile *right_tiles = (c < priv->width-1) ? tiles[IDX(r, priv->width, c+1)] : NULL;
-        const struct tile *left_tiles = (c > 0)              ? tiles[IDX(r, priv->width, c-1)] : NULL;
-
-        for(int chr = 0; chr < chunk_h; chr++) {
-        for(int chc = 0; chc < chunk_w; chc++) {
-
-            const struct tile *curr_tile = &tiles[IDX(r, priv->width, c)][IDX(chr, chunk_w, chc)];
-            const struct tile *bot_tile   = (chr < chunk_h-1) ? curr_tile + chunk_w 
-                                          : bot_tiles         ? &bot_tiles[IDX(0, chunk_w, chc)]
-                                          : NULL;
-            const struct tile *top_tile   = (chr > 0)         ? curr_tile - chunk_w
-                                          : top_tiles         ? &top_tiles[IDX(chunk_h-1, chunk_w, chc)]
-                                          : NULL;
-            const struct tile *left_tile  = (chc > 0)         ? curr_tile - 1 
-                                          : left_tiles        ? &left_tiles[IDX(chr, chunk_w, chunk_w-1)]
-                                          : NULL;
-            const struct tile *right_tile = (chc < chunk_w-1) ? curr_tile + 1 
-                                          : right_tiles       ? &right_tiles[IDX(chr, chunk_w, 0)]
-                                          : NULL;
-
-            if(n_cliff_edge(curr_tile, bot_tile))
-                n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_BOT);
-
-            if(n_cliff_edge(curr_tile, top_tile))
-                n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_TOP);
-
-            if(n_cliff_edge(curr_tile, left_tile))
-                n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_LEFT);
-
-            if(n_cliff_edge(curr_tile, right_tile))
-                n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_RIGHT);
-        }}
-    }}
+    const int r = td.chunk_r, c = td.chunk_c;
+    const int chr = td.tile_r, chc = td.tile_c;
+    struct nav_chunk *curr_chunk = &priv->chunks[IDX(r, priv->width, c)];
+
+    const struct tile *bot_tiles = (r < priv->height-1)  ? tiles[IDX(r+1, priv->width, c)] : NULL;
+    const struct tile *top_tiles = (r > 0)               ? tiles[IDX(r-1, priv->width, c)] : NULL;
+    const struct tile *right_tiles = (c < priv->width-1) ? tiles[IDX(r, priv->width, c+1)] : NULL;
+    const struct tile *left_tiles = (c > 0)              ? tiles[IDX(r, priv->width, c-1)] : NULL;
+
+    const struct tile *curr_tile = &tiles[IDX(r, priv->width, c)][IDX(chr, chunk_w, chc)];
+    const struct tile *bot_tile   = (chr < chunk_h-1) ? curr_tile + chunk_w 
+                                  : bot_tiles         ? &bot_tiles[IDX(0, chunk_w, chc)]
+                                  : NULL;
+    const struct tile *top_tile   = (chr > 0)         ? curr_tile - chunk_w
+                                  : top_tiles         ? &top_tiles[IDX(chunk_h-1, chunk_w, chc)]
+                                  : NULL;
+    const struct tile *left_tile  = (chc > 0)         ? curr_tile - 1 
+                                  : left_tiles        ? &left_tiles[IDX(chr, chunk_w, chunk_w-1)]
+                                  : NULL;
+    const struct tile *right_tile = (chc < chunk_w-1) ? curr_tile + 1 
+                                  : right_tiles       ? &right_tiles[IDX(chr, chunk_w, 0)]
+                                  : NULL;
+
+    if(n_cliff_edge(curr_tile, bot_tile))
+        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_BOT);
+
+    if(n_cliff_edge(curr_tile, top_tile))
+        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_TOP);
+
+    if(n_cliff_edge(curr_tile, left_tile))
+        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_LEFT);
+
+    if(n_cliff_edge(curr_tile, right_tile))
+        n_set_cost_edge(curr_chunk, chunk_w, chunk_h, chr, chc, EDGE_RIGHT);
+}
+
+/* The portals of every chunk are ordered by the edge that they're on, 
+ * and then by their position along the edge. */
+static const enum edge_type s_edge_order[] = {
+    EDGE_TOP, EDGE_LEFT, EDGE_BOT, EDGE_RIGHT
+};
+
+static struct nav_chunk *n_edge_neighbour(struct nav_private *priv, struct coord coord, 
+                                          enum edge_type edge, struct coord *out_coord)
+{
+    struct coord ret = coord;
+    switch(edge) {
+    case EDGE_TOP:   ret.r--; break;
+    case EDGE_BOT:   ret.r++; break;
+    case EDGE_LEFT:  ret.c--; break;
+    case EDGE_RIGHT: ret.c++; break;
+    default: assert(0);
+    }
+
+    if(ret.r < 0 || ret.r >= priv->height)
+        return NULL;
+    if(ret.c < 0 || ret.c >= priv->width)
+        return NULL;
+
+    if(out_coord)
+        *out_coord = ret;
+    return &priv->chunks[IDX(ret.r, priv->width, ret.c)];
+}
+
+static enum edge_type n_opposite_edge(enum edge_type edge)
+{
+    switch(edge) {
+    case EDGE_TOP:   return EDGE_BOT;
+    case EDGE_BOT:   return EDGE_TOP;
+    case EDGE_LEFT:  return EDGE_RIGHT;
+    case EDGE_RIGHT: return EDGE_LEFT;
+    default: assert(0); return 0;
+    }
 }
 
-static void n_link_chunks(struct nav_chunk *a, enum edge_type a_type, struct coord a_coord,
-                          struct nav_chunk *b, enum edge_type b_type, struct coord b_coord)
+static struct coord n_edge_tile(enum edge_type edge, int idx)
 {
-    assert(((a_type | b_type) == (EDGE_BOT | EDGE_TOP)) || ((a_type | b_type) == (EDGE_LEFT | EDGE_RIGHT)));
-    size_t stride = (a_type & (EDGE_BOT | EDGE_TOP)) ? 1 : FIELD_RES_C;
-    size_t line_len = (a_type & (EDGE_BOT | EDGE_TOP)) ? FIELD_RES_C : FIELD_RES_R;
+    switch(edge) {
+    case EDGE_TOP:   return (struct coord){0, idx};
+    case EDGE_BOT:   return (struct coord){FIELD_RES_R-1, idx};
+    case EDGE_LEFT:  return (struct coord){idx, 0};
+    case EDGE_RIGHT: return (struct coord){idx, FIELD_RES_C-1};
+    default: assert(0); return (struct coord){0};
+    }
+}
 
-    uint8_t *a_cursor = &a->cost_base[a_type == EDGE_BOT   ? FIELD_RES_R-1 : 0]
-                                     [a_type == EDGE_RIGHT ? FIELD_RES_C-1 : 0];
-    uint8_t *b_cursor = &b->cost_base[b_type == EDGE_BOT   ? FIELD_RES_R-1 : 0]
-                                     [b_type == EDGE_RIGHT ? FIELD_RES_C-1 : 0];
+/* A portal is a contiguous run of tiles along the chunk edge where neither 
+ * the tile nor the one across the edge is impassable. Returns the number
+ * of portals on the edge and their first and last indices along the edge. */
+static size_t n_edge_spans(struct nav_private *priv, struct coord coord, 
+                           enum edge_type edge, int out_spans[][2])
+{
+    const struct nav_chunk *a = &priv->chunks[IDX(coord.r, priv->width, coord.c)];
+    const struct nav_chunk *b = n_edge_neighbour(priv, coord, edge, NULL);
+    if(!b)
+        return 0;
 
-    int a_fixed_idx = a_type == EDGE_TOP   ? 0
-                    : a_type == EDGE_BOT   ? FIELD_RES_R-1
-                    : a_type == EDGE_LEFT  ? 0
-                    : a_type == EDGE_RIGHT ? FIELD_RES_C-1
-                    : (assert(0), 0);
-    int b_fixed_idx = b_type == EDGE_TOP   ? 0
-                    : b_type == EDGE_BOT   ? FIELD_RES_R-1
-                    : b_type == EDGE_LEFT  ? 0
-                    : b_type == EDGE_RIGHT ? FIELD_RES_C-1
-                    : (assert(0), 0);
+    enum edge_type b_edge = n_opposite_edge(edge);
+    size_t line_len = (edge & (EDGE_BOT | EDGE_TOP)) ? FIELD_RES_C : FIELD_RES_R;
+    size_t ret = 0;
+    int start = -1;
 
-    bool in_portal = false;
     for(int i = 0; i < line_len; i++) {
 
-        assert(CURSOR_OFF(a_cursor, &a->cost_base[0][0]) >= 0 
-            && CURSOR_OFF(a_cursor, &a->cost_base[0][0]) < (FIELD_RES_R*FIELD_RES_C));
-        assert(CURSOR_OFF(b_cursor, &b->cost_base[0][0]) >= 0 
-            && CURSOR_OFF(a_cursor, &b->cost_base[0][0]) < (FIELD_RES_R*FIELD_RES_C));
+        struct coord a_tile = n_edge_tile(edge, i);
+        struct coord b_tile = n_edge_tile(b_edge, i);
+        bool can_cross = a->cost_base[a_tile.r][a_tile.c] != COST_IMPASSABLE 
+                      && b->cost_base[b_tile.r][b_tile.c] != COST_IMPASSABLE;
 
-        bool can_cross = *a_cursor != COST_IMPASSABLE && *b_cursor != COST_IMPASSABLE;
-        /* First tile of portal */
-        if(can_cross && !in_portal) {
+        if(can_cross && start == -1)
+            start = i;
 
-            in_portal = true;
-            a->portals[a->num_portals] = (struct portal) {
-                .component_id   = 0,
-                .chunk          = a_coord,
-                .endpoints[0]   = (a_type & (EDGE_TOP | EDGE_BOT))    ? (struct coord){a_fixed_idx, i}
-                                : (a_type & (EDGE_LEFT | EDGE_RIGHT)) ? (struct coord){i, a_fixed_idx}
-                                : (assert(0), (struct coord){0}),
-                .num_neighbours = 0,
-                .connected      = &b->portals[b->num_portals]
-            };
-            b->portals[b->num_portals] = (struct portal) {
-                .component_id   = 0,
-                .chunk          = b_coord,
-                .endpoints[0]   = (b_type & (EDGE_TOP | EDGE_BOT))    ? (struct coord){b_fixed_idx, i}
-                                : (b_type & (EDGE_LEFT | EDGE_RIGHT)) ? (struct coord){i, b_fixed_idx}
-                                : (assert(0), (struct coord){0}),
-                .num_neighbours = 0,
-                .connected      = &a->portals[a->num_portals]
-            };
+        if(start != -1 && (!can_cross || i == line_len - 1)) {
 
-        /* Last tile of portal */
-        }else if(in_portal && (!can_cross || i == line_len - 1)) {
-
-            int idx = !can_cross ? i-1 : i;
-            in_portal = false;
-            a->portals[a->num_portals].endpoints[1] 
-                = (a_type & (EDGE_TOP | EDGE_BOT))    ? (struct coord){a_fixed_idx, idx}
-                : (a_type & (EDGE_LEFT | EDGE_RIGHT)) ? (struct coord){idx, a_fixed_idx}
-                : (assert(0), (struct coord){0});
-            b->portals[b->num_portals].endpoints[1] 
-                = (b_type & (EDGE_TOP | EDGE_BOT))    ? (struct coord){b_fixed_idx, idx}
-                : (b_type & (EDGE_LEFT | EDGE_RIGHT)) ? (struct coord){idx, b_fixed_idx}
-                : (assert(0), (struct coord){0});
-
-            a->num_portals++;
-            b->num_portals++;
-
-            assert(a->num_portals <= MAX_PORTALS_PER_CHUNK);
-            assert(b->num_portals <= MAX_PORTALS_PER_CHUNK);
+            out_spans[ret][0] = start;
+            out_spans[ret][1] = can_cross ? i : i-1;
+            start = -1;
+            ret++;
         }
+    }
+    return ret;
+}
+
+/* Returns the index of the first portal on the specified edge */
+static size_t n_edge_portal_offset(struct nav_private *priv, struct coord coord, enum edge_type edge)
+{
+    int spans[FIELD_RES_C][2];
+    size_t ret = 0;
 
-        a_cursor += stride;
-        b_cursor += stride;
+    for(int i = 0; i < ARR_SIZE(s_edge_order); i++) {
+        if(s_edge_order[i] == edge)
+            break;
+        ret += n_edge_spans(priv, coord, s_edge_order[i], spans);
     }
+    return ret;
 }
 
-static void n_create_portals(struct nav_private *priv)
+/* Re-create all the portals of the chunk from the cost fields. The portals 
+ * are left without any links. */
+static void n_rebuild_chunk_portals(struct nav_private *priv, struct coord coord)
 {
-    size_t n_links = 0;
+    struct nav_chunk *chunk = &priv->chunks[IDX(coord.r, priv->width, coord.c)];
+    chunk->num_portals = 0;
 
-    for(int r = 0; r < priv->height; r++) {
-        for(int c = 0; c < priv->width; c++) {
-            
-            struct nav_chunk *curr = &priv->chunks[IDX(r, priv->width, c)];
-            struct nav_chunk *bot = (r < priv->height-1) ? &priv->chunks[IDX(r+1, priv->width, c)] : NULL;
-            struct nav_chunk *right = (c < priv->width-1) ? &priv->chunks[IDX(r, priv->width, c+1)] : NULL;
+    for(int i = 0; i < ARR_SIZE(s_edge_order); i++) {
 
-            if(bot)   n_link_chunks(curr, EDGE_BOT, (struct coord){r, c}, bot, EDGE_TOP, (struct coord){r+1, c});
-            if(right) n_link_chunks(curr, EDGE_RIGHT, (struct coord){r, c}, right, EDGE_LEFT, (struct coord){r, c+1});
-    
-            n_links += (!!bot + !!right);
+        int spans[FIELD_RES_C][2];
+        size_t nspans = n_edge_spans(priv, coord, s_edge_order[i], spans);
+
+        for(int j = 0; j < nspans; j++) {
+
+            chunk->portals[chunk->num_portals++] = (struct portal) {
+                .component_id   = 0,
+                .chunk          = coord,
+                .endpoints[0]   = n_edge_tile(s_edge_order[i], spans[j][0]),
+                .endpoints[1]   = n_edge_tile(s_edge_order[i], spans[j][1]),
+                .num_neighbours = 0,
+                .connected      = NULL,
+                .region_node    = REGION_NODE_NONE
+            };
+            assert(chunk->num_portals <= MAX_PORTALS_PER_CHUNK);
         }
     }
+}
+
+/* Point the portals on the specified edge of the chunk and the matching 
+ * portals of the adjacent chunk at one another. */
+static void n_connect_edge_portals(struct nav_private *priv, struct coord coord, enum edge_type edge)
+{
+    struct coord b_coord;
+    struct nav_chunk *a = &priv->chunks[IDX(coord.r, priv->width, coord.c)];
+    struct nav_chunk *b = n_edge_neighbour(priv, coord, edge, &b_coord);
+    if(!b)
+        return;
 
-    assert(n_links == (priv->height)*(priv->width-1) + (priv->width)*(priv->height-1));
+    int spans[FIELD_RES_C][2];
+    size_t nspans = n_edge_spans(priv, coord, edge, spans);
+    size_t a_off = n_edge_portal_offset(priv, coord, edge);
+    size_t b_off = n_edge_portal_offset(priv, b_coord, n_opposite_edge(edge));
+
+    for(int i = 0; i < nspans; i++) {
+
+        assert(a_off + i < a->num_portals);
+        assert(b_off + i < b->num_portals);
+
+        a->portals[a_off + i].connected = &b->portals[b_off + i];
+        b->portals[b_off + i].connected = &a->portals[a_off + i];
+    }
 }
 
 static void n_link_chunk_portals(struct nav_chunk *chunk, struct coord chunk_coord)
@@ -469,7 +638,7 @@ static void n_link_chunk_portals(struct nav_chunk *chunk, struct coord chunk_coo
             float cost;
             bool has_path = AStar_GridPath(a, b, chunk_coord, chunk->cost_base, &path, &cost);
             if(has_path) {
-                port->edges[port->num_neighbours] = (struct edge){EDGE_STATE_ACTIVE, link_candidate, cost};
+                port->edges[port->num_neighbours] = (struct edge){EDGE_STATE_ACTIVE, j, cost};
                 port->num_neighbours++;    
             }
         }
@@ -478,20 +647,21 @@ static void n_link_chunk_portals(struct nav_chunk *chunk, struct coord chunk_coo
     vec_coord_destroy(&path);
 }
 
-static void n_visit_portal(struct portal *port, int comp_id)
+static void n_visit_portal(struct nav_private *priv, struct portal *port, int comp_id)
 {
     if(port->component_id != 0)
         return;
 
     port->component_id = comp_id;
-    n_visit_portal(port->connected, comp_id); 
+    n_visit_portal(priv, port->connected, comp_id); 
 
+    struct nav_chunk *chunk = &priv->chunks[IDX(port->chunk.r, priv->width, port->chunk.c)];
     for(int i = 0; i < port->num_neighbours; i++) {
 
-        struct portal *curr = port->edges[i].neighbour;
+        struct portal *curr = &chunk->portals[port->edges[i].neighbour];
         if(port->edges[i].es == EDGE_STATE_BLOCKED)
             continue;
-        n_visit_portal(curr, comp_id);
+        n_visit_portal(priv, curr, comp_id);
     }
 }
 
@@ -504,7 +674,7 @@ static void n_update_components(struct nav_private *priv)
 
     int comp_id = 1;
     FOREACH_PORTAL(priv, port, {
-        n_visit_portal(port, comp_id++);
+        n_visit_portal(priv, port, comp_id++);
     });
 }
 
@@ -542,7 +712,7 @@ static int n_update_edge_states(struct nav_chunk *chunk)
 
         for(int j = 0; j < port->num_neighbours; j++) {
 
-            struct portal *neighb = port->edges[j].neighbour;
+            struct portal *neighb = &chunk->portals[port->edges[j].neighbour];
             bool conn = n_local_ports_connected(port, neighb, chunk);
 
             enum edge_state new_es = conn ? EDGE_STATE_ACTIVE : EDGE_STATE_BLOCKED;
@@ -666,54 +836,8 @@ static dest_id_t n_dest_id(struct tile_desc dst_desc)
          | (((uint32_t)dst_desc.tile_c  & 0xff) <<  0);
 }
 
-static void n_visit_island(struct nav_private *priv, uint16_t id, struct tile_desc start)
-{
-    struct map_resolution res = {
-        priv->width, priv->height,
-        FIELD_RES_C, FIELD_RES_R
-    };
-
-    struct nav_chunk *chunk = &priv->chunks[IDX(start.chunk_r, priv->width, start.chunk_c)];
-    chunk->islands[start.tile_r][start.tile_c] = id;
-
-    queue_td_t frontier;
-    queue_td_init(&frontier, 1024);
-    queue_td_push(&frontier, &start);
-
-    while(queue_size(frontier) > 0) {
-    
-        struct tile_desc curr;
-        queue_td_pop(&frontier, &curr);
-
-        struct coord deltas[] = {
-            { 0, -1},
-            { 0, +1},
-            {-1,  0},
-            {+1,  0},
-        };
-
-        for(int i = 0; i < ARR_SIZE(deltas); i++) {
-        
-            struct tile_desc neighb = curr;
-            if(!M_Tile_RelativeDesc(res, &neighb, deltas[i].c, deltas[i].r))
-                continue;
-
-            assert(memcmp(&curr, &neighb, sizeof(struct tile_desc)) != 0);
-            chunk = &priv->chunks[IDX(neighb.chunk_r, priv->width, neighb.chunk_c)];
-
-            if(chunk->islands[neighb.tile_r][neighb.tile_c] == ISLAND_NONE
-            && chunk->cost_base[neighb.tile_r][neighb.tile_c] != COST_IMPASSABLE) {
-            
-                chunk->islands[neighb.tile_r][neighb.tile_c] = id;
-                queue_td_push(&frontier, &neighb);
-            }
-        }
-    }
-
-    queue_td_destroy(&frontier);
-}
-
-static void n_visit_island_local(struct nav_chunk *chunk, uint16_t id, struct coord start)
+static void n_visit_island_local(struct nav_chunk *chunk, uint16_t field[FIELD_RES_R][FIELD_RES_C],
+                                 bool blockers, uint16_t id, struct coord start)
 {
     struct map_resolution res = {
         1, 1, FIELD_RES_C, FIELD_RES_R
@@ -725,7 +849,7 @@ static void n_visit_island_local(struct nav_chunk *chunk, uint16_t id, struct co
     queue_td_t frontier;
     queue_td_init(&frontier, 1024);
 
-    chunk->local_islands[start.r][start.c] = id;
+    field[start.r][start.c] = id;
     queue_td_push(&frontier, &start_td);
 
     while(queue_size(frontier) > 0) {
@@ -749,13 +873,13 @@ static void n_visit_island_local(struct nav_chunk *chunk, uint16_t id, struct co
             if(chunk->cost_base[neighb.tile_r][neighb.tile_c] == COST_IMPASSABLE)
                 continue;
 
-            if(chunk->blockers[neighb.tile_r][neighb.tile_c] > 0)
+            if(blockers && chunk->blockers[neighb.tile_r][neighb.tile_c] > 0)
                 continue;
 
-            if(chunk->local_islands[neighb.tile_r][neighb.tile_c] != ISLAND_NONE)
+            if(field[neighb.tile_r][neighb.tile_c] != ISLAND_NONE)
                 continue;
 
-            chunk->local_islands[neighb.tile_r][neighb.tile_c] = id;
+            field[neighb.tile_r][neighb.tile_c] = id;
             queue_td_push(&frontier, &neighb);
         }
     }
@@ -763,19 +887,186 @@ static void n_visit_island_local(struct nav_chunk *chunk, uint16_t id, struct co
     queue_td_destroy(&frontier);
 }
 
-static bool enemy_ent(const struct entity *ent, void *arg)
+static void n_update_static_islands(struct nav_chunk *chunk)
 {
-    int faction_id = (uintptr_t)arg;
-    enum diplomacy_state ds;
+    size_t nislands = 0;
+    memset(chunk->static_islands, 0xff, sizeof(chunk->static_islands));
 
-    if(!(ent->flags & ENTITY_FLAG_COMBATABLE))
-        return false;
-    if(ent->faction_id == faction_id)
+    for(int r = 0; r < FIELD_RES_R; r++) {
+    for(int c = 0; c < FIELD_RES_C; c++) {
+
+        if(chunk->static_islands[r][c] != ISLAND_NONE)
+            continue;
+        if(chunk->cost_base[r][c] == COST_IMPASSABLE)
+            continue;
+        n_visit_island_local(chunk, chunk->static_islands, false, nislands++, (struct coord){r, c});
+    }}
+
+    assert(nislands <= ARR_SIZE(chunk->static_island_ids));
+    chunk->num_static_islands = nislands;
+}
+
+static uint32_t n_uf_find(uint32_t *parent, uint32_t node)
+{
+    while(parent[node] != node) {
+        parent[node] = parent[parent[node]];
+        node = parent[node];
+    }
+    return node;
+}
+
+static void n_uf_union(uint32_t *parent, uint32_t a, uint32_t b)
+{
+    a = n_uf_find(parent, a);
+    b = n_uf_find(parent, b);
+    /* Keep the earliest node as the root */
+    if(a < b)
+        parent[b] = a;
+    else if(b < a)
+        parent[a] = b;
+}
+
+static bool n_chunk_dirty(khash_t(coord) *dirty, int r, int c)
+{
+    if(!dirty)
+        return true;
+    uint32_t key = ((r & 0xffff) << 16) | (c & 0xffff);
+    return (kh_get(coord, dirty, key) != kh_end(dirty));
+}
+
+/* Assign global island IDs to the chunk-local islands by joining all the 
+ * local islands which touch across chunk borders with union-find. Only the 
+ * 'dirty' chunks have had their local islands re-computed. In order to touch
+ * as few tiles as possible, every global island keeps the ID that it had 
+ * previously, unless the ID has been claimed by another island (i.e. it
+ * was split) or merged with an island with an earlier ID. When 'dirty' is 
+ * NULL, all IDs are re-assigned from scratch. Returns false if the IDs
+ * could not be assigned, in which case the islands are left untouched. */
+static bool n_relabel_islands(struct nav_private *priv, khash_t(coord) *dirty)
+{
+    size_t nchunks = priv->width * priv->height;
+    size_t nnodes = 0;
+    bool ret = false;
+
+    uint32_t *base = malloc(nchunks * sizeof(uint32_t));
+    if(!base)
         return false;
 
-    bool result = G_GetDiplomacyState(ent->faction_id, faction_id, &ds);
-    assert(result);
-    return (ds == DIPLOMACY_STATE_WAR);
+    for(int i = 0; i < nchunks; i++) {
+        base[i] = nnodes;
+        nnodes += priv->chunks[i].num_static_islands;
+    }
+
+    uint32_t *parent = malloc(nnodes * sizeof(uint32_t));
+    uint16_t *hints = malloc(nnodes * sizeof(uint16_t));
+    uint16_t *ids = malloc(nnodes * sizeof(uint16_t));
+    bool *claimed = calloc(ISLAND_NONE, sizeof(bool));
+
+    if(nnodes && (!parent || !hints || !ids || !claimed))
+        goto out;
+
+    for(uint32_t i = 0; i < nnodes; i++) {
+        parent[i] = i;
+        ids[i] = ISLAND_NONE;
+    }
+
+    for(int r = 0; r < priv->height; r++) {
+    for(int c = 0; c < priv->width;  c++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[IDX(r, priv->width, c)];
+
+        if(c < priv->width-1) {
+            const struct nav_chunk *right = &priv->chunks[IDX(r, priv->width, c+1)];
+            for(int i = 0; i < FIELD_RES_R; i++) {
+                uint16_t a = chunk->static_islands[i][FIELD_RES_C-1];
+                uint16_t b = right->static_islands[i][0];
+                if(a != ISLAND_NONE && b != ISLAND_NONE)
+                    n_uf_union(parent, base[IDX(r, priv->width, c)] + a, base[IDX(r, priv->width, c+1)] + b);
+            }
+        }
+
+        if(r < priv->height-1) {
+            const struct nav_chunk *bot = &priv->chunks[IDX(r+1, priv->width, c)];
+            for(int i = 0; i < FIELD_RES_C; i++) {
+                uint16_t a = chunk->static_islands[FIELD_RES_R-1][i];
+                uint16_t b = bot->static_islands[0][i];
+                if(a != ISLAND_NONE && b != ISLAND_NONE)
+                    n_uf_union(parent, base[IDX(r, priv->width, c)] + a, base[IDX(r+1, priv->width, c)] + b);
+            }
+        }
+
+        /* The previous global ID of every local island. For the chunks whose 
+         * local islands were re-computed, take it from any of their tiles. */
+        uint16_t *node_hints = hints + base[IDX(r, priv->width, c)];
+        if(!dirty) {
+            memset(node_hints, 0xff, chunk->num_static_islands * sizeof(uint16_t));
+        }else if(n_chunk_dirty(dirty, r, c)) {
+            memset(node_hints, 0xff, chunk->num_static_islands * sizeof(uint16_t));
+            for(int tr = 0; tr < FIELD_RES_R; tr++) {
+            for(int tc = 0; tc < FIELD_RES_C; tc++) {
+                uint16_t local = chunk->static_islands[tr][tc];
+                if(local != ISLAND_NONE && node_hints[local] == ISLAND_NONE)
+                    node_hints[local] = chunk->islands[tr][tc];
+            }}
+        }else{
+            memcpy(node_hints, chunk->static_island_ids, chunk->num_static_islands * sizeof(uint16_t));
+        }
+    }}
+
+    for(uint32_t i = 0; i < nnodes; i++) {
+
+        uint32_t root = n_uf_find(parent, i);
+        if(ids[root] != ISLAND_NONE || hints[i] == ISLAND_NONE || claimed[hints[i]])
+            continue;
+        ids[root] = hints[i];
+        claimed[hints[i]] = true;
+    }
+
+    uint16_t next_id = 0;
+    for(uint32_t i = 0; i < nnodes; i++) {
+
+        uint32_t root = n_uf_find(parent, i);
+        if(ids[root] != ISLAND_NONE)
+            continue;
+        while(claimed[next_id])
+            next_id++;
+        assert(next_id < ISLAND_NONE);
+        ids[root] = next_id;
+        claimed[next_id] = true;
+    }
+
+    for(int r = 0; r < priv->height; r++) {
+    for(int c = 0; c < priv->width;  c++) {
+
+        struct nav_chunk *chunk = &priv->chunks[IDX(r, priv->width, c)];
+        uint32_t chunk_base = base[IDX(r, priv->width, c)];
+        bool changed = n_chunk_dirty(dirty, r, c);
+
+        for(int i = 0; i < chunk->num_static_islands; i++) {
+            uint16_t id = ids[n_uf_find(parent, chunk_base + i)];
+            changed |= (chunk->static_island_ids[i] != id);
+            chunk->static_island_ids[i] = id;
+        }
+
+        if(!changed)
+            continue;
+
+        for(int tr = 0; tr < FIELD_RES_R; tr++) {
+        for(int tc = 0; tc < FIELD_RES_C; tc++) {
+            uint16_t local = chunk->static_islands[tr][tc];
+            chunk->islands[tr][tc] = (local == ISLAND_NONE) ? ISLAND_NONE 
+                                                            : chunk->static_island_ids[local];
+        }}
+    }}
+    ret = true;
+
+out:
+    free(claimed);
+    free(ids);
+    free(hints);
+    free(parent);
+    free(base);
+    return ret;
 }
 
 static void n_update_local_islands(struct nav_chunk *chunk)
@@ -792,7 +1083,7 @@ static void n_update_local_islands(struct nav_chunk *chunk)
             continue;
         if(chunk->blockers[r][c] > 0)
             continue;
-        n_visit_island_local(chunk, ++local_iid, (struct coord){r, c});
+        n_visit_island_local(chunk, chunk->local_islands, true, ++local_iid, (struct coord){r, c});
     }}
 }
 
@@ -816,6 +1107,22 @@ static void n_update_dirty_local_islands(void *nav_private)
     s_local_islands_dirty = false;
 }
 
+static void n_pending_mark_stale(struct coord chunk)
+{
+    for(int i = 0; i < vec_size(&s_pending); i++) {
+
+        struct path_request *curr = vec_AT(&s_pending, i);
+        for(int j = 0; j < vec_size(&curr->snapshots); j++) {
+
+            struct chunk_snapshot *snap = &vec_AT(&curr->snapshots, j);
+            if(snap->coord.r == chunk.r && snap->coord.c == chunk.c) {
+                curr->stale = true;
+                break;
+            }
+        }
+    }
+}
+
 static void n_update_blockers(struct nav_private *priv, struct tile_desc *tds, size_t ntds, int ref_delta)
 {
     for(int i = 0; i < ntds; i++) {
@@ -837,6 +1144,7 @@ static void n_update_blockers(struct nav_private *priv, struct tile_desc *tds, s
             assert(ret != -1);
 
             s_local_islands_dirty = true;
+            n_pending_mark_stale((struct coord){curr.chunk_r, curr.chunk_c});
         }
     }
 }
@@ -949,21 +1257,37 @@ done:
     return ret; 
 }
 
+static uint16_t n_quantize_portal_cost(float cost)
+{
+    float ret = roundf(cost * PORTAL_COST_SCALE);
+    return (ret > PORTAL_COST_MAX) ? PORTAL_COST_MAX : ret;
+}
+
 static void n_build_portal_travel_index(struct nav_chunk *chunk)
 {
+    if(chunk->num_portals > chunk->travel_costs_capacity) {
+
+        void *costs = realloc(chunk->portal_travel_costs, 
+            chunk->num_portals * sizeof(chunk->portal_travel_costs[0]));
+        if(costs) {
+            chunk->portal_travel_costs = costs;
+            chunk->travel_costs_capacity = chunk->num_portals;
+        }
+    }
+
     queue_cc_t frontier;
     queue_cc_init(&frontier, 1024);
 
-    for(int pi = 0; pi < chunk->num_portals; pi++) {
+    /* In the unlikely case that we failed to grow the buffer, the 
+     * portals past the end of it are treated as unreachable. */
+    size_t nportals = MIN(chunk->num_portals, chunk->travel_costs_capacity);
+
+    for(int pi = 0; pi < nportals; pi++) {
 
         bool visited[FIELD_RES_R][FIELD_RES_C] = {0};
         assert(queue_size(frontier) == 0);
 
-        for(int r = 0; r < FIELD_RES_R; r++) {
-        for(int c = 0; c < FIELD_RES_C; c++) {
-
-            chunk->portal_travel_costs[pi][r][c] = FLT_MAX;
-        }}
+        memset(chunk->portal_travel_costs[pi], 0xff, sizeof(chunk->portal_travel_costs[pi]));
 
         const struct portal *port = &chunk->portals[pi];
         for(int r = port->endpoints[0].r; r <= port->endpoints[1].r; r++) {
@@ -979,7 +1303,7 @@ static void n_build_portal_travel_index(struct nav_chunk *chunk)
             struct cost_coord curr;
             queue_cc_pop(&frontier, &curr);
 
-            chunk->portal_travel_costs[pi][curr.coord.r][curr.coord.c] = curr.cost;
+            chunk->portal_travel_costs[pi][curr.coord.r][curr.coord.c] = n_quantize_portal_cost(curr.cost);
 
             struct coord neighbours[8];
             float costs[8];
@@ -1008,7 +1332,7 @@ static const struct portal *n_closest_reachable_portal(const struct nav_chunk *c
     for(int i = 0; i < chunk->num_portals; i++) {
 
         const struct portal *curr = &chunk->portals[i];
-        float cost = chunk->portal_travel_costs[i][start.r][start.c];
+        float cost = N_PortalTravelCost(chunk, i, start);
 
         if(cost < min_cost) {
             ret = curr;
@@ -1018,98 +1342,269 @@ static const struct portal *n_closest_reachable_portal(const struct nav_chunk *c
     return ret;
 }
 
-static void chunk_bounds(vec3_t map_pos, struct coord chunk, 
-                         vec2_t *out_xz_min, vec2_t *out_xz_max)
+static size_t n_threat_portal_idx(const struct nav_private *priv, const struct portal *port)
 {
-    out_xz_min->x = map_pos.x - (chunk.c + 1) * X_COORDS_PER_TILE * TILES_PER_CHUNK_WIDTH;
-    out_xz_max->x = map_pos.x - (chunk.c + 0) * X_COORDS_PER_TILE * TILES_PER_CHUNK_WIDTH;
-
-    out_xz_min->z = map_pos.z + (chunk.r + 0) * Z_COORDS_PER_TILE * TILES_PER_CHUNK_HEIGHT;
-    out_xz_max->z = map_pos.z + (chunk.r + 1) * Z_COORDS_PER_TILE * TILES_PER_CHUNK_HEIGHT;
+    const struct nav_chunk *chunk = &priv->chunks[IDX(port->chunk.r, priv->width, port->chunk.c)];
+    return IDX(port->chunk.r, priv->width, port->chunk.c) * MAX_PORTALS_PER_CHUNK 
+         + (port - chunk->portals);
 }
 
 /* Every set bit in the returned value represents the index of a portal 
- * in the chunk that we can path to to find enemies on the other side. 
+ * in the chunk that leads to a chunk closer to the faction's enemies. 
  */
-static uint64_t n_enemy_seek_portalmask(const struct nav_private *priv, vec3_t map_pos, 
-                                        struct coord chunk, int faction_id)
+static uint64_t n_threat_portalmask(const struct nav_private *priv, const struct threat_map *tm,
+                                    struct coord chunk)
 {
-    bool top = false, bot = false, left = false, right = false;
-
-    struct entity *ents[1];
-    vec2_t xz_min, xz_max;
-    struct coord curr;
+    const struct nav_chunk *nchunk = &priv->chunks[IDX(chunk.r, priv->width, chunk.c)];
+    uint16_t dist = tm->dist[IDX(chunk.r, priv->width, chunk.c)];
+    uint64_t ret = 0;
 
-    if(chunk.r > 0) {
+    for(int i = 0; i < nchunk->num_portals; i++) {
 
-        curr = (struct coord){chunk.r - 1, chunk.c};
-        chunk_bounds(map_pos, curr, &xz_min, &xz_max);
+        const struct portal *curr = &nchunk->portals[i];
+        if(!curr->connected)
+            continue;
 
-        top = (G_Pos_EntsInRectWithPred(xz_min, xz_max, ents, ARR_SIZE(ents), 
-            enemy_ent, (void*)(uintptr_t)faction_id) > 0);
+        struct coord next = curr->connected->chunk;
+        if(tm->dist[IDX(next.r, priv->width, next.c)] < dist)
+            ret |= (((uint64_t)1) << i);
     }
+    return ret;
+}
 
-    if(chunk.r < FIELD_RES_R-1) {
+/* Returns false when the faction has no enemies to seek from 'curr_pos'. 
+ * Otherwise, fills in the tile under 'curr_pos' and the target of the 
+ * enemy-seeking field for its chunk.
+ */
+static bool n_enemy_seek_target(const struct nav_private *priv, vec3_t map_pos, vec2_t curr_pos,
+                                int faction_id, struct tile_desc *out_tile, 
+                                struct field_target *out_target)
+{
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
 
-        curr = (struct coord){chunk.r + 1, chunk.c};
-        chunk_bounds(map_pos, curr, &xz_min, &xz_max);
+    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, out_tile);
+    assert(result);
 
-        bot = (G_Pos_EntsInRectWithPred(xz_min, xz_max, ents, ARR_SIZE(ents), 
-            enemy_ent, (void*)(uintptr_t)faction_id) > 0);
-    }
+    if(!priv->threat_maps || !priv->threat_maps[faction_id].dist)
+        return false;
 
-    if(chunk.c > 0) {
+    const struct threat_map *tm = &priv->threat_maps[faction_id];
+    struct coord chunk = (struct coord){out_tile->chunk_r, out_tile->chunk_c};
+    size_t chunk_idx = IDX(chunk.r, priv->width, chunk.c);
 
-        curr = (struct coord){chunk.r, chunk.c - 1};
-        chunk_bounds(map_pos, curr, &xz_min, &xz_max);
+    if(tm->dist[chunk_idx] == THREAT_NONE)
+        return false;
 
-        left = (G_Pos_EntsInRectWithPred(xz_min, xz_max, ents, ARR_SIZE(ents), 
-            enemy_ent, (void*)(uintptr_t)faction_id) > 0);
-    }
+    *out_target = (struct field_target){
+        .type = TARGET_ENEMIES,
+        .enemies.faction_id = faction_id,
+        .enemies.map_pos = map_pos,
+        .enemies.chunk = chunk,
+        .enemies.version = tm->version[chunk_idx]
+    };
+    return true;
+}
 
-    if(chunk.c < FIELD_RES_C-1) {
+/* The field is shared by all the faction's units in the chunk, until 
+ * the chunk's version is changed by the next update of the threat map. 
+ */
+static ff_id_t n_enemy_seek_field(struct nav_private *priv, struct field_target target)
+{
+    struct coord chunk = target.enemies.chunk;
+    size_t chunk_idx = IDX(chunk.r, priv->width, chunk.c);
+    const struct threat_map *tm = &priv->threat_maps[target.enemies.faction_id];
 
-        curr = (struct coord){chunk.r, chunk.c + 1};
-        chunk_bounds(map_pos, curr, &xz_min, &xz_max);
+    ff_id_t ffid = N_FlowField_ID(chunk, target);
+    struct flow_field ff;
 
-        right = (G_Pos_EntsInRectWithPred(xz_min, xz_max, ents, ARR_SIZE(ents), 
-            enemy_ent, (void*)(uintptr_t)faction_id) > 0);
-    }
+    if(N_FC_ContainsFlowField(ffid))
+        return ffid;
 
-    uint64_t ret = 0;
-    const struct nav_chunk *nchunk = &priv->chunks[IDX(chunk.r, priv->width, chunk.c)];
+    /* If there are enemies on this chunk, guide towards them. Else, 
+     * guide towards all the portals that lead closer to them. 
+     */
+    if(tm->dist[chunk_idx] == 0) {
+    
+        N_FlowFieldInit(chunk, priv, &ff);
+        N_FlowFieldUpdate(chunk, priv, target, &ff);
+        N_FC_PutFlowField(ffid, &ff);
 
-    for(int i = 0; i < nchunk->num_portals; i++) {
+    }else{
 
-        const struct portal *curr = &nchunk->portals[i];
+        struct field_target pm_target = (struct field_target){
+            .type = TARGET_PORTALMASK,
+            .portalmask = n_threat_portalmask(priv, tm, chunk),
+        };
 
-        if(top && curr->endpoints[0].r == 0 
-               && curr->endpoints[1].r == 0)
-            ret |= (((uint64_t)1) << i);
+        N_FlowFieldInit(chunk, priv, &ff);
+        N_FlowFieldUpdate(chunk, priv, pm_target, &ff);
+        N_FC_PutFlowField(ffid, &ff);
+    }
 
-        if(bot && curr->endpoints[0].r == FIELD_RES_R-1 
-               && curr->endpoints[1].r == FIELD_RES_R-1)
-            ret |= (((uint64_t)1) << i);
+    assert(N_FC_ContainsFlowField(ffid));
+    return ffid;
+}
 
-        if(left && curr->endpoints[0].c == 0 
-                && curr->endpoints[1].c == 0)
-            ret |= (((uint64_t)1) << i);
+/* Breadth-first search from all the chunks holding entities of the 'enemies' 
+ * factions at once. The search is made over the portals through which the
+ * chunks are entered, so that it never crosses a chunk between two portals 
+ * which are cut off from one another. 
+ */
+static void n_threat_dist(const struct nav_private *priv, uint16_t enemies, 
+                          struct threat_node *queue, bool *visited, uint16_t *out_dist)
+{
+    size_t nchunks = priv->width * priv->height;
+    size_t head = 0, tail = 0;
 
-        if(right && curr->endpoints[0].c == FIELD_RES_C-1 
-                 && curr->endpoints[1].c == FIELD_RES_C-1)
-            ret |= (((uint64_t)1) << i);
+    memset(visited, 0, nchunks * MAX_PORTALS_PER_CHUNK * sizeof(bool));
+    for(int i = 0; i < nchunks; i++) {
+        out_dist[i] = (priv->chunk_factions[i] & enemies) ? 0 : THREAT_NONE;
     }
 
-    return ret;
-}
+    for(int i = 0; i < nchunks; i++) {
+
+        if(out_dist[i] != 0)
+            continue;
+
+        const struct nav_chunk *chunk = &priv->chunks[i];
+        for(int j = 0; j < chunk->num_portals; j++) {
+
+            const struct portal *next = chunk->portals[j].connected;
+            if(!next)
+                continue;
+
+            size_t next_idx = n_threat_portal_idx(priv, next);
+            if(visited[next_idx])
+                continue;
+
+            visited[next_idx] = true;
+            queue[tail++] = (struct threat_node){next, 1};
+        }
+    }
+
+    while(head < tail) {
+
+        struct threat_node curr = queue[head++];
+        size_t chunk_idx = IDX(curr.port->chunk.r, priv->width, curr.port->chunk.c);
+        if(out_dist[chunk_idx] == 0)
+            continue;
+
+        if(out_dist[chunk_idx] == THREAT_NONE)
+            out_dist[chunk_idx] = curr.dist;
+
+        const struct nav_chunk *chunk = &priv->chunks[chunk_idx];
+        for(int i = 0; i < curr.port->num_neighbours; i++) {
+
+            if(curr.port->edges[i].es == EDGE_STATE_BLOCKED)
+                continue;
+
+            const struct portal *next = chunk->portals[curr.port->edges[i].neighbour].connected;
+            if(!next)
+                continue;
+
+            size_t next_idx = n_threat_portal_idx(priv, next);
+            if(visited[next_idx])
+                continue;
+
+            visited[next_idx] = true;
+            queue[tail++] = (struct threat_node){next, curr.dist + 1};
+        }
+    }
+}
+
+static bool n_threat_map_init(struct threat_map *tm, size_t nchunks)
+{
+    tm->dist = malloc(nchunks * sizeof(tm->dist[0]));
+    tm->version = calloc(nchunks, sizeof(tm->version[0]));
+
+    if(!tm->dist || !tm->version) {
+        free(tm->dist);
+        free(tm->version);
+        tm->dist = NULL;
+        tm->version = NULL;
+        return false;
+    }
+
+    for(int i = 0; i < nchunks; i++)
+        tm->dist[i] = THREAT_NONE;
+    return true;
+}
+
+static void n_threat_bump_version(const struct nav_private *priv, struct threat_map *tm, size_t idx)
+{
+    tm->version[idx]++;
+
+    /* The fields of the adjacent chunks point towards the portals 
+     * leading to this one, depending on its' distance. */
+    const struct nav_chunk *chunk = &priv->chunks[idx];
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        const struct portal *port = &chunk->portals[i];
+        if(!port->connected)
+            continue;
+        tm->version[IDX(port->connected->chunk.r, priv->width, port->connected->chunk.c)]++;
+    }
+}
+
+/* The distances are only searched again when the set of chunks holding 
+ * enemies has changed, or when 'force' is set because the connectivity 
+ * of the chunks has changed. The enemies move around inside their chunks, 
+ * so the fields of those chunks are always rebuilt. 
+ */
+static void n_threat_map_update(const struct nav_private *priv, struct threat_map *tm, 
+                                uint16_t enemies, const uint16_t *prev_factions, bool force,
+                                struct threat_node *queue, bool *visited, uint16_t *dist)
+{
+    size_t nchunks = priv->width * priv->height;
+    bool changed = force || (tm->enemies != enemies);
+
+    for(int i = 0; i < nchunks && !changed; i++) {
+        changed = (!!(prev_factions[i] & enemies) != !!(priv->chunk_factions[i] & enemies));
+    }
+    tm->enemies = enemies;
+
+    if(changed) {
+
+        n_threat_dist(priv, enemies, queue, visited, dist);
+        for(int i = 0; i < nchunks; i++) {
+
+            if(tm->dist[i] == dist[i])
+                continue;
+            tm->dist[i] = dist[i];
+            n_threat_bump_version(priv, tm, i);
+        }
+    }
+
+    for(int i = 0; i < nchunks; i++) {
+        if(tm->dist[i] == 0)
+            tm->version[i]++;
+    }
+}
+
+static void n_free_threat_maps(struct nav_private *priv)
+{
+    if(priv->threat_maps) {
+        for(int i = 0; i < MAX_FACTIONS; i++) {
+            free(priv->threat_maps[i].dist);
+            free(priv->threat_maps[i].version);
+        }
+    }
+    free(priv->threat_maps);
+    free(priv->chunk_factions);
+    priv->threat_maps = NULL;
+    priv->chunk_factions = NULL;
+}
 
 /* Returns true if, in the abscence of any blockers, the tiles would be on the same local island */
 static bool n_normally_reachable(const struct nav_chunk *chunk, struct coord a, struct coord b)
 {
     for(int i = 0; i < chunk->num_portals; i++) {
     
-        bool areach = (chunk->portal_travel_costs[i][a.r][a.c] != FLT_MAX);
-        bool breach = (chunk->portal_travel_costs[i][b.r][b.c] != FLT_MAX);
+        bool areach = (N_PortalTravelCost(chunk, i, a) != FLT_MAX);
+        bool breach = (N_PortalTravelCost(chunk, i, b) != FLT_MAX);
         if(areach != breach)
             return false;
     }
@@ -1241,18 +1736,762 @@ bool n_objects_adjacent(void *nav_private, vec3_t map_pos, const struct entity *
     return false;
 }
 
+static vec2_t n_tile_center(struct map_resolution res, vec3_t map_pos, struct tile_desc td)
+{
+    struct box bounds = M_Tile_Bounds(res, map_pos, td);
+    return (vec2_t){
+        bounds.x - bounds.width / 2.0f,
+        bounds.z + bounds.height / 2.0f
+    };
+}
+
+static vec2_t n_portal_center(struct map_resolution res, vec3_t map_pos, const struct portal *port)
+{
+    struct tile_desc td = (struct tile_desc){
+        port->chunk.r, 
+        port->chunk.c,
+        (port->endpoints[0].r + port->endpoints[1].r) / 2,
+        (port->endpoints[0].c + port->endpoints[1].c) / 2,
+    };
+    return n_tile_center(res, map_pos, td);
+}
+
+/* Returns a copy of the per-tile navigation data of a chunk, from which the 
+ * fields can be built off the main thread while the live data keeps changing. 
+ * The portals are not copied. */
+static const struct nav_chunk *n_request_snapshot(struct path_request *req, 
+                                                  const struct nav_private *priv, 
+                                                  struct coord chunk)
+{
+    for(int i = 0; i < vec_size(&req->snapshots); i++) {
+        struct chunk_snapshot *curr = &vec_AT(&req->snapshots, i);
+        if(curr->coord.r == chunk.r && curr->coord.c == chunk.c)
+            return curr->chunk;
+    }
+
+    const struct nav_chunk *src = &priv->chunks[IDX(chunk.r, priv->width, chunk.c)];
+    struct nav_chunk *copy = malloc(sizeof(struct nav_chunk));
+    if(!copy)
+        return NULL;
+
+    copy->num_portals = 0;
+    copy->portal_travel_costs = NULL;
+    copy->travel_costs_capacity = 0;
+    memcpy(copy->cost_base, src->cost_base, sizeof(src->cost_base));
+    memcpy(copy->blockers, src->blockers, sizeof(src->blockers));
+    memcpy(copy->islands, src->islands, sizeof(src->islands));
+    memcpy(copy->local_islands, src->local_islands, sizeof(src->local_islands));
+
+    if(!vec_snap_push(&req->snapshots, (struct chunk_snapshot){chunk, copy})) {
+        free(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+static bool n_request_has_field(const struct path_request *req, struct coord chunk)
+{
+    for(int i = 0; i < vec_size(&req->jobs); i++) {
+        const struct field_job *curr = vec_AT(&req->jobs, i);
+        if(curr->chunk.r == chunk.r && curr->chunk.c == chunk.c)
+            return true;
+    }
+    return false;
+}
+
+static int n_request_los_idx(const struct path_request *req, struct coord chunk)
+{
+    for(int i = 0; i < vec_size(&req->los); i++) {
+        const struct los_job *curr = vec_AT(&req->los, i);
+        if(curr->chunk.r == chunk.r && curr->chunk.c == chunk.c)
+            return i;
+    }
+    return -1;
+}
+
+static bool n_request_add_field(struct path_request *req, const struct nav_private *priv,
+                                struct coord chunk, struct field_target target, 
+                                ff_id_t id, vec2_t steer_xz)
+{
+    struct field_job *job = malloc(sizeof(struct field_job));
+    if(!job)
+        return false;
+
+    job->chunk = chunk;
+    job->snapshot = n_request_snapshot(req, priv, chunk);
+    job->target = target;
+    job->id = id;
+    job->steer_xz = steer_xz;
+    job->tid = NULL_TID;
+    N_FlowFieldInit(chunk, priv, &job->ff);
+
+    if(!job->snapshot || !vec_fjob_push(&req->jobs, job)) {
+        free(job);
+        return false;
+    }
+    return true;
+}
+
+static bool n_request_add_los(struct path_request *req, const struct nav_private *priv,
+                              struct coord chunk, const struct coord *prev)
+{
+    struct los_job *job = malloc(sizeof(struct los_job));
+    if(!job)
+        return false;
+
+    job->chunk = chunk;
+    job->snapshot = n_request_snapshot(req, priv, chunk);
+    job->prev_idx = -1;
+    job->has_prev = false;
+
+    if(prev) {
+        job->prev_idx = n_request_los_idx(req, *prev);
+        if(job->prev_idx == -1) {
+
+            /* The field for the previous chunk along the path has already been 
+             * built and is waiting in the cache. */
+            if(!N_FC_ContainsLOSField(req->dest_id, *prev)) {
+                free(job);
+                return false;
+            }
+            const struct LOS_field *prev_lf = N_FC_LOSFieldAcquire(req->dest_id, *prev);
+            job->prev = *prev_lf;
+            job->has_prev = true;
+            N_FC_LOSFieldRelease(prev_lf);
+        }
+    }
+
+    if(!job->snapshot || !vec_ljob_push(&req->los, job)) {
+        free(job);
+        return false;
+    }
+    return true;
+}
+
+static void n_request_free(struct path_request *req)
+{
+    for(int i = 0; i < vec_size(&req->jobs); i++)
+        free(vec_AT(&req->jobs, i));
+    for(int i = 0; i < vec_size(&req->los); i++)
+        free(vec_AT(&req->los, i));
+    for(int i = 0; i < vec_size(&req->snapshots); i++)
+        free(vec_AT(&req->snapshots, i).chunk);
+
+    vec_fjob_destroy(&req->jobs);
+    vec_ljob_destroy(&req->los);
+    vec_snap_destroy(&req->snapshots);
+    free(req);
+}
+
+static struct result n_field_task(void *arg)
+{
+    struct field_job *job = arg;
+    N_FlowFieldUpdateChunk(job->snapshot, job->target, &job->ff);
+    return NULL_RESULT;
+}
+
+/* The LOS fields must be built in order, starting at the destination 
+ * chunk, as each one depends on the field of the previous chunk. */
+static struct result n_los_task(void *arg)
+{
+    struct path_request *req = arg;
+
+    for(int i = 0; i < vec_size(&req->los); i++) {
+
+        struct los_job *curr = vec_AT(&req->los, i);
+        const struct LOS_field *prev = curr->has_prev ? &curr->prev
+                                     : curr->prev_idx >= 0 ? &vec_AT(&req->los, curr->prev_idx)->lf
+                                     : NULL;
+        N_LOSFieldCreateChunk(curr->chunk, req->dst_desc, curr->snapshot, req->res, 
+            req->map_pos, &curr->lf, prev);
+    }
+    return NULL_RESULT;
+}
+
+static void n_spawn(task_func_t code, void *arg, struct future *future, uint32_t *out_tid)
+{
+    SDL_AtomicSet(&future->status, FUTURE_INCOMPLETE);
+    *out_tid = Sched_Create(4, code, arg, future, TASK_BIG_STACK);
+
+    /* Out of tasks - do the work right away */
+    if(*out_tid == NULL_TID) {
+        code(arg);
+        SDL_AtomicSet(&future->status, FUTURE_COMPLETE);
+    }
+}
+
+static void n_await(struct future *future, uint32_t tid)
+{
+    while(!Sched_FutureIsReady(future)) {
+        Sched_RunSync(tid);
+    }
+}
+
+static void n_request_submit(struct path_request *req)
+{
+    for(int i = 0; i < vec_size(&req->jobs); i++) {
+        struct field_job *curr = vec_AT(&req->jobs, i);
+        n_spawn(n_field_task, curr, &curr->future, &curr->tid);
+    }
+    if(vec_size(&req->los) > 0) {
+        n_spawn(n_los_task, req, &req->los_future, &req->los_tid);
+    }
+}
+
+static void n_request_finish(struct path_request *req)
+{
+    for(int i = 0; i < vec_size(&req->jobs); i++) {
+        struct field_job *curr = vec_AT(&req->jobs, i);
+        n_await(&curr->future, curr->tid);
+    }
+    if(vec_size(&req->los) > 0) {
+        n_await(&req->los_future, req->los_tid);
+    }
+}
+
+/* All the fields of a request are added to the cache at once, so that 
+ * a path never becomes visible in a partially-built state. */
+static void n_request_publish(const struct nav_private *priv, struct path_request *req)
+{
+    for(int i = 0; i < vec_size(&req->jobs); i++) {
+
+        struct field_job *curr = vec_AT(&req->jobs, i);
+        ff_id_t exist_id;
+
+        /* Another path to the same destination (made by an earlier request, 
+         * or synchronously) already passes through this chunk with a different 
+         * field. Merge the two, in the same way as 'N_RequestPath' does, so 
+         * that the entities following the other path don't lose their way. 
+         * The request is not stale, so the chunk is unchanged since the 
+         * snapshot was taken. */
+        if(N_FC_GetDestFFMapping(req->dest_id, curr->chunk, &exist_id)
+        && exist_id != curr->id
+        && N_FC_ContainsFlowField(exist_id)) {
+
+            const struct flow_field *exist_ff = N_FC_FlowFieldAcquire(exist_id);
+            memcpy(&curr->ff, exist_ff, sizeof(struct flow_field));
+            N_FC_FlowFieldRelease(exist_ff);
+            N_FlowFieldUpdate(curr->chunk, priv, curr->target, &curr->ff);
+        }
+
+        N_FC_PutDestFFMapping(req->dest_id, curr->chunk, curr->id);
+        N_FC_PutFlowField(curr->id, &curr->ff);
+    }
+    for(int i = 0; i < vec_size(&req->los); i++) {
+
+        struct los_job *curr = vec_AT(&req->los, i);
+        N_FC_PutLOSField(req->dest_id, curr->chunk, &curr->lf);
+    }
+}
+
+static void n_pending_publish(const struct nav_private *priv)
+{
+    size_t nleft = 0;
+    for(int i = 0; i < vec_size(&s_pending); i++) {
+
+        struct path_request *curr = vec_AT(&s_pending, i);
+
+        /* Give the tasks until the next update to run in the background. 
+         * Whatever is still left to do at that point is done synchronously. 
+         * This keeps the latency at exactly one update. */
+        if(curr->submitted == s_nupdates) {
+            vec_AT(&s_pending, nleft++) = curr;
+            continue;
+        }
+
+        n_request_finish(curr);
+        if(!curr->stale) {
+            n_request_publish(priv, curr);
+        }
+        n_request_free(curr);
+    }
+    s_pending.size = nleft;
+}
+
+static void n_pending_discard(void)
+{
+    for(int i = 0; i < vec_size(&s_pending); i++) {
+
+        struct path_request *curr = vec_AT(&s_pending, i);
+        n_request_finish(curr);
+        n_request_free(curr);
+    }
+    vec_req_reset(&s_pending);
+}
+
+static bool n_pending_steer(dest_id_t id, struct coord chunk, vec2_t *out_xz)
+{
+    for(int i = 0; i < vec_size(&s_pending); i++) {
+
+        const struct path_request *curr = vec_AT(&s_pending, i);
+        if(curr->dest_id != id)
+            continue;
+
+        for(int j = 0; j < vec_size(&curr->jobs); j++) {
+
+            const struct field_job *job = vec_AT(&curr->jobs, j);
+            if(job->chunk.r == chunk.r && job->chunk.c == chunk.c) {
+                *out_xz = job->steer_xz;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static vec2_t n_seek_velocity(vec2_t curr_pos, vec2_t target)
+{
+    vec2_t ret;
+    PFM_Vec2_Sub(&target, &curr_pos, &ret);
+    if(PFM_Vec2_Len(&ret) < EPSILON)
+        return (vec2_t){0.0f};
+
+    PFM_Vec2_Normal(&ret, &ret);
+    return ret;
+}
+
+static void n_mark_cost_dirty(struct coord chunk)
+{
+    int ret;
+    uint32_t key = ((chunk.r & 0xffff) << 16) | (chunk.c & 0xffff);
+    kh_put(coord, s_dirty_costs, key, &ret);
+    assert(ret != -1);
+}
+
+static void n_bake_chunk_costs(const struct bake_ctx *ctx, struct coord coord)
+{
+    struct nav_private *priv = ctx->priv;
+    struct nav_chunk *chunk = &priv->chunks[IDX(coord.r, priv->width, coord.c)];
+    const struct tile *tiles = ctx->chunk_tiles[IDX(coord.r, priv->width, coord.c)];
+
+    chunk->num_portals = 0;
+    chunk->portal_travel_costs = NULL;
+    chunk->travel_costs_capacity = 0;
+
+    for(int tile_r = 0; tile_r < ctx->chunk_h; tile_r++) {
+    for(int tile_c = 0; tile_c < ctx->chunk_w; tile_c++) {
+
+        if(ctx->update) {
+            const struct tile *curr_tile = &tiles[tile_r * ctx->chunk_w + tile_c];
+            n_set_cost_for_tile(chunk, ctx->chunk_w, ctx->chunk_h, tile_r, tile_c, curr_tile);
+        }else{
+            n_clear_cost_for_tile(chunk, ctx->chunk_w, ctx->chunk_h, tile_r, tile_c);
+        }
+    }}
+    memset(chunk->blockers, 0, sizeof(chunk->blockers));
+    memset(chunk->cutouts, 0, sizeof(chunk->cutouts));
+
+    /* The cliff edges of a tile only ever modify the cost field of 
+     * the chunk that it's in, so this is safe to do per-chunk. */
+    for(int tile_r = 0; tile_r < ctx->chunk_h; tile_r++) {
+    for(int tile_c = 0; tile_c < ctx->chunk_w; tile_c++) {
+
+        struct tile_desc td = {coord.r, coord.c, tile_r, tile_c};
+        n_make_tile_cliff_edges(priv, ctx->chunk_tiles, ctx->chunk_w, ctx->chunk_h, td);
+    }}
+}
+
+static void n_bake_chunk_portals(const struct bake_ctx *ctx, struct coord coord)
+{
+    n_rebuild_chunk_portals(ctx->priv, coord);
+}
+
+static void n_bake_chunk_links(const struct bake_ctx *ctx, struct coord coord)
+{
+    struct nav_chunk *chunk = &ctx->priv->chunks[IDX(coord.r, ctx->priv->width, coord.c)];
+    n_link_chunk_portals(chunk, coord);
+    n_build_portal_travel_index(chunk);
+}
+
+static void n_bake_chunk_islands(const struct bake_ctx *ctx, struct coord coord)
+{
+    struct nav_chunk *chunk = &ctx->priv->chunks[IDX(coord.r, ctx->priv->width, coord.c)];
+    n_update_static_islands(chunk);
+}
+
+static struct result n_bake_task(void *arg)
+{
+    PERF_ENTER();
+    struct bake_job *job = arg;
+    const struct nav_private *priv = job->ctx->priv;
+
+    for(int i = job->begin; i < job->end; i++) {
+        job->func(job->ctx, (struct coord){i / priv->width, i % priv->width});
+    }
+    PERF_RETURN(NULL_RESULT);
+}
+
+/* Run the function for every chunk of the map, splitting the chunks 
+ * between tasks that are run on the worker threads. The function may 
+ * only write to the chunk that it is given. Returns when all the chunks 
+ * have been processed. */
+static void n_bake_parallel(const struct bake_ctx *ctx, bake_func_t func)
+{
+    const size_t nchunks = ctx->priv->width * ctx->priv->height;
+
+    /* Tasks can only be spawned from the main thread context */
+    if(Sched_ActiveTID() != NULL_TID) {
+        struct bake_job job = {ctx, func, 0, nchunks};
+        n_bake_task(&job);
+        return;
+    }
+
+    /* The cost of a chunk varies a lot with its' number of portals. Use
+     * more tasks than there are threads to balance out the load. */
+    size_t ntasks = MIN(SDL_GetCPUCount() * 4, MAX_BAKE_TASKS);
+    ntasks = MAX(MIN(ntasks, nchunks), 1);
+    size_t nitems = (nchunks + ntasks - 1) / ntasks;
+
+    struct bake_job jobs[MAX_BAKE_TASKS];
+    bool woke = Sched_WakeWorkers();
+
+    for(int i = 0; i < ntasks; i++) {
+        jobs[i] = (struct bake_job){
+            .ctx = ctx,
+            .func = func,
+            .begin = MIN(nitems * i, nchunks),
+            .end = MIN(nitems * (i + 1), nchunks)
+        };
+        n_spawn(n_bake_task, &jobs[i], &jobs[i].future, &jobs[i].tid);
+    }
+
+    for(int i = 0; i < ntasks; i++) {
+        n_await(&jobs[i].future, jobs[i].tid);
+    }
+
+    if(woke) {
+        Sched_ParkWorkers();
+    }
+}
+
+static int n_region_index(const struct nav_private *priv, struct coord chunk)
+{
+    return IDX(chunk.r / REGION_CHUNKS, priv->region_w, chunk.c / REGION_CHUNKS);
+}
+
+static void n_mark_region_dirty(struct nav_private *priv, struct coord chunk)
+{
+    if(!priv->regions)
+        return;
+    priv->regions[n_region_index(priv, chunk)].dirty = true;
+}
+
+/* Every region is built by the task that is given its' top-left chunk. 
+ * Only the portals of the region's own chunks are written to. */
+static void n_bake_chunk_region(const struct bake_ctx *ctx, struct coord coord)
+{
+    if((coord.r % REGION_CHUNKS) || (coord.c % REGION_CHUNKS))
+        return;
+
+    int idx = n_region_index(ctx->priv, coord);
+    if(ctx->priv->regions[idx].dirty) {
+        AStar_BuildRegion(ctx->priv, idx);
+    }
+}
+
+static void n_update_dirty_regions(struct nav_private *priv)
+{
+    if(!priv->regions)
+        return;
+
+    bool dirty = false;
+    for(int i = 0; i < priv->region_w * priv->region_h; i++) {
+        dirty = dirty || priv->regions[i].dirty;
+    }
+    if(!dirty)
+        return;
+
+    PERF_ENTER();
+    struct bake_ctx ctx = {.priv = priv};
+    n_bake_parallel(&ctx, n_bake_chunk_region);
+    PERF_RETURN_VOID();
+}
+
+static void n_free_regions(struct nav_private *priv)
+{
+    if(!priv->regions)
+        return;
+
+    for(int i = 0; i < priv->region_w * priv->region_h; i++) {
+        free(priv->regions[i].nodes);
+        free(priv->regions[i].offsets);
+        free(priv->regions[i].edges);
+    }
+    free(priv->regions);
+    priv->regions = NULL;
+}
+
+/* The upper level of the portal graph is only needed when there are 
+ * regions to cross in between the source and the destination. */
+static void n_bake_regions(struct nav_private *priv)
+{
+    size_t region_w = (priv->width + REGION_CHUNKS - 1) / REGION_CHUNKS;
+    size_t region_h = (priv->height + REGION_CHUNKS - 1) / REGION_CHUNKS;
+
+    if(!priv->regions) {
+
+        if(region_w * region_h <= 1)
+            return;
+        priv->regions = calloc(region_w * region_h, sizeof(struct nav_region));
+        if(!priv->regions)
+            return;
+        priv->region_w = region_w;
+        priv->region_h = region_h;
+    }
+
+    for(int i = 0; i < priv->region_w * priv->region_h; i++) {
+        priv->regions[i].dirty = true;
+    }
+    n_update_dirty_regions(priv);
+}
+
+/* Bring the portals, the portal graph and the islands up to date with the 
+ * cost fields of the modified chunks. Changing the costs of a chunk can
+ * change the portals on all 4 of its' edges, which will also shift the 
+ * indices of the portals in the adjacent chunks. Everything else stays 
+ * as-is. */
+static void n_update_dirty_costs(struct nav_private *priv)
+{
+    if(kh_size(s_dirty_costs) == 0)
+        return;
+
+    n_pending_discard();
+
+    khash_t(coord) *affected = kh_init(coord);
+    if(!affected)
+        return;
+
+    for(int i = kh_begin(s_dirty_costs); i != kh_end(s_dirty_costs); i++) {
+
+        if(!kh_exist(s_dirty_costs, i))
+            continue;
+
+        uint32_t key = kh_key(s_dirty_costs, i);
+        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
+        struct nav_chunk *chunk = &priv->chunks[IDX(curr.r, priv->width, curr.c)];
+
+        N_FC_InvalidateGridPathsAtChunk(curr);
+        n_update_static_islands(chunk);
+
+        int ret;
+        kh_put(coord, affected, key, &ret);
+
+        for(int j = 0; j < ARR_SIZE(s_edge_order); j++) {
+
+            struct coord adj;
+            if(!n_edge_neighbour(priv, curr, s_edge_order[j], &adj))
+                continue;
+            kh_put(coord, affected, ((adj.r & 0xffff) << 16) | (adj.c & 0xffff), &ret);
+        }
+    }
+
+    for(int i = kh_begin(affected); i != kh_end(affected); i++) {
+
+        if(!kh_exist(affected, i))
+            continue;
+
+        uint32_t key = kh_key(affected, i);
+        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
+
+        N_FC_InvalidateAllThroughChunk(curr);
+        N_FC_InvalidateAllAtChunk(curr);
+        n_rebuild_chunk_portals(priv, curr);
+    }
+    priv->threats_dirty = true;
+
+    for(int i = kh_begin(affected); i != kh_end(affected); i++) {
+
+        if(!kh_exist(affected, i))
+            continue;
+
+        uint32_t key = kh_key(affected, i);
+        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
+
+        for(int j = 0; j < ARR_SIZE(s_edge_order); j++)
+            n_connect_edge_portals(priv, curr, s_edge_order[j]);
+    }
+
+    for(int i = kh_begin(affected); i != kh_end(affected); i++) {
+
+        if(!kh_exist(affected, i))
+            continue;
+
+        uint32_t key = kh_key(affected, i);
+        struct coord curr = (struct coord){ key >> 16, key & 0xffff };
+        struct nav_chunk *chunk = &priv->chunks[IDX(curr.r, priv->width, curr.c)];
+
+        n_link_chunk_portals(chunk, curr);
+        n_build_portal_travel_index(chunk);
+        n_update_local_islands(chunk);
+        n_update_edge_states(chunk);
+        n_mark_region_dirty(priv, curr);
+    }
+
+    n_update_components(priv);
+    n_update_dirty_regions(priv);
+    kh_destroy(coord, affected);
+
+    /* Keep the chunks dirty so that the islands will be re-labelled 
+     * at the next update */
+    if(!n_relabel_islands(priv, s_dirty_costs))
+        return;
+    kh_clear(coord, s_dirty_costs);
+}
+
+static void n_bake_portals(struct nav_private *priv)
+{
+    PERF_ENTER();
+    struct bake_ctx ctx = {.priv = priv};
+
+    n_bake_parallel(&ctx, n_bake_chunk_portals);
+
+    for(int r = 0; r < priv->height; r++) {
+    for(int c = 0; c < priv->width; c++) {
+        n_connect_edge_portals(priv, (struct coord){r, c}, EDGE_BOT);
+        n_connect_edge_portals(priv, (struct coord){r, c}, EDGE_RIGHT);
+    }}
+
+    n_bake_parallel(&ctx, n_bake_chunk_links);
+    n_bake_regions(priv);
+    PERF_RETURN_VOID();
+}
+
+static void n_bake_islands(struct nav_private *priv)
+{
+    PERF_ENTER();
+    struct bake_ctx ctx = {.priv = priv};
+
+    n_bake_parallel(&ctx, n_bake_chunk_islands);
+
+    /* Mark every chunk dirty so that the islands will be re-labelled 
+     * from scratch at the next update */
+    if(!n_relabel_islands(priv, NULL)) {
+        for(int r = 0; r < priv->height; r++) {
+        for(int c = 0; c < priv->width; c++) {
+            struct nav_chunk *chunk = &priv->chunks[IDX(r, priv->width, c)];
+            memset(chunk->islands, 0xff, sizeof(chunk->islands));
+            n_mark_cost_dirty((struct coord){r, c});
+        }}
+    }
+    PERF_RETURN_VOID();
+}
+
+static uint64_t n_hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for(int i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* In the baked data, the portal pointers are replaced by the global index 
+ * of the portal plus one, or by 0 for NULL. */
+static uintptr_t n_portal_to_index(const struct nav_private *priv, const struct portal *port)
+{
+    if(!port)
+        return 0;
+
+    const struct nav_chunk *chunk = &priv->chunks[IDX(port->chunk.r, priv->width, port->chunk.c)];
+    return IDX(port->chunk.r, priv->width, port->chunk.c) * MAX_PORTALS_PER_CHUNK 
+         + (port - chunk->portals) + 1;
+}
+
+static bool n_index_to_portal(struct nav_private *priv, uintptr_t idx, struct portal **out)
+{
+    if(idx == 0) {
+        *out = NULL;
+        return true;
+    }
+
+    size_t chunk_idx = (idx - 1) / MAX_PORTALS_PER_CHUNK;
+    size_t portal_idx = (idx - 1) % MAX_PORTALS_PER_CHUNK;
+    if(chunk_idx >= priv->width * priv->height)
+        return false;
+
+    struct nav_chunk *chunk = &priv->chunks[chunk_idx];
+    if(portal_idx >= chunk->num_portals)
+        return false;
+
+    *out = &chunk->portals[portal_idx];
+    return true;
+}
+
+static void n_swizzle_chunk(const struct nav_private *priv, struct nav_chunk *chunk)
+{
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        struct portal *port = &chunk->portals[i];
+        port->connected = (void*)n_portal_to_index(priv, port->connected);
+    }
+    chunk->portal_travel_costs = NULL;
+    chunk->travel_costs_capacity = 0;
+}
+
+static bool n_unswizzle_chunk(struct nav_private *priv, struct nav_chunk *chunk)
+{
+    if(chunk->num_portals > MAX_PORTALS_PER_CHUNK)
+        return false;
+
+    for(int i = 0; i < chunk->num_portals; i++) {
+
+        struct portal *port = &chunk->portals[i];
+        if(port->num_neighbours > ARR_SIZE(port->edges))
+            return false;
+
+        for(int j = 0; j < port->num_neighbours; j++) {
+            if(port->edges[j].neighbour >= chunk->num_portals)
+                return false;
+        }
+        if(!n_index_to_portal(priv, (uintptr_t)port->connected, &port->connected))
+            return false;
+    }
+    return true;
+}
+
+static bool n_flow_cache_mb_validate(const struct sval *new_val)
+{
+    if(new_val->type != ST_TYPE_INT)
+        return false;
+    return (new_val->as_int >= 1 && new_val->as_int <= MAX_FLOW_CACHE_MB);
+}
+
+static void n_flow_cache_mb_commit(const struct sval *new_val)
+{
+    N_FC_SetFlowCacheBudget((size_t)new_val->as_int * 1024 * 1024);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
 
 bool N_Init(void)
 {
+    /* Committing the setting sizes the flow field cache, so that a saved 
+     * budget takes effect before any memory is reserved for it */
+    ss_e status = Settings_Create((struct setting){
+        .name = "pf.game.flow_field_cache_mb",
+        .val = (struct sval) {
+            .type = ST_TYPE_INT,
+            .as_int = CONFIG_FLOW_CACHE_MB
+        },
+        .prio = 0,
+        .validate = n_flow_cache_mb_validate,
+        .commit = n_flow_cache_mb_commit,
+    });
+    assert(status == SS_OKAY);
+
     if(!N_FC_Init())
         return false;
 
     if((s_dirty_chunks = kh_init(coord)) == NULL)
         return false;
 
+    if((s_dirty_costs = kh_init(coord)) == NULL)
+        return false;
+
+    vec_req_init(&s_pending);
     return true;
 }
 
@@ -1263,6 +2502,8 @@ void N_Update(void *nav_private)
     struct nav_private *priv = nav_private;
     bool components_dirty = false;
 
+    n_update_dirty_costs(priv);
+
     for(int i = kh_begin(s_dirty_chunks); i != kh_end(s_dirty_chunks); i++) {
 
         if(!kh_exist(s_dirty_chunks, i))
@@ -1277,27 +2518,44 @@ void N_Update(void *nav_private)
 
         if(nflipped) {
             components_dirty = true;
+            priv->threats_dirty = true;
             N_FC_InvalidateAllThroughChunk(curr);
+            n_mark_region_dirty(priv, curr);
         }
     }
 
     n_update_dirty_local_islands(priv);
     if(components_dirty)
         n_update_components(priv);
+    n_update_dirty_regions(priv);
 
     kh_clear(coord, s_dirty_chunks);
+
+    n_pending_publish(priv);
+    s_nupdates++;
     PERF_RETURN_VOID();
 }
 
+void N_DiscardPendingPaths(void)
+{
+    n_pending_discard();
+}
+
 void N_Shutdown(void)
 {
+    n_pending_discard();
+    vec_req_destroy(&s_pending);
     kh_destroy(coord, s_dirty_chunks);
+    kh_destroy(coord, s_dirty_costs);
     N_FC_Shutdown();
+    AStar_Shutdown();
+    Sweep_Shutdown();
 }
 
 void *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
                         const struct tile **chunk_tiles, bool update)
 {
+    PERF_ENTER();
     struct nav_private *ret;
     size_t alloc_size = sizeof(struct nav_private) + (w * h * sizeof(struct nav_chunk));
 
@@ -1307,43 +2565,190 @@ void *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
 
     ret->width = w;
     ret->height = h;
+    ret->tile_costs = update;
+    ret->region_w = 0;
+    ret->region_h = 0;
+    ret->regions = NULL;
+    ret->chunk_factions = NULL;
+    ret->threat_maps = NULL;
+    ret->threats_dirty = false;
 
     assert(FIELD_RES_R >= chunk_h && FIELD_RES_R % chunk_h == 0);
     assert(FIELD_RES_C >= chunk_w && FIELD_RES_C % chunk_w == 0);
 
-    /* First build the base cost field based on terrain */
-    for(int chunk_r = 0; chunk_r < ret->height; chunk_r++){
-    for(int chunk_c = 0; chunk_c < ret->width;  chunk_c++){
+    /* First build the base cost field based on terrain. The chunks are 
+     * independent of one another, save for the matching of the portals 
+     * along the chunk borders, so the work is spread across the workers. */
+    struct bake_ctx ctx = {ret, chunk_tiles, chunk_w, chunk_h, update};
+    n_bake_parallel(&ctx, n_bake_chunk_costs);
 
-        struct nav_chunk *curr_chunk = &ret->chunks[IDX(chunk_r, ret->width, chunk_c)];
-        const struct tile *curr_tiles = chunk_tiles[IDX(chunk_r, ret->width, chunk_c)];
-        curr_chunk->num_portals = 0;
+    kh_clear(coord, s_dirty_costs);
+    n_pending_discard();
+    n_bake_portals(ret);
+    n_bake_islands(ret);
+    PERF_RETURN(ret);
 
-        for(int tile_r = 0; tile_r < chunk_h; tile_r++) {
-        for(int tile_c = 0; tile_c < chunk_w; tile_c++) {
+fail_alloc:
+    PERF_RETURN(NULL);
+}
 
-            if(update) {
-                const struct tile *curr_tile = &curr_tiles[tile_r * chunk_w + tile_c];
-                n_set_cost_for_tile(curr_chunk, chunk_w, chunk_h, tile_r, tile_c, curr_tile);
-            }else{
-                n_clear_cost_for_tile(curr_chunk, chunk_w, chunk_h, tile_r, tile_c);
-            }
-        }}
-        memset(curr_chunk->blockers, 0, sizeof(curr_chunk->blockers));
-    }}
+uint64_t N_BakeHash(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
+                    const struct tile **chunk_tiles, bool update)
+{
+    uint64_t ret = FNV_OFFSET_BASIS;
+    const uint64_t params[] = {BAKED_VER, w, h, chunk_w, chunk_h, update};
+    ret = n_hash_bytes(ret, params, sizeof(params));
 
-    n_make_cliff_edges(ret, chunk_tiles, chunk_w, chunk_h);
-    N_UpdatePortals(ret);
-    N_UpdateIslandsField(ret);
+    for(int i = 0; i < w * h; i++) {
+    for(int j = 0; j < chunk_w * chunk_h; j++) {
+
+        const struct tile *curr = &chunk_tiles[i][j];
+        const int32_t attrs[] = {
+            curr->pathable, curr->type, curr->base_height, curr->ramp_height
+        };
+        ret = n_hash_bytes(ret, attrs, sizeof(attrs));
+    }}
     return ret;
+}
+
+bool N_SaveBaked(const void *nav_private, uint64_t hash, SDL_RWops *stream)
+{
+    const struct nav_private *priv = nav_private;
+    struct baked_hdr hdr = {
+        .version = BAKED_VER,
+        .hash = hash,
+        .width = priv->width,
+        .height = priv->height,
+        .chunk_size = sizeof(struct nav_chunk),
+        .tile_costs = priv->tile_costs
+    };
+    memcpy(hdr.magic, BAKED_MAGIC, sizeof(hdr.magic));
+
+    if(!SDL_RWwrite(stream, &hdr, sizeof(hdr), 1))
+        goto fail_write;
+
+    struct nav_chunk *copy = malloc(sizeof(struct nav_chunk));
+    if(!copy)
+        goto fail_write;
+
+    for(int i = 0; i < priv->width * priv->height; i++) {
 
+        memcpy(copy, &priv->chunks[i], sizeof(struct nav_chunk));
+        n_swizzle_chunk(priv, copy);
+        if(!SDL_RWwrite(stream, copy, sizeof(struct nav_chunk), 1))
+            goto fail_chunk;
+    }
+
+    for(int i = 0; i < priv->width * priv->height; i++) {
+
+        const struct nav_chunk *chunk = &priv->chunks[i];
+        if(chunk->num_portals == 0)
+            continue;
+        if(chunk->num_portals > chunk->travel_costs_capacity)
+            goto fail_chunk;
+        if(!SDL_RWwrite(stream, chunk->portal_travel_costs, 
+            sizeof(chunk->portal_travel_costs[0]), chunk->num_portals))
+            goto fail_chunk;
+    }
+
+    free(copy);
+    return true;
+
+fail_chunk:
+    free(copy);
+fail_write:
+    return false;
+}
+
+void *N_LoadBaked(SDL_RWops *stream, uint64_t hash)
+{
+    PERF_ENTER();
+
+    struct baked_hdr hdr;
+    if(!SDL_RWread(stream, &hdr, sizeof(hdr), 1))
+        goto fail_hdr;
+    if(memcmp(hdr.magic, BAKED_MAGIC, sizeof(hdr.magic)))
+        goto fail_hdr;
+    if(hdr.version != BAKED_VER || hdr.hash != hash)
+        goto fail_hdr;
+    if(hdr.chunk_size != sizeof(struct nav_chunk))
+        goto fail_hdr;
+
+    size_t nchunks = hdr.width * hdr.height;
+    struct nav_private *ret = malloc(sizeof(struct nav_private) + nchunks * sizeof(struct nav_chunk));
+    if(!ret)
+        goto fail_alloc;
+
+    ret->width = hdr.width;
+    ret->height = hdr.height;
+    ret->tile_costs = hdr.tile_costs;
+    ret->region_w = 0;
+    ret->region_h = 0;
+    ret->regions = NULL;
+    ret->chunk_factions = NULL;
+    ret->threat_maps = NULL;
+    ret->threats_dirty = false;
+
+    if(SDL_RWread(stream, ret->chunks, sizeof(struct nav_chunk), nchunks) != nchunks)
+        goto fail_chunks;
+
+    /* The number of portals of every chunk must be known before 
+     * any of the portal pointers can be restored */
+    for(int i = 0; i < nchunks; i++) {
+        ret->chunks[i].portal_travel_costs = NULL;
+        ret->chunks[i].travel_costs_capacity = 0;
+    }
+    for(int i = 0; i < nchunks; i++) {
+        if(!n_unswizzle_chunk(ret, &ret->chunks[i]))
+            goto fail_costs;
+    }
+
+    for(int i = 0; i < nchunks; i++) {
+
+        struct nav_chunk *chunk = &ret->chunks[i];
+        if(chunk->num_portals == 0)
+            continue;
+
+        chunk->portal_travel_costs = malloc(chunk->num_portals * sizeof(chunk->portal_travel_costs[0]));
+        if(!chunk->portal_travel_costs)
+            goto fail_costs;
+        chunk->travel_costs_capacity = chunk->num_portals;
+
+        if(SDL_RWread(stream, chunk->portal_travel_costs, 
+            sizeof(chunk->portal_travel_costs[0]), chunk->num_portals) != chunk->num_portals)
+            goto fail_costs;
+    }
+
+    n_bake_regions(ret);
+    kh_clear(coord, s_dirty_costs);
+    n_pending_discard();
+    PERF_RETURN(ret);
+
+fail_costs:
+    for(int i = 0; i < nchunks; i++)
+        free(ret->chunks[i].portal_travel_costs);
+fail_chunks:
+    free(ret);
 fail_alloc:
-    return NULL;
+fail_hdr:
+    PERF_RETURN(NULL);
 }
 
 void N_FreePrivate(void *nav_private)
 {
     assert(nav_private);
+    struct nav_private *priv = nav_private;
+    n_pending_discard();
+    kh_clear(coord, s_dirty_costs);
+
+    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
+    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
+
+        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        free(curr_chunk->portal_travel_costs);
+    }}
+    n_free_regions(priv);
+    n_free_threat_maps(priv);
     free(nav_private);
 }
 
@@ -1418,7 +2823,7 @@ void N_RenderPathFlowField(void *nav_private, const struct map *map,
     ff_id_t field_id;
     if(!N_FC_GetDestFFMapping(id, (struct coord){chunk_r, chunk_c}, &field_id))
         return;
-    const struct flow_field *ff = N_FC_FlowFieldAt(field_id);
+    const struct flow_field *ff = N_FC_FlowFieldAcquire(field_id);
     if(!ff)
         return;
 
@@ -1434,8 +2839,9 @@ void N_RenderPathFlowField(void *nav_private, const struct map *map,
             square_x - square_x_len / 2.0f,
             square_z + square_z_len / 2.0f
         };
-        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[ff->field[r][c].dir_idx];
+        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[N_FlowDir(ff, r, c)];
     }}
+    N_FC_FlowFieldRelease(ff);
 
     size_t count = FIELD_RES_R * FIELD_RES_C;
     R_PushCmd((struct rcmd){
@@ -1467,7 +2873,7 @@ void N_RenderLOSField(void *nav_private, const struct map *map, mat4x4_t *chunk_
     if(!N_FC_ContainsLOSField(id, (struct coord){chunk_r, chunk_c}))
         return;
 
-    const struct LOS_field *lf = N_FC_LOSFieldAt(id, (struct coord){chunk_r, chunk_c});
+    const struct LOS_field *lf = N_FC_LOSFieldAcquire(id, (struct coord){chunk_r, chunk_c});
     if(!lf)
         return;
 
@@ -1490,6 +2896,7 @@ void N_RenderLOSField(void *nav_private, const struct map *map, mat4x4_t *chunk_
         *colors_base++ = lf->field[r][c].visible ? (vec3_t){1.0f, 1.0f, 0.0f}
                                                  : (vec3_t){0.0f, 0.0f, 0.0f};
     }}
+    N_FC_LOSFieldRelease(lf);
 
     assert(colors_base == colors_buff + ARR_SIZE(colors_buff));
     assert(corners_base == corners_buff + ARR_SIZE(corners_buff));
@@ -1528,16 +2935,20 @@ void N_RenderEnemySeekField(void *nav_private, const struct map *map,
     vec2_t *corners_base = corners_buff;
     vec3_t *colors_base = colors_buff; 
 
+    if(!priv->threat_maps || !priv->threat_maps[faction_id].version)
+        return;
+
     struct field_target target = (struct field_target){
         .type = TARGET_ENEMIES,
         .enemies.faction_id = faction_id,
+        .enemies.version = priv->threat_maps[faction_id].version[IDX(chunk_r, priv->width, chunk_c)],
         /* rest of the fields are unused */
     };
     ff_id_t ffid = N_FlowField_ID((struct coord){chunk_r, chunk_c}, target);
     if(!N_FC_ContainsFlowField(ffid))
         return;
 
-    const struct flow_field *ff = N_FC_FlowFieldAt(ffid);
+    const struct flow_field *ff = N_FC_FlowFieldAcquire(ffid);
     if(!ff)
         return;
 
@@ -1553,16 +2964,17 @@ void N_RenderEnemySeekField(void *nav_private, const struct map *map,
             square_x - square_x_len / 2.0f,
             square_z + square_z_len / 2.0f
         };
-        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[ff->field[r][c].dir_idx];
+        dirs_buff[r * FIELD_RES_C + c] = g_flow_dir_lookup[N_FlowDir(ff, r, c)];
 
         *corners_base++ = (vec2_t){square_x, square_z};
         *corners_base++ = (vec2_t){square_x, square_z + square_z_len};
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z + square_z_len};
         *corners_base++ = (vec2_t){square_x - square_x_len, square_z};
 
-        *colors_base++ = ff->field[r][c].dir_idx == FD_NONE ? (vec3_t){1.0f, 0.0f, 0.0f}
+        *colors_base++ = N_FlowDir(ff, r, c) == FD_NONE ? (vec3_t){1.0f, 0.0f, 0.0f}
                                                             : (vec3_t){0.0f, 1.0f, 0.0f};
     }}
+    N_FC_FlowFieldRelease(ff);
 
     assert(colors_base == colors_buff + ARR_SIZE(colors_buff));
     assert(corners_base == corners_buff + ARR_SIZE(corners_buff));
@@ -1739,7 +3151,7 @@ void N_RenderNavigationPortals(void *nav_private, const struct map *map,
 
         for(int j = 0; j < port->num_neighbours; j++) {
 
-            struct portal *neighb = port->edges[j].neighbour;
+            const struct portal *neighb = &chunk->portals[port->edges[j].neighbour];
             struct coord a = (struct coord){
                 (port->endpoints[0].r + port->endpoints[1].r) / 2,
                 (port->endpoints[0].c + port->endpoints[1].c) / 2,
@@ -1766,6 +3178,8 @@ void N_RenderNavigationPortals(void *nav_private, const struct map *map,
 void N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *obb)
 {
     struct nav_private *priv = nav_private;
+    n_pending_discard();
+
     struct map_resolution res = {
         priv->width, priv->height,
         FIELD_RES_C, FIELD_RES_R
@@ -1776,31 +3190,27 @@ void N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *o
 
     for(int i = 0; i < ntiles; i++) {
 
-        priv->chunks[IDX(tds[i].chunk_r, priv->width, tds[i].chunk_c)]
-            .cost_base[tds[i].tile_r][tds[i].tile_c] = COST_IMPASSABLE;
+        struct nav_chunk *chunk = &priv->chunks[IDX(tds[i].chunk_r, priv->width, tds[i].chunk_c)];
+        if(chunk->cost_base[tds[i].tile_r][tds[i].tile_c] != COST_IMPASSABLE)
+            n_mark_cost_dirty((struct coord){tds[i].chunk_r, tds[i].chunk_c});
+
+        chunk->cost_base[tds[i].tile_r][tds[i].tile_c] = COST_IMPASSABLE;
+        chunk->cutouts[tds[i].tile_r][tds[i].tile_c] = 1;
     }
 }
 
+void N_UpdateDirtyCosts(void *nav_private)
+{
+    PERF_ENTER();
+    n_update_dirty_costs(nav_private);
+    PERF_RETURN_VOID();
+}
+
 void N_UpdatePortals(void *nav_private)
 {
     struct nav_private *priv = nav_private;
-
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
-    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
-            
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-        curr_chunk->num_portals = 0;
-    }}
-    
-    n_create_portals(priv);
-
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++){
-    for(int chunk_c = 0; chunk_c < priv->width; chunk_c++){
-            
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-        n_link_chunk_portals(curr_chunk, (struct coord){chunk_r, chunk_c});
-        n_build_portal_travel_index(curr_chunk);
-    }}
+    n_pending_discard();
+    n_bake_portals(priv);
 }
 
 void N_UpdateIslandsField(void *nav_private)
@@ -1808,41 +3218,65 @@ void N_UpdateIslandsField(void *nav_private)
     /* We assign a unique ID to each set of tiles that are mutually connected
      * (i.e. are on the same 'island'). The tile's 'island ID' can then be 
      * queried from the 'islands' field using the coordinate. 
-     * To build the field, we treat every tile in the cost field as a node in
-     * a graph, with cardinally adjacent pathable tiles being the 'neighbors'. 
-     * Then we solve an instance of the 'coonected components' problem. 
+     * To build the field, we first solve the 'connected components' problem 
+     * within every chunk, treating the cardinally adjacent pathable tiles 
+     * as neighbours. Then the components touching across chunk borders are 
+     * joined to get the global islands.
      */
 
     struct nav_private *priv = nav_private;
-    uint16_t island_id = 0;
+    n_pending_discard();
+    n_bake_islands(priv);
+}
+
+void N_UpdateTile(void *nav_private, const struct tile_desc *desc, 
+                  const struct tile **chunk_tiles, size_t chunk_w, size_t chunk_h)
+{
+    struct nav_private *priv = nav_private;
+    if(!priv->tile_costs)
+        return;
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
-    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+    struct map_resolution res = {
+        priv->width, priv->height,
+        chunk_w, chunk_h
+    };
 
-        /* Initialize every node as 'unvisited' */
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
-        memset(curr_chunk->islands, 0xff, sizeof(curr_chunk->islands));
-    }}
+    /* The tile's height also determines if there are cliff edges on the 
+     * adjacent tiles */
+    struct coord deltas[] = {
+        { 0,  0},
+        { 0, -1},
+        { 0, +1},
+        {-1,  0},
+        {+1,  0},
+    };
 
-    for(int chunk_r = 0; chunk_r < priv->height; chunk_r++) {
-    for(int chunk_c = 0; chunk_c < priv->width;  chunk_c++) {
+    for(int i = 0; i < ARR_SIZE(deltas); i++) {
 
-        struct nav_chunk *curr_chunk = &priv->chunks[IDX(chunk_r, priv->width, chunk_c)];
+        struct tile_desc curr = *desc;
+        if(!M_Tile_RelativeDesc(res, &curr, deltas[i].c, deltas[i].r))
+            continue;
 
-        for(int tile_r = 0; tile_r < FIELD_RES_R; tile_r++) {
-        for(int tile_c = 0; tile_c < FIELD_RES_C; tile_c++) {
+        struct nav_chunk *chunk = &priv->chunks[IDX(curr.chunk_r, priv->width, curr.chunk_c)];
+        const struct tile *tile = &chunk_tiles[IDX(curr.chunk_r, priv->width, curr.chunk_c)]
+                                              [IDX(curr.tile_r, chunk_w, curr.tile_c)];
 
-            if(curr_chunk->islands[tile_r][tile_c] != ISLAND_NONE)
-                continue;
+        uint8_t prev[2][2];
+        for(int r = 0; r < 2; r++) {
+        for(int c = 0; c < 2; c++) {
+            prev[r][c] = chunk->cost_base[curr.tile_r * 2 + r][curr.tile_c * 2 + c];
+        }}
 
-            if(curr_chunk->cost_base[tile_r][tile_c] == COST_IMPASSABLE)
-                continue;
+        n_set_cost_for_tile(chunk, chunk_w, chunk_h, curr.tile_r, curr.tile_c, tile);
+        n_make_tile_cliff_edges(priv, chunk_tiles, chunk_w, chunk_h, curr);
+        n_apply_cutouts_for_tile(chunk, chunk_w, chunk_h, curr.tile_r, curr.tile_c);
 
-            struct tile_desc td = {chunk_r, chunk_c, tile_r, tile_c};
-            n_visit_island(priv, island_id, td);
-            island_id++;
+        for(int r = 0; r < 2; r++) {
+        for(int c = 0; c < 2; c++) {
+            if(prev[r][c] != chunk->cost_base[curr.tile_r * 2 + r][curr.tile_c * 2 + c])
+                n_mark_cost_dirty((struct coord){curr.chunk_r, curr.chunk_c});
         }}
-    }}
+    }
 }
 
 dest_id_t N_DestIDForPos(void *nav_private, vec3_t map_pos, vec2_t xz_pos)
@@ -1871,6 +3305,7 @@ bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
         FIELD_RES_C, FIELD_RES_R
     };
 
+    n_update_dirty_costs(nav_private);
     n_update_dirty_local_islands(nav_private);
 
     /* Convert source and destination positions to tile coordinates */
@@ -2015,8 +3450,9 @@ bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
             /* This is the edge case when a path to a particular target takes us through
              * the same chunk more than once. This can happen if a chunk is divided into
              * 'islands' by unpathable barriers. */
-            const struct flow_field *exist_ff  = N_FC_FlowFieldAt(exist_id);
+            const struct flow_field *exist_ff  = N_FC_FlowFieldAcquire(exist_id);
             memcpy(&ff, exist_ff, sizeof(struct flow_field));
+            N_FC_FlowFieldRelease(exist_ff);
 
             N_FlowFieldUpdate(chunk_coord, priv, target, &ff);
             /* We set the updated flow field for the new (least recently used) key. Since in 
@@ -2040,19 +3476,20 @@ bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
     ff_exists:
         assert(N_FC_ContainsFlowField(new_id));
         /* Reference field in the cache */
-        (void)N_FC_FlowFieldAt(new_id);
+        N_FC_FlowFieldRelease(N_FC_FlowFieldAcquire(new_id));
 
         if(!N_FC_ContainsLOSField(ret, chunk_coord)) {
 
             assert((abs(prev_los_coord.r - chunk_coord.r) + abs(prev_los_coord.c - chunk_coord.c)) == 1);
             assert(N_FC_ContainsLOSField(ret, prev_los_coord));
 
-            const struct LOS_field *prev_los = N_FC_LOSFieldAt(ret, prev_los_coord);
+            const struct LOS_field *prev_los = N_FC_LOSFieldAcquire(ret, prev_los_coord);
             assert(prev_los);
             assert(prev_los->chunk.r == prev_los_coord.r && prev_los->chunk.c == prev_los_coord.c);
 
             struct LOS_field lf;
             N_LOSFieldCreate(ret, chunk_coord, dst_desc, priv, map_pos, &lf, prev_los);
+            N_FC_LOSFieldRelease(prev_los);
             N_FC_PutLOSField(ret, chunk_coord, &lf);
         }
 
@@ -2064,6 +3501,270 @@ bool N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
     PERF_RETURN(true);
 }
 
+bool N_RequestAsyncPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                        vec3_t map_pos, dest_id_t *out_dest_id)
+{
+    PERF_ENTER();
+    ASSERT_IN_MAIN_THREAD();
+
+    struct nav_private *priv = nav_private;
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    n_update_dirty_costs(nav_private);
+    n_update_dirty_local_islands(nav_private);
+
+    bool result;
+    (void)result;
+
+    struct tile_desc src_desc, dst_desc;
+    result = M_Tile_DescForPoint2D(res, map_pos, xz_src, &src_desc);
+    assert(result);
+    result = M_Tile_DescForPoint2D(res, map_pos, xz_dest, &dst_desc);
+    assert(result);
+
+    dest_id_t ret = n_dest_id(dst_desc);
+    struct coord dst_chunk_coord = (struct coord){dst_desc.chunk_r, dst_desc.chunk_c};
+
+    const struct nav_chunk *src_chunk = &priv->chunks[src_desc.chunk_r * priv->width + src_desc.chunk_c];
+    const struct nav_chunk *dst_chunk = &priv->chunks[dst_desc.chunk_r * priv->width + dst_desc.chunk_c];
+    uint16_t src_iid = src_chunk->islands[src_desc.tile_r][src_desc.tile_c];
+    uint16_t dst_iid = dst_chunk->islands[dst_desc.tile_r][dst_desc.tile_c];
+
+    if(src_iid != dst_iid)
+        PERF_RETURN(false); 
+
+    struct path_request *req = malloc(sizeof(struct path_request));
+    if(!req)
+        goto sync;
+
+    req->dest_id = ret;
+    req->dst_desc = dst_desc;
+    req->res = res;
+    req->map_pos = map_pos;
+    req->submitted = s_nupdates;
+    req->stale = false;
+    req->los_tid = NULL_TID;
+    vec_snap_init(&req->snapshots);
+    vec_fjob_init(&req->jobs);
+    vec_ljob_init(&req->los);
+
+    /* The fields that are already cached are not rebuilt, but the mappings 
+     * to them are added right away. */
+    ff_id_t id;
+    if(!N_FC_GetDestFFMapping(ret, dst_chunk_coord, &id)
+    || !N_FC_ContainsFlowField(id)) {
+
+        struct field_target target = (struct field_target){
+            .type = TARGET_TILE,
+            .tile = (struct coord){dst_desc.tile_r, dst_desc.tile_c}
+        };
+        id = N_FlowField_ID(dst_chunk_coord, target);
+
+        if(N_FC_ContainsFlowField(id)) {
+            N_FC_PutDestFFMapping(ret, dst_chunk_coord, id);
+        }else if(!n_request_add_field(req, priv, dst_chunk_coord, target, id, 
+            n_tile_center(res, map_pos, dst_desc))) {
+            goto fail_sync;
+        }
+    }
+
+    if(!N_FC_ContainsLOSField(ret, dst_chunk_coord)
+    && !n_request_add_los(req, priv, dst_chunk_coord, NULL))
+        goto fail_sync;
+
+    if(src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c
+    && src_chunk->local_islands[src_desc.tile_r][src_desc.tile_c] == src_chunk->local_islands[dst_desc.tile_r][dst_desc.tile_c])
+        goto submit;
+
+    if((src_desc.chunk_r == dst_desc.chunk_r && src_desc.chunk_c == dst_desc.chunk_c)
+    && n_normally_reachable(src_chunk, 
+        (struct coord){src_desc.tile_r, src_desc.tile_c},
+        (struct coord){dst_desc.tile_r, dst_desc.tile_c}))
+        goto submit;
+
+    const struct portal *dst_port = n_closest_reachable_portal(dst_chunk, 
+        (struct coord){dst_desc.tile_r, dst_desc.tile_c});
+    if(!dst_port)
+        goto fail;
+
+    float cost;
+    vec_portal_t path;
+    vec_portal_init(&path);
+
+    bool path_exists = AStar_PortalGraphPath(src_desc, dst_port, priv, &path, &cost);
+    if(!path_exists) {
+        vec_portal_destroy(&path);
+        goto fail;
+    }
+
+    /* Walk the path in the same way as 'N_RequestPath', but defer building 
+     * the missing fields to the tasks. */
+    struct coord prev_los_coord = dst_chunk_coord;
+    for(int i = vec_size(&path)-1; i > 0; i--) {
+
+        const struct portal *curr_node = vec_AT(&path, i - 1);
+        const struct portal *next_hop = vec_AT(&path, i);
+
+        if(i == 1 && (next_hop->chunk.r != src_desc.chunk_r || next_hop->chunk.c != src_desc.chunk_c))
+            next_hop = vec_AT(&path, 0);
+
+        if(curr_node->connected == next_hop)
+            continue;
+
+        if(curr_node->chunk.r == dst_desc.chunk_r 
+        && curr_node->chunk.c == dst_desc.chunk_c
+        && next_hop == dst_port)
+            continue;
+
+        struct coord chunk_coord = curr_node->chunk;
+        struct field_target target = (struct field_target){
+            .type = TARGET_PORTAL,
+            .port = next_hop
+        };
+
+        ff_id_t new_id = N_FlowField_ID(chunk_coord, target);
+        ff_id_t exist_id;
+
+        /* A path that takes us through the same chunk more than once needs 
+         * the fields to be merged. This is rare enough to be done synchronously. */
+        if(n_request_has_field(req, chunk_coord)) {
+            vec_portal_destroy(&path);
+            goto fail_sync;
+        }
+
+        if(N_FC_GetDestFFMapping(ret, chunk_coord, &exist_id)
+        && N_FC_ContainsFlowField(exist_id)) {
+
+            if(new_id != exist_id) {
+                vec_portal_destroy(&path);
+                goto fail_sync;
+            }
+            N_FC_FlowFieldRelease(N_FC_FlowFieldAcquire(new_id));
+
+        }else if(N_FC_ContainsFlowField(new_id)) {
+
+            N_FC_PutDestFFMapping(ret, chunk_coord, new_id);
+
+        }else if(!n_request_add_field(req, priv, chunk_coord, target, new_id, 
+            n_portal_center(res, map_pos, next_hop))) {
+
+            vec_portal_destroy(&path);
+            goto fail_sync;
+        }
+
+        if(!N_FC_ContainsLOSField(ret, chunk_coord)
+        && n_request_los_idx(req, chunk_coord) == -1) {
+
+            assert((abs(prev_los_coord.r - chunk_coord.r) + abs(prev_los_coord.c - chunk_coord.c)) == 1);
+            if(!n_request_add_los(req, priv, chunk_coord, &prev_los_coord)) {
+                vec_portal_destroy(&path);
+                goto fail_sync;
+            }
+        }
+
+        prev_los_coord = chunk_coord;
+    }
+    vec_portal_destroy(&path);
+
+submit:
+    if(vec_size(&req->jobs) == 0 && vec_size(&req->los) == 0) {
+        n_request_free(req);
+    }else if(vec_req_push(&s_pending, req)) {
+        n_request_submit(req);
+    }else{
+        goto fail_sync;
+    }
+
+    *out_dest_id = ret;
+    PERF_RETURN(true);
+
+fail:
+    n_request_free(req);
+    PERF_RETURN(false);
+
+fail_sync:
+    n_request_free(req);
+sync:;
+    bool ok = N_RequestPath(nav_private, xz_src, xz_dest, map_pos, out_dest_id);
+    PERF_RETURN(ok);
+}
+
+void N_EnsurePointSeekFields(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
+                             void *nav_private, vec3_t map_pos)
+{
+    struct nav_private *priv = nav_private;
+
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    struct tile_desc tile;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &tile);
+    assert(result);
+
+    ff_id_t ffid;
+    vec2_t steer_xz;
+    struct coord chunk_coord = (struct coord){tile.chunk_r, tile.chunk_c};
+
+    if(N_FC_GetDestFFMapping(id, chunk_coord, &ffid))
+        return;
+    if(n_pending_steer(id, chunk_coord, &steer_xz))
+        return;
+
+    dest_id_t ret;
+    if(!N_RequestAsyncPath(nav_private, curr_pos, xz_dest, map_pos, &ret))
+        return;
+    assert(ret == id);
+
+    if(n_pending_steer(id, chunk_coord, &steer_xz))
+        return;
+    if(!N_FC_GetDestFFMapping(id, chunk_coord, &ffid))
+        N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
+}
+
+bool N_SamplePointSeekVelocity(dest_id_t id, vec2_t curr_pos, void *nav_private, 
+                               vec3_t map_pos, vec2_t *out)
+{
+    struct nav_private *priv = nav_private;
+
+    struct map_resolution res = {
+        priv->width, priv->height,
+        FIELD_RES_C, FIELD_RES_R
+    };
+
+    struct tile_desc tile;
+    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &tile);
+    assert(result);
+
+    ff_id_t ffid;
+    struct coord chunk_coord = (struct coord){tile.chunk_r, tile.chunk_c};
+
+    if(!N_FC_GetDestFFMapping(id, chunk_coord, &ffid)) {
+
+        vec2_t steer_xz;
+        if(!n_pending_steer(id, chunk_coord, &steer_xz))
+            return false;
+        *out = n_seek_velocity(curr_pos, steer_xz);
+        return true;
+    }
+
+    const struct flow_field *ff = N_FC_FlowFieldAcquire(ffid);
+    if(!ff)
+        return false;
+
+    unsigned dir_idx = N_FlowDir(ff, tile.tile_r, tile.tile_c);
+    N_FC_FlowFieldRelease(ff);
+
+    if(dir_idx == FD_NONE)
+        return false;
+    *out = g_flow_dir_lookup[dir_idx];
+    return true;
+}
+
 vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
                                   void *nav_private, vec3_t map_pos)
 {
@@ -2080,18 +3781,37 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
     assert(result);
 
     ff_id_t ffid;
-    if(!N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid)) {
+    struct coord chunk_coord = (struct coord){tile.chunk_r, tile.chunk_c};
+
+    if(!N_FC_GetDestFFMapping(id, chunk_coord, &ffid)) {
+
+        /* Until the fields are built, head straight for the portal 
+         * leading out of the current chunk */
+        vec2_t steer_xz;
+        if(n_pending_steer(id, chunk_coord, &steer_xz))
+            return n_seek_velocity(curr_pos, steer_xz);
 
         dest_id_t ret;
-        bool result = N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
+        bool result = N_RequestAsyncPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
         if(!result)
             return (vec2_t){0.0f};
         assert(ret == id);
-        N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid);
+
+        if(n_pending_steer(id, chunk_coord, &steer_xz))
+            return n_seek_velocity(curr_pos, steer_xz);
+
+        if(!N_FC_GetDestFFMapping(id, chunk_coord, &ffid)) {
+            result = N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
+            if(!result)
+                return (vec2_t){0.0f};
+            N_FC_GetDestFFMapping(id, chunk_coord, &ffid);
+        }
     }
 
-    const struct flow_field *ff = N_FC_FlowFieldAt(ffid);
-    if(!ff || ff->field[tile.tile_r][tile.tile_c].dir_idx == FD_NONE) {
+    const struct flow_field *ff = N_FC_FlowFieldAcquire(ffid);
+    if(!ff || N_FlowDir(ff, tile.tile_r, tile.tile_c) == FD_NONE) {
+
+        N_FC_FlowFieldRelease(ff);
 
         dest_id_t ret;
         bool result = N_RequestPath(nav_private, curr_pos, xz_dest, map_pos, &ret);
@@ -2099,9 +3819,8 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
             return (vec2_t){0.0f};
         assert(ret == id);
         N_FC_GetDestFFMapping(id, (struct coord){tile.chunk_r, tile.chunk_c}, &ffid);
+        ff = N_FC_FlowFieldAcquire(ffid);
     }
-
-    ff = N_FC_FlowFieldAt(ffid);
     assert(ff);
 
     /*   1. The original path took us through another global 'island' in
@@ -2110,7 +3829,7 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
      *      would have updated the flow field with a valid direction for
      *      the current tile.
      */
-    if(ff->field[tile.tile_r][tile.tile_c].dir_idx != FD_NONE)
+    if(N_FlowDir(ff, tile.tile_r, tile.tile_c) != FD_NONE)
         goto ff_found;
 
     const struct nav_chunk *chunk = &priv->chunks[IDX(tile.chunk_r, priv->width, tile.chunk_c)];
@@ -2124,9 +3843,10 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
     if(local_iid == ISLAND_NONE) {
 
         struct flow_field exist_ff = *ff;
+        N_FC_FlowFieldRelease(ff);
         N_FlowFieldUpdateToNearestPathable(chunk, (struct coord){tile.tile_r, tile.tile_c}, &exist_ff);
         N_FC_PutFlowField(ffid, &exist_ff);
-        ff = N_FC_FlowFieldAt(ffid);
+        ff = N_FC_FlowFieldAcquire(ffid);
         goto ff_found;
     }
 
@@ -2137,6 +3857,7 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
      *      due to blockers).
      */
     struct flow_field exist_ff = *ff;
+    N_FC_FlowFieldRelease(ff);
     N_FlowFieldUpdateIslandToNearest(local_iid, priv, &exist_ff);
     N_FC_PutFlowField(ffid, &exist_ff);
 
@@ -2145,149 +3866,155 @@ vec2_t N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest,
      *      We have nothing left to do but pass the 'None' direction
      *      to the caller.
      */
-    ff = N_FC_FlowFieldAt(ffid);
+    ff = N_FC_FlowFieldAcquire(ffid);
 
 ff_found:
     assert(ff);
-    dir_idx = ff->field[tile.tile_r][tile.tile_c].dir_idx;
+    dir_idx = N_FlowDir(ff, tile.tile_r, tile.tile_c);
+    N_FC_FlowFieldRelease(ff);
     return g_flow_dir_lookup[dir_idx];
 }
 
-vec2_t N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, vec3_t map_pos, int faction_id)
+void N_UpdateThreatMaps(void *nav_private, vec3_t map_pos, size_t nents,
+                        const vec2_t *xz_positions, const int *faction_ids)
 {
+    PERF_ENTER();
+
     struct nav_private *priv = nav_private;
     struct map_resolution res = {
         priv->width, priv->height,
         FIELD_RES_C, FIELD_RES_R
     };
+    size_t nchunks = priv->width * priv->height;
 
-    struct tile_desc curr_tile;
-    bool result = M_Tile_DescForPoint2D(res, map_pos, curr_pos, &curr_tile);
-    assert(result);
-
-    struct coord chunk = (struct coord){curr_tile.chunk_r, curr_tile.chunk_c};
+    if(!priv->threat_maps) {
 
-    struct field_target target = (struct field_target){
-        .type = TARGET_ENEMIES,
-        .enemies.faction_id = faction_id,
-        .enemies.map_pos = map_pos,
-        .enemies.chunk = chunk
-    };
-
-    ff_id_t ffid = N_FlowField_ID(chunk, target);
-    struct flow_field ff;
+        priv->threat_maps = calloc(MAX_FACTIONS, sizeof(struct threat_map));
+        priv->chunk_factions = calloc(nchunks, sizeof(uint16_t));
+        if(!priv->threat_maps || !priv->chunk_factions) {
+            n_free_threat_maps(priv);
+            PERF_RETURN_VOID();
+        }
+    }
 
-    if(!N_FC_ContainsFlowField(ffid)) {
+    uint16_t *prev_factions = malloc(nchunks * sizeof(uint16_t));
+    uint16_t *dist = malloc(nchunks * sizeof(uint16_t));
+    struct threat_node *queue = malloc(nchunks * MAX_PORTALS_PER_CHUNK * sizeof(struct threat_node));
+    bool *visited = malloc(nchunks * MAX_PORTALS_PER_CHUNK * sizeof(bool));
+    if(!prev_factions || !dist || !queue || !visited)
+        goto out;
 
-        vec2_t chunk_center = (vec2_t){
-            map_pos.x - (chunk.c + 0.5f) * X_COORDS_PER_TILE * TILES_PER_CHUNK_WIDTH,
-            map_pos.z + (chunk.r + 0.5f) * Z_COORDS_PER_TILE * TILES_PER_CHUNK_HEIGHT,
-        };
-        struct entity *nearest_enemy = G_Pos_NearestWithPred(chunk_center, enemy_ent, 
-                                                             (void*)(uintptr_t)target.enemies.faction_id, 0.0f);
-        if(!nearest_enemy)
-            return (vec2_t){0.0f, 0.0f};
+    memcpy(prev_factions, priv->chunk_factions, nchunks * sizeof(uint16_t));
+    memset(priv->chunk_factions, 0, nchunks * sizeof(uint16_t));
 
-        struct tile_desc target_tile;
-        bool result = M_Tile_DescForPoint2D(res, map_pos, G_Pos_GetXZ(nearest_enemy->uid), &target_tile);
-        assert(result);
-        bool done = false;
+    for(int i = 0; i < nents; i++) {
 
-        /* If there are enemies on this chunk, guide towards them. 
-         */
-        if(target_tile.chunk_r == curr_tile.chunk_r
-        && target_tile.chunk_c == curr_tile.chunk_c) {
-        
-            N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, target, &ff);
-            N_FC_PutFlowField(ffid, &ff);
-            done = true;
-        }
+        struct tile_desc td;
+        if(!M_Tile_DescForPoint2D(res, map_pos, xz_positions[i], &td))
+            continue;
+        priv->chunk_factions[IDX(td.chunk_r, priv->width, td.chunk_c)] |= (0x1 << faction_ids[i]);
+    }
 
-        /* Else, if there are enemies on the cardinally adjacent chunks, guide
-         * towards all portals that will lead to them. 
-         */
-        uint64_t pm = n_enemy_seek_portalmask(priv, map_pos, chunk, faction_id);
-        if(!done && pm) {
+    uint16_t factions = G_GetFactions(NULL, NULL, NULL);
+    for(int i = 0; i < MAX_FACTIONS; i++) {
 
-            struct field_target pm_target = (struct field_target){
-                .type = TARGET_PORTALMASK,
-                .portalmask = pm,
-            };
+        if(!(factions & (0x1 << i)))
+            continue;
 
-            N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, pm_target, &ff);
-            N_FC_PutFlowField(ffid, &ff);
-            done = true;
-        }
+        uint16_t enemies = G_GetEnemyFactions(i);
+        struct threat_map *tm = &priv->threat_maps[i];
+        if(!tm->dist && !n_threat_map_init(tm, nchunks))
+            continue;
+        n_threat_map_update(priv, tm, enemies, prev_factions, 
+            priv->threats_dirty, queue, visited, dist);
+    }
+    priv->threats_dirty = false;
 
-        /* Lastly, resort towards pathing towards the closest entity 
-         */
-        if(!done) {
+out:
+    free(prev_factions);
+    free(dist);
+    free(queue);
+    free(visited);
+    PERF_RETURN_VOID();
+}
 
-            assert(target_tile.chunk_r != curr_tile.chunk_r || target_tile.chunk_c != curr_tile.chunk_c);
+void N_EnsureEnemySeekField(vec2_t curr_pos, void *nav_private, vec3_t map_pos, int faction_id)
+{
+    struct nav_private *priv = nav_private;
+    struct tile_desc curr_tile;
+    struct field_target target;
 
-            /* The closest enemy is in another chunk. In this case, compute the
-             * field that will take us to the next chunk in the path and store
-             * that with the computed ID as the key. The rest of the fields will
-             * be computed on-the-fly, if necessary.
-             */
-            struct nav_chunk *target_chunk = &priv->chunks[IDX(target_tile.chunk_r, priv->width, target_tile.chunk_c)];
-            const struct portal *dst_port = n_closest_reachable_portal(target_chunk, 
-                (struct coord){target_tile.tile_r, target_tile.tile_c});
+    if(!n_enemy_seek_target(priv, map_pos, curr_pos, faction_id, &curr_tile, &target))
+        return;
+    n_enemy_seek_field(priv, target);
+}
 
-            if(!dst_port)
-                return (vec2_t){0.0f, 0.0f};
+bool N_SampleEnemySeekVelocity(vec2_t curr_pos, void *nav_private, vec3_t map_pos, 
+                               int faction_id, vec2_t *out)
+{
+    struct nav_private *priv = nav_private;
+    struct tile_desc curr_tile;
+    struct field_target target;
 
-            float cost;
-            vec_portal_t path;
-            vec_portal_init(&path);
+    if(!n_enemy_seek_target(priv, map_pos, curr_pos, faction_id, &curr_tile, &target)) {
+        *out = (vec2_t){0.0f, 0.0f};
+        return true;
+    }
 
-            bool path_exists = AStar_PortalGraphPath(curr_tile, dst_port, priv, &path, &cost);
-            if(!path_exists) {
-                vec_portal_destroy(&path);
-                return (vec2_t){0.0f, 0.0f}; 
-            }
+    ff_id_t ffid = N_FlowField_ID(target.enemies.chunk, target);
+    const struct flow_field *pff = N_FC_FlowFieldAcquire(ffid);
+    if(!pff)
+        return false;
 
-            struct field_target portal_target = (struct field_target){
-                .type = TARGET_PORTAL,
-                .port = vec_AT(&path, 0)
-            };
+    int dir_idx = N_FlowDir(pff, curr_tile.tile_r, curr_tile.tile_c);
+    N_FC_FlowFieldRelease(pff);
 
-            N_FlowFieldInit(chunk, priv, &ff);
-            N_FlowFieldUpdate(chunk, priv, portal_target, &ff);
-            N_FC_PutFlowField(ffid, &ff);
+    if(dir_idx == FD_NONE)
+        return false;
+    *out = g_flow_dir_lookup[dir_idx];
+    return true;
+}
 
-            vec_portal_destroy(&path);
-        }
+vec2_t N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, vec3_t map_pos, int faction_id)
+{
+    struct nav_private *priv = nav_private;
+    struct tile_desc curr_tile;
+    struct field_target target;
 
-        assert(N_FC_ContainsFlowField(ffid));
-    }
+    if(!n_enemy_seek_target(priv, map_pos, curr_pos, faction_id, &curr_tile, &target))
+        return (vec2_t){0.0f, 0.0f};
 
-    const struct flow_field *pff = N_FC_FlowFieldAt(ffid);
+    ff_id_t ffid = n_enemy_seek_field(priv, target);
+    const struct flow_field *pff = N_FC_FlowFieldAcquire(ffid);
     assert(pff);
 
-    int dir_idx = pff->field[curr_tile.tile_r][curr_tile.tile_c].dir_idx;
+    int dir_idx = N_FlowDir(pff, curr_tile.tile_r, curr_tile.tile_c);
     if(dir_idx == FD_NONE) {
 
         const struct nav_chunk *nchunk = &priv->chunks[IDX(curr_tile.chunk_r, priv->width, curr_tile.chunk_c)];
         uint16_t local_iid = nchunk->local_islands[curr_tile.tile_r][curr_tile.tile_c];
 
         struct flow_field exist_ff = *pff;
+        N_FC_FlowFieldRelease(pff);
+        pff = NULL;
         N_FlowFieldUpdateIslandToNearest(local_iid, priv, &exist_ff);
         N_FC_PutFlowField(ffid, &exist_ff);
 
-        dir_idx = exist_ff.field[curr_tile.tile_r][curr_tile.tile_c].dir_idx;
+        dir_idx = N_FlowDir(&exist_ff, curr_tile.tile_r, curr_tile.tile_c);
     }
 
+    N_FC_FlowFieldRelease(pff);
     return g_flow_dir_lookup[dir_idx];
 }
 
 bool N_HasEntityLOS(vec2_t curr_pos, const struct entity *ent, void *nav_private, vec3_t map_pos)
 {
     vec2_t ent_pos = G_Pos_GetXZ(ent->uid);
-    bool result;
+    return N_HasLOSBetween(curr_pos, ent_pos, nav_private, map_pos);
+}
 
+bool N_HasLOSBetween(vec2_t curr_pos, vec2_t ent_pos, void *nav_private, vec3_t map_pos)
+{
     struct nav_private *priv = nav_private;
     struct map_resolution res = {
         priv->width, priv->height,
@@ -2324,9 +4051,11 @@ bool N_HasDestLOS(dest_id_t id, vec2_t curr_pos, void *nav_private, vec3_t map_p
     if(!N_FC_ContainsLOSField(id, (struct coord){tile.chunk_r, tile.chunk_c}))
         return false;
 
-    const struct LOS_field *lf = N_FC_LOSFieldAt(id, (struct coord){tile.chunk_r, tile.chunk_c});
+    const struct LOS_field *lf = N_FC_LOSFieldAcquire(id, (struct coord){tile.chunk_r, tile.chunk_c});
     assert(lf);
-    return lf->field[tile.tile_r][tile.tile_c].visible;
+    bool ret = lf->field[tile.tile_r][tile.tile_c].visible;
+    N_FC_LOSFieldRelease(lf);
+    return ret;
 }
 
 bool N_PositionPathable(vec2_t xz_pos, void *nav_private, vec3_t map_pos)
@@ -2526,6 +4255,18 @@ bool N_PortalReachableFromTile(const struct portal *port, struct coord tile, con
     return false;
 }
 
+float N_PortalTravelCost(const struct nav_chunk *chunk, int portal_idx, struct coord tile)
+{
+    assert(portal_idx < chunk->num_portals);
+    if(portal_idx >= chunk->travel_costs_capacity)
+        return FLT_MAX;
+
+    uint16_t cost = chunk->portal_travel_costs[portal_idx][tile.r][tile.c];
+    if(cost == PORTAL_COST_NONE)
+        return FLT_MAX;
+    return ((float)cost) / PORTAL_COST_SCALE;
+}
+
 int N_GridNeighbours(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord coord, 
                      struct coord out_neighbours[static 8], float out_costs[static 8])
 {
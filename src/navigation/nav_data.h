@@ -38,12 +38,28 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #define MAX_PORTALS_PER_CHUNK 64
 #define FIELD_RES_R           64
 #define FIELD_RES_C           64
 #define COST_IMPASSABLE       0xff
 #define ISLAND_NONE           0xffff
+/* Portal travel costs are stored in fixed point, with this 
+ * many steps per unit of cost. */
+#define PORTAL_COST_SCALE     8
+#define PORTAL_COST_MAX       0xfffe
+#define PORTAL_COST_NONE      0xffff
+/* The chunks are grouped into square regions, this many chunks 
+ * on a side, which make up the upper level of the portal graph. */
+#define REGION_CHUNKS         8
+#define REGION_NODE_NONE      0xffff
+#define THREAT_NONE           0xffff
+
+/* The version must be bumped whenever the layout of the baked 
+ * navigation data changes */
+#define BAKED_MAGIC           "PFNV"
+#define BAKED_VER             3
 
 struct coord{
     int r, c;
@@ -54,9 +70,11 @@ enum edge_state{
     EDGE_STATE_BLOCKED,
 };
 
+/* The edges only ever link portals of the same chunk, so the neighbour 
+ * is stored as an index into the chunk's 'portals' array. */
 struct edge{
-    enum edge_state es;
-    struct portal  *neighbour;
+    uint8_t         es;         /* enum edge_state */
+    uint8_t         neighbour;
     /* Cost of moving from the center of one portal to the center
      * of the next. */
     float           cost;
@@ -73,6 +91,9 @@ struct portal{
     size_t            num_neighbours;
     struct edge       edges[MAX_PORTALS_PER_CHUNK-1];
     struct portal    *connected;
+    /* The index of the portal in its' region's 'nodes' array, or 
+     * REGION_NODE_NONE if it is not on the border of the region. */
+    uint16_t          region_node;
 };
 
 struct nav_chunk{
@@ -82,11 +103,19 @@ struct nav_chunk{
      * cost may never be reached.
      */
     uint8_t         cost_base[FIELD_RES_R][FIELD_RES_C]; 
+    /* Non-zero for the tiles which have been made impassable by a static
+     * object being cut out of the cost field. These must stay impassable
+     * when the 'cost_base' of the tile is derived from the terrain again.
+     */
+    uint8_t         cutouts[FIELD_RES_R][FIELD_RES_C];
     /* Holds the cost to travel from every tile to every portal,
-     * when the portal is reachable from the tile. This field is 
-     * synchronized with the 'cost_base' field.
+     * or PORTAL_COST_NONE when the portal is not reachable from 
+     * the tile. There is one field for each of the chunk's portals, 
+     * allocated on the heap. This field is synchronized with the 
+     * 'cost_base' field.
      */
-    float           portal_travel_costs[MAX_PORTALS_PER_CHUNK][FIELD_RES_R][FIELD_RES_C];
+    uint16_t      (*portal_travel_costs)[FIELD_RES_R][FIELD_RES_C];
+    size_t          travel_costs_capacity;
     /* Every tile in the 'blockers' holds a reference count for
      * how many stationary entities are currently 'retaining' that 
      * tile by being positioned on it. 'Blocked' tiles are treated 
@@ -100,6 +129,16 @@ struct nav_chunk{
      * (shared by all chunks)
      */
     uint16_t        islands[FIELD_RES_R][FIELD_RES_C];
+    /* The 'islands' field is derived from chunk-local island IDs which 
+     * do not account for the blockers or the rest of the map. The global 
+     * ID of every local island is found by joining the local islands 
+     * which touch across chunk borders. This way, a change to the cost
+     * field of one chunk only requires re-labelling the tiles of chunks
+     * whose islands were actually merged or split.
+     */
+    uint16_t        static_islands[FIELD_RES_R][FIELD_RES_C];
+    size_t          num_static_islands;
+    uint16_t        static_island_ids[FIELD_RES_R * FIELD_RES_C / 2];
     /* This field uses chunk-local island IDs and accounts for
      * the blockers, but does not account for any part of the
      * map outside the local chunk. This field is synchronized
@@ -111,4 +150,61 @@ struct nav_chunk{
     uint16_t        local_islands[FIELD_RES_R][FIELD_RES_C];
 };
 
+struct region_edge{
+    uint16_t        neighbour;
+    /* Cost of the shortest path between the two portals that does not 
+     * leave the region, including the per-portal penalties along it. */
+    float           cost;
+};
+
+/* The upper level of the portal graph. Its' nodes are the portals which 
+ * lead to a different region, and its' edges link every pair of them that
+ * can be reached from one another without leaving the region. The regions 
+ * in between the source and the destination of a path can then be crossed 
+ * in a single hop, without visiting any of the portals inside.
+ */
+struct nav_region{
+    /* Global portal indices (chunk_index * MAX_PORTALS_PER_CHUNK + 
+     * portal_index) of the region's border portals */
+    size_t              num_nodes;
+    uint32_t           *nodes;
+    /* The edges of node 'i' are edges[offsets[i]] to edges[offsets[i+1]] */
+    uint32_t           *offsets;
+    struct region_edge *edges;
+    /* Set when the portals or edges of one of the region's chunks have 
+     * changed, and the region must be rebuilt before the next search. */
+    bool                dirty;
+};
+
+/* A distance field over the chunk grid, which counts the chunk borders that
+ * need to be crossed to get from every chunk to the nearest chunk holding 
+ * the enemies of a faction, or THREAT_NONE if there are none reachable. 
+ */
+struct threat_map{
+    /* The bitmask of the factions at war with the map's owner at the time 
+     * it was built */
+    uint16_t            enemies;
+    uint16_t           *dist;
+    /* Changed every time the field guiding the faction's units across the 
+     * chunk may have changed, so that it is rebuilt on the next use. */
+    uint16_t           *version;
+};
+
+/* The baked navigation data is laid out as the header, followed by the 
+ * raw images of all the chunks, followed by the 'portal_travel_costs' 
+ * fields of every chunk that has portals. Portal pointers in the chunk 
+ * images are replaced with (chunk_index * MAX_PORTALS_PER_CHUNK + 
+ * portal_index + 1), with 0 standing in for NULL. The regions are not 
+ * saved, but rebuilt when the data is loaded.
+ */
+struct baked_hdr{
+    char     magic[4];
+    uint32_t version;
+    uint64_t hash;
+    uint64_t width;
+    uint64_t height;
+    uint64_t chunk_size;
+    uint32_t tile_costs;
+};
+
 #endif
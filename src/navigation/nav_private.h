@@ -39,17 +39,33 @@
 #include "../map/public/tile.h"
 #include "nav_data.h"
 #include <stddef.h>
+#include <stdbool.h>
 
 struct portal;
 
 struct nav_private{
-    size_t           width, height;
-    struct nav_chunk chunks[];
+    size_t             width, height;
+    /* Whether the cost fields were derived from the map tiles */
+    bool               tile_costs;
+    /* The regions are NULL when the whole map fits in a single one */
+    size_t             region_w, region_h;
+    struct nav_region *regions;
+    /* The factions with combatable entities in every chunk, and the 
+     * threat maps of all the factions, both as of the last update */
+    uint16_t          *chunk_factions;
+    struct threat_map *threat_maps;
+    /* Set when the portals or the edges between them have changed, so that
+     * the threat maps' distances are searched again on the next update */
+    bool               threats_dirty;
+    struct nav_chunk   chunks[];
 };
 
 bool N_PortalReachableFromTile(const struct portal *port, struct coord tile, 
                                const struct nav_chunk *chunk);
 
+/* Returns FLT_MAX when the portal is not reachable from the tile */
+float N_PortalTravelCost(const struct nav_chunk *chunk, int portal_idx, struct coord tile);
+
 int  N_GridNeighbours(const uint8_t cost_field[FIELD_RES_R][FIELD_RES_C], struct coord coord, 
                       struct coord out_neighbours[static 8], float out_costs[static 8]);
 
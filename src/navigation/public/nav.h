@@ -39,8 +39,10 @@
 #include "../../pf_math.h"
 #include <stddef.h>
 #include <stdbool.h>
+#include <SDL.h> /* for SDL_RWops */
 
 struct tile;
+struct tile_desc;
 struct map;
 struct obb;
 struct entity;
@@ -65,6 +67,23 @@ struct fc_stats{
     float    grid_path_hit_rate;
 };
 
+struct fc_shard_stats{
+    unsigned los_used;
+    unsigned los_query;
+    unsigned los_hit;
+    unsigned los_invalidated;
+    unsigned flow_used;
+    unsigned flow_query;
+    unsigned flow_hit;
+    unsigned flow_invalidated;
+    unsigned ffid_used;
+    unsigned ffid_query;
+    unsigned ffid_hit;
+    unsigned grid_path_used;
+    unsigned grid_path_query;
+    unsigned grid_path_hit;
+};
+
 #define DEST_ID_INVALID (~((uint32_t)0))
 
 /*###########################################################################*/
@@ -100,7 +119,31 @@ void     *N_BuildForMapData(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
                             const struct tile **chunk_tiles, bool update);
 
 /* ------------------------------------------------------------------------
- * Clean up resources allocated by 'N_BuildForMapData'.
+ * Returns a hash of all the inputs of 'N_BuildForMapData', used for 
+ * checking if previously baked navigation data is still up-to-date.
+ * Only the tile attributes which affect pathability are hashed.
+ * ------------------------------------------------------------------------
+ */
+uint64_t  N_BakeHash(size_t w, size_t h, size_t chunk_w, size_t chunk_h,
+                     const struct tile **chunk_tiles, bool update);
+
+/* ------------------------------------------------------------------------
+ * Write out the navigation context, exactly as it was returned by 
+ * 'N_BuildForMapData', tagged with the 'hash' of the inputs.
+ * ------------------------------------------------------------------------
+ */
+bool      N_SaveBaked(const void *nav_private, uint64_t hash, SDL_RWops *stream);
+
+/* ------------------------------------------------------------------------
+ * Returns a new navigation context read from a stream written by 
+ * 'N_SaveBaked', without re-computing any of it. Returns NULL if the 
+ * data does not match the 'hash' or cannot be read. 
+ * ------------------------------------------------------------------------
+ */
+void     *N_LoadBaked(SDL_RWops *stream, uint64_t hash);
+
+/* ------------------------------------------------------------------------
+ * Clean up resources allocated by 'N_BuildForMapData' or 'N_LoadBaked'.
  * ------------------------------------------------------------------------
  */
 void      N_FreePrivate(void *nav_private);
@@ -171,11 +214,20 @@ void      N_RenderNavigationPortals(void *nav_private, const struct map *map,
 
 /* ------------------------------------------------------------------------
  * Make an impassable region in the cost field, completely covering the 
- * specified OBB.
+ * specified OBB. The chunks whose costs changed will have their portals 
+ * and islands re-computed at the next 'N_Update' or 'N_UpdateDirtyCosts'.
  * ------------------------------------------------------------------------
  */
 void      N_CutoutStaticObject(void *nav_private, vec3_t map_pos, const struct obb *obb);
 
+/* ------------------------------------------------------------------------
+ * Re-compute the portals and islands of only the chunks whose cost field 
+ * has changed (and their immediate neighbours) right away, instead of 
+ * waiting for the next 'N_Update'.
+ * ------------------------------------------------------------------------
+ */
+void      N_UpdateDirtyCosts(void *nav_private);
+
 /* ------------------------------------------------------------------------
  * Update portals and the links between them after there have been 
  * changes to the cost field, as new obstructions could have closed off 
@@ -191,6 +243,17 @@ void      N_UpdatePortals(void *nav_private);
  */
 void      N_UpdateIslandsField(void *nav_private);
 
+/* ------------------------------------------------------------------------
+ * Update the cost field after the map tile at 'desc' (in map tile 
+ * coordinates) has been modified. Only the chunks whose costs changed, 
+ * and their immediate neighbours, will have their portals and islands 
+ * re-computed at the next 'N_Update'. Any static objects previously cut
+ * out of the tile keep it impassable.
+ * ------------------------------------------------------------------------
+ */
+void      N_UpdateTile(void *nav_private, const struct tile_desc *desc, 
+                       const struct tile **chunk_tiles, size_t chunk_w, size_t chunk_h);
+
 /* ------------------------------------------------------------------------
  * Returns a unique ID that is used to associated all flow fields guiding 
  * to this (at tile granularity) position.
@@ -208,6 +271,25 @@ dest_id_t N_DestIDForPos(void *nav_private, vec3_t map_pos, vec2_t xz_pos);
 bool      N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
                         vec3_t map_pos, dest_id_t *out_dest_id);
 
+/* ------------------------------------------------------------------------
+ * Same as 'N_RequestPath', but the missing flow and LOS fields are built
+ * by background tasks. The returned 'out_dest_id' can be used right away. 
+ * The fields are added to the cache all at once on the next update. Until 
+ * then, 'N_DesiredPointSeekVelocity' steers towards the first portal 
+ * along the path.
+ * ------------------------------------------------------------------------
+ */
+bool      N_RequestAsyncPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest, 
+                             vec3_t map_pos, dest_id_t *out_dest_id);
+
+/* ------------------------------------------------------------------------
+ * Wait for the outstanding asynchronous path requests to complete and 
+ * discard their results. Must be called before the scheduler's tasks are 
+ * cleared.
+ * ------------------------------------------------------------------------
+ */
+void      N_DiscardPendingPaths(void);
+
 /* ------------------------------------------------------------------------
  * Returns the desired velocity for an entity at 'curr_pos' for it to flow
  * towards a particular destination.
@@ -216,14 +298,60 @@ bool      N_RequestPath(void *nav_private, vec2_t xz_src, vec2_t xz_dest,
 vec2_t    N_DesiredPointSeekVelocity(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
                                      void *nav_private, vec3_t map_pos);
 
+/* ------------------------------------------------------------------------
+ * Make sure the field (or an in-flight request for it) guiding towards a
+ * particular destination exists for the chunk under 'curr_pos'. Must be 
+ * called from the main thread.
+ * ------------------------------------------------------------------------
+ */
+void      N_EnsurePointSeekFields(dest_id_t id, vec2_t curr_pos, vec2_t xz_dest, 
+                                  void *nav_private, vec3_t map_pos);
+
+/* ------------------------------------------------------------------------
+ * Like 'N_DesiredPointSeekVelocity', but only reads the already existing 
+ * fields and is safe to call from the worker threads. Returns false when 
+ * the velocity cannot be had without updating the fields.
+ * ------------------------------------------------------------------------
+ */
+bool      N_SamplePointSeekVelocity(dest_id_t id, vec2_t curr_pos, void *nav_private, 
+                                    vec3_t map_pos, vec2_t *out);
+
+/* ------------------------------------------------------------------------
+ * Rebuild the threat maps of all factions from the positions and factions 
+ * of all the combatable entities. Every faction's threat map holds the 
+ * distance from every chunk to the nearest chunk with its' enemies, and 
+ * is what guides its' units towards them.
+ * ------------------------------------------------------------------------
+ */
+void      N_UpdateThreatMaps(void *nav_private, vec3_t map_pos, size_t nents,
+                             const vec2_t *xz_positions, const int *faction_ids);
+
 /* ------------------------------------------------------------------------
  * Returns the desired velocity for an entity at 'curr_pos' for it to flow
- * towards the closest enemy units within the same chunk.
+ * towards the closest enemy units, as of the last update of the threat 
+ * maps.
  * ------------------------------------------------------------------------
  */
 vec2_t    N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private, 
                                      vec3_t map_pos, int faction_id);
 
+/* ------------------------------------------------------------------------
+ * Make sure the enemy-seeking field of the faction exists for the chunk 
+ * under 'curr_pos'. Must be called from the main thread.
+ * ------------------------------------------------------------------------
+ */
+void      N_EnsureEnemySeekField(vec2_t curr_pos, void *nav_private, 
+                                 vec3_t map_pos, int faction_id);
+
+/* ------------------------------------------------------------------------
+ * Like 'N_DesiredEnemySeekVelocity', but only reads the already existing 
+ * fields and is safe to call from the worker threads. Returns false when 
+ * the velocity cannot be had without updating the fields.
+ * ------------------------------------------------------------------------
+ */
+bool      N_SampleEnemySeekVelocity(vec2_t curr_pos, void *nav_private, vec3_t map_pos, 
+                                    int faction_id, vec2_t *out);
+
 /* ------------------------------------------------------------------------
  * Returns true if the particular entity is in direct line of sight of the 
  * specified position.
@@ -231,6 +359,13 @@ vec2_t    N_DesiredEnemySeekVelocity(vec2_t curr_pos, void *nav_private,
  */
 bool      N_HasEntityLOS(vec2_t curr_pos, const struct entity *ent, void *nav_private, vec3_t map_pos);
 
+/* ------------------------------------------------------------------------
+ * Returns true if the 'target' position is in direct line of sight of the 
+ * 'curr_pos' position. Safe to call from the worker threads.
+ * ------------------------------------------------------------------------
+ */
+bool      N_HasLOSBetween(vec2_t curr_pos, vec2_t target, void *nav_private, vec3_t map_pos);
+
 /* ------------------------------------------------------------------------
  * Returns true if the particular destination is in direct line of sight 
  * of the specified position.
@@ -336,6 +471,15 @@ void      N_FC_ClearStats(void);
  */
 void      N_FC_GetStats(struct fc_stats *out_stats);
 
+/* ------------------------------------------------------------------------
+ * The field caches are split into a number of independently locked shards.
+ * Get the raw query, hit and invalidation counters of a single shard, in 
+ * order to inspect how evenly the load is spread between them.
+ * ------------------------------------------------------------------------
+ */
+int       N_FC_NumShards(void);
+void      N_FC_GetShardStats(int idx, struct fc_shard_stats *out_stats);
+
 /* ------------------------------------------------------------------------
  * Reset the contents of all the caches.
  * ------------------------------------------------------------------------
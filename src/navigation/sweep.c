@@ -0,0 +1,242 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#include "sweep.h"
+#include "../perf.h"
+
+#include <SDL_atomic.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if FIELD_RES_R != FIELD_RES_C
+#error "The integration field is transposed in place, so it must be square"
+#endif
+
+#define MIN(a, b)       ((a) < (b) ? (a) : (b))
+#define FIELD_RES       (FIELD_RES_R)
+
+/* The cost of stepping onto every tile, in both the row-major and the 
+ * column-major order. This is too large to be kept on the stacks of 
+ * the tasks that build the fields. */
+struct sweep_scratch{
+    struct sweep_scratch *next;
+    float                 weights[FIELD_RES][FIELD_RES];
+    float                 weights_t[FIELD_RES][FIELD_RES];
+};
+
+/*****************************************************************************/
+/* STATIC VARIABLES                                                          */
+/*****************************************************************************/
+
+static SDL_SpinLock          s_scratch_lock;
+static struct sweep_scratch *s_scratch_pool;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static struct sweep_scratch *scratch_acquire(void)
+{
+    SDL_AtomicLock(&s_scratch_lock);
+    struct sweep_scratch *ret = s_scratch_pool;
+    if(ret) {
+        s_scratch_pool = ret->next;
+    }
+    SDL_AtomicUnlock(&s_scratch_lock);
+
+    if(!ret)
+        ret = malloc(sizeof(struct sweep_scratch));
+    return ret;
+}
+
+static void scratch_release(struct sweep_scratch *scratch)
+{
+    SDL_AtomicLock(&s_scratch_lock);
+    scratch->next = s_scratch_pool;
+    s_scratch_pool = scratch;
+    SDL_AtomicUnlock(&s_scratch_lock);
+}
+
+/* Lower every tile of the row 'dst' to the cost of reaching it from the 
+ * same tile of the adjacent row 'src', 8 or 4 tiles at a time when AVX or 
+ * SSE is available. Returns true if any of the tiles got cheaper. 
+ */
+static bool relax_row(float *restrict dst, const float *restrict src, 
+                      const float *restrict weights)
+{
+    int i = 0;
+    int changed = 0;
+
+#if defined(__AVX__)
+    __m256 any = _mm256_setzero_ps();
+    for(; i + 8 <= FIELD_RES; i += 8) {
+        __m256 old = _mm256_loadu_ps(dst + i);
+        __m256 cand = _mm256_add_ps(_mm256_loadu_ps(src + i), _mm256_loadu_ps(weights + i));
+        any = _mm256_or_ps(any, _mm256_cmp_ps(cand, old, _CMP_LT_OQ));
+        _mm256_storeu_ps(dst + i, _mm256_min_ps(old, cand));
+    }
+    changed = _mm256_movemask_ps(any);
+#elif defined(__SSE2__)
+    __m128 any = _mm_setzero_ps();
+    for(; i + 4 <= FIELD_RES; i += 4) {
+        __m128 old = _mm_loadu_ps(dst + i);
+        __m128 cand = _mm_add_ps(_mm_loadu_ps(src + i), _mm_loadu_ps(weights + i));
+        any = _mm_or_ps(any, _mm_cmplt_ps(cand, old));
+        _mm_storeu_ps(dst + i, _mm_min_ps(old, cand));
+    }
+    changed = _mm_movemask_ps(any);
+#endif
+
+    for(; i < FIELD_RES; i++) {
+        float cand = src[i] + weights[i];
+        changed |= (cand < dst[i]);
+        dst[i] = MIN(dst[i], cand);
+    }
+    return changed;
+}
+
+/* Relax every row from the one above it, and then from the one below it, 
+ * so that the cost is carried all the way down and back up in one call. 
+ */
+static bool sweep_rows(float field[FIELD_RES][FIELD_RES], const float weights[FIELD_RES][FIELD_RES])
+{
+    bool changed = false;
+    for(int r = 1; r < FIELD_RES; r++)
+        changed |= relax_row(field[r], field[r-1], weights[r]);
+    for(int r = FIELD_RES-2; r >= 0; r--)
+        changed |= relax_row(field[r], field[r+1], weights[r]);
+    return changed;
+}
+
+/* The columns are swept as the rows of the transposed field, so that they 
+ * can be relaxed with the same vector operations. 
+ */
+static void transpose(float field[FIELD_RES][FIELD_RES])
+{
+#if defined(__SSE2__)
+    for(int r = 0; r < FIELD_RES; r += 4) {
+    for(int c = r; c < FIELD_RES; c += 4) {
+
+        __m128 a0 = _mm_loadu_ps(&field[r+0][c]);
+        __m128 a1 = _mm_loadu_ps(&field[r+1][c]);
+        __m128 a2 = _mm_loadu_ps(&field[r+2][c]);
+        __m128 a3 = _mm_loadu_ps(&field[r+3][c]);
+        __m128 b0 = _mm_loadu_ps(&field[c+0][r]);
+        __m128 b1 = _mm_loadu_ps(&field[c+1][r]);
+        __m128 b2 = _mm_loadu_ps(&field[c+2][r]);
+        __m128 b3 = _mm_loadu_ps(&field[c+3][r]);
+
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+        _mm_storeu_ps(&field[c+0][r], a0);
+        _mm_storeu_ps(&field[c+1][r], a1);
+        _mm_storeu_ps(&field[c+2][r], a2);
+        _mm_storeu_ps(&field[c+3][r], a3);
+        _mm_storeu_ps(&field[r+0][c], b0);
+        _mm_storeu_ps(&field[r+1][c], b1);
+        _mm_storeu_ps(&field[r+2][c], b2);
+        _mm_storeu_ps(&field[r+3][c], b3);
+    }}
+#else
+    for(int r = 0; r < FIELD_RES; r++) {
+    for(int c = r + 1; c < FIELD_RES; c++) {
+
+        float tmp = field[r][c];
+        field[r][c] = field[c][r];
+        field[c][r] = tmp;
+    }}
+#endif
+}
+
+/*****************************************************************************/
+/* EXTERN FUNCTIONS                                                          */
+/*****************************************************************************/
+
+bool Sweep_IntegrationField(const struct nav_chunk *chunk, float inout[FIELD_RES_R][FIELD_RES_C])
+{
+    PERF_ENTER();
+
+    struct sweep_scratch *scratch = scratch_acquire();
+    if(!scratch)
+        PERF_RETURN(false);
+
+    for(int r = 0; r < FIELD_RES; r++) {
+    for(int c = 0; c < FIELD_RES; c++) {
+
+        float cost = chunk->cost_base[r][c];
+        if(chunk->cost_base[r][c] == COST_IMPASSABLE || chunk->blockers[r][c] > 0)
+            cost = INFINITY;
+        scratch->weights[r][c] = cost;
+        scratch->weights_t[c][r] = cost;
+    }}
+
+    /* Every pass sweeps down, up, right and left. A path that changes 
+     * between moving along the rows and along the columns many times 
+     * takes more passes to settle, but most of them take only a few. */
+    bool changed;
+    do{
+        changed = sweep_rows(inout, scratch->weights);
+        transpose(inout);
+        changed |= sweep_rows(inout, scratch->weights_t);
+        transpose(inout);
+    }while(changed);
+
+    scratch_release(scratch);
+    PERF_RETURN(true);
+}
+
+void Sweep_Shutdown(void)
+{
+    SDL_AtomicLock(&s_scratch_lock);
+    struct sweep_scratch *curr = s_scratch_pool;
+    s_scratch_pool = NULL;
+    SDL_AtomicUnlock(&s_scratch_lock);
+
+    while(curr) {
+        struct sweep_scratch *next = curr->next;
+        free(curr);
+        curr = next;
+    }
+}
+
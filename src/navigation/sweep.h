@@ -0,0 +1,62 @@
+/*
+ *  This file is part of Permafrost Engine. 
+ *  Copyright (C) 2018-2020 Eduard Permyakov 
+ *
+ *  Permafrost Engine is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Permafrost Engine is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * 
+ *  Linking this software statically or dynamically with other modules is making 
+ *  a combined work based on this software. Thus, the terms and conditions of 
+ *  the GNU General Public License cover the whole combination. 
+ *  
+ *  As a special exception, the copyright holders of Permafrost Engine give 
+ *  you permission to link Permafrost Engine with independent modules to produce 
+ *  an executable, regardless of the license terms of these independent 
+ *  modules, and to copy and distribute the resulting executable under 
+ *  terms of your choice, provided that you also meet, for each linked 
+ *  independent module, the terms and conditions of the license of that 
+ *  module. An independent module is a module which is not derived from 
+ *  or based on Permafrost Engine. If you modify Permafrost Engine, you may 
+ *  extend this exception to your version of Permafrost Engine, but you are not 
+ *  obliged to do so. If you do not wish to do so, delete this exception 
+ *  statement from your version.
+ *
+ */
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "nav_data.h"
+#include <stdbool.h>
+
+/* ------------------------------------------------------------------------
+ * Fill in the integration field of the chunk: the cost of the cheapest path 
+ * from every tile to the nearest tile holding 0.0f in 'inout', moving only 
+ * between adjacent passable tiles. All other tiles must hold INFINITY on 
+ * entry, and the impassable ones keep that value. The field is relaxed in 
+ * alternating sweeps over whole rows and columns until nothing changes, 
+ * which gives exactly the same costs as a Dijkstra search from the same 
+ * tiles, since they are sums of integer tile costs. Returns false if the 
+ * scratch buffer could not be allocated, leaving the field untouched.
+ * ------------------------------------------------------------------------
+ */
+bool Sweep_IntegrationField(const struct nav_chunk *chunk, float inout[FIELD_RES_R][FIELD_RES_C]);
+
+/* ------------------------------------------------------------------------
+ * Free the scratch buffers that are kept around for re-use by the sweeps.
+ * ------------------------------------------------------------------------
+ */
+void Sweep_Shutdown(void);
+
+#endif
+
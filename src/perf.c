@@ -224,6 +224,52 @@ static bool register_gpu_state(void)
     return true;
 }
 
+static size_t perf_report(int ticks_ago, bool gpu, size_t maxout, struct perf_info **out)
+{
+    size_t ret = 0;
+    for(khiter_t k = kh_begin(s_thread_state_table); k != kh_end(s_thread_state_table); k++) {
+    
+        if(!kh_exist(s_thread_state_table, k))
+            continue;
+        if(ret == maxout)
+            break;
+
+        bool is_gpu = (k == kh_get(pstate, s_thread_state_table, GPU_STATE_KEY));
+        if(is_gpu && !gpu)
+            continue;
+
+        struct perf_state *ps = &kh_val(s_thread_state_table, k);
+        int read_idx = (ps->perf_tree_idx + NFRAMES_LOGGED - ticks_ago) % NFRAMES_LOGGED;
+        struct perf_info *info = malloc(sizeof(struct perf_info) + vec_size(&ps->perf_trees[read_idx]) * sizeof(info->entries[0]));
+        if(!info)
+            break;
+
+        pf_strlcpy(info->threadname, ps->name, sizeof(info->threadname));
+        info->nentries = vec_size(&ps->perf_trees[read_idx]);
+
+        for(int i = 0; i < vec_size(&ps->perf_trees[read_idx]); i++) {
+
+            const struct perf_entry *entry = &vec_AT(&ps->perf_trees[read_idx], i);
+
+            if(is_gpu) {
+                uint64_t hz = GPU_TIMER_HZ;
+                uint64_t delta = abs(entry->end.gpu_ts - entry->begin.gpu_ts);
+                info->entries[i].pc_delta = delta;
+                info->entries[i].ms_delta = (delta * 1000.0 / hz);
+            }else{
+                uint64_t hz = SDL_GetPerformanceFrequency();
+                info->entries[i].pc_delta = entry->pc_delta;
+                info->entries[i].ms_delta = (entry->pc_delta * 1000.0 / hz);
+            }
+
+            info->entries[i].funcname = name_for_id(ps, entry->name_id);
+            info->entries[i].parent_idx = entry->parent_idx;
+        }
+        out[ret++] = info;
+    }
+    return ret;
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -404,48 +450,15 @@ void Perf_FinishTick(void)
 size_t Perf_Report(size_t maxout, struct perf_info **out)
 {
     PERF_ENTER();
-
-    size_t ret = 0;
-    for(khiter_t k = kh_begin(s_thread_state_table); k != kh_end(s_thread_state_table); k++) {
-    
-        if(!kh_exist(s_thread_state_table, k))
-            continue;
-        if(ret == maxout)
-            break;
-
-        struct perf_state *ps = &kh_val(s_thread_state_table, k);
-        int read_idx = (ps->perf_tree_idx + 1) % NFRAMES_LOGGED;
-        struct perf_info *info = malloc(sizeof(struct perf_info) + vec_size(&ps->perf_trees[read_idx]) * sizeof(info->entries[0]));
-        if(!info)
-            break;
-
-        pf_strlcpy(info->threadname, ps->name, sizeof(info->threadname));
-        info->nentries = vec_size(&ps->perf_trees[read_idx]);
-
-        for(int i = 0; i < vec_size(&ps->perf_trees[read_idx]); i++) {
-
-            const struct perf_entry *entry = &vec_AT(&ps->perf_trees[read_idx], i);
-
-            if(k == kh_get(pstate, s_thread_state_table, GPU_STATE_KEY)) {
-                uint64_t hz = GPU_TIMER_HZ;
-                uint64_t delta = abs(entry->end.gpu_ts - entry->begin.gpu_ts);
-                info->entries[i].pc_delta = delta;
-                info->entries[i].ms_delta = (delta * 1000.0 / hz);
-            }else{
-                uint64_t hz = SDL_GetPerformanceFrequency();
-                info->entries[i].pc_delta = entry->pc_delta;
-                info->entries[i].ms_delta = (entry->pc_delta * 1000.0 / hz);
-            }
-
-            info->entries[i].funcname = name_for_id(ps, entry->name_id);
-            info->entries[i].parent_idx = entry->parent_idx;
-        }
-        out[ret++] = info;
-    }
-
+    size_t ret = perf_report(NFRAMES_LOGGED - 1, true, maxout, out);
     PERF_RETURN(ret);
 }
 
+size_t Perf_ReportLastTick(size_t maxout, struct perf_info **out)
+{
+    return perf_report(1, false, maxout, out);
+}
+
 uint32_t Perf_LastFrameMS(void)
 {
     int read_idx = (s_last_idx + 1) % NFRAMES_LOGGED;
@@ -99,6 +99,10 @@ void     Perf_PopGPU(uint32_t cookie);
 /* This returns an array of perf_info structs (one for each thread). They
  * must be 'free'd by the caller. */
 size_t   Perf_Report(size_t maxout, struct perf_info **out);
+/* Like 'Perf_Report', but returns the CPU statistics of the tick that was 
+ * just finished, without any delay. Used for benchmarking in headless mode, 
+ * where there are no GPU timings to wait for. */
+size_t   Perf_ReportLastTick(size_t maxout, struct perf_info **out);
 uint32_t Perf_LastFrameMS(void);
 uint32_t Perf_CurrFrameMS(void);
 
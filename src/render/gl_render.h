@@ -72,7 +72,7 @@ void   R_GL_ShadowMapBind(void);
 void   R_GL_SetClipPlane(vec4_t plane_eq);
 
 /* Terrain */
-void   R_GL_MapFogBindLast(GLuint tunit, GLuint shader_prog, const char *uname);
+void   R_GL_MapFogBind(GLuint tunit, GLuint shader_prog, const char *uname);
 void   R_GL_MapUpdateFogClear(void);
 
 
@@ -36,16 +36,17 @@
 #include "gl_render.h"
 #include "gl_texture.h"
 #include "gl_shader.h"
-#include "gl_ringbuffer.h"
 #include "gl_assert.h"
 #include "gl_state.h"
 #include "gl_perf.h"
 #include "render_private.h"
 #include "../main.h"
 #include "../map/public/tile.h"
+#include "../lib/public/pf_string.h"
 
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 
 #define ARR_SIZE(a)     (sizeof(a)/sizeof(a[0]))
 
@@ -55,8 +56,32 @@
 
 static struct texture_arr     s_map_textures;
 static bool                   s_map_ctx_active = false;
-static struct gl_ring        *s_fog_ring;
 static struct map_resolution  s_res;
+/* The fog-of-war state of every tile. The buffer persists between frames 
+ * and only the chunks that changed are uploaded to it. */
+static GLuint                 s_fog_vbo;
+static GLuint                 s_fog_tex;
+/* A buffer with every tile visible, which is used in place of the fog 
+ * for the draw calls between 'R_GL_MapUpdateFogClear' and the next 
+ * 'R_GL_MapInvalidate'. */
+static GLuint                 s_clear_vbo;
+static GLuint                 s_clear_tex;
+static bool                   s_fog_cleared = false;
+
+/*****************************************************************************/
+/* STATIC FUNCTIONS                                                          */
+/*****************************************************************************/
+
+static void map_init_visbuff(GLuint *out_vbo, GLuint *out_tex, const void *data, size_t size)
+{
+    glGenBuffers(1, out_vbo);
+    glBindBuffer(GL_TEXTURE_BUFFER, *out_vbo);
+    glBufferData(GL_TEXTURE_BUFFER, size, data, GL_DYNAMIC_DRAW);
+
+    glGenTextures(1, out_tex);
+    glBindTexture(GL_TEXTURE_BUFFER, *out_tex);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, *out_vbo);
+}
 
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
@@ -69,8 +94,17 @@ void R_GL_MapInit(const char map_texfiles[][256], const size_t *num_textures,
     ASSERT_IN_RENDER_THREAD();
 
     size_t nchunks = res->chunk_w * res->chunk_h;
-    s_fog_ring = R_GL_RingbufferInit(nchunks * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT * 3, RING_UBYTE);
-    assert(s_fog_ring);
+    size_t ntiles = nchunks * TILES_PER_CHUNK_WIDTH * TILES_PER_CHUNK_HEIGHT;
+
+    /* Every tile starts off unexplored (0) */
+    unsigned char *buff = calloc(ntiles, 1);
+    assert(buff);
+    map_init_visbuff(&s_fog_vbo, &s_fog_tex, buff, ntiles);
+
+    memset(buff, 0x2, ntiles);
+    map_init_visbuff(&s_clear_vbo, &s_clear_tex, buff, ntiles);
+    free(buff);
+    s_fog_cleared = false;
 
     bool status = R_GL_Texture_ArrayMakeMap(map_texfiles, *num_textures, &s_map_textures, GL_TEXTURE0);
     assert(status);
@@ -88,10 +122,30 @@ void R_GL_MapInit(const char map_texfiles[][256], const size_t *num_textures,
     GL_PERF_RETURN_VOID();
 }
 
-void R_GL_MapUpdateFog(void *buff, const size_t *size)
+void R_GL_MapUpdateFog(void *buff, const uint32_t *chunks, const size_t *nchunks)
 {
     GL_PERF_ENTER();
-    R_GL_RingbufferPush(s_fog_ring, buff, *size);
+    ASSERT_IN_RENDER_THREAD();
+
+    const size_t chunk_size = s_res.tile_w * s_res.tile_h;
+    const unsigned char *src = buff;
+    glBindBuffer(GL_TEXTURE_BUFFER, s_fog_vbo);
+
+    /* The tiles of a chunk are contiguous in the buffer, so every run of 
+     * consecutive chunks can be uploaded with a single call */
+    size_t i = 0;
+    while(i < *nchunks) {
+
+        size_t end = i + 1;
+        while(end < *nchunks && chunks[end] == chunks[end - 1] + 1)
+            end++;
+
+        size_t size = (end - i) * chunk_size;
+        glBufferSubData(GL_TEXTURE_BUFFER, chunks[i] * chunk_size, size, src);
+        src += size;
+        i = end;
+    }
+
     GL_ASSERT_OK();
     GL_PERF_RETURN_VOID();
 }
@@ -99,18 +153,17 @@ void R_GL_MapUpdateFog(void *buff, const size_t *size)
 void R_GL_MapShutdown(void)
 {
     R_GL_Texture_ArrayFree(s_map_textures);
-    R_GL_RingbufferDestroy(s_fog_ring);
+    glDeleteTextures(1, &s_fog_tex);
+    glDeleteBuffers(1, &s_fog_vbo);
+    glDeleteTextures(1, &s_clear_tex);
+    glDeleteBuffers(1, &s_clear_vbo);
 }
 
-/* Push a fully 'visible' field into the ringbuffer. Must be followed
- * with a matching R_GL_MapInvalidate to consume the fence. */
+/* Make the map fully 'visible' for the subsequent draw calls. Must be 
+ * followed with a matching R_GL_MapInvalidate to restore the fog. */
 void R_GL_MapUpdateFogClear(void)
 {
-    size_t size = s_res.chunk_w * s_res.chunk_h * s_res.tile_w * s_res.tile_h;
-    void *buff = malloc(size);
-    memset(buff, 0x2, size);
-    R_GL_RingbufferPush(s_fog_ring, buff, size);
-    free(buff);
+    s_fog_cleared = true;
 }
 
 void R_GL_MapBegin(const bool *shadows, const vec2_t *pos)
@@ -129,7 +182,7 @@ void R_GL_MapBegin(const bool *shadows, const vec2_t *pos)
     R_GL_Shader_InstallProg(shader_prog);
 
     R_GL_Texture_BindArray(&s_map_textures, shader_prog);
-    R_GL_RingbufferBindLast(s_fog_ring, GL_TEXTURE1, shader_prog, "visbuff");
+    R_GL_MapFogBind(GL_TEXTURE1, shader_prog, "visbuff");
 
 	R_GL_StateSet(GL_U_MAP_POS, (struct uval){
         .type = UTYPE_VEC2,
@@ -154,12 +207,29 @@ void R_GL_MapEnd(void)
 void R_GL_MapInvalidate(void)
 {
     GL_PERF_ENTER();
-    R_GL_RingbufferSyncLast(s_fog_ring);
+    s_fog_cleared = false;
     GL_PERF_RETURN_VOID();
 }
 
-void R_GL_MapFogBindLast(GLuint tunit, GLuint shader_prog, const char *uname)
+void R_GL_MapFogBind(GLuint tunit, GLuint shader_prog, const char *uname)
 {
-    R_GL_RingbufferBindLast(s_fog_ring, tunit, shader_prog, uname);
+    char uname_offset[128];
+    pf_snprintf(uname_offset, sizeof(uname_offset), "%s_offset", uname);
+
+    glActiveTexture(tunit);
+    glBindTexture(GL_TEXTURE_BUFFER, s_fog_cleared ? s_clear_tex : s_fog_tex);
+    R_GL_Shader_InstallProg(shader_prog);
+
+    R_GL_StateSet(uname, (struct uval){
+        .type = UTYPE_INT,
+        .val.as_int = tunit - GL_TEXTURE0
+    });
+    R_GL_StateInstall(uname, shader_prog);
+
+    R_GL_StateSet(uname_offset, (struct uval){
+        .type = UTYPE_INT,
+        .val.as_int = 0
+    });
+    R_GL_StateInstall(uname_offset, shader_prog);
 }
 
@@ -359,7 +359,7 @@ static void setup_fog_uniforms(GLuint shader_prog, const struct map *map)
     });
     R_GL_StateInstall(GL_U_MAP_POS, shader_prog);
 
-    R_GL_MapFogBindLast(VISBUFF_TUNIT, shader_prog, "visbuff");
+    R_GL_MapFogBind(VISBUFF_TUNIT, shader_prog, "visbuff");
 }
 
 static void setup_map_uniforms(GLuint shader_prog)
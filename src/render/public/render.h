@@ -377,10 +377,12 @@ void  R_GL_MapBegin(const bool *shadows, const vec2_t *pos);
 void  R_GL_MapEnd(void);
 
 /* ---------------------------------------------------------------------------
- * Send the current-frame fog-of-war information to the rendering susbsystem.
+ * Update the fog-of-war information of the specified chunks. 'chunks' holds 
+ * the row-major indices of the chunks, in increasing order, and 'buff' holds 
+ * the tile states of every chunk in the same order.
  * ---------------------------------------------------------------------------
  */
-void  R_GL_MapUpdateFog(void *buff, const size_t *size);
+void  R_GL_MapUpdateFog(void *buff, const uint32_t *chunks, const size_t *nchunks);
 
 /* ---------------------------------------------------------------------------
  * Must be Called once per frame when we are sure there will be no more draw 
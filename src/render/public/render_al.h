@@ -50,6 +50,20 @@ struct tile;
  */
 void  *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream);
 
+/* ---------------------------------------------------------------------------
+ * Same as 'R_AL_PrivFromStream', but for a cooked PFOBJ stream. When the 
+ * stream is memory-mapped, the vertices are uploaded directly from it.
+ * ---------------------------------------------------------------------------
+ */
+void  *R_AL_PrivFromCooked(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream);
+
+/* ---------------------------------------------------------------------------
+ * Consumes the render section of a PFOBJ stream and writes it to 'out' in
+ * cooked form.
+ * ---------------------------------------------------------------------------
+ */
+bool   R_AL_CookPFObj(const struct pfobj_hdr *header, SDL_RWops *in, SDL_RWops *out);
+
 /* ---------------------------------------------------------------------------
  * Dumps private render data in PF Object format.
  * ---------------------------------------------------------------------------
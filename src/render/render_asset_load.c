@@ -132,7 +132,7 @@ fail:
     return false;
 }
 
-static bool al_read_material(SDL_RWops *stream, const char *basedir, struct material *out, bool *out_null)
+static bool al_read_material(SDL_RWops *stream, struct material *out, bool *out_null)
 {
     char line[MAX_LINE_LEN];
 
@@ -164,16 +164,6 @@ static bool al_read_material(SDL_RWops *stream, const char *basedir, struct mate
         goto fail;
     out->texname[sizeof(out->texname)-1] = '\0';
 
-    R_PushCmd((struct rcmd){
-        .func = R_GL_Texture_GetOrLoad,
-        .nargs = 3,
-        .args = {
-            R_PushArg(basedir, strlen(basedir) + 1),
-            R_PushArg(out->texname, strlen(out->texname) + 1),
-            &out->texture.id,
-        },
-    });
-
     *out_null = false;
     return true;
 
@@ -181,6 +171,85 @@ fail:
     return false;
 }
 
+static bool al_read_verts(SDL_RWops *stream, const struct pfobj_hdr *header, void *out)
+{
+    bool anim = (header->num_as > 0);
+
+    for(int i = 0; i < header->num_verts; i++) {
+
+        bool status;
+        char ignoreline[MAX_LINE_LEN];
+
+        if(anim) {
+            status = al_read_anim_vertex(stream, ((struct anim_vert*)out) + i);
+        }else{
+            status = al_read_vertex(stream, ((struct vertex*)out) + i, ignoreline);
+        }
+        if(!status)
+            return false;
+    }
+    return true;
+}
+
+static bool al_read_materials(SDL_RWops *stream, const struct pfobj_hdr *header, 
+                              struct material *out)
+{
+    for(int i = 0; i < header->num_materials; i++) {
+
+        bool null;
+        if(!al_read_material(stream, &out[i], &null)) 
+            return false;
+        assert(!null);
+    }
+    return true;
+}
+
+static void al_load_textures(struct render_private *priv, const char *basedir)
+{
+    for(int i = 0; i < priv->num_materials; i++) {
+
+        struct material *mat = &priv->materials[i];
+        mat->texture.tunit = GL_TEXTURE0 + i;
+        mat->texture.id = -1;
+
+        R_PushCmd((struct rcmd){
+            .func = R_GL_Texture_GetOrLoad,
+            .nargs = 3,
+            .args = {
+                R_PushArg(basedir, strlen(basedir) + 1),
+                R_PushArg(mat->texname, strlen(mat->texname) + 1),
+                &mat->texture.id,
+            },
+        });
+    }
+}
+
+static void al_push_init(struct render_private *priv, bool anim, const void *vbuff, size_t vbuff_sz)
+{
+    struct sval sh_setting;
+    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
+    assert(status == SS_OKAY);
+
+    const char *shader;
+    if(sh_setting.as_bool) {
+        shader = anim ? "mesh.animated.textured-phong-shadowed" 
+                      : "mesh.static.textured-phong-shadowed";
+    }else{
+        shader = anim ? "mesh.animated.textured-phong" 
+                      : "mesh.static.textured-phong";
+    }
+
+    R_PushCmd((struct rcmd){
+        .func = R_GL_Init,
+        .nargs = 3,
+        .args = {
+            priv,
+            (void*)shader,
+            R_PushArg(vbuff, vbuff_sz),
+        },
+    });
+}
+
 size_t al_priv_buffsize_from_header(const struct pfobj_hdr *header)
 {
     size_t ret = 0;
@@ -225,64 +294,122 @@ void *R_AL_PrivFromStream(const char *base_path, const struct pfobj_hdr *header,
     priv->num_materials = header->num_materials;
     priv->materials = (void*)(priv + 1);
 
-    for(int i = 0; i < header->num_verts; i++) {
+    if(!al_read_verts(stream, header, vbuff))
+        goto fail_parse;
 
-        bool status;
-        char ignoreline[MAX_LINE_LEN];
+    if(!al_read_materials(stream, header, priv->materials))
+        goto fail_parse;
 
-        if(anim) {
-            status = al_read_anim_vertex(stream, ((struct anim_vert*)vbuff) + i);
-        }else{
-            status = al_read_vertex(stream, ((struct vertex*)vbuff) + i, ignoreline);
-        }
-        if(!status)
-            goto fail_parse;
-    }
+    al_load_textures(priv, base_path);
+    al_push_init(priv, anim, vbuff, vbuff_sz);
 
-    for(int i = 0; i < header->num_materials; i++) {
+    free(vbuff);
+    PERF_RETURN(priv);
 
-        bool null;
-        priv->materials[i].texture.tunit = GL_TEXTURE0 + i;
-        priv->materials[i].texture.id = -1;
-        if(!al_read_material(stream, base_path, &priv->materials[i], &null)) 
-            goto fail_parse;
-        assert(!null);
-    }
+fail_parse:
+    free(vbuff);
+fail_alloc_vbuff:
+    free(priv);
+fail_alloc_priv:
+    PERF_RETURN(NULL);
+}
 
-    struct sval sh_setting;
-    ss_e status = Settings_Get("pf.video.shadows_enabled", &sh_setting);
-    assert(status == SS_OKAY);
+/*
+ * Cooked render section layout:
+ *
+ *  +---------------------------------+
+ *  | vertex_stride * num_verts bytes |
+ *  |    (struct vertex or anim_vert) |
+ *  +---------------------------------+
+ *  | struct material[num_materials]  |
+ *  +---------------------------------+
+ *
+ */
 
-    const char *shader;
-    if(sh_setting.as_bool) {
-        shader = anim ? "mesh.animated.textured-phong-shadowed" 
-                      : "mesh.static.textured-phong-shadowed";
-    }else{
-        shader = anim ? "mesh.animated.textured-phong" 
-                      : "mesh.static.textured-phong";
+void *R_AL_PrivFromCooked(const char *base_path, const struct pfobj_hdr *header, SDL_RWops *stream)
+{
+    PERF_ENTER();
+    struct render_private *priv = malloc(al_priv_buffsize_from_header(header));
+    if(!priv)
+        goto fail_alloc_priv;
+
+    bool anim = (header->num_as > 0);
+    priv->vertex_stride = anim ? sizeof(struct anim_vert) : sizeof(struct vertex);
+    priv->mesh.num_verts = header->num_verts;
+    priv->num_materials = header->num_materials;
+    priv->materials = (void*)(priv + 1);
+
+    /* When the file is mapped into memory, the vertices can be handed to the 
+     * renderer as-is, without making an intermediate copy. */
+    size_t vbuff_sz = header->num_verts * priv->vertex_stride;
+    const void *vbuff = AL_StreamData(stream, vbuff_sz);
+    void *copy = NULL;
+
+    if(!vbuff) {
+        copy = malloc(vbuff_sz);
+        if(!copy)
+            goto fail_alloc_vbuff;
+        if(vbuff_sz && !SDL_RWread(stream, copy, vbuff_sz, 1))
+            goto fail_parse;
+        vbuff = copy;
     }
 
-    R_PushCmd((struct rcmd){
-        .func = R_GL_Init,
-        .nargs = 3,
-        .args = {
-            priv,
-            (void*)shader,
-            R_PushArg(vbuff, vbuff_sz),
-        },
-    });
+    size_t mats_sz = header->num_materials * sizeof(struct material);
+    if(mats_sz && !SDL_RWread(stream, priv->materials, mats_sz, 1))
+        goto fail_parse;
 
-    free(vbuff);
+    al_load_textures(priv, base_path);
+    al_push_init(priv, anim, vbuff, vbuff_sz);
+
+    free(copy);
     PERF_RETURN(priv);
 
 fail_parse:
-    free(vbuff);
+    free(copy);
 fail_alloc_vbuff:
     free(priv);
 fail_alloc_priv:
     PERF_RETURN(NULL);
 }
 
+bool R_AL_CookPFObj(const struct pfobj_hdr *header, SDL_RWops *in, SDL_RWops *out)
+{
+    bool anim = (header->num_as > 0);
+    size_t vbuff_sz = header->num_verts * (anim ? sizeof(struct anim_vert) : sizeof(struct vertex));
+    size_t mats_sz = header->num_materials * sizeof(struct material);
+
+    void *vbuff = calloc(1, vbuff_sz + 1);
+    if(!vbuff)
+        goto fail_alloc_vbuff;
+
+    struct material *mats = calloc(1, mats_sz + 1);
+    if(!mats)
+        goto fail_alloc_mats;
+
+    if(!al_read_verts(in, header, vbuff))
+        goto fail;
+
+    if(!al_read_materials(in, header, mats))
+        goto fail;
+
+    if(vbuff_sz && !SDL_RWwrite(out, vbuff, vbuff_sz, 1))
+        goto fail;
+
+    if(mats_sz && !SDL_RWwrite(out, mats, mats_sz, 1))
+        goto fail;
+
+    free(mats);
+    free(vbuff);
+    return true;
+
+fail:
+    free(mats);
+fail_alloc_mats:
+    free(vbuff);
+fail_alloc_vbuff:
+    return false;
+}
+
 void R_AL_DumpPrivate(FILE *stream, void *priv_data)
 {
     struct render_private *priv = priv_data;
@@ -41,7 +41,6 @@
 #include "event.h"
 #include "game/public/game.h"
 #include "script/public/script.h"
-#include "lib/public/pqueue.h"
 #include "lib/public/queue.h"
 #include "lib/public/khash.h"
 #include "lib/public/pf_string.h"
@@ -128,7 +127,11 @@ struct task{
     void          *arg;
     void         (*destructor)(void*);
     void          *darg;
+    /* Links in the free list or in a ready deque tier */
     struct task   *prev, *next;
+    /* The ready deque the task is currently in, if any. Only changed 
+     * while holding the lock of that deque. */
+    void          *readyq;
     SDL_Event      earg;
 };
 
@@ -138,9 +141,9 @@ struct task{
 #define BIG_STACK_SZ            (8 * 1024 * 1024)
 #define SCHED_TICK_MS           (1.0f / CONFIG_SCHED_TARGET_FPS * 1000.0f)
 #define ALIGNED(val, align)     (((val) + ((align) - 1)) & ~((align) - 1))
-
-PQUEUE_TYPE(task, struct task*)
-PQUEUE_IMPL(static, task, struct task*)
+/* Tasks with a lower priority value are run first. Priorities 
+ * higher than the last tier all share the last tier. */
+#define PRIO_TIERS              (32)
 
 QUEUE_TYPE(tid, uint32_t)
 QUEUE_IMPL(static, tid, uint32_t)
@@ -148,6 +151,19 @@ QUEUE_IMPL(static, tid, uint32_t)
 KHASH_MAP_INIT_INT64(tid, uint32_t)
 KHASH_MAP_INIT_INT(tqueue, queue_tid_t)
 
+/* Every thread owns a deque of ready tasks, split into per-priority tiers. 
+ * The owner pops tasks from the front of its' deque and idle threads steal 
+ * from the back of the other threads' deques. Each deque is protected by 
+ * its' own spinlock, which is only held for a handful of instructions, so 
+ * there is no single point of contention between the threads.
+ */
+struct ready_deque{
+    SDL_SpinLock   lock;
+    uint32_t       tiermask;
+    struct task   *head[PRIO_TIERS];
+    struct task   *tail[PRIO_TIERS];
+}__attribute__((aligned(64)));
+
 
 uint64_t    sched_switch_ctx(struct context *save, struct context *restore, uint64_t retval, void *arg);
 void        sched_task_exit_trampoline(void);
@@ -172,29 +188,36 @@ static queue_tid_t      s_msg_queues[MAX_TASKS];
 static bool             s_parent_waiting[MAX_TASKS];
 static khash_t(tqueue) *s_event_queues;
 
-/* Lock used to serialzie the scheduler requests */
-static SDL_mutex       *s_request_lock;
+/* The free list is shared by all threads. Each task additionally has 
+ * its' own lock, protecting its' message queue and its' state when it's 
+ * blocked on another task. */
+static SDL_SpinLock     s_free_lock;
+static SDL_SpinLock     s_task_locks[MAX_TASKS];
+static SDL_SpinLock     s_event_lock;
 
-/* The active worker threads wait on the ready cond to be 
- * notified when the ready queue(s) becomes non-empty, so that
- * they can pop a task to execute. At the end of a frame, the 
- * ready condition variable is also used to notify the workers 
- * that the 'quiesce' flags has been set, instructing them to 
- * go back to waiting on a start/quit command. 
- * 
- * We have 2 diff. queues to allow only de-queuing tasks based
- * on the thread. The worker threads will not dequeue from the 
- * 'main' queues.
- *
- * All the queues are protected by the ready lock.
+/* Deques of ready tasks. The worker threads will not dequeue from 
+ * the 'main' (pinned) deque, but any thread may steal from the main 
+ * thread's general deque. 
+ */
+static struct ready_deque s_worker_deques[MAX_WORKER_THREADS];
+static struct ready_deque s_main_deque;
+static struct ready_deque s_pinned_deque;
+/* The number of tasks in the general (non-pinned) deques */
+static SDL_atomic_t     s_nready;
+static SDL_atomic_t     s_npinned;
+
+/* Idle worker threads wait on the ready cond to be notified when 
+ * new tasks become ready, so that they can go and steal them. At the 
+ * end of a frame, the ready condition variable is also used to notify
+ * the workers that the 'quiesce' flags has been set, instructing them
+ * to go back to waiting on a start/quit command. The ready lock is only 
+ * ever taken when a thread has run out of work.
  */
-static pq_task_t        s_ready_queue;
-static pq_task_t        s_ready_queue_main;
-
 static SDL_mutex       *s_ready_lock;
 static SDL_cond        *s_ready_cond;
-static int              s_nwaiters;     /* protected by ready lock */
-static bool             s_quiesce;      /* protected by ready lock */
+static SDL_atomic_t     s_nwaiters;     /* written with ready lock held */
+static SDL_atomic_t     s_main_waiting; /* written with ready lock held */
+static SDL_atomic_t     s_quiesce;      /* written with ready lock held */
 static int              s_idle_workers; /* protected by ready lock */
 
 static size_t           s_nworkers;
@@ -495,41 +518,210 @@ static uint32_t sched_curr_thread_worker_id(void)
 
 static struct task *sched_task_alloc(void)
 {
-    if(!s_freehead)
-        return NULL;
-
+    SDL_AtomicLock(&s_free_lock);
     struct task *ret = s_freehead;
+    if(!ret)
+        goto out;
+
     if(ret->prev)
         ret->prev->next = ret->next;
     if(ret->next)
         ret->next->prev = ret->prev;
 
     s_freehead = s_freehead->next;
+out:
+    SDL_AtomicUnlock(&s_free_lock);
     return ret;
 }
 
 static void sched_task_free(struct task *task)
 {
+    SDL_AtomicLock(&s_free_lock);
     task->next = s_freehead;
     task->prev = NULL;
     if(s_freehead)
         s_freehead->prev = task;
     s_freehead = task;
+    SDL_AtomicUnlock(&s_free_lock);
 }
 
-static void sched_reactivate(struct task *task)
+static int task_tier(const struct task *task)
+{
+    if(task->prio < 0)
+        return 0;
+    if(task->prio >= PRIO_TIERS)
+        return PRIO_TIERS - 1;
+    return task->prio;
+}
+
+/* The following 'deque_' routines must be called with the deque lock held */
+
+static int deque_top_tier(const struct ready_deque *dq)
+{
+    if(!dq->tiermask)
+        return -1;
+    return __builtin_ctz(dq->tiermask);
+}
+
+static void deque_push_back(struct ready_deque *dq, struct task *task)
+{
+    int tier = task_tier(task);
+
+    task->next = NULL;
+    task->prev = dq->tail[tier];
+    if(dq->tail[tier])
+        dq->tail[tier]->next = task;
+    else
+        dq->head[tier] = task;
+
+    dq->tail[tier] = task;
+    dq->tiermask |= (1u << tier);
+    SDL_AtomicSetPtr(&task->readyq, dq);
+}
+
+static void deque_remove(struct ready_deque *dq, struct task *task)
 {
+    int tier = task_tier(task);
+
+    if(task->prev)
+        task->prev->next = task->next;
+    else
+        dq->head[tier] = task->next;
+
+    if(task->next)
+        task->next->prev = task->prev;
+    else
+        dq->tail[tier] = task->prev;
+
+    if(!dq->head[tier])
+        dq->tiermask &= ~(1u << tier);
+
+    task->prev = task->next = NULL;
+    SDL_AtomicSetPtr(&task->readyq, NULL);
+}
+
+/* The owner takes from the front of the tier so that tasks which yield 
+ * often don't starve the others of the same priority. Thieves take from 
+ * the back. */
+static struct task *deque_pop(struct ready_deque *dq, bool steal)
+{
+    int tier = deque_top_tier(dq);
+    if(tier < 0)
+        return NULL;
+
+    struct task *ret = steal ? dq->tail[tier] : dq->head[tier];
+    deque_remove(dq, ret);
+    return ret;
+}
+
+static struct ready_deque *sched_curr_thread_deque(void)
+{
+    if(SDL_ThreadID() == g_main_thread_id)
+        return &s_main_deque;
+    return &s_worker_deques[sched_curr_thread_worker_id()];
+}
+
+static struct task *sched_pop_locked(struct ready_deque *dq, bool steal)
+{
+    SDL_AtomicLock(&dq->lock);
+    struct task *ret = deque_pop(dq, steal);
+    SDL_AtomicUnlock(&dq->lock);
+    return ret;
+}
+
+static struct task *sched_steal(struct ready_deque *self)
+{
+    /* Start at a different victim for every thread so that the 
+     * thieves don't all hammer the same deque. */
+    size_t ndeques = s_nworkers + 1;
+    size_t start = (self == &s_main_deque) ? 0 : (self - s_worker_deques) + 1;
+
+    for(int i = 0; i < ndeques; i++) {
+
+        size_t idx = (start + i) % ndeques;
+        struct ready_deque *victim = (idx == s_nworkers) ? &s_main_deque : &s_worker_deques[idx];
+        if(victim == self)
+            continue;
+
+        struct task *ret = sched_pop_locked(victim, true);
+        if(ret)
+            return ret;
+    }
+    return NULL;
+}
+
+/* Take the next task from the calling thread's own deque or, if that is 
+ * empty, steal one from another thread. */
+static struct task *sched_next_task(void)
+{
+    if(SDL_AtomicGet(&s_nready) == 0)
+        return NULL;
+
+    struct ready_deque *self = sched_curr_thread_deque();
+    struct task *ret = sched_pop_locked(self, false);
+    if(!ret)
+        ret = sched_steal(self);
+    if(ret)
+        SDL_AtomicAdd(&s_nready, -1);
+    return ret;
+}
+
+/* Wake up any threads that ran out of work */
+static void sched_notify_ready(bool pinned)
+{
+    if(pinned && !SDL_AtomicGet(&s_main_waiting))
+        return;
+    if(!pinned && !SDL_AtomicGet(&s_nwaiters) && !SDL_AtomicGet(&s_main_waiting))
+        return;
+
     SDL_LockMutex(s_ready_lock); 
+    if(pinned)
+        SDL_CondBroadcast(s_ready_cond);
+    else
+        SDL_CondSignal(s_ready_cond);
+    SDL_UnlockMutex(s_ready_lock);
+}
+
+static void sched_reactivate(struct task *task)
+{
     task->state = TASK_STATE_READY;
+    bool pinned = !!(task->flags & TASK_MAIN_THREAD_PINNED);
+
+    if(pinned) {
+
+        SDL_AtomicLock(&s_pinned_deque.lock);
+        deque_push_back(&s_pinned_deque, task);
+        SDL_AtomicIncRef(&s_npinned);
+        SDL_AtomicUnlock(&s_pinned_deque.lock);
 
-    if(task->flags & TASK_MAIN_THREAD_PINNED) {
-        pq_task_push(&s_ready_queue_main, task->prio, task);
     }else{
-        pq_task_push(&s_ready_queue, task->prio, task);
+
+        struct ready_deque *dq = sched_curr_thread_deque();
+        SDL_AtomicLock(&dq->lock);
+        deque_push_back(dq, task);
+        SDL_AtomicIncRef(&s_nready);
+        SDL_AtomicUnlock(&dq->lock);
     }
 
-    SDL_CondSignal(s_ready_cond);
-    SDL_UnlockMutex(s_ready_lock);
+    sched_notify_ready(pinned);
+}
+
+/* Remove a task from whatever ready deque it is in. Fails if the 
+ * task is not ready or has just been taken by another thread. */
+static bool sched_take_ready(struct task *task)
+{
+    struct ready_deque *dq = SDL_AtomicGetPtr(&task->readyq);
+    if(!dq)
+        return false;
+
+    SDL_AtomicLock(&dq->lock);
+    bool found = (SDL_AtomicGetPtr(&task->readyq) == dq);
+    if(found) {
+        deque_remove(dq, task);
+        SDL_AtomicAdd((dq == &s_pinned_deque) ? &s_npinned : &s_nready, -1);
+    }
+    SDL_AtomicUnlock(&dq->lock);
+    return found;
 }
 
 __attribute__((used)) static void sched_task_exit(struct result ret)
@@ -587,6 +779,7 @@ static void sched_task_init(struct task *task, int prio, uint32_t flags,
 static void sched_send(struct task *task, uint32_t tid, void *msg, size_t msglen)
 {
     struct task *recv_task = &s_tasks[tid - 1];
+    SDL_AtomicLock(&s_task_locks[tid - 1]);
 
     /* write data to blocked send-blocked task to unblock it */
     if(recv_task->state == TASK_STATE_SEND_BLOCKED) {
@@ -608,10 +801,13 @@ static void sched_send(struct task *task, uint32_t tid, void *msg, size_t msglen
         task->state = TASK_STATE_RECV_BLOCKED;
         queue_tid_push(&s_msg_queues[tid - 1], &task->tid);
     }
+    SDL_AtomicUnlock(&s_task_locks[tid - 1]);
 }
 
 static void sched_receive(struct task *task, uint32_t *out_tid, void *msg, size_t msglen)
 {
+    SDL_AtomicLock(&s_task_locks[task->tid - 1]);
+
     if(queue_size(s_msg_queues[task->tid - 1]) > 0) {
     
         uint32_t send_tid = 0;
@@ -636,6 +832,7 @@ static void sched_receive(struct task *task, uint32_t *out_tid, void *msg, size_
 
         task->state = TASK_STATE_SEND_BLOCKED;
     }
+    SDL_AtomicUnlock(&s_task_locks[task->tid - 1]);
 }
 
 static void sched_reply(struct task *task, uint32_t tid, void *reply, size_t replylen)
@@ -658,6 +855,7 @@ static void sched_reply(struct task *task, uint32_t tid, void *reply, size_t rep
 static void sched_await_event(struct task *task, int event)
 {
     task->state = TASK_STATE_EVENT_BLOCKED;
+    SDL_AtomicLock(&s_event_lock);
 
     int status;
     khiter_t k = kh_get(tqueue, s_event_queues, event);
@@ -669,6 +867,7 @@ static void sched_await_event(struct task *task, int event)
         queue_tid_init(&kh_val(s_event_queues, k), 32);
     }
     queue_tid_push(&kh_val(s_event_queues, k), &task->tid);
+    SDL_AtomicUnlock(&s_event_lock);
 }
 
 static uint32_t sched_create(int prio, task_func_t code, void *arg, struct future *result, 
@@ -692,21 +891,23 @@ static bool sched_wait(struct task *task, uint32_t child_tid)
     || (child->flags & TASK_DETACHED))
         return false;
 
+    SDL_AtomicLock(&s_task_locks[child_tid - 1]);
     if(child->state == TASK_STATE_ZOMBIE) {
         sched_task_free(child);
         assert(task->state != TASK_STATE_EVENT_BLOCKED);
         sched_reactivate(task);
-        return true;
+    }else{
+        s_parent_waiting[child_tid - 1] = true;
     }
-
-    s_parent_waiting[child_tid - 1] = true;
+    SDL_AtomicUnlock(&s_task_locks[child_tid - 1]);
     return true;
 }
 
+/* Requests are serviced on the thread that ran the task, concurrently with 
+ * the requests of tasks on other threads. Each request only locks the state 
+ * that it actually touches. */
 static void sched_task_service_request(struct task *task)
 {
-    SDL_LockMutex(s_request_lock);
-
     switch((int)task->req.type) {
     case SCHED_REQ_CREATE:
         task->retval = sched_create(
@@ -774,6 +975,7 @@ static void sched_task_service_request(struct task *task)
         if(task->flags & TASK_BIG_STACK) {
             free(task->stackmem);
         }
+        SDL_AtomicLock(&s_task_locks[task->tid - 1]);
         if(task->flags & TASK_DETACHED) {
             sched_task_free(task);
         }else if(s_parent_waiting[task->tid - 1]) {
@@ -786,11 +988,10 @@ static void sched_task_service_request(struct task *task)
         }else{
             task->state = TASK_STATE_ZOMBIE;
         }
+        SDL_AtomicUnlock(&s_task_locks[task->tid - 1]);
         break;
     default: assert(0);    
     }
-
-    SDL_UnlockMutex(s_request_lock);
 }
 
 static void sched_task_run(struct task *task)
@@ -858,7 +1059,7 @@ static void sched_wait_workers_done(void)
     SDL_UnlockMutex(s_ready_lock);
 
     assert(s_idle_workers == s_nworkers);
-    assert(s_nwaiters == 0);
+    assert(SDL_AtomicGet(&s_nwaiters) == 0);
 }
 
 static void sched_quiesce_workers(void)
@@ -867,16 +1068,33 @@ static void sched_quiesce_workers(void)
     PERF_ENTER();
 
     SDL_LockMutex(s_ready_lock);
-    s_quiesce = true;
+    SDL_AtomicSet(&s_quiesce, true);
     SDL_CondBroadcast(s_ready_cond);
     SDL_UnlockMutex(s_ready_lock);
 
     sched_wait_workers_done();
 
-    s_quiesce = false;
+    SDL_AtomicSet(&s_quiesce, false);
     PERF_RETURN_VOID();
 }
 
+static void sched_start_workers(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
+    SDL_LockMutex(s_ready_lock);
+    s_idle_workers = 0;
+    SDL_UnlockMutex(s_ready_lock);
+
+    for(int i = 0; i < s_nworkers; i++) {
+    
+        SDL_LockMutex(s_worker_locks[i]);
+        s_worker_start[i] = true;
+        SDL_CondSignal(s_worker_conds[i]);
+        SDL_UnlockMutex(s_worker_locks[i]);
+    }
+}
+
 static void worker_wait_on_cmd(int id)
 {
     SDL_LockMutex(s_worker_locks[id]);
@@ -894,36 +1112,38 @@ static void worker_notify_done(int id)
     SDL_UnlockMutex(s_ready_lock);
 }
 
-static struct task *worker_wait_task_or_quiesce(void)
+/* Returns false when the worker has been told to quiesce */
+static bool worker_wait_ready_or_quiesce(void)
 {
-    struct task *task = NULL;
-
     SDL_LockMutex(s_ready_lock);
-    s_nwaiters++;
+    SDL_AtomicIncRef(&s_nwaiters);
 
-    if(s_nwaiters == s_nworkers) {
+    if(SDL_AtomicGet(&s_nwaiters) == s_nworkers) {
         SDL_CondBroadcast(s_ready_cond);
     }
 
-    while(!s_quiesce && !pq_task_pop(&s_ready_queue, &task)) {
+    while(!SDL_AtomicGet(&s_quiesce) && !SDL_AtomicGet(&s_nready)) {
         SDL_CondWait(s_ready_cond, s_ready_lock);
     }
 
-    s_nwaiters--;
+    SDL_AtomicAdd(&s_nwaiters, -1);
+    bool ret = !SDL_AtomicGet(&s_quiesce);
     SDL_UnlockMutex(s_ready_lock);
 
-    return task;
+    return ret;
 }
 
 static void worker_do_work(int id)
 {
-    while(true) {
+    while(!SDL_AtomicGet(&s_quiesce)) {
 
-        struct task *task = worker_wait_task_or_quiesce();
-        if(!task)
-            return;
+        struct task *task = sched_next_task();
+        if(!task) {
+            if(!worker_wait_ready_or_quiesce())
+                return;
+            continue;
+        }
 
-        assert(task);
         sched_task_run(task);
         sched_task_service_request(task);
     }
@@ -944,11 +1164,44 @@ static int worker_threadfn(void *arg)
     return 0;
 }
 
-static int tasks_compare(void *a, void *b)
+/* The main thread runs the pinned tasks and the general tasks, 
+ * whichever has the higher priority. */
+static struct task *main_next_task(void)
 {
-    struct task *ta = *(struct task**)a;
-    struct task *tb = *(struct task**)b;
-    return ((uintptr_t)(ta) - (uintptr_t)(tb));
+    int pinned_tier = -1;
+    if(SDL_AtomicGet(&s_npinned)) {
+        SDL_AtomicLock(&s_pinned_deque.lock);
+        pinned_tier = deque_top_tier(&s_pinned_deque);
+        SDL_AtomicUnlock(&s_pinned_deque.lock);
+    }
+
+    int main_tier = -1;
+    if(pinned_tier >= 0) {
+        SDL_AtomicLock(&s_main_deque.lock);
+        main_tier = deque_top_tier(&s_main_deque);
+        SDL_AtomicUnlock(&s_main_deque.lock);
+    }
+
+    if(pinned_tier >= 0 && (main_tier < 0 || pinned_tier <= main_tier)) {
+
+        struct task *ret = sched_pop_locked(&s_pinned_deque, false);
+        if(ret) {
+            SDL_AtomicAdd(&s_npinned, -1);
+            return ret;
+        }
+    }
+    return sched_next_task();
+}
+
+static void sched_clear_deque(struct ready_deque *dq)
+{
+    struct task *curr;
+    while((curr = deque_pop(dq, false))) {
+        if(curr->destructor) {
+            curr->destructor(curr->darg);
+        }
+        sched_task_free(curr);
+    }
 }
 
 /*****************************************************************************/
@@ -967,10 +1220,6 @@ bool Sched_Init(void)
     if(!s_thread_worker_id_map)
         goto fail_thread_worker_id_map;
 
-    s_request_lock = SDL_CreateMutex();
-    if(!s_request_lock)
-        goto fail_req_lock;
-
     s_event_queues = kh_init(tqueue);
     if(!s_event_queues)
         goto fail_event_queue;
@@ -983,13 +1232,11 @@ bool Sched_Init(void)
     if(!s_ready_cond)
         goto fail_ready_cond;
 
-    pq_task_init(&s_ready_queue);
-    if(!pq_task_reserve(&s_ready_queue, MAX_TASKS))
-        goto fail_ready_queue;
-
-    pq_task_init(&s_ready_queue_main);
-    if(!pq_task_reserve(&s_ready_queue_main, MAX_TASKS))
-        goto fail_ready_queue_main;
+    SDL_AtomicSet(&s_nready, 0);
+    SDL_AtomicSet(&s_npinned, 0);
+    SDL_AtomicSet(&s_nwaiters, 0);
+    SDL_AtomicSet(&s_main_waiting, false);
+    SDL_AtomicSet(&s_quiesce, false);
 
     assert(MAX_TASKS >= 2);
     s_tasks[0].prev = NULL;
@@ -1012,6 +1259,8 @@ bool Sched_Init(void)
 
     /* On a single-core system, all the tasks will just be run on the main thread */
     s_nworkers = SDL_GetCPUCount() - 1;
+    /* The workers start out parked, waiting to be started */
+    s_idle_workers = s_nworkers;
 
     for(int i = 0; i < s_nworkers; i++) {
 
@@ -1060,18 +1309,12 @@ fail_msg_queue:
     for(int i = 0; i < MAX_TASKS; i++) {
         queue_tid_destroy(s_msg_queues + i);
     }
-    pq_task_destroy(&s_ready_queue_main);
-fail_ready_queue_main:
-    pq_task_destroy(&s_ready_queue);
-fail_ready_queue:
     SDL_DestroyCond(s_ready_cond);
 fail_ready_cond:
     SDL_DestroyMutex(s_ready_lock);
 fail_ready_lock:
     kh_destroy(tqueue, s_event_queues);
 fail_event_queue:
-    SDL_DestroyMutex(s_request_lock);
-fail_req_lock:
     kh_destroy(tid, s_thread_worker_id_map);
 fail_thread_worker_id_map:
     kh_destroy(tid, s_thread_tid_map);
@@ -1096,9 +1339,6 @@ void Sched_Shutdown(void)
     SDL_DestroyMutex(s_ready_lock);
     kh_destroy(tid, s_thread_tid_map);
     kh_destroy(tid, s_thread_worker_id_map);
-    SDL_DestroyMutex(s_request_lock);
-    pq_task_destroy(&s_ready_queue);
-    pq_task_destroy(&s_ready_queue_main);
 
     for(int i = 0; i < s_nworkers; i++) {
         sched_signal_worker_quit(i);
@@ -1116,14 +1356,16 @@ void Sched_Shutdown(void)
 void Sched_HandleEvent(int event, void *arg, int event_source, bool immediate)
 {
     ASSERT_IN_MAIN_THREAD();
-    SDL_LockMutex(s_request_lock);
 
     queue_tid_t torun;
     queue_tid_init(&torun, 32);
+    SDL_AtomicLock(&s_event_lock);
 
     khiter_t k = kh_get(tqueue, s_event_queues, event);
-    if(k == kh_end(s_event_queues))
+    if(k == kh_end(s_event_queues)) {
+        SDL_AtomicUnlock(&s_event_lock);
         goto out;
+    }
 
     queue_tid_t *waiters = &kh_val(s_event_queues, k);
     while(queue_size(*waiters) > 0) {
@@ -1159,6 +1401,9 @@ void Sched_HandleEvent(int event, void *arg, int event_source, bool immediate)
         }
     }
 
+    /* The tasks may wait on events again when they are run */
+    SDL_AtomicUnlock(&s_event_lock);
+
     while(queue_size(torun) > 0) {
 
         uint32_t tid;
@@ -1171,7 +1416,6 @@ void Sched_HandleEvent(int event, void *arg, int event_source, bool immediate)
 
 out:
     queue_tid_destroy(&torun);
-    SDL_UnlockMutex(s_request_lock);
 }    
 
 void Sched_StartBackgroundTasks(void)
@@ -1182,17 +1426,28 @@ void Sched_StartBackgroundTasks(void)
     if(s_prev_ss != G_RUNNING)
         return;
 
+    sched_start_workers();
+}
+
+bool Sched_WakeWorkers(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+
     SDL_LockMutex(s_ready_lock);
-    s_idle_workers = 0;
+    bool parked = (s_idle_workers == s_nworkers);
     SDL_UnlockMutex(s_ready_lock);
 
-    for(int i = 0; i < s_nworkers; i++) {
-    
-        SDL_LockMutex(s_worker_locks[i]);
-        s_worker_start[i] = true;
-        SDL_CondSignal(s_worker_conds[i]);
-        SDL_UnlockMutex(s_worker_locks[i]);
-    }
+    if(!parked)
+        return false;
+
+    sched_start_workers();
+    return true;
+}
+
+void Sched_ParkWorkers(void)
+{
+    ASSERT_IN_MAIN_THREAD();
+    sched_quiesce_workers();
 }
 
 void Sched_Tick(void)
@@ -1206,47 +1461,45 @@ void Sched_Tick(void)
     /* Use a do-while to ensure we're always making at least _some_ forward progress */
      do{
         int nwaiters = 0;
-        struct task *curr = NULL;
-
-        SDL_LockMutex(s_ready_lock);
-        while(!pq_size(&s_ready_queue_main) 
-           && !pq_size(&s_ready_queue) 
-           && ((nwaiters = s_nwaiters) < s_nworkers)
-           && (s_idle_workers < s_nworkers)) {
-
-            size_t left = (Perf_CurrFrameMS() < SCHED_TICK_MS) 
-                        ? SCHED_TICK_MS - Perf_CurrFrameMS() 
-                        : 0;
-
-            SDL_CondWaitTimeout(s_ready_cond, s_ready_lock, left);
-            if(left == 0) {
-                s_quiesce = true;
-                SDL_CondBroadcast(s_ready_cond); 
-            }
-        }
-        if(pq_size(&s_ready_queue_main) || pq_size(&s_ready_queue)) {
+        struct task *curr = main_next_task();
+
+        if(!curr) {
+
+            SDL_LockMutex(s_ready_lock);
+            SDL_AtomicSet(&s_main_waiting, true);
 
-            float prio_main = -1.0, prio_gen = -1.0;
-            pq_task_top_prio(&s_ready_queue_main, &prio_main);
-            pq_task_top_prio(&s_ready_queue, &prio_gen);
+            while(!SDL_AtomicGet(&s_npinned)
+               && !SDL_AtomicGet(&s_nready)
+               && ((nwaiters = SDL_AtomicGet(&s_nwaiters)) < s_nworkers)
+               && (s_idle_workers < s_nworkers)) {
 
-            if(prio_gen > prio_main) {
-                pq_task_pop(&s_ready_queue, &curr);
-            }else {
-                pq_task_pop(&s_ready_queue_main, &curr);
+                size_t left = (Perf_CurrFrameMS() < SCHED_TICK_MS) 
+                            ? SCHED_TICK_MS - Perf_CurrFrameMS() 
+                            : 0;
+
+                SDL_CondWaitTimeout(s_ready_cond, s_ready_lock, left);
+                if(left == 0) {
+                    SDL_AtomicSet(&s_quiesce, true);
+                    SDL_CondBroadcast(s_ready_cond); 
+                }
             }
+
+            SDL_AtomicSet(&s_main_waiting, false);
+            SDL_UnlockMutex(s_ready_lock);
+            curr = main_next_task();
         }
-        SDL_UnlockMutex(s_ready_lock);
 
-        /* When the ready queue is empty and all the workers are in a state of waiting, 
+        /* When the ready queues are empty and all the workers are in a state of waiting, 
          * there is no more work to be done. In that case, let's not waste any more time. 
          */
         if(curr == NULL && nwaiters == s_nworkers)
             break;
         if(curr == NULL && s_idle_workers == s_nworkers)
             break;
+        /* Another thread took the task that we were woken up for */
+        if(curr == NULL)
+            continue;
 
-        assert(curr);
         sched_task_run(curr);
         sched_task_service_request(curr);
 
@@ -1259,41 +1512,23 @@ void Sched_Tick(void)
 uint32_t Sched_Create(int prio, task_func_t code, void *arg, struct future *result, int flags)
 {
     ASSERT_IN_MAIN_THREAD();
-
-    SDL_LockMutex(s_request_lock);
-    uint32_t ret = sched_create(prio, code, arg, result, flags | TASK_DETACHED, NULL_TID);
-    SDL_UnlockMutex(s_request_lock);
-
-    return ret;
+    return sched_create(prio, code, arg, result, flags | TASK_DETACHED, NULL_TID);
 }
 
 bool Sched_RunSync(uint32_t tid)
 {
     ASSERT_IN_MAIN_THREAD();
 
-    SDL_LockMutex(s_request_lock);
-    bool ret = false;
-
     struct task *task = &s_tasks[tid - 1];
-    if(!(task->flags & TASK_DETACHED)) {
-        goto out;
-    }
-
-    SDL_LockMutex(s_ready_lock);
-    bool found = pq_task_remove(&s_ready_queue, tasks_compare, task) 
-              || pq_task_remove(&s_ready_queue_main, tasks_compare, task);
-    SDL_UnlockMutex(s_ready_lock);
+    if(!(task->flags & TASK_DETACHED))
+        return false;
 
-    if(!found)
-        goto out;
+    if(!sched_take_ready(task))
+        return false;
 
     sched_task_run(task);
     sched_task_service_request(task);
-    ret = true;
-
-out:
-    SDL_UnlockMutex(s_request_lock);
-    return ret;
+    return true;
 }
 
 void Sched_ClearState(void)
@@ -1302,27 +1537,15 @@ void Sched_ClearState(void)
 
     sched_quiesce_workers();
 
-    SDL_LockMutex(s_ready_lock);
-
-    while(pq_size(&s_ready_queue)) {
-        struct task *curr = NULL;
-        pq_task_pop(&s_ready_queue, &curr);
-        if(curr->destructor) {
-            curr->destructor(curr->darg);
-        }
-        sched_task_free(curr);
-    }
-
-    while(pq_size(&s_ready_queue_main)) {
-        struct task *curr = NULL;
-        pq_task_pop(&s_ready_queue_main, &curr);
-        if(curr->destructor) {
-            curr->destructor(curr->darg);
-        }
-        sched_task_free(curr);
+    /* All the workers are idle - nobody else is touching the deques */
+    for(int i = 0; i < s_nworkers; i++) {
+        sched_clear_deque(&s_worker_deques[i]);
     }
+    sched_clear_deque(&s_main_deque);
+    sched_clear_deque(&s_pinned_deque);
 
-    SDL_UnlockMutex(s_ready_lock);
+    SDL_AtomicSet(&s_nready, 0);
+    SDL_AtomicSet(&s_npinned, 0);
 
     for(khiter_t k = kh_begin(s_event_queues); k != kh_end(s_event_queues); k++) {
         if(!kh_exist(s_event_queues, k))
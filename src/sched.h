@@ -101,6 +101,11 @@ void     Sched_Tick(void);
 uint32_t Sched_Create(int prio, task_func_t code, void *arg, struct future *result, int flags);
 bool     Sched_RunSync(uint32_t tid);
 void     Sched_ClearState(void);
+/* Wake up the worker threads outside of the tick (ex. while loading) so that 
+ * they can pick up newly created tasks. Returns false if the workers are 
+ * already running, else the call must be paired with 'Sched_ParkWorkers'. */
+bool     Sched_WakeWorkers(void);
+void     Sched_ParkWorkers(void);
 
 /* The following may only be called from task context 
  * (i.e. from the body of a task function) */
@@ -827,6 +827,10 @@ static PyTypeObject PyMovableEntity_type = {
 
 static khash_t(PyObject) *s_uid_pyobj_table;
 static PyObject          *s_loaded;
+/* Every distinct resource name takes up one of a fixed number of IDs, 
+ * which are only given back when the game state is cleared. */
+static const char        *s_resource_name_err = 
+    "Unable to set the resource name: too many distinct resource names are in use.";
 
 /*****************************************************************************/
 /* STATIC FUNCTIONS                                                          */
@@ -1184,6 +1188,10 @@ static int PyEntity_set_faction_id(PyEntityObject *self, PyObject *value, void *
     G_Fog_UpdateVisionRange(xz_pos, old, self->ent->vision_range, 0.0f);
     G_Fog_UpdateVisionRange(xz_pos, self->ent->faction_id, 0.0f, self->ent->vision_range);
     G_Combat_UpdateRef(old, self->ent->faction_id, xz_pos);
+
+    if(self->ent->flags & ENTITY_FLAG_STORAGE_SITE) {
+        G_StorageSite_UpdateFaction(self->ent);
+    }
     return 0;
 }
 
@@ -2369,7 +2377,10 @@ static int PyResourceEntity_init(PyResourceEntityObject *self, PyObject *args, P
         return -1;
     }
 
-    G_Resource_SetName(self->super.ent->uid, PyString_AS_STRING(name));
+    if(!G_Resource_SetName(self->super.ent->uid, PyString_AS_STRING(name))) {
+        PyErr_SetString(PyExc_RuntimeError, s_resource_name_err);
+        return -1;
+    }
     G_Resource_SetAmount(self->super.ent->uid, PyInt_AS_LONG(amount));
 
     /* Call the next __init__ method in the MRO. This is required for all __init__ calls in the 
@@ -2454,7 +2465,10 @@ static PyObject *PyResourceEntity_unpickle(PyObject *cls, PyObject *args, PyObje
         SDL_RWread(stream, &tmp, 1, 1); /* consume NULL byte */
         CHK_TRUE(name, fail_unpickle);
         CHK_TRUE(PyString_Check(name), fail_name);
-        G_Resource_SetName(((PyResourceEntityObject*)ent)->super.ent->uid, PyString_AS_STRING(name));
+        if(!G_Resource_SetName(((PyResourceEntityObject*)ent)->super.ent->uid, PyString_AS_STRING(name))) {
+            PyErr_SetString(PyExc_RuntimeError, s_resource_name_err);
+            goto fail_name;
+        }
 
         amount = S_UnpickleObjgraph(stream);
         SDL_RWread(stream, &tmp, 1, 1); /* consume NULL byte */
@@ -59,6 +59,7 @@
 #include "../scene.h"
 #include "../settings.h"
 #include "../main.h"
+#include "../asset_load.h"
 #include "../ui.h"
 #include "../session.h"
 #include "../perf.h"
@@ -583,7 +584,9 @@ static PyObject *PyPf_load_map(PyObject *self, PyObject *args, PyObject *kwargs)
     }
     pf_strlcat(pfmap_path, pfmap, sizeof(pfmap_path));
 
-    SDL_RWops *stream = SDL_RWFromFile(pfmap_path, "r");
+    SDL_RWops *stream = AL_OpenCooked(pfmap_path);
+    if(!stream)
+        stream = SDL_RWFromFile(pfmap_path, "r");
     if(!stream) {
         char errbuff[256];
         pf_snprintf(errbuff, sizeof(errbuff), "Unable to open PFMap file %s", pfmap_path);
@@ -591,7 +594,7 @@ static PyObject *PyPf_load_map(PyObject *self, PyObject *args, PyObject *kwargs)
         return NULL;
     }
 
-    if(!G_LoadMap(stream, update_navgrid)) {
+    if(!G_LoadMap(stream, pfmap_path, update_navgrid)) {
         PyErr_SetString(PyExc_RuntimeError, "Unable to load the specified map file.");
         SDL_RWclose(stream);
         return NULL; 
@@ -615,7 +618,7 @@ static PyObject *PyPf_load_map_string(PyObject *self, PyObject *args, PyObject *
     SDL_RWops *stream = SDL_RWFromConstMem(mapstr, strlen(mapstr));
     assert(stream);
 
-    if(!G_LoadMap(stream, update_navgrid)) {
+    if(!G_LoadMap(stream, NULL, update_navgrid)) {
         PyErr_SetString(PyExc_RuntimeError, "Unable to load the specified map.");
         SDL_RWclose(stream);
         return NULL;
@@ -968,6 +971,44 @@ static PyObject *PyPf_get_nav_perfstats(PyObject *self)
     rval |= PyDict_SetItemString(ret, "grid_path_hit_rate", Py_BuildValue("f", stats.grid_path_hit_rate));
     assert(0 == rval);
 
+    PyObject *shards = PyList_New(N_FC_NumShards());
+    if(!shards) {
+        Py_DECREF(ret);
+        return NULL;
+    }
+
+    for(int i = 0; i < N_FC_NumShards(); i++) {
+
+        struct fc_shard_stats sstats;
+        N_FC_GetShardStats(i, &sstats);
+
+        PyObject *shard = Py_BuildValue("{s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i, s:i}",
+            "los_used",         sstats.los_used,
+            "los_query",        sstats.los_query,
+            "los_hit",          sstats.los_hit,
+            "los_invalidated",  sstats.los_invalidated,
+            "flow_used",        sstats.flow_used,
+            "flow_query",       sstats.flow_query,
+            "flow_hit",         sstats.flow_hit,
+            "flow_invalidated", sstats.flow_invalidated,
+            "ffid_used",        sstats.ffid_used,
+            "ffid_query",       sstats.ffid_query,
+            "ffid_hit",         sstats.ffid_hit,
+            "grid_path_used",   sstats.grid_path_used,
+            "grid_path_query",  sstats.grid_path_query,
+            "grid_path_hit",    sstats.grid_path_hit);
+        if(!shard) {
+            Py_DECREF(shards);
+            Py_DECREF(ret);
+            return NULL;
+        }
+        PyList_SET_ITEM(shards, i, shard);
+    }
+
+    rval = PyDict_SetItemString(ret, "shards", shards);
+    Py_DECREF(shards);
+    assert(0 == rval);
+
     return ret;
 }
 
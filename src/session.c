@@ -45,6 +45,7 @@
 #include "lib/public/SDL_vec_rwops.h"
 #include "game/public/game.h"
 #include "script/public/script.h"
+#include "navigation/public/nav.h"
 
 #include <SDL.h> /* for SDL_RWops */
 #include <assert.h>
@@ -90,6 +91,7 @@ static char            s_saved_argv[MAX_ARGC + 1][128];
 static void subsession_clear(void)
 {
     E_ClearPendingEvents();
+    N_DiscardPendingPaths();
     Sched_ClearState();
     E_DeleteScriptHandlers();
     S_ClearState();
@@ -127,7 +127,7 @@ static struct result timeserver_task(void *arg)
         int reply = 0;
 
         Task_Receive(&tid, &request, sizeof(request));
-        uint32_t curr_tick = SDL_GetTicks();
+        uint32_t curr_tick = Engine_GetTicks();
 
         switch(request.type) {
         case TS_REQ_NOTIFY:
@@ -294,7 +294,9 @@ static void ui_init_font_stash(struct nk_context *ctx)
 
     Engine_FlushRenderWorkQueue();
 
-    nk_font_atlas_end(&s_atlas, nk_handle_id(R_UI_GetFontTexID()), &s_null);
+    /* In headless mode, the atlas is never uploaded to the GPU */
+    int tex_id = Engine_Headless() ? 0 : R_UI_GetFontTexID();
+    nk_font_atlas_end(&s_atlas, nk_handle_id(tex_id), &s_null);
     nk_style_set_font(ctx, &s_atlas.default_font->handle);
 }
 
@@ -381,6 +383,11 @@ static void ui_render(void *user, void *event)
     nk_clear(&s_ctx);
 }
 
+static void ui_clear(void *user, void *event)
+{
+    nk_clear(&s_ctx);
+}
+
 /*****************************************************************************/
 /* EXTERN FUNCTIONS                                                          */
 /*****************************************************************************/
@@ -404,7 +411,13 @@ bool UI_Init(const char *basedir, SDL_Window *win)
 
     vec_td_init(&s_curr_frame_labels);
     E_Global_Register(EVENT_UPDATE_UI, on_update_ui, NULL, G_RUNNING | G_PAUSED_UI_RUNNING);
-    E_Global_Register(EVENT_RENDER_FINISH, ui_render, NULL, G_RUNNING | G_PAUSED_UI_RUNNING | G_PAUSED_FULL);
+
+    /* Nothing gets drawn in headless mode, but the frame must still be retired */
+    if(Engine_Headless()) {
+        E_Global_Register(EVENT_UPDATE_START, ui_clear, NULL, G_RUNNING | G_PAUSED_UI_RUNNING | G_PAUSED_FULL);
+    }else{
+        E_Global_Register(EVENT_RENDER_FINISH, ui_render, NULL, G_RUNNING | G_PAUSED_UI_RUNNING | G_PAUSED_FULL);
+    }
 
     return true;
 }
@@ -412,7 +425,11 @@ bool UI_Init(const char *basedir, SDL_Window *win)
 void UI_Shutdown(void)
 {
     E_Global_Unregister(EVENT_UPDATE_UI, on_update_ui);
-    E_Global_Unregister(EVENT_RENDER_FINISH, ui_render);
+    if(Engine_Headless()) {
+        E_Global_Unregister(EVENT_UPDATE_START, ui_clear);
+    }else{
+        E_Global_Unregister(EVENT_RENDER_FINISH, ui_render);
+    }
     vec_td_destroy(&s_curr_frame_labels);
 
     nk_font_atlas_clear(&s_atlas);